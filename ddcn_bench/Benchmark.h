@@ -0,0 +1,60 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef BENCHMARK_H_INCLUDED
+#define BENCHMARK_H_INCLUDED
+
+#include <QtGlobal>
+#include <cstdio>
+
+/**
+ * Prints the result of a measurement as the time per operation.
+ *
+ * @param name Description of the measured operation.
+ * @param count Number of operations which were executed.
+ * @param nsecs Total time in nanoseconds.
+ */
+inline void printResult(const char *name, int count, qint64 nsecs) {
+	printf("%-45s %10.1f ns/op  (%d ops in %.1f ms)\n", name,
+		(double)nsecs / count, count, nsecs / 1000000.0);
+	fflush(stdout);
+}
+
+/**
+ * Prints a throughput in megabytes per second.
+ *
+ * @param name Description of the measured operation.
+ * @param bytes Number of bytes which were processed.
+ * @param nsecs Total time in nanoseconds.
+ */
+inline void printThroughput(const char *name, qint64 bytes, qint64 nsecs) {
+	printf("%-45s %10.1f MB/s   (%.1f MB in %.1f ms)\n", name,
+		bytes * 1000.0 / nsecs, bytes / 1000000.0, nsecs / 1000000.0);
+	fflush(stdout);
+}
+
+#endif
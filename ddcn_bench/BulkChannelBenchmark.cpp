@@ -0,0 +1,340 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "BulkChannelBenchmark.h"
+#include "BulkChannel.h"
+#include "Benchmark.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QEventLoop>
+#include <QFile>
+#include <QSocketNotifier>
+#include <QStringList>
+#include <QThread>
+#include <QTimer>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * Size of the file which is transferred.
+ */
+static const int FILE_SIZE = 64 * 1024 * 1024;
+/**
+ * Number of times the file is transferred in each measurement.
+ */
+static const int FILE_COUNT = 16;
+/**
+ * Buffer size of the read()/write() copy loop used for comparison.
+ */
+static const int COPY_BUFFER_SIZE = 64 * 1024;
+
+BulkChannelBenchmark::BulkChannelBenchmark(const QString &fileName,
+		int fileCount, bool encrypted) : fileName(fileName),
+		fileCount(fileCount), encrypted(encrypted), listenFd(-1),
+		listenNotifier(NULL), sender(NULL), receiver(NULL),
+		senderReady(false), receiverReady(false), receivedCount(0),
+		elapsed(0) {
+}
+BulkChannelBenchmark::~BulkChannelBenchmark() {
+	delete sender;
+	delete receiver;
+	delete listenNotifier;
+	if (listenFd != -1) {
+		close(listenFd);
+	}
+}
+
+bool BulkChannelBenchmark::start() {
+	quint16 port;
+	listenFd = BulkChannel::listen(0, &port);
+	if (listenFd == -1) {
+		return false;
+	}
+	listenNotifier = new QSocketNotifier(listenFd, QSocketNotifier::Read, this);
+	connect(listenNotifier, SIGNAL(activated(int)),
+		this, SLOT(onConnectionPending()));
+	QByteArray token(BulkChannel::TOKEN_SIZE, 'x');
+	sender = new BulkChannel(QStringList("127.0.0.1"), port, token);
+	connect(sender, SIGNAL(connected(BulkChannel*)),
+		this, SLOT(onConnected(BulkChannel*)));
+	connect(sender, SIGNAL(closed(BulkChannel*)),
+		this, SLOT(onClosed(BulkChannel*)));
+	sender->connectToPeer();
+	return true;
+}
+
+void BulkChannelBenchmark::onConnectionPending() {
+	int fd = BulkChannel::acceptConnection(listenFd);
+	if (fd == -1 || receiver) {
+		if (fd != -1) {
+			close(fd);
+		}
+		return;
+	}
+	receiver = new BulkChannel(fd);
+	connect(receiver, SIGNAL(tokenReceived(BulkChannel*, QByteArray)),
+		this, SLOT(onTokenReceived(BulkChannel*, QByteArray)));
+	connect(receiver, SIGNAL(fileReceived(BulkChannel*, int, unsigned int, unsigned int, QString)),
+		this, SLOT(onFileReceived(BulkChannel*, int, unsigned int, unsigned int, QString)));
+	connect(receiver, SIGNAL(fileOffered(BulkChannel*, int, unsigned int, unsigned int, quint64, bool*)),
+		this, SLOT(onFileOffered(BulkChannel*, int, unsigned int, unsigned int, quint64, bool*)),
+		Qt::DirectConnection);
+	connect(receiver, SIGNAL(closed(BulkChannel*)),
+		this, SLOT(onClosed(BulkChannel*)));
+}
+void BulkChannelBenchmark::onConnected(BulkChannel *channel) {
+	// The keys only have to match, the direction of the sender is the reverse
+	// of the one of the receiver
+	QByteArray forward(BulkChannel::KEY_MATERIAL_SIZE, 'a');
+	QByteArray backward(BulkChannel::KEY_MATERIAL_SIZE, 'b');
+	if (encrypted && !channel->enableKernelTLS(forward, backward)) {
+		emit finished();
+		return;
+	}
+	senderReady = true;
+	startSending();
+}
+void BulkChannelBenchmark::onTokenReceived(BulkChannel *channel,
+		const QByteArray &token) {
+	QByteArray forward(BulkChannel::KEY_MATERIAL_SIZE, 'a');
+	QByteArray backward(BulkChannel::KEY_MATERIAL_SIZE, 'b');
+	if (encrypted && !channel->enableKernelTLS(backward, forward)) {
+		emit finished();
+		return;
+	}
+	receiverReady = true;
+	startSending();
+}
+void BulkChannelBenchmark::onFileOffered(BulkChannel *channel, int kind,
+		unsigned int transferId, unsigned int index, quint64 size, bool *accept) {
+	*accept = true;
+}
+void BulkChannelBenchmark::onFileReceived(BulkChannel *channel, int kind,
+		unsigned int transferId, unsigned int index, const QString &fileName) {
+	QFile::remove(fileName);
+	receivedCount++;
+	if (receivedCount == fileCount) {
+		elapsed = timer.nsecsElapsed();
+		emit finished();
+	}
+}
+void BulkChannelBenchmark::onClosed(BulkChannel *channel) {
+	qWarning("The bulk channel was closed.");
+	emit finished();
+}
+
+void BulkChannelBenchmark::startSending() {
+	if (!senderReady || !receiverReady) {
+		return;
+	}
+	timer.start();
+	for (int i = 0; i < fileCount; i++) {
+		if (!sender->sendFile(BulkFileKind::JobInput, 0, i, fileName, false)) {
+			emit finished();
+			return;
+		}
+	}
+}
+
+/**
+ * Thread which sends a file several times with read() and write(), this is the
+ * sender of the copy loop used for comparison.
+ */
+class CopySender : public QThread {
+public:
+	CopySender(int fd, const QString &fileName, int fileCount) : fd(fd),
+			fileName(fileName), fileCount(fileCount) {
+	}
+protected:
+	virtual void run() {
+		char *buffer = new char[COPY_BUFFER_SIZE];
+		for (int i = 0; i < fileCount; i++) {
+			int file = open(QFile::encodeName(fileName).data(), O_RDONLY);
+			ssize_t length;
+			while ((length = read(file, buffer, COPY_BUFFER_SIZE)) > 0) {
+				ssize_t written = 0;
+				while (written < length) {
+					ssize_t result = write(fd, buffer + written, length - written);
+					if (result <= 0) {
+						qWarning("write() failed: %s", strerror(errno));
+						close(file);
+						delete[] buffer;
+						return;
+					}
+					written += result;
+				}
+			}
+			close(file);
+		}
+		delete[] buffer;
+	}
+private:
+	int fd;
+	QString fileName;
+	int fileCount;
+};
+
+/**
+ * Transfers the file over a loopback TCP connection with a read()/write() copy
+ * loop on both ends, which copies all data through user space.
+ *
+ * @return Time needed for the transfer in nanoseconds, or -1 if the
+ * connection could not be created.
+ */
+static qint64 measureCopy(const QString &fileName, int fileCount) {
+	quint16 port;
+	int listenFd = BulkChannel::listen(0, &port);
+	if (listenFd == -1) {
+		return -1;
+	}
+	int senderFd = socket(AF_INET, SOCK_STREAM, 0);
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (::connect(senderFd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+		close(senderFd);
+		close(listenFd);
+		return -1;
+	}
+	struct pollfd pending = { listenFd, POLLIN, 0 };
+	poll(&pending, 1, -1);
+	int receiverFd = BulkChannel::acceptConnection(listenFd);
+	close(listenFd);
+	// The accepted socket is non-blocking
+	fcntl(receiverFd, F_SETFL, fcntl(receiverFd, F_GETFL) & ~O_NONBLOCK);
+	QString outputName = QDir::tempPath() + "/ddcn_bench_copy";
+	int output = open(QFile::encodeName(outputName).data(),
+		O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	char *buffer = new char[COPY_BUFFER_SIZE];
+	qint64 remaining = (qint64)FILE_SIZE * fileCount;
+	QElapsedTimer timer;
+	timer.start();
+	CopySender copySender(senderFd, fileName, fileCount);
+	copySender.start();
+	while (remaining > 0) {
+		ssize_t length = read(receiverFd, buffer, COPY_BUFFER_SIZE);
+		if (length <= 0) {
+			break;
+		}
+		// Like the bulk channel, each file is written to the disk
+		if (write(output, buffer, length) != length) {
+			break;
+		}
+		remaining -= length;
+	}
+	qint64 elapsed = timer.nsecsElapsed();
+	copySender.wait();
+	delete[] buffer;
+	close(output);
+	QFile::remove(outputName);
+	close(senderFd);
+	close(receiverFd);
+	return remaining == 0 ? elapsed : -1;
+}
+
+/**
+ * Runs one bulk channel transfer with an event loop.
+ *
+ * @return Time needed for the transfer in nanoseconds, or -1 if it failed.
+ */
+static qint64 measureBulkChannel(const QString &fileName, int fileCount,
+		bool encrypted) {
+	BulkChannelBenchmark benchmark(fileName, fileCount, encrypted);
+	QEventLoop loop;
+	QObject::connect(&benchmark, SIGNAL(finished()), &loop, SLOT(quit()));
+	QTimer::singleShot(120000, &loop, SLOT(quit()));
+	if (!benchmark.start()) {
+		return -1;
+	}
+	loop.exec();
+	if (!benchmark.isSuccessful()) {
+		return -1;
+	}
+	return benchmark.getElapsedNsecs();
+}
+
+/**
+ * Measures the throughput of bulk channels over the loopback interface,
+ * unencrypted and with kernel TLS, and compares it to a plain read()/write()
+ * copy loop. Loopback hides the network, so this only shows the CPU cost per
+ * byte of the different paths.
+ */
+int main(int argc, char **argv) {
+	QCoreApplication app(argc, argv);
+	QString fileName = QDir::tempPath() + "/ddcn_bench_bulk";
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		fprintf(stderr, "Could not create %s.\n", fileName.toAscii().data());
+		return 1;
+	}
+	QByteArray block(1024 * 1024, 0);
+	for (int i = 0; i < block.size(); i++) {
+		block[i] = (char)(i * 7 + i / 4096);
+	}
+	for (int i = 0; i < FILE_SIZE / block.size(); i++) {
+		file.write(block);
+	}
+	file.close();
+	qint64 bytes = (qint64)FILE_SIZE * FILE_COUNT;
+	int result = 0;
+	qint64 nsecs = measureCopy(fileName, FILE_COUNT);
+	if (nsecs != -1) {
+		printThroughput("read()/write() copy", bytes, nsecs);
+	} else {
+		fprintf(stderr, "The copy loop failed.\n");
+		result = 1;
+	}
+	nsecs = measureBulkChannel(fileName, FILE_COUNT, false);
+	if (nsecs != -1) {
+		printThroughput("BulkChannel, unencrypted", bytes, nsecs);
+	} else {
+		fprintf(stderr, "The unencrypted transfer failed.\n");
+		result = 1;
+	}
+	if (BulkChannel::isKernelTLSSupported()) {
+		nsecs = measureBulkChannel(fileName, FILE_COUNT, true);
+		if (nsecs != -1) {
+			printThroughput("BulkChannel, kernel TLS", bytes, nsecs);
+		} else {
+			// The tls module might not be loaded
+			fprintf(stderr, "The kernel TLS transfer failed.\n");
+		}
+	} else {
+		printf("Kernel TLS is not supported by this build.\n");
+	}
+	QFile::remove(fileName);
+	return result;
+}
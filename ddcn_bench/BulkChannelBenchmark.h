@@ -0,0 +1,107 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef BULKCHANNELBENCHMARK_H_INCLUDED
+#define BULKCHANNELBENCHMARK_H_INCLUDED
+
+#include <QObject>
+#include <QElapsedTimer>
+
+class BulkChannel;
+class QSocketNotifier;
+
+/**
+ * Transfers the same file several times over a bulk channel through the
+ * loopback interface and measures the time until all copies have been
+ * received.
+ */
+class BulkChannelBenchmark : public QObject {
+	Q_OBJECT
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param fileName File which is sent.
+	 * @param fileCount Number of times the file is sent.
+	 * @param encrypted If true, kernel TLS is enabled on both ends.
+	 */
+	BulkChannelBenchmark(const QString &fileName, int fileCount,
+		bool encrypted);
+	~BulkChannelBenchmark();
+
+	/**
+	 * Opens the listening socket and connects to it. finished() is emitted
+	 * once all files have been received or if the channel failed.
+	 *
+	 * @return False if the listening socket could not be created.
+	 */
+	bool start();
+
+	/**
+	 * Returns true if all files have been received.
+	 */
+	bool isSuccessful() {
+		return receivedCount == fileCount;
+	}
+	/**
+	 * Returns the time from the first sendFile() call until the last file
+	 * had been received.
+	 */
+	qint64 getElapsedNsecs() {
+		return elapsed;
+	}
+signals:
+	void finished();
+private slots:
+	void onConnectionPending();
+	void onConnected(BulkChannel *channel);
+	void onTokenReceived(BulkChannel *channel, const QByteArray &token);
+	void onFileOffered(BulkChannel *channel, int kind,
+		unsigned int transferId, unsigned int index, quint64 size, bool *accept);
+	void onFileReceived(BulkChannel *channel, int kind,
+		unsigned int transferId, unsigned int index, const QString &fileName);
+	void onClosed(BulkChannel *channel);
+private:
+	void startSending();
+
+	QString fileName;
+	int fileCount;
+	bool encrypted;
+
+	int listenFd;
+	QSocketNotifier *listenNotifier;
+	BulkChannel *sender;
+	BulkChannel *receiver;
+	bool senderReady;
+	bool receiverReady;
+
+	int receivedCount;
+	QElapsedTimer timer;
+	qint64 elapsed;
+};
+
+#endif
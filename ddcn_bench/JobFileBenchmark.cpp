@@ -0,0 +1,150 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "Benchmark.h"
+#include "JobFileTask.h"
+
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFuture>
+#include <QThreadPool>
+#include <QtConcurrentRun>
+
+/**
+ * Number of jobs whose input files are compressed.
+ */
+static const int JOB_COUNT = 64;
+/**
+ * Size of the generated input file if no preprocessed file is passed, a
+ * typical size of a preprocessed C++ file.
+ */
+static const int INPUT_SIZE = 1024 * 1024;
+
+/**
+ * Creates text which compresses roughly like preprocessed source code.
+ */
+static QByteArray createInput() {
+	QByteArray input;
+	int i = 0;
+	while (input.size() < INPUT_SIZE) {
+		input.append(QString("# %1 \"/usr/include/header%2.h\" 3\n"
+			"extern int function%1(const char *name, unsigned long size%3);\n"
+			"struct type%1 { int member%2; void *pointer%3; };\n")
+			.arg(i).arg(i % 97).arg(i % 13).toAscii());
+		i++;
+	}
+	return input;
+}
+
+/**
+ * Runs JobFileTask::createJobData() for all tasks with compression, either on
+ * the calling thread or in the global thread pool as CompilerNetwork does.
+ *
+ * @return Time needed in nanoseconds, or -1 if a packet was not created.
+ */
+static qint64 measure(const QList<JobFileTask> &tasks, bool parallel) {
+	QElapsedTimer timer;
+	timer.start();
+	QList<JobFileTask> results;
+	if (parallel) {
+		QList<QFuture<JobFileTask> > futures;
+		foreach (const JobFileTask &task, tasks) {
+			futures.append(QtConcurrent::run(JobFileTask::createJobData, task,
+				QByteArray(), true));
+		}
+		for (int i = 0; i < futures.size(); i++) {
+			results.append(futures[i].result());
+		}
+	} else {
+		foreach (const JobFileTask &task, tasks) {
+			results.append(JobFileTask::createJobData(task, QByteArray(), true));
+		}
+	}
+	qint64 elapsed = timer.nsecsElapsed();
+	foreach (const JobFileTask &result, results) {
+		if (!result.packet.isValid()) {
+			return -1;
+		}
+	}
+	return elapsed;
+}
+
+/**
+ * Measures how fast the input files of jobs are read and compressed on one
+ * thread, as the main thread did before, and in the global thread pool.
+ *
+ * A preprocessed source file can be passed as an argument and is then used as
+ * the input file of every job.
+ */
+int main(int argc, char **argv) {
+	if (argc > 2) {
+		fprintf(stderr, "Usage: %s [preprocessed file]\n", argv[0]);
+		return 2;
+	}
+	QByteArray input;
+	if (argc == 2) {
+		QFile file(QString::fromLocal8Bit(argv[1]));
+		if (!file.open(QIODevice::ReadOnly)) {
+			fprintf(stderr, "Could not open %s.\n", argv[1]);
+			return 2;
+		}
+		input = file.readAll();
+	} else {
+		input = createInput();
+	}
+	QList<JobFileTask> tasks;
+	for (int i = 0; i < JOB_COUNT; i++) {
+		JobFileTask task(JobFileTask::Type::SendJobData, NULL, i);
+		QString fileName = QDir::tempPath() + "/ddcn_bench_job" + QString::number(i);
+		QFile file(fileName);
+		if (!file.open(QIODevice::WriteOnly) || file.write(input) != input.size()) {
+			fprintf(stderr, "Could not create %s.\n", fileName.toAscii().data());
+			return 1;
+		}
+		task.inputFiles.append(fileName);
+		tasks.append(task);
+	}
+	printf("%d jobs with %d bytes of input each, %d worker threads.\n",
+		JOB_COUNT, input.size(), QThreadPool::globalInstance()->maxThreadCount());
+	qint64 bytes = (qint64)input.size() * JOB_COUNT;
+	int result = 0;
+	for (int parallel = 0; parallel < 2; parallel++) {
+		qint64 nsecs = measure(tasks, parallel);
+		if (nsecs == -1) {
+			fprintf(stderr, "Could not create a JobData packet.\n");
+			result = 1;
+			break;
+		}
+		printThroughput(parallel ? "Compression, thread pool"
+			: "Compression, one thread", bytes, nsecs);
+	}
+	foreach (const JobFileTask &task, tasks) {
+		QFile::remove(task.inputFiles[0]);
+	}
+	return result;
+}
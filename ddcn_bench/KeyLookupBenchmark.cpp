@@ -0,0 +1,198 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "Benchmark.h"
+#include "PublicKey.h"
+#include "NodeRegistry.h"
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <cstdlib>
+
+/**
+ * Number of trusted keys, a large installation.
+ */
+static const int KEY_COUNT = 10000;
+/**
+ * Number of peers which are looked up, every peer has one of the trusted keys.
+ */
+static const int PEER_COUNT = 1000;
+/**
+ * Number of times the keys of all peers are looked up again, this is what
+ * happens for the packets of peers which are already connected.
+ */
+static const int REPEAT_COUNT = 100;
+/**
+ * Number of connected peers in the node registry.
+ */
+static const int NODE_COUNT = 1000;
+/**
+ * Number of incoming messages which are mapped to their node.
+ */
+static const int MESSAGE_COUNT = 100000;
+
+/**
+ * Measures looking up the keys of connecting peers in the trusted keys, once
+ * with a linear search as getTrustedPeer() did before, and once with a QHash
+ * index as it does now. The keys of the peers are deserialized from DER, so
+ * they do not share the memoized hash of the trusted keys, just like keys
+ * taken from the certificate of a TLS connection.
+ */
+static int benchmarkKeyLookup() {
+	KeyType::List type = PrivateKey::getDefaultType();
+	QList<PublicKey> trustedKeys;
+	for (int i = 0; i < KEY_COUNT; i++) {
+		PrivateKey key = PrivateKey::generate(type);
+		if (!key.isValid()) {
+			fprintf(stderr, "Could not generate a key.\n");
+			return 1;
+		}
+		trustedKeys.append(PublicKey(key));
+	}
+	srand(1);
+	QList<PublicKey> peerKeys;
+	for (int i = 0; i < PEER_COUNT; i++) {
+		QByteArray der = trustedKeys[rand() % KEY_COUNT].toDER();
+		peerKeys.append(PublicKey::fromDER(der));
+	}
+	QElapsedTimer timer;
+	// Linear search comparing every key
+	int found = 0;
+	timer.start();
+	for (int i = 0; i < PEER_COUNT; i++) {
+		for (int j = 0; j < KEY_COUNT; j++) {
+			if (trustedKeys[j] == peerKeys[i]) {
+				found++;
+				break;
+			}
+		}
+	}
+	printResult("Linear search", PEER_COUNT, timer.nsecsElapsed());
+	if (found != PEER_COUNT) {
+		fprintf(stderr, "Only %d of %d keys were found.\n", found, PEER_COUNT);
+		return 1;
+	}
+	// Building the index computes the hash of every trusted key
+	QHash<PublicKey, int> index;
+	timer.restart();
+	for (int i = 0; i < KEY_COUNT; i++) {
+		index.insert(trustedKeys[i], i);
+	}
+	printResult("QHash insertion", KEY_COUNT, timer.nsecsElapsed());
+	// The first lookup of a key computes its fingerprint
+	found = 0;
+	timer.restart();
+	for (int i = 0; i < PEER_COUNT; i++) {
+		if (index.contains(peerKeys[i])) {
+			found++;
+		}
+	}
+	printResult("QHash lookup, first time", PEER_COUNT, timer.nsecsElapsed());
+	// Later lookups use the memoized hash
+	timer.restart();
+	for (int round = 0; round < REPEAT_COUNT; round++) {
+		for (int i = 0; i < PEER_COUNT; i++) {
+			if (index.contains(peerKeys[i])) {
+				found++;
+			}
+		}
+	}
+	printResult("QHash lookup, memoized hash", PEER_COUNT * REPEAT_COUNT,
+		timer.nsecsElapsed());
+	if (found != PEER_COUNT * (REPEAT_COUNT + 1)) {
+		fprintf(stderr, "Not all keys were found in the index.\n");
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Measures mapping incoming messages to the NetworkNode of their sender, once
+ * with a QMap keyed by the string form of the node id as NetworkInterface did
+ * before, and once with the NodeRegistry. The node ids of the messages are
+ * copies, like the ids which ariba passes with every message.
+ */
+static int benchmarkNodeLookup() {
+	QList<NetworkNode*> nodes;
+	for (int i = 0; i < NODE_COUNT; i++) {
+		ariba::utility::NodeID nodeId = ariba::utility::Identifier::random();
+		nodes.append(new NetworkNode(nodeId, ariba::utility::LinkID(), 0));
+	}
+	srand(1);
+	QList<ariba::utility::NodeID> senders;
+	for (int i = 0; i < MESSAGE_COUNT; i++) {
+		senders.append(nodes[rand() % NODE_COUNT]->getNodeId());
+	}
+	QElapsedTimer timer;
+	// QMap with the node id as a string
+	QMap<QString, NetworkNode*> nodesByName;
+	timer.start();
+	for (int i = 0; i < NODE_COUNT; i++) {
+		QString name = QString::fromStdString(nodes[i]->getNodeId().toString());
+		nodesByName.insert(name, nodes[i]);
+	}
+	printResult("QMap<QString> insertion", NODE_COUNT, timer.nsecsElapsed());
+	int found = 0;
+	timer.restart();
+	for (int i = 0; i < MESSAGE_COUNT; i++) {
+		QString name = QString::fromStdString(senders[i].toString());
+		if (nodesByName.value(name, NULL)) {
+			found++;
+		}
+	}
+	printResult("QMap<QString> lookup", MESSAGE_COUNT, timer.nsecsElapsed());
+	// NodeRegistry with the binary node id
+	NodeRegistry registry;
+	timer.restart();
+	for (int i = 0; i < NODE_COUNT; i++) {
+		registry.insert(nodes[i]);
+	}
+	printResult("NodeRegistry insertion", NODE_COUNT, timer.nsecsElapsed());
+	timer.restart();
+	for (int i = 0; i < MESSAGE_COUNT; i++) {
+		if (registry.get(senders[i])) {
+			found++;
+		}
+	}
+	printResult("NodeRegistry lookup", MESSAGE_COUNT, timer.nsecsElapsed());
+	registry.clear();
+	qDeleteAll(nodes);
+	if (found != MESSAGE_COUNT * 2) {
+		fprintf(stderr, "Not all nodes were found.\n");
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	if (benchmarkKeyLookup() != 0) {
+		return 1;
+	}
+	return benchmarkNodeLookup();
+}
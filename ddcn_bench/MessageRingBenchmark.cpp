@@ -0,0 +1,231 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "MessageRingBenchmark.h"
+#include "MessageRing.h"
+#include "Benchmark.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * Number of messages passed between the threads in each measurement.
+ */
+static const int MESSAGE_COUNT = 1000000;
+/**
+ * Message rate of the paced measurements, a very busy ariba thread.
+ */
+static const int MESSAGE_RATE = 100000;
+/**
+ * Number of messages sent at once by a paced producer.
+ */
+static const int PACING_BATCH = 100;
+/**
+ * Size of the payload of every message.
+ */
+static const int PAYLOAD_SIZE = 200;
+
+/**
+ * Message passed through the ring, like the events from the ariba thread
+ * without the ariba ids.
+ */
+struct Message {
+	int type;
+	QByteArray data;
+};
+
+/**
+ * Returns the CPU time used by the calling thread in nanoseconds.
+ */
+static qint64 getThreadCpuTime() {
+	struct timespec time;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+	return (qint64)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/**
+ * Sleeps after every PACING_BATCH messages so that the producer keeps the
+ * given rate.
+ */
+static void pace(const QElapsedTimer &timer, int sent, int rate) {
+	if (rate == 0 || sent % PACING_BATCH != 0) {
+		return;
+	}
+	qint64 due = (qint64)sent * 1000000000 / rate;
+	qint64 now = timer.nsecsElapsed();
+	if (due > now) {
+		usleep((due - now) / 1000);
+	}
+}
+
+void SignalSender::run() {
+	QByteArray payload(PAYLOAD_SIZE, 'x');
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < count; i++) {
+		emit message(payload);
+		pace(timer, i + 1, rate);
+	}
+}
+
+/**
+ * Pushes messages into a ring and wakes up the consumer through an eventfd,
+ * as the ariba thread does now.
+ */
+class RingProducer : public QThread {
+public:
+	RingProducer(MessageRing<Message> *ring, int eventFd, int count, int rate)
+			: ring(ring), eventFd(eventFd), count(count), rate(rate) {
+	}
+protected:
+	virtual void run() {
+		Message message;
+		message.type = 0;
+		message.data = QByteArray(PAYLOAD_SIZE, 'x');
+		QElapsedTimer timer;
+		timer.start();
+		for (int i = 0; i < count; i++) {
+			if (ring->push(message)) {
+				wakeUp();
+			}
+			// The ariba thread retries later, here the consumer is fast
+			// enough that yielding is sufficient
+			while (ring->hasOverflow()) {
+				yieldCurrentThread();
+				if (ring->flush()) {
+					wakeUp();
+				}
+			}
+			pace(timer, i + 1, rate);
+		}
+	}
+private:
+	void wakeUp() {
+		uint64_t value = 1;
+		if (write(eventFd, &value, sizeof(value)) != sizeof(value)) {
+			qWarning("Could not write to the eventfd.");
+		}
+	}
+
+	MessageRing<Message> *ring;
+	int eventFd;
+	int count;
+	int rate;
+};
+
+static void printResults(const char *name, int rate, qint64 elapsed,
+		qint64 cpuTime, int wakeups) {
+	QByteArray prefix = name;
+	if (rate == 0) {
+		prefix += ", unpaced";
+		printResult((prefix + ": wall time").data(), MESSAGE_COUNT, elapsed);
+	} else {
+		prefix += ", ";
+		prefix += QByteArray::number(rate) + "/s";
+	}
+	printResult((prefix + ": consumer CPU time").data(), MESSAGE_COUNT, cpuTime);
+	if (wakeups != -1) {
+		printf("%-45s %10.1f messages/wakeup\n", (prefix + ": batching").data(),
+			(double)MESSAGE_COUNT / wakeups);
+	}
+}
+
+static bool measureRing(int rate) {
+	MessageRing<Message> ring;
+	int eventFd = eventfd(0, EFD_CLOEXEC);
+	if (eventFd == -1) {
+		return false;
+	}
+	RingProducer producer(&ring, eventFd, MESSAGE_COUNT, rate);
+	QList<Message> messages;
+	int received = 0;
+	int wakeups = 0;
+	QElapsedTimer timer;
+	timer.start();
+	qint64 cpuStart = getThreadCpuTime();
+	producer.start();
+	while (received < MESSAGE_COUNT) {
+		uint64_t value;
+		if (read(eventFd, &value, sizeof(value)) != sizeof(value)) {
+			break;
+		}
+		wakeups++;
+		ring.takeAll(messages);
+		received += messages.size();
+		messages.clear();
+	}
+	qint64 cpuTime = getThreadCpuTime() - cpuStart;
+	qint64 elapsed = timer.nsecsElapsed();
+	producer.wait();
+	close(eventFd);
+	if (received != MESSAGE_COUNT) {
+		return false;
+	}
+	printResults("MessageRing", rate, elapsed, cpuTime, wakeups);
+	return true;
+}
+
+static void measureSignals(int rate) {
+	SignalSender sender(MESSAGE_COUNT, rate);
+	SignalReceiver receiver(MESSAGE_COUNT);
+	QObject::connect(&sender, SIGNAL(message(QByteArray)),
+		&receiver, SLOT(onMessage(QByteArray)), Qt::QueuedConnection);
+	QEventLoop loop;
+	QObject::connect(&receiver, SIGNAL(finished()), &loop, SLOT(quit()));
+	QElapsedTimer timer;
+	timer.start();
+	qint64 cpuStart = getThreadCpuTime();
+	sender.start();
+	loop.exec();
+	qint64 cpuTime = getThreadCpuTime() - cpuStart;
+	qint64 elapsed = timer.nsecsElapsed();
+	sender.wait();
+	printResults("Queued signals", rate, elapsed, cpuTime, -1);
+}
+
+/**
+ * Passes messages from a producer thread to the main thread, once through a
+ * MessageRing with an eventfd and once with one queued signal per message.
+ * The consumer CPU time is the cost per message for the main thread.
+ */
+int main(int argc, char **argv) {
+	QCoreApplication app(argc, argv);
+	int rates[2] = { 0, MESSAGE_RATE };
+	for (int i = 0; i < 2; i++) {
+		if (!measureRing(rates[i])) {
+			fprintf(stderr, "The ring did not deliver all messages.\n");
+			return 1;
+		}
+		measureSignals(rates[i]);
+	}
+	return 0;
+}
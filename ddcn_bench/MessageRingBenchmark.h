@@ -0,0 +1,83 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef MESSAGERINGBENCHMARK_H_INCLUDED
+#define MESSAGERINGBENCHMARK_H_INCLUDED
+
+#include <QThread>
+#include <QByteArray>
+
+/**
+ * Sends messages to another thread with one queued signal per message, as
+ * the ariba thread did before MessageRing was used.
+ */
+class SignalSender : public QThread {
+	Q_OBJECT
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param count Number of messages to send.
+	 * @param rate Messages per second, or 0 to send as fast as possible.
+	 */
+	SignalSender(int count, int rate) : count(count), rate(rate) {
+	}
+signals:
+	void message(const QByteArray &data);
+protected:
+	virtual void run();
+private:
+	int count;
+	int rate;
+};
+
+/**
+ * Counts the messages sent by SignalSender.
+ */
+class SignalReceiver : public QObject {
+	Q_OBJECT
+public:
+	SignalReceiver(int count) : count(count), received(0) {
+	}
+signals:
+	/**
+	 * Emitted when all messages have been received.
+	 */
+	void finished();
+public slots:
+	void onMessage(const QByteArray &data) {
+		received++;
+		if (received == count) {
+			emit finished();
+		}
+	}
+private:
+	int count;
+	int received;
+};
+
+#endif
@@ -0,0 +1,146 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "ParameterParser.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <cstdio>
+
+/**
+ * Classifies the gcc calls in corpus files with ParameterParser and reports
+ * how many of them could be delegated.
+ *
+ * Every line of a corpus starts with a label followed by the complete command
+ * line including the compiler. Empty lines and lines starting with "#" are
+ * ignored. Response files are looked up next to the corpus.
+ *
+ * Calls recorded from real builds (see scripts/record_gcc_calls.sh) are
+ * labeled "compile" if they contain "-c" and "other" otherwise. The
+ * delegation rate is the share of the compile calls which are delegated or
+ * split. Compile calls which are kept local are listed, calls labeled "other"
+ * must never be delegated.
+ *
+ * Constructed test cases are labeled with the expected result instead
+ * ("local", "delegate" or "split").
+ *
+ * The program fails if any call is not classified as expected.
+ */
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <corpus>...\n", argv[0]);
+		return 2;
+	}
+	int compileCount = 0;
+	int otherCount = 0;
+	int delegatedCount = 0;
+	int splitCount = 0;
+	int caseCount = 0;
+	int mismatchCount = 0;
+	for (int file = 1; file < argc; file++) {
+		QFile corpus(QString::fromLocal8Bit(argv[file]));
+		if (!corpus.open(QIODevice::ReadOnly)) {
+			fprintf(stderr, "Could not open %s.\n", argv[file]);
+			return 2;
+		}
+		QString workingDirectory = QFileInfo(corpus).absolutePath();
+		QByteArray data = corpus.readAll();
+		QStringList lines = QString::fromLocal8Bit(data.constData(),
+			data.size()).split('\n');
+		for (int i = 0; i < lines.size(); i++) {
+			QString line = lines[i].trimmed();
+			if (line.isEmpty() || line.startsWith('#')) {
+				continue;
+			}
+			QStringList parameters = ParameterParser::splitResponseFile(line);
+			if (parameters.size() < 2) {
+				fprintf(stderr, "%s:%d: Invalid line.\n", argv[file], i + 1);
+				return 2;
+			}
+			QString label = parameters.takeFirst();
+			// The compiler itself is not passed to ddcn
+			parameters.removeFirst();
+			ParameterParser parser(parameters, workingDirectory);
+			QString result = "local";
+			if (parser.isSplittable()) {
+				result = "split";
+			} else if (parser.isDelegatable()) {
+				result = "delegate";
+			}
+			if (label == "compile") {
+				compileCount++;
+				if (result == "split") {
+					splitCount++;
+				} else if (result == "delegate") {
+					delegatedCount++;
+				} else {
+					printf("%s:%d: compile call kept local\n", argv[file],
+						i + 1);
+				}
+			} else if (label == "other") {
+				otherCount++;
+				if (result != "local") {
+					printf("%s:%d: expected local, got %s\n", argv[file],
+						i + 1, result.toLocal8Bit().data());
+					mismatchCount++;
+				}
+			} else if (label == "local" || label == "delegate"
+					|| label == "split") {
+				caseCount++;
+				if (result != label) {
+					printf("%s:%d: expected %s, got %s\n", argv[file], i + 1,
+						label.toLocal8Bit().data(),
+						result.toLocal8Bit().data());
+					mismatchCount++;
+				}
+			} else {
+				fprintf(stderr, "%s:%d: Invalid label.\n", argv[file], i + 1);
+				return 2;
+			}
+		}
+	}
+	if (compileCount + otherCount + caseCount == 0) {
+		fprintf(stderr, "The corpus is empty.\n");
+		return 2;
+	}
+	printf("%d recorded calls: %d compile calls, %d other calls\n",
+		compileCount + otherCount, compileCount, otherCount);
+	if (compileCount != 0) {
+		printf("Compile calls: %d delegated, %d split, %d local\n",
+			delegatedCount, splitCount,
+			compileCount - delegatedCount - splitCount);
+		printf("Delegation rate: %.1f%%\n",
+			100.0 * (delegatedCount + splitCount) / compileCount);
+	}
+	printf("%d test cases\n", caseCount);
+	if (mismatchCount != 0) {
+		printf("%d calls were not classified as expected.\n", mismatchCount);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,163 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "Benchmark.h"
+#include "SendLanes.h"
+
+#include <QElapsedTimer>
+
+/**
+ * Size of the payload of large packets, a large job or job result.
+ */
+static const int BULK_PAYLOAD_SIZE = 16 * 1024 * 1024;
+/**
+ * Number of large packets queued at the same time.
+ */
+static const int BULK_PACKET_COUNT = 8;
+/**
+ * Size of the payload of small packets, e.g. a job request.
+ */
+static const int CONTROL_PAYLOAD_SIZE = 100;
+/**
+ * Number of small packets sent in the CPU time measurement.
+ */
+static const int CONTROL_PACKET_COUNT = 1000000;
+/**
+ * Number of bytes sent between two small packets in the latency measurement.
+ */
+static const int CONTROL_INTERVAL = 1024 * 1024;
+/**
+ * Bytes per millisecond of the simulated link (1 Gbit/s).
+ */
+static const double LINK_BYTES_PER_MSEC = 125000.0;
+
+/**
+ * Takes all frames which can be sent and immediately removes them from the
+ * send window again, as if ariba took them over at once.
+ *
+ * @return Number of bytes in the frames, including the frame headers.
+ */
+static qint64 sendAll(SendLanes &lanes, int *frameCount) {
+	qint64 bytes = 0;
+	SendLanes::Frame frame;
+	while (lanes.takeFrame(frame)) {
+		unsigned int frameBytes = frame.size + sizeof(FrameHeader);
+		lanes.onFramesAcknowledged(frameBytes);
+		bytes += frameBytes;
+		(*frameCount)++;
+	}
+	return bytes;
+}
+
+static void measureFrames(const Packet &bulkPacket, const Packet &controlPacket) {
+	SendLanes lanes;
+	int frameCount = 0;
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < BULK_PACKET_COUNT; i++) {
+		lanes.append(bulkPacket);
+	}
+	sendAll(lanes, &frameCount);
+	printResult("Large packets, per frame", frameCount, timer.nsecsElapsed());
+	frameCount = 0;
+	timer.restart();
+	for (int i = 0; i < CONTROL_PACKET_COUNT; i++) {
+		lanes.append(controlPacket);
+		sendAll(lanes, &frameCount);
+	}
+	printResult("Small packets, per packet", CONTROL_PACKET_COUNT,
+		timer.nsecsElapsed());
+}
+
+/**
+ * Queues several large packets and then regularly adds a small packet while
+ * the large ones are sent, and prints how many bytes are sent before each
+ * small packet. Without lanes, all data queued before the small packet would
+ * have been sent first, so this is printed for comparison.
+ */
+static void measureLatency(const Packet &bulkPacket, const Packet &controlPacket) {
+	SendLanes lanes;
+	for (int i = 0; i < BULK_PACKET_COUNT; i++) {
+		lanes.append(bulkPacket);
+	}
+	int controlCount = 0;
+	qint64 maxDelay = 0;
+	qint64 totalDelay = 0;
+	qint64 maxQueued = 0;
+	qint64 totalQueued = 0;
+	SendLanes::Frame frame;
+	qint64 sinceControl = 0;
+	qint64 controlDelay = -1;
+	while (lanes.takeFrame(frame)) {
+		unsigned int frameBytes = frame.size + sizeof(FrameHeader);
+		lanes.onFramesAcknowledged(frameBytes);
+		if (controlDelay != -1) {
+			controlDelay += frameBytes;
+			if (frame.lane == SendLane::Control) {
+				maxDelay = qMax(maxDelay, controlDelay);
+				totalDelay += controlDelay;
+				controlCount++;
+				controlDelay = -1;
+			}
+		}
+		sinceControl += frameBytes;
+		if (sinceControl >= CONTROL_INTERVAL && controlDelay == -1) {
+			qint64 queued = lanes.getBufferedBytes();
+			maxQueued = qMax(maxQueued, queued);
+			totalQueued += queued;
+			lanes.append(controlPacket);
+			sinceControl = 0;
+			controlDelay = 0;
+		}
+	}
+	if (controlCount == 0) {
+		return;
+	}
+	printf("Small packets sent while large ones were queued: %d\n", controlCount);
+	printf("%-45s %10.3f ms avg  %10.3f ms max\n", "Delay at 1 Gbit/s, with lanes",
+		totalDelay / controlCount / LINK_BYTES_PER_MSEC,
+		maxDelay / LINK_BYTES_PER_MSEC);
+	printf("%-45s %10.3f ms avg  %10.3f ms max\n", "Delay at 1 Gbit/s, single queue",
+		totalQueued / controlCount / LINK_BYTES_PER_MSEC,
+		maxQueued / LINK_BYTES_PER_MSEC);
+}
+
+/**
+ * Measures the CPU time needed to split packets into frames and how long
+ * small packets wait behind large ones with and without separate lanes. The
+ * link itself is simulated, so ariba and TLS are not part of the measurement.
+ */
+int main(int argc, char **argv) {
+	// The packets are shared, so queueing the same one several times does
+	// not need more memory
+	Packet bulkPacket = Packet::fromData(PacketType::JobData, BULK_PAYLOAD_SIZE);
+	Packet controlPacket = Packet::fromData(PacketType::JobRequest,
+		CONTROL_PAYLOAD_SIZE);
+	measureFrames(bulkPacket, controlPacket);
+	measureLatency(bulkPacket, controlPacket);
+	return 0;
+}
@@ -0,0 +1,228 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "Benchmark.h"
+#include "TLS.h"
+
+#include <QElapsedTimer>
+
+/**
+ * Number of key pairs generated for each key type.
+ */
+static const int KEY_COUNT = 20;
+/**
+ * Number of connections established for each handshake measurement.
+ */
+static const int HANDSHAKE_COUNT = 200;
+/**
+ * Size of the data sent through one connection in each throughput
+ * measurement.
+ */
+static const int TRANSFER_SIZE = 256 * 1024 * 1024;
+/**
+ * Size of the individual writes, the size of one TLS record.
+ */
+static const int CHUNK_SIZE = 16 * 1024;
+
+/**
+ * Key pair and certificate used by both ends of the connections.
+ */
+struct Identity {
+	const char *name;
+	PrivateKey key;
+	Certificate cert;
+};
+
+/**
+ * Moves the data written by the two ends of a connection to the other end
+ * until neither has anything left to send.
+ */
+static void transfer(TLS &client, TLS &server) {
+	while (true) {
+		QByteArray toServer = client.readOutgoing();
+		QByteArray toClient = server.readOutgoing();
+		if (toServer.isEmpty() && toClient.isEmpty()) {
+			return;
+		}
+		if (!toServer.isEmpty()) {
+			server.writeIncoming(toServer);
+		}
+		if (!toClient.isEmpty()) {
+			client.writeIncoming(toClient);
+		}
+	}
+}
+
+/**
+ * Creates a connection between two TLS instances in memory.
+ *
+ * @param resumptionKey Key passed to TLS::setResumptionKey() of the client.
+ * @return False if the handshake failed.
+ */
+static bool connectPair(TLS &client, TLS &server, const Identity &identity,
+		bool encrypted, const QByteArray &resumptionKey) {
+	TLS *ends[2] = { &client, &server };
+	for (int i = 0; i < 2; i++) {
+		ends[i]->setCertificate(identity.cert);
+		ends[i]->setPrivateKey(identity.key);
+		ends[i]->setEncryptionRequired(encrypted);
+	}
+	client.setResumptionKey(resumptionKey);
+	if (!server.startServer() || !client.startClient()) {
+		return false;
+	}
+	transfer(client, server);
+	// exportKeyingMaterial() only returns data once the handshake is done
+	return !client.exportKeyingMaterial("ddcn benchmark", 16).isEmpty()
+		&& !server.exportKeyingMaterial("ddcn benchmark", 16).isEmpty();
+}
+
+static bool measureKeyGeneration(const char *name, KeyType::List type) {
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < KEY_COUNT; i++) {
+		if (!PrivateKey::generate(type).isValid()) {
+			fprintf(stderr, "Could not generate a key.\n");
+			return false;
+		}
+	}
+	printResult(name, KEY_COUNT, timer.nsecsElapsed());
+	return true;
+}
+
+static bool measureHandshakes(const char *name, const Identity &identity,
+		bool encrypted, bool resumed) {
+	QByteArray resumptionKey;
+	TLS::clearSessionCache();
+	if (resumed) {
+		// The first connection stores the session which is then resumed
+		resumptionKey = "benchmark";
+		TLS client;
+		TLS server;
+		if (!connectPair(client, server, identity, encrypted, resumptionKey)) {
+			fprintf(stderr, "%s: The handshake failed.\n", name);
+			return false;
+		}
+	}
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < HANDSHAKE_COUNT; i++) {
+		TLS client;
+		TLS server;
+		if (!connectPair(client, server, identity, encrypted, resumptionKey)) {
+			fprintf(stderr, "%s: The handshake failed.\n", name);
+			return false;
+		}
+		if (client.isResumed() != resumed) {
+			fprintf(stderr, "%s: Unexpected session resumption state.\n", name);
+			return false;
+		}
+	}
+	printResult(name, HANDSHAKE_COUNT, timer.nsecsElapsed());
+	return true;
+}
+
+static bool measureThroughput(const char *name, const Identity &identity,
+		bool encrypted) {
+	TLS::clearSessionCache();
+	TLS client;
+	TLS server;
+	if (!connectPair(client, server, identity, encrypted, QByteArray())) {
+		fprintf(stderr, "%s: The handshake failed.\n", name);
+		return false;
+	}
+	if (client.isEncrypted() != encrypted) {
+		fprintf(stderr, "%s: Unexpected cipher.\n", name);
+		return false;
+	}
+	QByteArray chunk(CHUNK_SIZE, 'x');
+	qint64 received = 0;
+	QElapsedTimer timer;
+	timer.start();
+	for (int sent = 0; sent < TRANSFER_SIZE; sent += chunk.size()) {
+		client.write(chunk);
+		server.writeIncoming(client.readOutgoing());
+		received += server.read().size();
+	}
+	qint64 nsecs = timer.nsecsElapsed();
+	if (received != TRANSFER_SIZE) {
+		fprintf(stderr, "%s: Only %lld bytes were received.\n", name,
+			(long long)received);
+		return false;
+	}
+	printThroughput(name, received, nsecs);
+	return true;
+}
+
+/**
+ * Measures key generation, full and resumed TLS handshakes and the
+ * throughput of TLS connections in memory, with and without encryption. RSA
+ * keys are included for comparison with older versions of ddcn.
+ */
+int main(int argc, char **argv) {
+	TLS::initialize();
+	QList<Identity> identities;
+	KeyType::List types[3] = { KeyType::RSA, KeyType::ECDSA, KeyType::Ed25519 };
+	const char *names[3] = { "RSA 2048", "ECDSA P-256", "Ed25519" };
+	for (int i = 0; i < 3; i++) {
+		if (!PrivateKey::isSupported(types[i])) {
+			printf("%s keys are not supported.\n", names[i]);
+			continue;
+		}
+		Identity identity;
+		identity.name = names[i];
+		identity.key = PrivateKey::generate(types[i]);
+		identity.cert = Certificate::createSelfSigned(identity.key);
+		identities.append(identity);
+		QByteArray name = QByteArray(names[i]) + ": key generation";
+		if (!measureKeyGeneration(name.data(), types[i])) {
+			return 1;
+		}
+	}
+	foreach (const Identity &identity, identities) {
+		for (int encrypted = 1; encrypted >= 0; encrypted--) {
+			QByteArray mode = encrypted ? "encrypted" : "plaintext";
+			QByteArray name = QByteArray(identity.name) + ", " + mode
+				+ ": full handshake";
+			if (!measureHandshakes(name.data(), identity, encrypted, false)) {
+				return 1;
+			}
+			name = QByteArray(identity.name) + ", " + mode + ": resumed handshake";
+			if (!measureHandshakes(name.data(), identity, encrypted, true)) {
+				return 1;
+			}
+		}
+	}
+	// The throughput does not depend on the key type
+	for (int encrypted = 1; encrypted >= 0; encrypted--) {
+		const char *name = encrypted ? "Encrypted transfer" : "Plaintext transfer";
+		if (!measureThroughput(name, identities.last(), encrypted)) {
+			return 1;
+		}
+	}
+	return 0;
+}
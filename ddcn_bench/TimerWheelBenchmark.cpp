@@ -0,0 +1,187 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "Benchmark.h"
+#include "JobKey.h"
+#include "TimerWheel.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QHash>
+#include <QList>
+#include <QTimer>
+#include <cstdlib>
+#include <ctime>
+
+/**
+ * Number of deadlines, timers or jobs in each measurement.
+ */
+static const int DEADLINE_COUNT = 100000;
+/**
+ * Number of peers the jobs are distributed across.
+ */
+static const int PEER_COUNT = 1000;
+/**
+ * Number of lookups for the linear search, which is too slow for more.
+ */
+static const int LINEAR_LOOKUP_COUNT = 1000;
+/**
+ * Deadlines expire at random times within this interval in the expiry
+ * measurement.
+ */
+static const int EXPIRY_INTERVAL = 2000;
+
+static void measureStartStop(const QList<int> &timeouts) {
+	TimerWheel wheel;
+	Deadline *deadlines = new Deadline[DEADLINE_COUNT];
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < DEADLINE_COUNT; i++) {
+		wheel.start(&deadlines[i], timeouts[i], 0, &deadlines[i]);
+	}
+	printResult("TimerWheel::start()", DEADLINE_COUNT, timer.nsecsElapsed());
+	// Job requests restart their deadline when they are accepted
+	timer.restart();
+	for (int i = 0; i < DEADLINE_COUNT; i++) {
+		wheel.start(&deadlines[i], timeouts[DEADLINE_COUNT - i - 1], 0,
+			&deadlines[i]);
+	}
+	printResult("TimerWheel::start(), restart", DEADLINE_COUNT,
+		timer.nsecsElapsed());
+	timer.restart();
+	for (int i = 0; i < DEADLINE_COUNT; i++) {
+		deadlines[i].stop();
+	}
+	printResult("Deadline::stop()", DEADLINE_COUNT, timer.nsecsElapsed());
+	delete[] deadlines;
+}
+
+static void measureTimers(const QList<int> &timeouts) {
+	// Every request used to own a single-shot QTimer
+	QList<QTimer*> timers;
+	QElapsedTimer timer;
+	timer.start();
+	for (int i = 0; i < DEADLINE_COUNT; i++) {
+		QTimer *requestTimer = new QTimer;
+		requestTimer->setSingleShot(true);
+		QObject::connect(requestTimer, SIGNAL(timeout()),
+			QCoreApplication::instance(), SLOT(quit()));
+		requestTimer->start(timeouts[i]);
+		timers.append(requestTimer);
+	}
+	printResult("QTimer, create and start", DEADLINE_COUNT, timer.nsecsElapsed());
+	timer.restart();
+	for (int i = 0; i < DEADLINE_COUNT; i++) {
+		timers[i]->stop();
+		delete timers[i];
+	}
+	printResult("QTimer, stop and delete", DEADLINE_COUNT, timer.nsecsElapsed());
+}
+
+static void measureExpiry() {
+	TimerWheel wheel(10);
+	Deadline *deadlines = new Deadline[DEADLINE_COUNT];
+	for (int i = 0; i < DEADLINE_COUNT; i++) {
+		wheel.start(&deadlines[i], rand() % EXPIRY_INTERVAL, 0, &deadlines[i]);
+	}
+	QElapsedTimer timer;
+	timer.start();
+	clock_t cpuStart = clock();
+	while (wheel.getActiveCount() > 0) {
+		QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+	}
+	clock_t cpuTime = clock() - cpuStart;
+	qint64 elapsed = timer.elapsed();
+	printResult("Deadline expiry, CPU time", DEADLINE_COUNT,
+		(qint64)cpuTime * 1000000000 / CLOCKS_PER_SEC);
+	printf("All deadlines expired after %lld ms (%d ms requested).\n",
+		(long long)elapsed, EXPIRY_INTERVAL);
+	delete[] deadlines;
+}
+
+static bool measureJobLookup() {
+	QList<JobKey> jobList;
+	QHash<JobKey, int> jobIndex;
+	for (int i = 0; i < DEADLINE_COUNT; i++) {
+		// Only the address of the peer is used
+		NetworkNode *node = (NetworkNode*)(quintptr)(64 + (i % PEER_COUNT) * 64);
+		JobKey key(node, i / PEER_COUNT);
+		jobList.append(key);
+		jobIndex.insert(key, i);
+	}
+	QList<JobKey> lookups;
+	for (int i = 0; i < DEADLINE_COUNT; i++) {
+		lookups.append(jobList[rand() % DEADLINE_COUNT]);
+	}
+	QElapsedTimer timer;
+	int found = 0;
+	timer.start();
+	for (int i = 0; i < LINEAR_LOOKUP_COUNT; i++) {
+		for (int j = 0; j < jobList.size(); j++) {
+			if (jobList[j] == lookups[i]) {
+				found++;
+				break;
+			}
+		}
+	}
+	printResult("Job lookup, linear search", LINEAR_LOOKUP_COUNT,
+		timer.nsecsElapsed());
+	timer.restart();
+	for (int i = 0; i < DEADLINE_COUNT; i++) {
+		if (jobIndex.contains(lookups[i])) {
+			found++;
+		}
+	}
+	printResult("Job lookup, QHash", DEADLINE_COUNT, timer.nsecsElapsed());
+	if (found != LINEAR_LOOKUP_COUNT + DEADLINE_COUNT) {
+		fprintf(stderr, "Not all jobs were found.\n");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Compares the timer wheel used for job timeouts with one QTimer per request,
+ * and the lookup of jobs by (peer, id) in a QHash with a linear search.
+ */
+int main(int argc, char **argv) {
+	QCoreApplication app(argc, argv);
+	srand(1);
+	// Job requests time out after seconds to minutes
+	QList<int> timeouts;
+	for (int i = 0; i < DEADLINE_COUNT; i++) {
+		timeouts.append(1000 + rand() % 600000);
+	}
+	measureStartStop(timeouts);
+	measureTimers(timeouts);
+	measureExpiry();
+	if (!measureJobLookup()) {
+		return 1;
+	}
+	return 0;
+}
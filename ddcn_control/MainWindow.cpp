@@ -347,7 +347,7 @@ void MainWindow::createGroup() {
 		return;
 	}
 	// Automatically generate a random key pair for the group
-	PrivateKey privateKey = PrivateKey::generate();
+	PrivateKey privateKey = PrivateKey::generate(PrivateKey::getDefaultType());
 	QString pemKey = privateKey.toPEM();
 	dbusNetwork.call("addGroupMembership", peerName, pemKey);
 }
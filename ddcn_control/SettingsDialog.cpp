@@ -125,16 +125,43 @@ bool SettingsDialog::writeSettings() {
 }
 
 void SettingsDialog::generateKey() {
+	// Let the user select the key type, the fastest supported type is the
+	// default
+	QStringList typeNames;
+	QList<KeyType::List> types;
+	KeyType::List allTypes[] = {
+		KeyType::Ed25519, KeyType::ECDSA, KeyType::RSA
+	};
+	const char *allTypeNames[] = {
+		"Ed25519", "ECDSA (P-256)", "RSA"
+	};
+	for (unsigned int i = 0; i < sizeof(allTypes) / sizeof(allTypes[0]); i++) {
+		if (PrivateKey::isSupported(allTypes[i])) {
+			types.append(allTypes[i]);
+			typeNames.append(allTypeNames[i]);
+		}
+	}
 	bool ok;
-	int bits = QInputDialog::getInt(this, "Enter key length",
-			"Enter the length of the key in bits.", 2048, 0, 1 << 16, 1, &ok);
+	QString typeName = QInputDialog::getItem(this, "Select key type",
+			"Select the type of the key.", typeNames,
+			types.indexOf(PrivateKey::getDefaultType()), false, &ok);
 	if (!ok) {
 		return;
 	}
-	PrivateKey privateKey = PrivateKey::generate(bits);
+	KeyType::List type = types[typeNames.indexOf(typeName)];
+	int bits = 2048;
+	if (type == KeyType::RSA) {
+		bits = QInputDialog::getInt(this, "Enter key length",
+				"Enter the length of the key in bits.", 2048, 0, 1 << 16, 1,
+				&ok);
+		if (!ok) {
+			return;
+		}
+	}
+	PrivateKey privateKey = PrivateKey::generate(type, bits);
 	if (!privateKey.isValid()) {
 		QMessageBox::critical(this, "Error",
-				"Could not generate a key with this length.");
+				"Could not generate a key of this type and length.");
 		return;
 	}
 	keyChanged = true;
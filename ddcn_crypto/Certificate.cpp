@@ -48,11 +48,25 @@ Certificate Certificate::createSelfSigned(const PublicKey &key) {
 	PublicKeyData *keyData = key.keyData;
 	EVP_PKEY *osslKey = keyData->getKey();
 	X509 *osslCert = X509_new();
-	X509_set_version(osslCert, 3);
+	// Version 3 certificate (the value is zero-based)
+	X509_set_version(osslCert, 2);
 	ASN1_INTEGER_set(X509_get_serialNumber(osslCert), 0);
 	X509_gmtime_adj(X509_get_notBefore(osslCert), 0);
 	X509_gmtime_adj(X509_get_notAfter(osslCert), (long)60*60*24*365);
 	X509_set_pubkey(osslCert, osslKey);
+	X509_NAME *name = X509_get_subject_name(osslCert);
+	X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+			(const unsigned char*)"ddcn", -1, -1, 0);
+	X509_set_issuer_name(osslCert, name);
+	// The certificate has to be signed, newer OpenSSL versions refuse to use
+	// certificates without a valid signature algorithm
+	if (keyData->isPrivateKey()) {
+		if (X509_sign(osslCert, osslKey, keyData->getSignatureDigest(false)) == 0) {
+			qWarning("Could not sign the certificate.");
+			X509_free(osslCert);
+			return Certificate();
+		}
+	}
 	CertificateData *certData = new CertificateData(osslCert);
 	certData->setPublicKey(key);
 	Certificate certificate(certData);
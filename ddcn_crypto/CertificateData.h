@@ -31,6 +31,7 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <openssl/evp.h>
 #include <openssl/x509.h>
+#include <QAtomicInt>
 
 struct CertificateData {
 public:
@@ -43,10 +44,10 @@ public:
 	}
 
 	void grab() {
-		refCount++;
+		refCount.ref();
 	}
 	void drop() {
-		if (--refCount == 0) {
+		if (!refCount.deref()) {
 			delete this;
 		}
 	}
@@ -62,7 +63,7 @@ public:
 		return key;
 	}
 private:
-	int refCount;
+	QAtomicInt refCount;
 	X509 *cert;
 
 	PublicKey key;
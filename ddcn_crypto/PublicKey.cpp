@@ -29,6 +29,10 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <openssl/pem.h>
 #include <openssl/evp.h>
+#include <openssl/rsa.h>
+#ifndef OPENSSL_NO_EC
+#include <openssl/ec.h>
+#endif
 #include <QFile>
 
 static QByteArray toByteArray(BIO *bio) {
@@ -99,20 +103,13 @@ QString PublicKey::toPEM() const {
 	if (!isValid()) {
 		return "";
 	}
-	EVP_PKEY *osslKey = keyData->getKey();
-	BIO *bio = BIO_new(BIO_s_mem());
-	PEM_write_bio_PUBKEY(bio, osslKey);
-	QByteArray buf = toByteArray(bio);
-	return QString::fromAscii(buf);
+	return keyData->getPEM();
 }
 QByteArray PublicKey::toDER() const {
 	if (!isValid()) {
 		return "";
 	}
-	EVP_PKEY *osslKey = keyData->getKey();
-	BIO *bio = BIO_new(BIO_s_mem());
-	i2d_PUBKEY_bio(bio, osslKey);
-	return toByteArray(bio);
+	return keyData->getDER();
 }
 
 QString PublicKey::fingerprint() const {
@@ -150,12 +147,21 @@ bool PublicKey::verify(QByteArray data, QByteArray signature) {
 	if (!isValid()) {
 		return false;
 	}
-	EVP_MD_CTX context;
-	const EVP_MD *method = EVP_sha1();
-	EVP_VerifyInit(&context, method);
-	EVP_VerifyUpdate(&context, data.data(), data.size());
-	return EVP_VerifyFinal(&context, (unsigned char*)signature.data(),
-			signature.size(), keyData->getKey()) == 1;
+	EVP_MD_CTX *context = EVP_MD_CTX_create();
+	const EVP_MD *method = keyData->getSignatureDigest(true);
+	bool valid = false;
+	if (EVP_DigestVerifyInit(context, NULL, method, NULL, keyData->getKey()) == 1) {
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+		valid = EVP_DigestVerify(context, (unsigned char*)signature.data(),
+				signature.size(), (unsigned char*)data.data(), data.size()) == 1;
+#else
+		EVP_DigestVerifyUpdate(context, data.data(), data.size());
+		valid = EVP_DigestVerifyFinal(context, (unsigned char*)signature.data(),
+				signature.size()) == 1;
+#endif
+	}
+	EVP_MD_CTX_destroy(context);
+	return valid;
 }
 
 PublicKey &PublicKey::operator=(const PublicKey &other) {
@@ -228,17 +234,100 @@ PrivateKey::PrivateKey(const PublicKey &other) : keyData(other.keyData) {
 }
 
 PrivateKey PrivateKey::generate(unsigned int bits) {
-	RSA *rsa = RSA_generate_key(bits, RSA_F4, NULL, NULL);
-	EVP_PKEY *pkey = EVP_PKEY_new();
-	if (EVP_PKEY_assign_RSA(pkey, rsa) == 0) {
-		qFatal("Could not assign RSA key.");
+	return generate(KeyType::RSA, bits);
+}
+PrivateKey PrivateKey::generate(KeyType::List type, unsigned int bits) {
+	if (!isSupported(type)) {
+		return PrivateKey();
+	}
+	EVP_PKEY_CTX *context;
+	switch (type) {
+		case KeyType::RSA:
+			context = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+			break;
+#ifndef OPENSSL_NO_EC
+		case KeyType::ECDSA:
+			context = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
+			break;
+#endif
+#ifdef EVP_PKEY_ED25519
+		case KeyType::Ed25519:
+			context = EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, NULL);
+			break;
+#endif
+		default:
+			return PrivateKey();
+	}
+	if (!context) {
+		return PrivateKey();
 	}
+	EVP_PKEY *pkey = NULL;
+	bool success = EVP_PKEY_keygen_init(context) == 1;
+	if (success && type == KeyType::RSA) {
+		success = EVP_PKEY_CTX_set_rsa_keygen_bits(context, bits) == 1;
+	}
+#ifndef OPENSSL_NO_EC
+	if (success && type == KeyType::ECDSA) {
+		success = EVP_PKEY_CTX_set_ec_paramgen_curve_nid(context,
+				NID_X9_62_prime256v1) == 1;
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+		// Store the curve name instead of the parameters, otherwise the key
+		// cannot be used in TLS
+		if (success) {
+			success = EVP_PKEY_CTX_set_ec_param_enc(context,
+					OPENSSL_EC_NAMED_CURVE) == 1;
+		}
+#endif
+	}
+#endif
+	if (success) {
+		success = EVP_PKEY_keygen(context, &pkey) == 1;
+	}
+	EVP_PKEY_CTX_free(context);
+	if (!success) {
+		qWarning("Could not generate a key pair.");
+		return PrivateKey();
+	}
+#if OPENSSL_VERSION_NUMBER < 0x10100000L && !defined(OPENSSL_NO_EC)
+	if (type == KeyType::ECDSA) {
+		EC_KEY *ecKey = EVP_PKEY_get1_EC_KEY(pkey);
+		EC_KEY_set_asn1_flag(ecKey, OPENSSL_EC_NAMED_CURVE);
+		EC_KEY_free(ecKey);
+	}
+#endif
 	PublicKeyData *keyData = new PublicKeyData();
 	keyData->setPrivateKey(true);
 	keyData->setKey(pkey);
 	PrivateKey key(keyData);
 	return key;
 }
+bool PrivateKey::isSupported(KeyType::List type) {
+	switch (type) {
+		case KeyType::RSA:
+			return true;
+		case KeyType::ECDSA:
+#ifndef OPENSSL_NO_EC
+			return true;
+#else
+			return false;
+#endif
+		case KeyType::Ed25519:
+#ifdef EVP_PKEY_ED25519
+			return true;
+#else
+			return false;
+#endif
+	}
+	return false;
+}
+KeyType::List PrivateKey::getDefaultType() {
+	if (isSupported(KeyType::Ed25519)) {
+		return KeyType::Ed25519;
+	} else if (isSupported(KeyType::ECDSA)) {
+		return KeyType::ECDSA;
+	}
+	return KeyType::RSA;
+}
 
 PrivateKey PrivateKey::fromPEM(QString data) {
 	BIO *bio = BIO_new(BIO_s_mem());
@@ -313,15 +402,27 @@ QByteArray PrivateKey::sign(QByteArray data) {
 	if (!isValid()) {
 		return QByteArray();
 	}
-	EVP_MD_CTX context;
-	const EVP_MD *method = EVP_sha1();
-	EVP_SignInit(&context, method);
-	EVP_SignUpdate(&context, data.data(), data.size());
+	EVP_MD_CTX *context = EVP_MD_CTX_create();
+	const EVP_MD *method = keyData->getSignatureDigest(true);
 	QByteArray signature;
-	signature.resize(EVP_PKEY_size(keyData->getKey()));
-	unsigned int signatureSize;
-	EVP_SignFinal(&context, (unsigned char*)signature.data(), &signatureSize,
-			keyData->getKey());
+	size_t signatureSize = EVP_PKEY_size(keyData->getKey());
+	signature.resize(signatureSize);
+	bool success = EVP_DigestSignInit(context, NULL, method, NULL,
+			keyData->getKey()) == 1;
+	if (success) {
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+		success = EVP_DigestSign(context, (unsigned char*)signature.data(),
+				&signatureSize, (unsigned char*)data.data(), data.size()) == 1;
+#else
+		EVP_DigestSignUpdate(context, data.data(), data.size());
+		success = EVP_DigestSignFinal(context, (unsigned char*)signature.data(),
+				&signatureSize) == 1;
+#endif
+	}
+	EVP_MD_CTX_destroy(context);
+	if (!success) {
+		return QByteArray();
+	}
 	signature.resize(signatureSize);
 	return signature;
 }
@@ -33,6 +33,26 @@ class PublicKeyData;
 class PrivateKey;
 class TLS;
 
+/**
+ * Algorithm of a key pair created with PrivateKey::generate().
+ */
+struct KeyType {
+	enum List {
+		/**
+		 * RSA key, the length is given in bits.
+		 */
+		RSA,
+		/**
+		 * ECDSA key on the NIST P-256 curve.
+		 */
+		ECDSA,
+		/**
+		 * Ed25519 key, only available with OpenSSL 1.1.1 or later.
+		 */
+		Ed25519
+	};
+};
+
 /**
  * Wraps around an OpenSSL public key.
  *
@@ -180,6 +200,13 @@ private:
 	friend class TLS;
 };
 
+/**
+ * Hash function so that public keys can be used as keys in QHash.
+ */
+inline uint qHash(const PublicKey &key) {
+	return key.hash();
+}
+
 /**
  * Wraps around an OpenSSL public key.
  *
@@ -225,6 +252,26 @@ public:
 	 * @return Generated private key.
 	 */
 	static PrivateKey generate(unsigned int bits = 2048);
+	/**
+	 * Creates a new random key pair of the given type.
+	 *
+	 * Elliptic curve keys are much faster to generate and make both the TLS
+	 * handshake and signatures cheaper than RSA keys.
+	 *
+	 * @param type Algorithm of the new key pair.
+	 * @param bits Number of bits, only used for RSA keys.
+	 * @return Generated private key or an invalid key if the type is not
+	 * supported by the OpenSSL version in use.
+	 */
+	static PrivateKey generate(KeyType::List type, unsigned int bits = 2048);
+	/**
+	 * Returns true if keys of the given type can be generated and used.
+	 */
+	static bool isSupported(KeyType::List type);
+	/**
+	 * Returns the fastest key type supported by the OpenSSL version in use.
+	 */
+	static KeyType::List getDefaultType();
 
 	/**
 	 * Creates a private key from  the PEM text representation.
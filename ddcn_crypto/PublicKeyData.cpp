@@ -28,56 +28,140 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <openssl/rsa.h>
 #include <openssl/dsa.h>
+#include <openssl/x509.h>
+#include <openssl/pem.h>
 #include <QHash>
+#include <QMutexLocker>
 
-QByteArray toByteArray(BIGNUM *bignum) {
+static QByteArray toByteArray(const BIGNUM *bignum) {
 	QByteArray data;
 	data.resize(BN_num_bytes(bignum));
 	BN_bn2bin(bignum, (unsigned char*)data.data());
 	return data;
 }
 
+int PublicKeyData::getType() {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	return EVP_PKEY_base_id(key);
+#else
+	return EVP_PKEY_type(key->type);
+#endif
+}
+
+const EVP_MD *PublicKeyData::getSignatureDigest(bool legacy) {
+	switch (getType()) {
+#ifdef EVP_PKEY_ED25519
+		case EVP_PKEY_ED25519:
+			return NULL;
+#endif
+		case EVP_PKEY_RSA:
+		case EVP_PKEY_DSA:
+			if (legacy) {
+				return EVP_sha1();
+			}
+			return EVP_sha256();
+		default:
+			return EVP_sha256();
+	}
+}
+
+QByteArray PublicKeyData::getDER() {
+	QMutexLocker lock(&mutex);
+	if (!der.isEmpty()) {
+		return der;
+	}
+	int size = i2d_PUBKEY(key, NULL);
+	if (size <= 0) {
+		return QByteArray();
+	}
+	der.resize(size);
+	unsigned char *data = (unsigned char*)der.data();
+	i2d_PUBKEY(key, &data);
+	return der;
+}
+
+QString PublicKeyData::getPEM() {
+	QMutexLocker lock(&mutex);
+	if (!pem.isEmpty()) {
+		return pem;
+	}
+	BIO *bio = BIO_new(BIO_s_mem());
+	PEM_write_bio_PUBKEY(bio, key);
+	char *data;
+	long size = BIO_get_mem_data(bio, &data);
+	pem = QString::fromAscii(data, size);
+	BIO_free(bio);
+	return pem;
+}
+
 QString PublicKeyData::getFingerprint() {
+	QMutexLocker lock(&mutex);
 	// Use precomputed fingerprint if possible
 	if (fingerprint != "") {
 		return fingerprint;
 	}
-	EVP_MD_CTX context;
 	const EVP_MD *method = EVP_sha1();
 	// Get data to be hashed
 	QByteArray keyData;
-	switch (EVP_PKEY_type(key->type)) {
+	switch (getType()) {
 #ifndef OPENSSL_NO_RSA
-		case EVP_PKEY_RSA:
+		case EVP_PKEY_RSA: {
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+			const BIGNUM *n, *e;
+			RSA_get0_key(EVP_PKEY_get0_RSA(key), &n, &e, NULL);
+			keyData.append(toByteArray(n));
+			keyData.append(toByteArray(e));
+#else
 			keyData.append(toByteArray(key->pkey.rsa->n));
 			keyData.append(toByteArray(key->pkey.rsa->e));
+#endif
 			break;
+		}
 #endif
 #ifndef OPENSSL_NO_DSA
-		case EVP_PKEY_DSA:
+		case EVP_PKEY_DSA: {
 			// TODO: Not compatible to OpenSSH fingerprint
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+			const BIGNUM *p, *q, *g, *pubKey;
+			DSA_get0_pqg(EVP_PKEY_get0_DSA(key), &p, &q, &g);
+			DSA_get0_key(EVP_PKEY_get0_DSA(key), &pubKey, NULL);
+			keyData.append(toByteArray(p));
+			keyData.append(toByteArray(q));
+			keyData.append(toByteArray(g));
+			keyData.append(toByteArray(pubKey));
+#else
 			keyData.append(toByteArray(key->pkey.dsa->p));
 			keyData.append(toByteArray(key->pkey.dsa->q));
 			keyData.append(toByteArray(key->pkey.dsa->g));
 			keyData.append(toByteArray(key->pkey.dsa->pub_key));
+#endif
 			break;
+		}
 #endif
 		default:
-			// TODO: Are there other key types which need to be added?
-			return "";
+			// Elliptic curve keys are identified by their DER encoded
+			// SubjectPublicKeyInfo
+			keyData = getDER();
+			if (keyData.isEmpty()) {
+				return "";
+			}
+			break;
 	}
 	// Hash data
 	QByteArray fingerprint;
 	fingerprint.resize(EVP_MAX_MD_SIZE);
-	EVP_DigestInit(&context, method);
-	EVP_DigestUpdate(&context, keyData.data(), keyData.size());
+	EVP_MD_CTX *context = EVP_MD_CTX_create();
+	EVP_DigestInit(context, method);
+	EVP_DigestUpdate(context, keyData.data(), keyData.size());
 	uint digestSize = 0;
-	EVP_DigestFinal(&context, (unsigned char*)fingerprint.data(), &digestSize);
+	EVP_DigestFinal(context, (unsigned char*)fingerprint.data(), &digestSize);
+	EVP_MD_CTX_destroy(context);
 	this->fingerprint = QString::fromAscii(fingerprint.left(digestSize).toHex());
 	return this->fingerprint;
 }
 
 unsigned int PublicKeyData::getHash() {
+	QMutexLocker lock(&mutex);
 	if (hasHash) {
 		return hash;
 	}
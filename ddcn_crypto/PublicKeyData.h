@@ -29,10 +29,13 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <openssl/evp.h>
 #include <QString>
+#include <QAtomicInt>
+#include <QMutex>
 
 struct PublicKeyData {
 public:
-	PublicKeyData() : refCount(0), key(NULL), privateKey(false), hasHash(false) {
+	PublicKeyData() : refCount(0), key(NULL), privateKey(false),
+			mutex(QMutex::Recursive), hasHash(false) {
 	}
 	~PublicKeyData() {
 		if (key) {
@@ -42,19 +45,17 @@ public:
 
 	/**
 	 * Increases the reference count for this key data object.
-	 * @note This is not thread-safe.
 	 */
 	void grab() {
-		refCount++;
+		refCount.ref();
 	}
 	/**
 	 * Decreases the reference count for this key data object.
 	 *
 	 * This deletes the object if the reference count goes down to 0.
-	 * @note This is not thread-safe.
 	 */
 	void drop() {
-		if (--refCount == 0) {
+		if (!refCount.deref()) {
 			delete this;
 		}
 	}
@@ -66,6 +67,29 @@ public:
 	EVP_PKEY *getKey() {
 		return key;
 	}
+	/**
+	 * Returns the OpenSSL type of the key (EVP_PKEY_RSA, EVP_PKEY_EC, ...).
+	 */
+	int getType();
+	/**
+	 * Returns the digest used when signing data with this key. For Ed25519
+	 * keys this is NULL as the algorithm does its own hashing.
+	 *
+	 * @param legacy If true, SHA-1 is used for RSA and DSA keys to stay
+	 * compatible to signatures created by older versions.
+	 */
+	const EVP_MD *getSignatureDigest(bool legacy);
+	/**
+	 * Returns the DER encoding of the public key. The encoding is computed
+	 * only once, keys are sent and compared very often. The same key can be
+	 * used by multiple threads, so this and the other cached values are
+	 * protected by a mutex.
+	 */
+	QByteArray getDER();
+	/**
+	 * Returns the PEM encoding of the public key, computed only once.
+	 */
+	QString getPEM();
 	QString getFingerprint();
 	unsigned int getHash();
 
@@ -76,10 +100,13 @@ public:
 		return privateKey;
 	}
 private:
-	int refCount;
+	QAtomicInt refCount;
 	EVP_PKEY *key;
 	bool privateKey;
 
+	QMutex mutex;
+	QByteArray der;
+	QString pem;
 	QString fingerprint;
 	bool hasHash;
 	unsigned int hash;
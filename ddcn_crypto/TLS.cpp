@@ -29,21 +29,80 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "CertificateData.h"
 
 #include <openssl/err.h>
+#include <openssl/rand.h>
+#include <QMap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
 #include <stdio.h>
 
+/**
+ * Sessions of client connections which can be resumed, indexed by the
+ * resumption key of the connection.
+ */
+static QMap<QByteArray, SSL_SESSION*> sessionCache;
+/**
+ * Keys used to encrypt the session tickets sent by server connections. These
+ * are shared by all connections so that any later connection can decrypt the
+ * tickets. OpenSSL 1.1 and later expect a key name, an HMAC key and an AES key
+ * of 16, 32 and 32 bytes, older versions use 16 bytes for each.
+ */
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+static unsigned char ticketKeys[80];
+#else
+static unsigned char ticketKeys[48];
+#endif
+static bool ticketKeysValid = false;
+/**
+ * Protects sessionCache and the ticket keys as connections can live in
+ * different threads.
+ */
+static QMutex sessionMutex;
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+// Older OpenSSL versions need the application to provide locks for the
+// internal data structures if they are used by multiple threads
+static QMutex *openSSLLocks = NULL;
+
+static void openSSLLockingCallback(int mode, int type, const char *file,
+		int line) {
+	if (mode & CRYPTO_LOCK) {
+		openSSLLocks[type].lock();
+	} else {
+		openSSLLocks[type].unlock();
+	}
+}
+static unsigned long openSSLThreadIdCallback() {
+	return (unsigned long)QThread::currentThreadId();
+}
+#endif
+
 void TLS::initialize() {
 	// Initialize OpenSSL
 	SSL_load_error_strings();
 	SSLeay_add_ssl_algorithms();
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	if (!openSSLLocks) {
+		openSSLLocks = new QMutex[CRYPTO_num_locks()];
+		CRYPTO_set_id_callback(openSSLThreadIdCallback);
+		CRYPTO_set_locking_callback(openSSLLockingCallback);
+	}
+#endif
 }
 
-TLS::TLS() : context(NULL), ssl(NULL), handshaken(false) {
+TLS::TLS() : context(NULL), ssl(NULL), handshaken(false),
+		encryptionRequired(true) {
 }
 TLS::~TLS() {
 	if (context) {
 		SSL_CTX_free(context);
 	}
 	if (ssl) {
+		// Connections are closed without a TLS shutdown, OpenSSL would mark
+		// the session as not resumable otherwise
+		if (handshaken) {
+			SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+		}
 		SSL_free(ssl);
 	}
 }
@@ -55,7 +114,11 @@ bool TLS::startServer() {
 	if (!key.isValid()) {
 		qFatal("No valid private key!");
 	}
-	const SSL_METHOD *method = TLSv1_server_method();
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	const SSL_METHOD *method = TLS_server_method();
+#else
+	const SSL_METHOD *method = SSLv23_server_method();
+#endif
 	if (!init(method)) {
 		qFatal("Could not initialize TLS context.");
 	}
@@ -77,7 +140,11 @@ bool TLS::startClient() {
 	if (!key.isValid()) {
 		qFatal("No valid private key!");
 	}
-	const SSL_METHOD *method = TLSv1_client_method();
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	const SSL_METHOD *method = TLS_client_method();
+#else
+	const SSL_METHOD *method = SSLv23_client_method();
+#endif
 	if (!init(method)) {
 		qFatal("Could not initialize TLS context.");
 	}
@@ -104,6 +171,36 @@ void TLS::setPrivateKey(PrivateKey key) {
 PrivateKey TLS::getPrivateKey() {
 	return key;
 }
+void TLS::setResumptionKey(const QByteArray &key) {
+	resumptionKey = key;
+}
+void TLS::setEncryptionRequired(bool required) {
+	encryptionRequired = required;
+}
+bool TLS::isEncrypted() {
+	if (!ssl || !handshaken) {
+		return false;
+	}
+	const SSL_CIPHER *cipher = SSL_get_current_cipher(ssl);
+	if (!cipher) {
+		return false;
+	}
+	int bits = 0;
+	SSL_CIPHER_get_bits(cipher, &bits);
+	return bits > 0;
+}
+bool TLS::isResumed() {
+	return ssl && handshaken && SSL_session_reused(ssl);
+}
+void TLS::clearSessionCache() {
+	QMutexLocker lock(&sessionMutex);
+	foreach (SSL_SESSION *session, sessionCache) {
+		SSL_SESSION_free(session);
+	}
+	sessionCache.clear();
+	// New tickets are created with new keys
+	ticketKeysValid = false;
+}
 
 void TLS::write(const QByteArray &data) {
 	if (!handshaken) {
@@ -129,6 +226,26 @@ Certificate TLS::getPeerCertificate() {
 	}
 	return peerCert;
 }
+QByteArray TLS::exportKeyingMaterial(const QByteArray &label, int length,
+		const QByteArray &context) {
+	if (!handshaken) {
+		return QByteArray();
+	}
+#if OPENSSL_VERSION_NUMBER >= 0x10001000L
+	QByteArray material;
+	material.resize(length);
+	if (SSL_export_keying_material(ssl, (unsigned char*)material.data(),
+			material.size(), label.data(), label.size(),
+			(const unsigned char*)context.data(), context.size(),
+			context.isEmpty() ? 0 : 1) != 1) {
+		ERR_print_errors_fp(stderr);
+		return QByteArray();
+	}
+	return material;
+#else
+	return QByteArray();
+#endif
+}
 
 void TLS::writeIncoming(const QByteArray &data) {
 	BIO_write(rbio, data.data(), data.size());
@@ -178,12 +295,76 @@ bool TLS::init(const SSL_METHOD *method) {
 	// Do not actually check the certificate, we only need the public key
 	SSL_CTX_set_cert_verify_callback(context, tlsVerifyCallback, NULL);
 	SSL_CTX_set_mode(context, SSL_MODE_ENABLE_PARTIAL_WRITE);
+	// Only allow TLS 1.2 and newer with AEAD ciphers and forward secrecy
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+#else
+	SSL_CTX_set_options(context, SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3
+			| SSL_OP_NO_TLSv1 | SSL_OP_NO_TLSv1_1);
+#endif
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L && OPENSSL_VERSION_NUMBER < 0x10100000L
+	SSL_CTX_set_ecdh_auto(context, 1);
+#endif
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	if (!SSL_CTX_set_ciphersuites(context, "TLS_AES_128_GCM_SHA256:"
+			"TLS_CHACHA20_POLY1305_SHA256:TLS_AES_256_GCM_SHA384")) {
+		ERR_print_errors_fp(stderr);
+		return false;
+	}
+#endif
+	const char *cipherList = "ECDHE+AESGCM:ECDHE+CHACHA20:!aNULL";
+	if (!encryptionRequired) {
+		// TLS 1.3 does not have any cipher suites without encryption, so we
+		// have to stay at TLS 1.2. The ciphers without encryption are only
+		// preferred, if the other peer requires encryption, it still gets it.
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+		SSL_CTX_set_max_proto_version(context, TLS1_2_VERSION);
+		SSL_CTX_set_security_level(context, 0);
+#endif
+		SSL_CTX_set_options(context, SSL_OP_CIPHER_SERVER_PREFERENCE);
+		cipherList = "ECDHE+eNULL:ECDHE+AESGCM:ECDHE+CHACHA20:!aNULL";
+	}
+	if (!SSL_CTX_set_cipher_list(context, cipherList)) {
+		ERR_print_errors_fp(stderr);
+		return false;
+	}
+	// Enable session resumption - every connection has its own context, so
+	// servers use session tickets with shared keys and clients keep their
+	// sessions in sessionCache
+	SSL_CTX_set_session_id_context(context, (const unsigned char*)"ddcn", 4);
+	QMutexLocker lock(&sessionMutex);
+	if (server) {
+		if (!ticketKeysValid) {
+			if (RAND_bytes(ticketKeys, sizeof(ticketKeys)) != 1) {
+				ERR_print_errors_fp(stderr);
+				return false;
+			}
+			ticketKeysValid = true;
+		}
+		if (SSL_CTX_set_tlsext_ticket_keys(context, ticketKeys,
+				sizeof(ticketKeys)) != 1) {
+			qWarning("Could not set the session ticket keys.");
+			return false;
+		}
+	} else {
+		SSL_CTX_set_session_cache_mode(context,
+			SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+		SSL_CTX_sess_set_new_cb(context, onNewSession);
+	}
 	// Create SSL instance
 	ssl = SSL_new(context);
 	if (!ssl) {
 		ERR_print_errors_fp(stderr);
 		return false;
 	}
+	SSL_set_app_data(ssl, this);
+	if (!server && !resumptionKey.isEmpty()) {
+		QMap<QByteArray, SSL_SESSION*>::Iterator it = sessionCache.find(resumptionKey);
+		if (it != sessionCache.end()) {
+			SSL_set_session(ssl, it.value());
+		}
+	}
+	lock.unlock();
 	// Set BIOs to plug in our custom network layer
 	rbio = BIO_new(BIO_s_mem());
 	wbio = BIO_new(BIO_s_mem());
@@ -214,6 +395,9 @@ TLS::AcceptConnectState::List TLS::nonBlockingConnectAccept(int status) {
 		}
 	} else {
 		handshaken = true;
+		if (SSL_session_reused(ssl)) {
+			qDebug("TLS session resumed.");
+		}
 		// Fetch remote certificate
 		CertificateData *certData = new CertificateData(SSL_get_peer_certificate(ssl));
 		peerCert = Certificate(certData);
@@ -278,6 +462,21 @@ bool TLS::checkOutgoing() {
 	}
 }
 
+int TLS::onNewSession(SSL *ssl, SSL_SESSION *session) {
+	TLS *tls = (TLS*)SSL_get_app_data(ssl);
+	if (!tls || tls->resumptionKey.isEmpty()) {
+		return 0;
+	}
+	QMutexLocker lock(&sessionMutex);
+	QMap<QByteArray, SSL_SESSION*>::Iterator it = sessionCache.find(tls->resumptionKey);
+	if (it != sessionCache.end()) {
+		SSL_SESSION_free(it.value());
+	}
+	// Returning 1 transfers the reference to the session to us
+	sessionCache.insert(tls->resumptionKey, session);
+	return 1;
+}
+
 void TLS::continueHandshake() {
 	AcceptConnectState::List handshakeState = doHandshake();
 	if (handshakeState == AcceptConnectState::Error) {
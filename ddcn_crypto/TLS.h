@@ -57,7 +57,11 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * Encapsulates a TLS connection with both client and server authentication.
  *
  * We use a full TLS handshake to identicate the other peer as well as we
- * have symmetric connections.
+ * have symmetric connections. Only TLS 1.2 and 1.3 with AEAD cipher suites are
+ * accepted.
+ *
+ * Different connections can be used in different threads, but a single
+ * connection must not be used by multiple threads at the same time.
  */
 class TLS : public QObject {
 	Q_OBJECT
@@ -116,6 +120,42 @@ public:
 	 * @return Private key of this peer.
 	 */
 	PrivateKey getPrivateKey();
+	/**
+	 * Sets an identifier for the other peer which is used to store the TLS
+	 * session once the handshake is complete. Later client connections with
+	 * the same identifier then try to resume the session instead of doing a
+	 * full handshake. Has to be called before the connection is started.
+	 *
+	 * @param key Unique identifier of the other peer.
+	 */
+	void setResumptionKey(const QByteArray &key);
+	/**
+	 * Sets whether the connection has to be encrypted. If not, cipher suites
+	 * which only authenticate the data are preferred. These only save CPU
+	 * time on CPUs without AES instructions, otherwise AES-GCM is faster than
+	 * their SHA-1 MAC. They are only selected if both peers do not
+	 * require encryption, and they limit the connection to TLS 1.2 as TLS 1.3
+	 * does not define any such suites. Channels keyed with
+	 * exportKeyingMaterial() do their own encryption and are not affected. Has
+	 * to be called before the connection is started.
+	 *
+	 * @param required False if the connection may be unencrypted.
+	 */
+	void setEncryptionRequired(bool required);
+	/**
+	 * Returns true if the negotiated cipher suite encrypts the data.
+	 */
+	bool isEncrypted();
+	/**
+	 * Returns true if the handshake resumed a previous session.
+	 */
+	bool isResumed();
+	/**
+	 * Removes all stored sessions and invalidates all session tickets issued
+	 * by this process. Has to be called when the local key is changed as
+	 * resumed sessions would still carry the old certificate.
+	 */
+	static void clearSessionCache();
 
 	/**
 	 * Writes some (non-encrypted) data to this connection. This might trigger
@@ -144,6 +184,21 @@ public:
 	 * @return Certificate of the other peer.
 	 */
 	Certificate getPeerCertificate();
+	/**
+	 * Derives keying material from the master secret of this connection as
+	 * described in RFC 5705. Both peers get the same result for the same label,
+	 * so this can be used to key additional channels between the two peers
+	 * without another handshake.
+	 *
+	 * @param label Label which makes the derived material unique.
+	 * @param length Number of bytes to derive.
+	 * @param context Optional context value which is mixed into the derived
+	 * material, e.g. to get different keys for multiple channels.
+	 * @return Derived keying material or an empty array if the connection is
+	 * not ready or OpenSSL does not support key export.
+	 */
+	QByteArray exportKeyingMaterial(const QByteArray &label, int length,
+		const QByteArray &context = QByteArray());
 
 	/**
 	 * Writes some (encrypted) data which has been received from the network
@@ -194,6 +249,8 @@ private:
 	bool checkOutgoing();
 	void continueHandshake();
 
+	static int onNewSession(SSL *ssl, SSL_SESSION *session);
+
 	Certificate cert;
 	Certificate peerCert;
 	PrivateKey key;
@@ -205,6 +262,8 @@ private:
 
 	bool server;
 	bool handshaken;
+	bool encryptionRequired;
+	QByteArray resumptionKey;
 
 	QByteArray toNetwork;
 	QByteArray readBuffer;
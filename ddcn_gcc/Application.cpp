@@ -32,6 +32,7 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <iostream>
 #include <QDir>
 #include <cstdio>
+#include <cstring>
 
 QDBusArgument &operator<<(QDBusArgument &argument, const ToolChainInfo &info)
 {
@@ -66,6 +67,28 @@ const QDBusArgument &operator>>(const QDBusArgument &argument, JobResult &jobRes
 }
 
 int Application::run(int argc, char **argv) {
+	// Select a language
+	QString language = "c";
+	const char *languageEnv = getenv("DDCN_LANGUAGE");
+	if (languageEnv) {
+		language = languageEnv;
+	}
+	if (language != "c" && language != "c++") {
+		language = "c";
+	}
+	// Check whether we need to read stdin
+	bool readStdin = false;
+	for (int i = 1; i < argc; i++) {
+		// "-" says that we should read from stdin
+		if (!strcmp(argv[i], "-")) {
+			readStdin = true;
+			break;
+		}
+	}
+	QStringList parameters;
+	for (int i = 1; i < argc; i++) {
+		parameters.append(argv[i]);
+	}
 	// Fetch list of available tool chains
 	QStringList availableToolChains = fetchToolChainList();
 	if (availableToolChains.count() == 0) {
@@ -87,29 +110,12 @@ int Application::run(int argc, char **argv) {
 			qCritical("Error: Selected toolchain not supported by the service.");
 			return -1;
 		}
-	}
-	// Select a language
-	QString language = "c";
-	const char *languageEnv = getenv("DDCN_LANGUAGE");
-	if (languageEnv) {
-		language = languageEnv;
-	}
-	if (language != "c" && language != "c++") {
-		language = "c";
-	}
-	// Check whether we need to read stdin
-	QByteArray stdinData;
-	for (int i = 1; i < argc; i++) {
-		// "-" says that we should read from stdin
-		if (!strcmp(argv[i], "-")) {
-			stdinData = readStdin();
-			break;
-		}
+		toolChain = toolChainEnv;
 	}
 	// Send the job
-	QStringList parameters;
-	for (int i = 1; i < argc; i++) {
-		parameters.append(argv[i]);
+	QByteArray stdinData;
+	if (readStdin) {
+		stdinData = readStdinData();
 	}
 	return executeJob(toolChain, parameters, stdinData, language);
 }
@@ -163,7 +169,7 @@ int Application::executeJob(QString toolChain, QStringList parameters,
 	return result.returnValue;
 }
 
-QByteArray Application::readStdin() {
+QByteArray Application::readStdinData() {
 	QFile input;
 	input.open(stdin, QIODevice::ReadOnly);
 	QByteArray inputData = input.readAll();
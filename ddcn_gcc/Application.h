@@ -65,7 +65,7 @@ private:
 	QStringList fetchToolChainList();
 	int executeJob(QString toolChain, QStringList parameters, const QByteArray &stdinData, QString language);
 
-	QByteArray readStdin ();
+	QByteArray readStdinData();
 };
 
 #endif
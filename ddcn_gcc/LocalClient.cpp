@@ -0,0 +1,206 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LocalClient.h"
+
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+static unsigned long long getMicroseconds() {
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (unsigned long long)time.tv_sec * 1000000 + time.tv_nsec / 1000;
+}
+
+int LocalClient::executeJob(int argc, char **argv, bool *available) {
+	*available = false;
+	unsigned long long startTime = getMicroseconds();
+	std::string path = getSocketPath();
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(address.sun_path)) {
+		return -1;
+	}
+	strcpy(address.sun_path, path.c_str());
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+		// Old service or service not running, use D-Bus
+		close(fd);
+		return -1;
+	}
+	// The source code and the terminal must not be passed to a socket of
+	// another user
+	struct ucred credentials;
+	socklen_t length = sizeof(credentials);
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0
+			|| credentials.uid != getuid()) {
+		fprintf(stderr, "Warning: %s does not belong to this user.\n", path.c_str());
+		close(fd);
+		return -1;
+	}
+	// Serialize the request, the toolchain is selected by the service
+	const char *toolChain = getenv("DDCN_TOOLCHAIN");
+	std::string language = "c";
+	const char *languageEnv = getenv("DDCN_LANGUAGE");
+	if (languageEnv && !strcmp(languageEnv, "c++")) {
+		language = "c++";
+	}
+	char workingPath[4096];
+	if (!getcwd(workingPath, sizeof(workingPath))) {
+		close(fd);
+		return -1;
+	}
+	bool readStdin = false;
+	std::string request;
+	appendInt(request, 0);
+	appendInt(request, argc - 1);
+	for (int i = 1; i < argc; i++) {
+		// "-" says that the compiler reads from stdin
+		if (!strcmp(argv[i], "-")) {
+			readStdin = true;
+		}
+		appendString(request, argv[i]);
+	}
+	appendString(request, toolChain ? toolChain : "");
+	appendString(request, workingPath);
+	appendString(request, language);
+	request.push_back(readStdin ? 1 : 0);
+	unsigned int size = htonl(request.size() - 4);
+	memcpy(&request[0], &size, 4);
+	if (!sendRequest(fd, request, available)) {
+		close(fd);
+		return -1;
+	}
+	unsigned long long sentTime = getMicroseconds();
+	// The output has already been written to our terminal when the return
+	// value arrives
+	int returnValue;
+	if (!receiveReturnValue(fd, &returnValue)) {
+		fprintf(stderr, "Error: The compiler service closed the connection.\n");
+		close(fd);
+		return -1;
+	}
+	close(fd);
+	if (getenv("DDCN_TIMING")) {
+		unsigned long long endTime = getMicroseconds();
+		fprintf(stderr, "ddcn: wrapper overhead %llu us, job %llu us\n",
+			(sentTime - startTime) + (getMicroseconds() - endTime),
+			endTime - sentTime);
+	}
+	return returnValue;
+}
+
+std::string LocalClient::getSocketPath() {
+	// This has to match LocalJobServer::getSocketPath() in ddcn_service
+	const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+	if (runtimeDir && runtimeDir[0] != 0) {
+		return std::string(runtimeDir) + "/ddcn.sock";
+	}
+	const char *tempDir = getenv("TMPDIR");
+	if (!tempDir || tempDir[0] == 0) {
+		tempDir = "/tmp";
+	}
+	char name[64];
+	snprintf(name, sizeof(name), "/ddcn-%u/ddcn.sock", (unsigned int)getuid());
+	return std::string(tempDir) + name;
+}
+void LocalClient::appendInt(std::string &request, unsigned int value) {
+	value = htonl(value);
+	request.append((const char*)&value, 4);
+}
+void LocalClient::appendString(std::string &request, const std::string &value) {
+	appendInt(request, value.size());
+	request.append(value);
+}
+bool LocalClient::sendRequest(int fd, const std::string &request, bool *available) {
+	// Send our terminal along with the first part of the request
+	int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+	union {
+		struct cmsghdr header;
+		char data[CMSG_SPACE(sizeof(fds))];
+	} control;
+	memset(&control, 0, sizeof(control));
+	struct iovec vector;
+	vector.iov_base = (void*)request.data();
+	vector.iov_len = request.size();
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &vector;
+	message.msg_iovlen = 1;
+	message.msg_control = control.data;
+	message.msg_controllen = sizeof(control.data);
+	struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+	header->cmsg_level = SOL_SOCKET;
+	header->cmsg_type = SCM_RIGHTS;
+	header->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(header), fds, sizeof(fds));
+	ssize_t sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+	if (sent <= 0) {
+		return false;
+	}
+	// From here on the service might execute the job, so we must not fall back
+	// to D-Bus anymore
+	*available = true;
+	while ((size_t)sent < request.size()) {
+		ssize_t count = send(fd, request.data() + sent, request.size() - sent,
+			MSG_NOSIGNAL);
+		if (count == -1 && errno == EINTR) {
+			continue;
+		}
+		if (count <= 0) {
+			fprintf(stderr, "Error: Could not send the job to the compiler service.\n");
+			return false;
+		}
+		sent += count;
+	}
+	return true;
+}
+bool LocalClient::receiveReturnValue(int fd, int *returnValue) {
+	unsigned int received = 0;
+	while (received < sizeof(*returnValue)) {
+		ssize_t count = recv(fd, (char*)returnValue + received,
+			sizeof(*returnValue) - received, 0);
+		if (count == -1 && errno == EINTR) {
+			continue;
+		}
+		if (count <= 0) {
+			return false;
+		}
+		received += count;
+	}
+	return true;
+}
@@ -0,0 +1,62 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LOCALCLIENT_H_INCLUDED
+#define LOCALCLIENT_H_INCLUDED
+
+#include <string>
+#include <vector>
+
+/**
+ * Sends jobs to the local socket of ddcn_service.
+ *
+ * This class does not use Qt at all, so that no Qt initialization is
+ * necessary if the service is reachable via the socket. The whole job is
+ * sent as a single request together with stdin, stdout and stderr, the
+ * service selects the toolchain and writes the output of the compiler directly
+ * to our terminal.
+ *
+ * The request format has to match LocalJobServer in ddcn_service.
+ */
+class LocalClient {
+public:
+	/**
+	 * Executes the job described by the command line.
+	 *
+	 * @param available Set to false if the service cannot be reached via the
+	 * socket and D-Bus has to be used instead.
+	 * @return Return value of the compiler.
+	 */
+	static int executeJob(int argc, char **argv, bool *available);
+private:
+	static std::string getSocketPath();
+	static void appendInt(std::string &request, unsigned int value);
+	static void appendString(std::string &request, const std::string &value);
+	static bool sendRequest(int fd, const std::string &request, bool *available);
+	static bool receiveReturnValue(int fd, int *returnValue);
+};
+
+#endif
@@ -10,7 +10,7 @@ modification, are permitted provided that the following conditions are met:
 
    2. Redistributions in binary form must reproduce the above copyright
       notice, this list of conditions and the following disclaimer in the
-      documentation and/or other materials provided with the distribution.
+	  documentation and/or other materials provided with the distribution.
 
 THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
 IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
@@ -24,21 +24,48 @@ NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
 EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
-#include <QCoreApplication>
+#include "LocalClient.h"
 
-#include "Application.h"
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+/**
+ * Name of the Qt-based client which sends the job via D-Bus.
+ */
+static const char *DBUS_CLIENT = "ddcn_gcc_dbus";
+
+/**
+ * Replaces this process with the D-Bus client, which is searched next to this
+ * executable first and then in PATH.
+ */
+static void execDBusClient(char **argv) {
+	char path[4096];
+	ssize_t length = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	if (length > 0) {
+		path[length] = 0;
+		char *separator = strrchr(path, '/');
+		if (separator) {
+			std::string client = std::string(path, separator + 1) + DBUS_CLIENT;
+			argv[0] = (char*)client.c_str();
+			execv(client.c_str(), argv);
+		}
+	}
+	argv[0] = (char*)DBUS_CLIENT;
+	execvp(DBUS_CLIENT, argv);
+}
 
 int main(int argc, char **argv) {
-	qDBusRegisterMetaType<JobResult>();
-	qDBusRegisterMetaType<ToolChainInfo>();
-	qDBusRegisterMetaType<QList<ToolChainInfo> >();
-	// All our parameters are supposed to be gcc parameters, so do not pass any
-	// to Qt
-	char *arg0 = argv[0];
-	int newArgc = 1;
-	QCoreApplication qtApp(newArgc, &arg0);
-
-	// Start the application
-	Application app;
-	return app.run(argc, argv);
+	// Try the local socket of the service first. This executable does not link
+	// against Qt so that the startup time is as low as possible
+	bool available = false;
+	int returnValue = LocalClient::executeJob(argc, argv, &available);
+	if (available) {
+		return returnValue;
+	}
+	// Fall back to D-Bus
+	execDBusClient(argv);
+	fprintf(stderr, "Error: Compiler service not available.\n");
+	return -1;
 }
@@ -0,0 +1,577 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "BulkChannel.h"
+#include "TemporaryFile.h"
+
+#include <QSocketNotifier>
+#include <QFile>
+#include <QtEndian>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <netdb.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef HAVE_LINUX_TLS_H
+#include <linux/tls.h>
+#endif
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+// Maximum number of bytes moved by a single sendfile()/splice() call, this
+// keeps the event loop responsive while large files are transferred
+static const size_t MAX_CHUNK_SIZE = 1024 * 1024;
+static const quint64 DEFAULT_MAX_FILE_SIZE = 1024 * 1024 * 1024;
+
+BulkChannel::BulkChannel(int fd) : fd(fd), state(State::WaitingForToken),
+		port(0), tokenBytes(0), readNotifier(NULL), writeNotifier(NULL),
+		pendingBytes(0), maxFileSize(DEFAULT_MAX_FILE_SIZE),
+		incomingHeaderBytes(0), incomingFd(-1), incomingRemaining(0) {
+	pipeFds[0] = pipeFds[1] = -1;
+	token.resize(TOKEN_SIZE);
+	startNotifiers();
+}
+BulkChannel::BulkChannel(const QStringList &addresses, quint16 port,
+		const QByteArray &token) : fd(-1), state(State::Connecting),
+		addresses(addresses), port(port), token(token), tokenBytes(0),
+		readNotifier(NULL), writeNotifier(NULL), pendingBytes(0),
+		maxFileSize(DEFAULT_MAX_FILE_SIZE), incomingHeaderBytes(0),
+		incomingFd(-1), incomingRemaining(0) {
+	pipeFds[0] = pipeFds[1] = -1;
+}
+BulkChannel::~BulkChannel() {
+	// Do not emit closed() from the destructor
+	blockSignals(true);
+	close();
+}
+
+void BulkChannel::connectToPeer() {
+	connectToNextAddress();
+}
+
+bool BulkChannel::enableKernelTLS(const QByteArray &txKey, const QByteArray &rxKey) {
+#if defined(HAVE_LINUX_TLS_H) && defined(TLS_TX) && defined(TLS_RX)
+	if (txKey.size() != KEY_MATERIAL_SIZE || rxKey.size() != KEY_MATERIAL_SIZE) {
+		qCritical("BulkChannel: Invalid key material size.");
+		return false;
+	}
+	if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+		qWarning("BulkChannel: Kernel TLS not available: %s", strerror(errno));
+		return false;
+	}
+	const QByteArray *keys[2] = { &txKey, &rxKey };
+	const int directions[2] = { TLS_TX, TLS_RX };
+	for (int i = 0; i < 2; i++) {
+		struct tls12_crypto_info_aes_gcm_128 cryptoInfo;
+		memset(&cryptoInfo, 0, sizeof(cryptoInfo));
+		cryptoInfo.info.version = TLS_1_2_VERSION;
+		cryptoInfo.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+		// Key material layout: key, salt, iv - the record sequence number
+		// starts at zero as the key is only ever used for this channel
+		const char *material = keys[i]->data();
+		memcpy(cryptoInfo.key, material, TLS_CIPHER_AES_GCM_128_KEY_SIZE);
+		material += TLS_CIPHER_AES_GCM_128_KEY_SIZE;
+		memcpy(cryptoInfo.salt, material, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+		material += TLS_CIPHER_AES_GCM_128_SALT_SIZE;
+		memcpy(cryptoInfo.iv, material, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+		if (setsockopt(fd, SOL_TLS, directions[i], &cryptoInfo, sizeof(cryptoInfo)) != 0) {
+			qWarning("BulkChannel: Could not enable kernel TLS: %s", strerror(errno));
+			return false;
+		}
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+bool BulkChannel::isKernelTLSSupported() {
+#if defined(HAVE_LINUX_TLS_H) && defined(TLS_TX) && defined(TLS_RX)
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool BulkChannel::sendFile(BulkFileKind::List kind, unsigned int transferId,
+		unsigned int index, const QString &fileName, bool removeWhenSent) {
+	if (state != State::Ready) {
+		return false;
+	}
+	OutgoingFile file;
+	file.fd = open(QFile::encodeName(fileName).data(), O_RDONLY | O_CLOEXEC);
+	if (file.fd == -1) {
+		qWarning("BulkChannel: Could not open \"%s\".", fileName.toAscii().data());
+		return false;
+	}
+	struct stat fileInfo;
+	if (fstat(file.fd, &fileInfo) != 0) {
+		::close(file.fd);
+		return false;
+	}
+	file.header.transferId = qToBigEndian((quint32)transferId);
+	file.header.index = qToBigEndian((quint16)index);
+	file.header.kind = kind;
+	file.header.reserved = 0;
+	file.header.size = qToBigEndian((quint64)fileInfo.st_size);
+	file.headerSent = 0;
+	file.offset = 0;
+	file.size = fileInfo.st_size;
+	file.fileName = fileName;
+	file.removeWhenSent = removeWhenSent;
+	sendQueue.append(file);
+	pendingBytes += fileInfo.st_size;
+	writeNotifier->setEnabled(true);
+	return true;
+}
+
+int BulkChannel::listen(quint16 port, quint16 *boundPort) {
+	// Try a dual-stack IPv6 socket first and fall back to IPv4
+	int fd = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd != -1) {
+		int value = 0;
+		setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &value, sizeof(value));
+		value = 1;
+		setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
+		struct sockaddr_in6 address;
+		memset(&address, 0, sizeof(address));
+		address.sin6_family = AF_INET6;
+		address.sin6_addr = in6addr_any;
+		address.sin6_port = htons(port);
+		if (bind(fd, (struct sockaddr*)&address, sizeof(address)) == 0
+				&& ::listen(fd, 16) == 0) {
+			socklen_t length = sizeof(address);
+			getsockname(fd, (struct sockaddr*)&address, &length);
+			*boundPort = ntohs(address.sin6_port);
+			return fd;
+		}
+		::close(fd);
+	}
+	fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+		return -1;
+	}
+	int value = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &value, sizeof(value));
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0
+			|| ::listen(fd, 16) != 0) {
+		qWarning("BulkChannel: Could not listen on port %d: %s", port, strerror(errno));
+		::close(fd);
+		return -1;
+	}
+	socklen_t length = sizeof(address);
+	getsockname(fd, (struct sockaddr*)&address, &length);
+	*boundPort = ntohs(address.sin_port);
+	return fd;
+}
+int BulkChannel::acceptConnection(int listenFd) {
+	return accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+}
+QStringList BulkChannel::getLocalAddresses() {
+	QStringList addresses;
+	QStringList loopbackAddresses;
+	struct ifaddrs *interfaces;
+	if (getifaddrs(&interfaces) != 0) {
+		return addresses;
+	}
+	for (struct ifaddrs *it = interfaces; it != NULL; it = it->ifa_next) {
+		if (it->ifa_addr == NULL) {
+			continue;
+		}
+		char buffer[INET6_ADDRSTRLEN];
+		if (it->ifa_addr->sa_family == AF_INET) {
+			struct sockaddr_in *address = (struct sockaddr_in*)it->ifa_addr;
+			inet_ntop(AF_INET, &address->sin_addr, buffer, sizeof(buffer));
+		} else if (it->ifa_addr->sa_family == AF_INET6) {
+			struct sockaddr_in6 *address = (struct sockaddr_in6*)it->ifa_addr;
+			// Link-local addresses would need the interface name of the other
+			// peer, skip them
+			if (IN6_IS_ADDR_LINKLOCAL(&address->sin6_addr)) {
+				continue;
+			}
+			inet_ntop(AF_INET6, &address->sin6_addr, buffer, sizeof(buffer));
+		} else {
+			continue;
+		}
+		if (it->ifa_flags & IFF_LOOPBACK) {
+			loopbackAddresses.append(buffer);
+		} else {
+			addresses.append(buffer);
+		}
+	}
+	freeifaddrs(interfaces);
+	return addresses + loopbackAddresses;
+}
+QStringList BulkChannel::filterOfferedAddresses(const QStringList &addresses) {
+	QStringList localAddresses = getLocalAddresses();
+	QStringList filtered;
+	QStringList loopbackAddresses;
+	bool sameHost = false;
+	foreach (const QString &address, addresses) {
+		QByteArray ascii = address.toAscii();
+		struct in_addr address4;
+		struct in6_addr address6;
+		bool loopback;
+		if (inet_pton(AF_INET, ascii.data(), &address4) == 1) {
+			in_addr_t host = ntohl(address4.s_addr);
+			if (host == INADDR_ANY || host == INADDR_BROADCAST
+					|| IN_MULTICAST(host)) {
+				continue;
+			}
+			loopback = (host >> 24) == IN_LOOPBACKNET;
+		} else if (inet_pton(AF_INET6, ascii.data(), &address6) == 1) {
+			if (IN6_IS_ADDR_UNSPECIFIED(&address6)
+					|| IN6_IS_ADDR_MULTICAST(&address6)
+					|| IN6_IS_ADDR_LINKLOCAL(&address6)) {
+				continue;
+			}
+			loopback = IN6_IS_ADDR_LOOPBACK(&address6);
+		} else {
+			continue;
+		}
+		if (loopback) {
+			loopbackAddresses.append(address);
+			continue;
+		}
+		if (localAddresses.contains(address)) {
+			sameHost = true;
+		}
+		filtered.append(address);
+	}
+	if (sameHost) {
+		filtered.append(loopbackAddresses);
+	}
+	return filtered.mid(0, MAX_OFFERED_ADDRESSES);
+}
+
+void BulkChannel::onReadable() {
+	if (state == State::WaitingForToken) {
+		receiveToken();
+		// The owner first has to set up encryption before any file data can
+		// be read, so return to the event loop here
+		return;
+	}
+	while (state == State::Ready && receiveFile()) {
+	}
+}
+void BulkChannel::onWritable() {
+	while (!sendQueue.empty()) {
+		OutgoingFile &file = sendQueue.first();
+		if (file.headerSent < sizeof(BulkFileHeader)) {
+			int flags = MSG_NOSIGNAL;
+			if (file.size > 0) {
+				flags |= MSG_MORE;
+			}
+			ssize_t sent = send(fd, (char*)&file.header + file.headerSent,
+				sizeof(BulkFileHeader) - file.headerSent, flags);
+			if (sent < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+					return;
+				}
+				qWarning("BulkChannel: send() failed: %s", strerror(errno));
+				close();
+				return;
+			}
+			file.headerSent += sent;
+			continue;
+		}
+		if (file.offset < file.size) {
+			size_t chunk = qMin((size_t)(file.size - file.offset), MAX_CHUNK_SIZE);
+			ssize_t sent = sendfile(fd, file.fd, &file.offset, chunk);
+			if (sent < 0) {
+				if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+					return;
+				}
+				qWarning("BulkChannel: sendfile() failed: %s", strerror(errno));
+				close();
+				return;
+			} else if (sent == 0) {
+				// The file was truncated while we were sending it, the other
+				// peer cannot recover from this
+				qWarning("BulkChannel: File \"%s\" was truncated.",
+					file.fileName.toAscii().data());
+				close();
+				return;
+			}
+			pendingBytes -= sent;
+			continue;
+		}
+		// The file has been sent completely
+		::close(file.fd);
+		if (file.removeWhenSent) {
+			QFile::remove(file.fileName);
+		}
+		sendQueue.removeFirst();
+	}
+	writeNotifier->setEnabled(false);
+}
+void BulkChannel::onConnectFinished() {
+	delete writeNotifier;
+	writeNotifier = NULL;
+	int error = 0;
+	socklen_t length = sizeof(error);
+	if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+		::close(fd);
+		fd = -1;
+		connectToNextAddress();
+		return;
+	}
+	// Send the token of the offer - this is the first data sent over the fresh
+	// connection, so it always fits into the socket buffer
+	if (send(fd, token.data(), token.size(), MSG_NOSIGNAL) != token.size()) {
+		::close(fd);
+		fd = -1;
+		connectToNextAddress();
+		return;
+	}
+	state = State::Ready;
+	startNotifiers();
+	emit connected(this);
+}
+
+void BulkChannel::connectToNextAddress() {
+	while (!addresses.empty()) {
+		QByteArray address = addresses.takeFirst().toAscii();
+		struct addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+		hints.ai_socktype = SOCK_STREAM;
+		struct addrinfo *result;
+		if (getaddrinfo(address.data(), QByteArray::number(port).data(), &hints, &result) != 0) {
+			continue;
+		}
+		fd = socket(result->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+		if (fd == -1) {
+			freeaddrinfo(result);
+			continue;
+		}
+		int status = ::connect(fd, result->ai_addr, result->ai_addrlen);
+		freeaddrinfo(result);
+		if (status == 0 || errno == EINPROGRESS) {
+			// Wait until the socket becomes writable, then check whether the
+			// connection attempt was successful
+			writeNotifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+			connect(writeNotifier, SIGNAL(activated(int)), this, SLOT(onConnectFinished()));
+			return;
+		}
+		::close(fd);
+		fd = -1;
+	}
+	qDebug("BulkChannel: Could not connect to the other peer.");
+	state = State::Closed;
+	emit closed(this);
+}
+void BulkChannel::startNotifiers() {
+	readNotifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+	connect(readNotifier, SIGNAL(activated(int)), this, SLOT(onReadable()));
+	writeNotifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+	connect(writeNotifier, SIGNAL(activated(int)), this, SLOT(onWritable()));
+	writeNotifier->setEnabled(false);
+}
+void BulkChannel::close() {
+	if (state == State::Closed) {
+		return;
+	}
+	state = State::Closed;
+	delete readNotifier;
+	readNotifier = NULL;
+	delete writeNotifier;
+	writeNotifier = NULL;
+	if (fd != -1) {
+		::close(fd);
+		fd = -1;
+	}
+	// Drop all files which have not been sent yet
+	foreach (const OutgoingFile &file, sendQueue) {
+		::close(file.fd);
+		if (file.removeWhenSent) {
+			QFile::remove(file.fileName);
+		}
+	}
+	sendQueue.clear();
+	pendingBytes = 0;
+	// Remove partially received files
+	if (incomingFd != -1) {
+		::close(incomingFd);
+		incomingFd = -1;
+		QFile::remove(incomingFileName);
+	}
+	if (pipeFds[0] != -1) {
+		::close(pipeFds[0]);
+		::close(pipeFds[1]);
+		pipeFds[0] = pipeFds[1] = -1;
+	}
+	emit closed(this);
+}
+
+bool BulkChannel::receiveToken() {
+	ssize_t received = recv(fd, token.data() + tokenBytes, TOKEN_SIZE - tokenBytes, 0);
+	if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK
+			&& errno != EINTR)) {
+		close();
+		return false;
+	} else if (received < 0) {
+		return false;
+	}
+	tokenBytes += received;
+	if (tokenBytes == TOKEN_SIZE) {
+		state = State::Ready;
+		emit tokenReceived(this, token);
+	}
+	return true;
+}
+bool BulkChannel::receiveFile() {
+	if (incomingHeaderBytes < sizeof(BulkFileHeader)) {
+		ssize_t received = recv(fd, (char*)&incomingHeader + incomingHeaderBytes,
+			sizeof(BulkFileHeader) - incomingHeaderBytes, 0);
+		if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK
+				&& errno != EINTR)) {
+			close();
+			return false;
+		} else if (received < 0) {
+			return false;
+		}
+		incomingHeaderBytes += received;
+		if (incomingHeaderBytes < sizeof(BulkFileHeader)) {
+			return true;
+		}
+		incomingRemaining = qFromBigEndian(incomingHeader.size);
+		// Discarding the data would block the channel for too long
+		if (incomingRemaining > maxFileSize) {
+			qWarning("BulkChannel: Received a file which is too large (%llu bytes).",
+				(unsigned long long)incomingRemaining);
+			close();
+			return false;
+		}
+		bool accept = false;
+		emit fileOffered(this, incomingHeader.kind,
+			qFromBigEndian(incomingHeader.transferId),
+			qFromBigEndian(incomingHeader.index), incomingRemaining, &accept);
+		if (!accept) {
+			// The other peer might not know yet that the job has been
+			// aborted, so only the file is dropped
+			qWarning("BulkChannel: Discarding an unexpected file.");
+			incomingFd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+			if (incomingFd == -1) {
+				close();
+				return false;
+			}
+			if (incomingRemaining == 0) {
+				finishReceivedFile();
+			}
+			return true;
+		}
+		// Create the file which receives the data
+		const char *extension;
+		if (incomingHeader.kind == BulkFileKind::JobOutput) {
+			extension = ".o";
+		} else if (incomingHeader.kind == BulkFileKind::ToolChainPackage) {
+			extension = ".tar.gz";
+		} else {
+			extension = ".c";
+		}
+		TemporaryFile file(extension, "ddcn_bulk_");
+		incomingFileName = file.getFilename();
+		delete file.getFile();
+		incomingFd = open(QFile::encodeName(incomingFileName).data(),
+			O_WRONLY | O_TRUNC | O_CLOEXEC);
+		if (incomingFd == -1) {
+			qWarning("BulkChannel: Could not open \"%s\".", incomingFileName.toAscii().data());
+			QFile::remove(incomingFileName);
+			close();
+			return false;
+		}
+		if (incomingRemaining == 0) {
+			finishReceivedFile();
+		}
+		return true;
+	}
+	if (pipeFds[0] == -1 && pipe2(pipeFds, O_CLOEXEC) != 0) {
+		qWarning("BulkChannel: Could not create pipe: %s", strerror(errno));
+		close();
+		return false;
+	}
+	// Move the data from the socket into the file via a pipe so that it stays
+	// within the kernel
+	size_t chunk = qMin(incomingRemaining, (quint64)MAX_CHUNK_SIZE);
+	ssize_t received = splice(fd, NULL, pipeFds[1], NULL, chunk,
+		SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (received == 0 || (received < 0 && errno != EAGAIN && errno != EWOULDBLOCK
+			&& errno != EINTR)) {
+		close();
+		return false;
+	} else if (received < 0) {
+		return false;
+	}
+	ssize_t remaining = received;
+	while (remaining > 0) {
+		ssize_t written = splice(pipeFds[0], NULL, incomingFd, NULL, remaining,
+			SPLICE_F_MOVE);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		} else if (written <= 0) {
+			qWarning("BulkChannel: Could not write received data: %s", strerror(errno));
+			close();
+			return false;
+		}
+		remaining -= written;
+	}
+	incomingRemaining -= received;
+	if (incomingRemaining == 0) {
+		finishReceivedFile();
+	}
+	return true;
+}
+void BulkChannel::finishReceivedFile() {
+	::close(incomingFd);
+	incomingFd = -1;
+	incomingHeaderBytes = 0;
+	QString fileName = incomingFileName;
+	incomingFileName = QString();
+	// Discarded files do not have a name
+	if (fileName.isEmpty()) {
+		return;
+	}
+	emit fileReceived(this, incomingHeader.kind, qFromBigEndian(incomingHeader.transferId),
+		qFromBigEndian(incomingHeader.index), fileName);
+}
@@ -0,0 +1,319 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BULKCHANNEL_H_INCLUDED
+#define BULKCHANNEL_H_INCLUDED
+
+#include <QObject>
+#include <QStringList>
+#include <stdint.h>
+#include <sys/types.h>
+
+class QSocketNotifier;
+
+/**
+ * Type of a file transferred over a BulkChannel.
+ */
+struct BulkFileKind {
+	enum List {
+		/**
+		 * Input file of a job, sent by the peer which delegated the job.
+		 */
+		JobInput,
+		/**
+		 * Output file of a job, sent by the peer which executed the job.
+		 */
+		JobOutput,
+		/**
+		 * Compiler package requested by a peer which does not have a
+		 * compatible toolchain (see ToolChainPackageStore).
+		 */
+		ToolChainPackage,
+		/**
+		 * Precompiled header requested by a peer which has received a job
+		 * using it (see PrecompiledHeaderStore).
+		 */
+		PrecompiledHeader,
+		/**
+		 * .dwo file of a job compiled with -gsplit-dwarf, requested by the
+		 * peer which delegated the job. The file is compressed with
+		 * qCompress().
+		 */
+		DebugInfo,
+		/**
+		 * Header requested by a peer which preprocesses a job itself (see
+		 * HeaderStore).
+		 */
+		Header
+	};
+};
+
+/**
+ * Header which is sent in front of every file on a bulk channel.
+ */
+struct BulkFileHeader {
+	// All fields in network byte order!
+	uint32_t transferId;
+	uint16_t index;
+	uint8_t kind;
+	uint8_t reserved;
+	quint64 size;
+} __attribute__((packed));
+
+/**
+ * Direct TCP connection to another peer which is used to transfer the input and
+ * output files of jobs.
+ *
+ * The control protocol stays on the ariba overlay, the channel itself is
+ * negotiated there (see PacketType::BulkChannelOffer). Files are sent with
+ * sendfile() and received with splice() so that their content never has to be
+ * copied into user space. The stream is always encrypted with kernel TLS using
+ * keys derived from the TLS session of the overlay connection to the same
+ * peer, as plain TCP would not protect the integrity of the files.
+ */
+class BulkChannel : public QObject {
+	Q_OBJECT
+public:
+	/**
+	 * Creates a channel for a socket returned by acceptConnection(). The
+	 * channel waits for the other peer to send the token of the offer and then
+	 * emits tokenReceived().
+	 *
+	 * @param fd Connected non-blocking socket.
+	 */
+	BulkChannel(int fd);
+	/**
+	 * Creates a channel which connects to a peer which has sent an offer.
+	 * connectToPeer() has to be called to actually create the connection.
+	 *
+	 * @param addresses Addresses of the other peer, tried one after another.
+	 * @param port TCP port the other peer is listening on.
+	 * @param token Token which identifies the offer at the other peer.
+	 */
+	BulkChannel(const QStringList &addresses, quint16 port,
+		const QByteArray &token);
+	/**
+	 * Destructor. Closes the connection.
+	 */
+	~BulkChannel();
+
+	/**
+	 * Starts connecting to the addresses passed to the constructor. Either
+	 * connected() or closed() is emitted when this is finished.
+	 */
+	void connectToPeer();
+
+	/**
+	 * Returns true if the connection is established and files can be sent.
+	 */
+	bool isReady() {
+		return state == State::Ready;
+	}
+	/**
+	 * Returns the token which was sent to or received from the other peer.
+	 */
+	QByteArray getToken() {
+		return token;
+	}
+
+	/**
+	 * Switches the connection to kernel TLS. This has to be called directly
+	 * after connected() or tokenReceived() has been emitted, before any file
+	 * is sent.
+	 *
+	 * @param txKey Key material for outgoing data (KEY_MATERIAL_SIZE bytes).
+	 * @param rxKey Key material for incoming data (KEY_MATERIAL_SIZE bytes).
+	 * @return False if the kernel does not support TLS offloading, in which
+	 * case the channel must not be used.
+	 */
+	bool enableKernelTLS(const QByteArray &txKey, const QByteArray &rxKey);
+	/**
+	 * Returns true if ddcn was compiled with kernel TLS support.
+	 */
+	static bool isKernelTLSSupported();
+
+	/**
+	 * Queues a file for sending. The file is opened immediately, so it can be
+	 * deleted by the caller before the transfer is finished.
+	 *
+	 * @param kind Type of the file.
+	 * @param transferId Id of the job the file belongs to.
+	 * @param index Index of the file within the job.
+	 * @param fileName Name of the file to be sent.
+	 * @param removeWhenSent If true, the file is deleted once it has been
+	 * sent or if the channel is closed before.
+	 * @return False if the file could not be opened.
+	 */
+	bool sendFile(BulkFileKind::List kind, unsigned int transferId,
+		unsigned int index, const QString &fileName, bool removeWhenSent);
+	/**
+	 * Returns the number of bytes which have been queued but not sent yet.
+	 */
+	quint64 getPendingBytes() {
+		return pendingBytes;
+	}
+	/**
+	 * Sets the maximum size of a received file. If the other peer sends a
+	 * larger file, the channel is closed. The default is 1 GiB.
+	 */
+	void setMaxFileSize(quint64 size) {
+		maxFileSize = size;
+	}
+
+	/**
+	 * Creates a non-blocking listening socket for incoming bulk channels.
+	 *
+	 * @param port Port to listen on, 0 selects a random port.
+	 * @param boundPort Receives the port which was actually used.
+	 * @return Socket or -1 if an error occurred.
+	 */
+	static int listen(quint16 port, quint16 *boundPort);
+	/**
+	 * Accepts a connection on a socket created with listen().
+	 *
+	 * @return Connected non-blocking socket or -1 if no connection was
+	 * pending.
+	 */
+	static int acceptConnection(int listenFd);
+	/**
+	 * Returns the addresses of all local network interfaces which are sent to
+	 * other peers in an offer. Loopback addresses are placed at the end.
+	 */
+	static QStringList getLocalAddresses();
+	/**
+	 * Removes all addresses from an offer which a channel must not connect
+	 * to: Anything but numeric unicast addresses, and loopback addresses
+	 * unless the offer also contains a non-loopback address of this host, i.e.
+	 * unless the other peer runs on the same machine. At most
+	 * MAX_OFFERED_ADDRESSES addresses are returned.
+	 */
+	static QStringList filterOfferedAddresses(const QStringList &addresses);
+
+	/**
+	 * Size of the token which identifies an offer.
+	 */
+	static const int TOKEN_SIZE = 16;
+	/**
+	 * Size of the key material needed for one direction of kernel TLS
+	 * (AES-128-GCM key, salt and initialization vector).
+	 */
+	static const int KEY_MATERIAL_SIZE = 28;
+	/**
+	 * Maximum number of addresses tried for a single offer.
+	 */
+	static const int MAX_OFFERED_ADDRESSES = 16;
+signals:
+	/**
+	 * Emitted when an outgoing connection has been established and the token
+	 * has been sent.
+	 */
+	void connected(BulkChannel *channel);
+	/**
+	 * Emitted when the token has been received on an accepted connection.
+	 */
+	void tokenReceived(BulkChannel *channel, const QByteArray &token);
+	/**
+	 * Emitted when the header of an incoming file has been received. The
+	 * receiver has to be connected with Qt::DirectConnection and has to set
+	 * accept to true if it expects the file, otherwise the data of the file
+	 * is discarded and fileReceived() is not emitted.
+	 *
+	 * @param size Size of the file in bytes.
+	 * @param accept Set to false before the signal is emitted.
+	 */
+	void fileOffered(BulkChannel *channel, int kind, unsigned int transferId,
+		unsigned int index, quint64 size, bool *accept);
+	/**
+	 * Emitted when a file has been received completely.
+	 *
+	 * @param kind Type of the file (BulkFileKind::List).
+	 * @param transferId Id of the job the file belongs to.
+	 * @param index Index of the file within the job.
+	 * @param fileName Temporary file which contains the data. The receiver
+	 * takes over ownership of the file.
+	 */
+	void fileReceived(BulkChannel *channel, int kind, unsigned int transferId,
+		unsigned int index, const QString &fileName);
+	/**
+	 * Emitted when the connection was closed or could not be established.
+	 */
+	void closed(BulkChannel *channel);
+private slots:
+	void onReadable();
+	void onWritable();
+	void onConnectFinished();
+private:
+	struct State {
+		enum List {
+			Connecting,
+			WaitingForToken,
+			Ready,
+			Closed
+		};
+	};
+
+	struct OutgoingFile {
+		BulkFileHeader header;
+		unsigned int headerSent;
+		int fd;
+		off_t offset;
+		off_t size;
+		QString fileName;
+		bool removeWhenSent;
+	};
+
+	void connectToNextAddress();
+	void startNotifiers();
+	void close();
+
+	bool receiveToken();
+	bool receiveFile();
+	void finishReceivedFile();
+
+	int fd;
+	State::List state;
+
+	QStringList addresses;
+	quint16 port;
+	QByteArray token;
+	int tokenBytes;
+
+	QSocketNotifier *readNotifier;
+	QSocketNotifier *writeNotifier;
+
+	QList<OutgoingFile> sendQueue;
+	quint64 pendingBytes;
+	quint64 maxFileSize;
+
+	BulkFileHeader incomingHeader;
+	unsigned int incomingHeaderBytes;
+	int incomingFd;
+	QString incomingFileName;
+	quint64 incomingRemaining;
+	int pipeFds[2];
+};
+
+#endif
@@ -0,0 +1,179 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef BULKJOB_H_INCLUDED
+#define BULKJOB_H_INCLUDED
+
+#include "ToolChain.h"
+#include "IncludeScanner.h"
+
+#include "TimerWheel.h"
+#include <QStringList>
+
+class NetworkNode;
+class OutgoingJob;
+
+/**
+ * Stores information about a file which has been received over a bulk channel
+ * but which has not been assigned to a job yet.
+ */
+struct ReceivedBulkFile {
+	NetworkNode *node;
+	int kind;
+	unsigned int id;
+	unsigned int index;
+	QString fileName;
+};
+
+/**
+ * Stores information about a job whose JobData packet has been received while
+ * the input files are still being transferred over the bulk channel or are
+ * still being written by the thread pool.
+ */
+struct IncomingBulkJob {
+	NetworkNode *source;
+	unsigned int id;
+	ToolChain toolChain;
+	QString language;
+	QStringList compilerParameters;
+	/**
+	 * Cached precompiled header the input files have to refer to, or "".
+	 */
+	QString precompiledHeader;
+	/**
+	 * Working directory and input file names on the other peer.
+	 */
+	QString sourceDirectory;
+	QStringList sourceFiles;
+	/**
+	 * Name of the .dwo file relative to the working directory of the other
+	 * peer if the job is compiled with -gsplit-dwarf, or "".
+	 */
+	QString debugInfoName;
+	/**
+	 * True if the job is preprocessed here, the headers of includeTree have
+	 * to be received before it can be started.
+	 */
+	bool preprocess;
+	IncludeTree includeTree;
+	unsigned int fileCount;
+	/**
+	 * True if the files were sent within the packet and are written by a
+	 * JobFileTask.
+	 */
+	bool writingFiles;
+	/**
+	 * True once the input files are complete, they are stored in inputFiles
+	 * then and the job only waits for headers.
+	 */
+	bool inputComplete;
+	QStringList inputFiles;
+	QStringList outputFiles;
+	Deadline timeout;
+};
+
+/**
+ * Stores the result of a delegated job whose output files are still being
+ * transferred over the bulk channel or are still being written by the thread
+ * pool.
+ */
+struct BulkJobResult {
+	OutgoingJob *outgoing;
+	int returnValue;
+	QByteArray stdout;
+	QByteArray stderr;
+	unsigned int fileCount;
+	/**
+	 * True if the files were sent within the packet and are written by a
+	 * JobFileTask.
+	 */
+	bool writingFiles;
+};
+
+/**
+ * Stores information about a toolchain package which has been requested from
+ * another peer (see ToolChainPackageStore).
+ */
+struct ToolChainPackageRequest {
+	NetworkNode *node;
+	unsigned int id;
+	QString hash;
+	Deadline timeout;
+};
+
+/**
+ * Stores information about a precompiled header which has been requested from
+ * another peer (see PrecompiledHeaderStore).
+ */
+struct PrecompiledHeaderRequest {
+	NetworkNode *node;
+	unsigned int id;
+	QString hash;
+	Deadline timeout;
+};
+
+/**
+ * Stores information about headers which have been requested from another
+ * peer for jobs which are preprocessed by this peer (see HeaderStore).
+ */
+struct HeaderRequest {
+	NetworkNode *node;
+	unsigned int id;
+	/**
+	 * Requested hashes, indexed like the files sent by the other peer. Hashes
+	 * are cleared once the file has been received.
+	 */
+	QStringList hashes;
+	unsigned int remaining;
+	Deadline timeout;
+};
+
+/**
+ * Stores the .dwo file of a job compiled with -gsplit-dwarf until the peer
+ * which delegated the job fetches it.
+ */
+struct DebugInfoFile {
+	NetworkNode *node;
+	unsigned int id;
+	QString fileName;
+	Deadline timeout;
+};
+
+/**
+ * Stores information about a .dwo file which is fetched from the peer which
+ * executed the job.
+ */
+struct DebugInfoRequest {
+	NetworkNode *node;
+	unsigned int id;
+	/**
+	 * Location of the .dwo file on this peer.
+	 */
+	QString fileName;
+	Deadline timeout;
+};
+
+#endif
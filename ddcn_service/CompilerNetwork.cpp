@@ -25,14 +25,28 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "CompilerNetwork.h"
+#include "BulkChannel.h"
+#include "TemporaryFile.h"
+
+#include <QtConcurrentRun>
+#include <QFutureWatcher>
+#include <QRegExp>
+#include <unistd.h>
+
+/**
+ * Time after which a peer is told to reconnect again if its link still uses
+ * the old key, in milliseconds.
+ */
+static const int RECONNECT_TIMEOUT = 60000;
 
 void FreeCompilerSlotList::append(const FreeCompilerSlots &freeSlots) {
+	removeAll(freeSlots.node);
 	if (freeSlotCount > 200) {
 		// Limit the slot count so that other peers cannot make this peer
 		// run low on memory
 		return;
 	}
-	if (freeSlots.slotCount == 0) {
+	if (freeSlots.slotCount == 0 || isUseless(freeSlots)) {
 		return;
 	}
 	slotList.append(freeSlots);
@@ -40,25 +54,38 @@ void FreeCompilerSlotList::append(const FreeCompilerSlots &freeSlots) {
 	// As soon as the remote slot count grows, set the new maximum
 	maxFreeSlotCount = freeSlotCount;
 }
-NetworkNode *FreeCompilerSlotList::removeFirst(QString toolChain) {
-	while (!slotList.empty()) {
-		unsigned int chosenIndex = qrand() % slotList.count();
-		FreeCompilerSlots &freeSlots = slotList[chosenIndex];
-		if (isCompatible(toolChain, freeSlots)) {
-			freeSlots.slotCount--;
-			freeSlotCount--;
-			// Take a copy as the reference is invalidated in removeLast()
-			NetworkNode *node = freeSlots.node;
-			if (freeSlots.slotCount == 0) {
-				slotList.removeAt(chosenIndex);
-			}
-			return node;
-		} else {
-			freeSlotCount -= freeSlots.slotCount;
-			slotList.removeAt(chosenIndex);
+NetworkNode *FreeCompilerSlotList::removeFirst(int toolChain, bool shippable) {
+	// Slots of congested peers stay in the list, they can be used once the
+	// peer has received the queued data
+	QList<int> candidates;
+	for (int i = 0; i < slotList.size(); i++) {
+		if (!slotList[i].node->isCongested()
+				&& isCompatible(toolChain, shippable, slotList[i])) {
+			candidates.append(i);
 		}
 	}
-	return NULL;
+	if (candidates.empty()) {
+		return NULL;
+	}
+	unsigned int chosenIndex = candidates[qrand() % candidates.size()];
+	FreeCompilerSlots &freeSlots = slotList[chosenIndex];
+	freeSlots.slotCount--;
+	freeSlotCount--;
+	// Take a copy as the reference is invalidated in removeAt()
+	NetworkNode *node = freeSlots.node;
+	if (freeSlots.slotCount == 0) {
+		slotList.removeAt(chosenIndex);
+	}
+	return node;
+}
+unsigned int FreeCompilerSlotList::getFreeSlotCount(int toolChain, bool shippable) {
+	unsigned int count = 0;
+	for (int i = 0; i < slotList.size(); i++) {
+		if (isCompatible(toolChain, shippable, slotList[i])) {
+			count += slotList[i].slotCount;
+		}
+	}
+	return count;
 }
 
 void FreeCompilerSlotList::removeAll(NetworkNode *node) {
@@ -71,35 +98,166 @@ void FreeCompilerSlotList::removeAll(NetworkNode *node) {
 	}
 }
 
-bool FreeCompilerSlotList::isCompatible(QString toolChain,
-                                        FreeCompilerSlots &freeSlots) {
-	if (freeSlots.toolChainVersions.contains(toolChain)) {
+void FreeCompilerSlotList::updateCapabilities(ToolChainIndex &index) {
+	for (int i = 0; i < slotList.size(); i++) {
+		slotList[i].capabilities = index.getCapabilities(slotList[i].toolChainIds);
+		// Slots which do not fit any local toolchain anymore would only
+		// clutter the list
+		if (isUseless(slotList[i])) {
+			freeSlotCount -= slotList[i].slotCount;
+			slotList.removeAt(i);
+			i--;
+		}
+	}
+}
+
+/**
+ * Moves a file, falling back to copying if the target is on a different file
+ * system.
+ */
+static bool moveFile(const QString &from, const QString &to) {
+	QFile::remove(to);
+	if (QFile::rename(from, to)) {
+		return true;
+	}
+	bool copied = QFile::copy(from, to);
+	QFile::remove(from);
+	return copied;
+}
+
+/**
+ * Creates a hard link to a file, falling back to copying if the target is on
+ * a different file system.
+ */
+static bool linkFile(const QString &from, const QString &to) {
+	if (link(QFile::encodeName(from).data(), QFile::encodeName(to).data()) == 0) {
 		return true;
 	}
-	foreach (QString version, freeSlots.toolChainVersions) {
-		if (ToolChain::isCompatible(toolChain, version)) {
+	return QFile::copy(from, to);
+}
+
+/**
+ * Removes the input files of an incoming job which is dropped while it waits
+ * for headers.
+ */
+static void removeBulkJobFiles(const IncomingBulkJob *bulkJob) {
+	foreach (const QString &fileName, bulkJob->inputFiles + bulkJob->outputFiles) {
+		QFile::remove(fileName);
+	}
+}
+
+/**
+ * Returns true if a path received from another peer is absolute and stays
+ * within the directory it is placed in, i.e. no ".." segment is left after
+ * cleaning it.
+ */
+static bool isSafePath(const QString &path) {
+	return path.startsWith('/')
+			&& !QDir::cleanPath(path).split('/').contains("..");
+}
+
+/**
+ * Returns true if all paths of an include tree received from another peer are
+ * absolute paths which stay within the job directory.
+ */
+static bool isValidIncludeTree(const IncludeTree &includeTree) {
+	QStringList paths = includeTree.quoteDirectories + includeTree.directories
+			+ includeTree.systemDirectories + includeTree.forcedIncludes
+			+ includeTree.files;
+	foreach (const QString &path, paths) {
+		if (!isSafePath(path) || QDir::cleanPath(path) != path
+				|| path == "/") {
+			return false;
+		}
+	}
+	if (includeTree.files.size() != includeTree.hashes.size()) {
+		return false;
+	}
+	foreach (const QString &hash, includeTree.hashes) {
+		if (!HeaderStore::isValidHash(hash)) {
+			return false;
+		}
+	}
+	// Forced includes are shipped like all other headers
+	foreach (const QString &forcedInclude, includeTree.forcedIncludes) {
+		if (!includeTree.files.contains(forcedInclude)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Returns true if the parameters contain the option or a variant of it with an
+ * argument ("-frandom-seed", "-frandom-seed=foo").
+ */
+static bool hasOption(const QStringList &parameters, const QString &option) {
+	foreach (const QString &parameter, parameters) {
+		if (parameter == option || parameter.startsWith(option + "=")) {
 			return true;
 		}
 	}
 	return false;
 }
 
+/**
+ * Returns the name of the .dwo file gcc would create for the job with
+ * -gsplit-dwarf, relative to the working directory. Returns "" if the job does
+ * not create debug information, already uses -gsplit-dwarf or if the output
+ * file is outside of the working directory.
+ */
+static QString getDebugInfoName(Job *job) {
+	QRegExp debugOption("-g(gdb)?([1-3]|dwarf(-[2-5])?)?");
+	QRegExp noDebugOption("-g(gdb)?0");
+	bool debugInfo = false;
+	foreach (const QString &parameter, job->getCompilerParameters()) {
+		if (debugOption.exactMatch(parameter)) {
+			debugInfo = true;
+		} else if (noDebugOption.exactMatch(parameter)) {
+			debugInfo = false;
+		} else if (parameter == "-gsplit-dwarf" || parameter == "-gno-split-dwarf") {
+			return "";
+		}
+	}
+	QStringList outputFiles = job->getOutputFiles();
+	if (!debugInfo || outputFiles.size() != 1) {
+		return "";
+	}
+	QString output = outputFiles[0];
+	if (output.startsWith('/') || output.contains("..")) {
+		return "";
+	}
+	// gcc replaces the extension of the object file
+	int extension = output.lastIndexOf('.');
+	if (extension > output.lastIndexOf('/') + 1) {
+		output = output.left(extension);
+	}
+	return output + ".dwo";
+}
+
 CompilerNetwork::CompilerNetwork() : encryptionEnabled(true),
 		compressionEnabled(true), freeLocalSlots(0), lastJobId(0),
 		settings(QSettings::IniFormat, QSettings::UserScope, "ddcn", "ddcn"),
-		maxThreads(0), currentThreads(0) {
+		restartPending(false), keyRotationPending(false), maxThreads(0),
+		currentThreads(0) {
 	// Load peer name and public key from configuration
 	if (!settings.value("name").isValid()) {
 		settings.setValue("name", "ddcn_node");
 	}
 	QString name = settings.value("name").toString();
 	setPeerName(name);
+	encryptionEnabled = settings.value("network/encryption", true).toBool();
+	toolChainPackages = new ToolChainPackageStore(this);
+	precompiledHeaders = new PrecompiledHeaderStore(this);
+	headers = new HeaderStore;
+	includeScanner = new IncludeScanner(headers);
+	splitDwarf = settings.value("service/split_dwarf", false).toBool();
 	// Load key from file in the settings directory
 	QString keyFile = QFileInfo(settings.fileName()).absolutePath() + "/privkey.pem";
 	localKey = PrivateKey::load(keyFile);
 	if (!localKey.isValid()) {
 		qWarning("Warning: Could not read local private key, generating new key.");
-		localKey = PrivateKey::generate(2048);
+		localKey = PrivateKey::generate(PrivateKey::getDefaultType());
 		if (!localKey.save(keyFile)) {
 			qWarning("Warning: Could not save local private key!");
 		}
@@ -122,6 +280,22 @@ CompilerNetwork::CompilerNetwork() : encryptionEnabled(true),
 	        SIGNAL(groupMessageReceived(McpoGroup*, NetworkNode*, Packet)),
 	        this,
 	        SLOT(onGroupMessageReceived(McpoGroup*, NetworkNode*, Packet)));
+	connect(network,
+	        SIGNAL(bulkFileReceived(NetworkNode*, int, unsigned int, unsigned int, QString)),
+	        this,
+	        SLOT(onBulkFileReceived(NetworkNode*, int, unsigned int, unsigned int, QString)));
+	connect(network,
+	        SIGNAL(bulkFileOffered(NetworkNode*, int, unsigned int, unsigned int, quint64, bool*)),
+	        this,
+	        SLOT(onBulkFileOffered(NetworkNode*, int, unsigned int, unsigned int, quint64, bool*)),
+	        Qt::DirectConnection);
+	connect(network,
+	        SIGNAL(peerCongestionChanged(NetworkNode*, bool)),
+	        this,
+	        SLOT(onPeerCongestionChanged(NetworkNode*, bool)));
+	network->setEncryptionRequired(encryptionEnabled);
+	connect(&reconfigurationTimer, SIGNAL(timeout()), this, SLOT(onReconfigurationTimeout()));
+	connect(&timeouts, SIGNAL(expired(int, void*)), this, SLOT(onTimeout(int, void*)));
 	loadSettings();
 }
 CompilerNetwork::~CompilerNetwork() {
@@ -140,7 +314,44 @@ CompilerNetwork::~CompilerNetwork() {
 	foreach (IncomingJobRequest *request, incomingJobRequests) {
 		delete request;
 	}
+	foreach (IncomingBulkJob *bulkJob, incomingBulkJobs) {
+		removeBulkJobFiles(bulkJob);
+		delete bulkJob;
+	}
+	foreach (BulkJobResult *result, bulkJobResults) {
+		delete result;
+	}
+	foreach (ToolChainPackageRequest *request, toolChainPackageRequests) {
+		delete request;
+	}
+	foreach (PrecompiledHeaderRequest *request, precompiledHeaderRequests) {
+		delete request;
+	}
+	foreach (DebugInfoFile *file, debugInfoFiles) {
+		QFile::remove(file->fileName);
+		delete file;
+	}
+	foreach (DebugInfoRequest *request, debugInfoRequests) {
+		delete request;
+	}
+	foreach (DebugInfoRequest *request, queuedDebugInfoRequests) {
+		delete request;
+	}
+	foreach (HeaderRequest *request, headerRequests) {
+		delete request;
+	}
+	foreach (WaitingJobQueue *queue, waitingQueues) {
+		foreach (OutgoingJobRequest *request, queue->acceptedRequests) {
+			delete request;
+		}
+		delete queue;
+	}
+	foreach (const ReceivedBulkFile &file, receivedBulkFiles) {
+		QFile::remove(file.fileName);
+	}
 	delete network;
+	delete includeScanner;
+	delete headers;
 }
 
 void CompilerNetwork::setPeerName(QString peerName) {
@@ -160,11 +371,24 @@ bool CompilerNetwork::getCompression() {
 	return compressionEnabled;
 }
 
+void CompilerNetwork::setEncryption(bool encryptionEnabled) {
+	this->encryptionEnabled = encryptionEnabled;
+	settings.setValue("network/encryption", encryptionEnabled);
+	network->setEncryptionRequired(encryptionEnabled);
+	emit encryptionChanged(encryptionEnabled);
+}
+bool CompilerNetwork::getEncryption() {
+	return encryptionEnabled;
+}
+
 void CompilerNetwork::setLocalKey(const PrivateKey &privateKey) {
 	localKey = privateKey;
-	// Change the key in NetworkInterface
+	// Change the key in NetworkInterface - existing connections are replaced
+	// one after another in onReconfigurationTimeout()
 	network->changeIdentity(peerName, privateKey);
-	network->restart();
+	keyRotationPending = true;
+	keyRotationStart.start();
+	startReconfiguration();
 	// Save key
 	QString keyFile = QFileInfo(settings.fileName()).absolutePath() + "/privkey.pem";
 	if (!privateKey.save(keyFile)) {
@@ -173,7 +397,8 @@ void CompilerNetwork::setLocalKey(const PrivateKey &privateKey) {
 	emit localKeyChanged(privateKey);
 }
 void CompilerNetwork::generateLocalKey(int keyLength) {
-	PrivateKey privateKey = PrivateKey::generate(keyLength);
+	PrivateKey privateKey = PrivateKey::generate(PrivateKey::getDefaultType(),
+			keyLength);
 	setLocalKey(privateKey);
 }
 PrivateKey CompilerNetwork::getLocalKey() {
@@ -182,7 +407,7 @@ PrivateKey CompilerNetwork::getLocalKey() {
 
 void CompilerNetwork::setBootstrapHints(const QString &bootstrapHints) {
 	bootstrapConfig.setBootstrapHints(bootstrapHints);
-	network->restart();
+	network->addBootstrapHints(bootstrapHints);
 	emit bootstrapHintsChanged(bootstrapHints);
 }
 QString CompilerNetwork::getBootstrapHints() {
@@ -191,7 +416,11 @@ QString CompilerNetwork::getBootstrapHints() {
 
 void CompilerNetwork::setEndpoints(const QString &endpoints) {
 	bootstrapConfig.setEndPoints(endpoints);
-	network->restart();
+	if (!restartPending) {
+		restartPending = true;
+		restartStart.start();
+	}
+	startReconfiguration();
 	emit endpointsChanged(endpoints);
 }
 QString CompilerNetwork::getEndpoints() {
@@ -206,6 +435,7 @@ void CompilerNetwork::addTrustedPeer(QString name, const PublicKey &publicKey) {
 	}
 	TrustedPeer *trustedPeer = new TrustedPeer(name, publicKey);
 	trustedPeers.append(trustedPeer);
+	trustedPeerIndex.insert(publicKey, trustedPeer);
 	NetworkNode *node = network->getNetworkNode(publicKey);
 	if (node) {
 		node->setTrustedPeer(trustedPeer);
@@ -215,18 +445,16 @@ void CompilerNetwork::addTrustedPeer(QString name, const PublicKey &publicKey) {
 	emit trustedPeersChanged(trustedPeers);
 }
 void CompilerNetwork::removeTrustedPeer(QString name, const PublicKey &publicKey) {
-	// TODO: Way too slow
-	foreach (TrustedPeer *trustedPeer, trustedPeers) {
-		if (trustedPeer->getPublicKey() == publicKey) {
-			if (trustedPeer->getNetworkNode() != NULL) {
-				freeRemoteSlots.removeAll(trustedPeer->getNetworkNode());
-				trustedPeer->getNetworkNode()->setTrustedPeer(NULL);
-			}
-			trustedPeers.removeOne(trustedPeer);
-			delete trustedPeer;
-			return;
-		}
+	TrustedPeer *trustedPeer = trustedPeerIndex.take(publicKey);
+	if (!trustedPeer) {
+		return;
 	}
+	if (trustedPeer->getNetworkNode() != NULL) {
+		freeRemoteSlots.removeAll(trustedPeer->getNetworkNode());
+		trustedPeer->getNetworkNode()->setTrustedPeer(NULL);
+	}
+	trustedPeers.removeOne(trustedPeer);
+	delete trustedPeer;
 	saveSettings();
 	emit trustedPeersChanged(trustedPeers);
 }
@@ -239,6 +467,7 @@ void CompilerNetwork::addTrustedGroup(QString name, const PublicKey &publicKey)
 	}
 	TrustedGroup *trustedGroup = new TrustedGroup(name, publicKey);
 	trustedGroups.append(trustedGroup);
+	trustedGroupIndex.insert(publicKey, trustedGroup);
 	// Join the group
 	ariba::ServiceID serviceId(publicKey.hash());
 	trustedGroup->setMcpoGroup(network->joinGroup(serviceId));
@@ -246,15 +475,13 @@ void CompilerNetwork::addTrustedGroup(QString name, const PublicKey &publicKey)
 	emit trustedGroupsChanged(trustedGroups);
 }
 void CompilerNetwork::removeTrustedGroup(QString name, const PublicKey &publicKey) {
-	// TODO: Way too slow
-	foreach (TrustedGroup *trustedGroup, trustedGroups) {
-		if (trustedGroup->getPublicKey() == publicKey) {
-			network->leaveGroup(trustedGroup->getMcpoGroup());
-			trustedGroups.removeOne(trustedGroup);
-			delete trustedGroup;
-			return;
-		}
+	TrustedGroup *trustedGroup = trustedGroupIndex.take(publicKey);
+	if (!trustedGroup) {
+		return;
 	}
+	network->leaveGroup(trustedGroup->getMcpoGroup());
+	trustedGroups.removeOne(trustedGroup);
+	delete trustedGroup;
 	saveSettings();
 	emit trustedGroupsChanged(trustedGroups);
 }
@@ -267,6 +494,7 @@ void CompilerNetwork::addGroupMembership(QString name, const PrivateKey &private
 	}
 	GroupMembership *groupMembership = new GroupMembership(name, privateKey);
 	groupMemberships.append(groupMembership);
+	groupMembershipIndex.insert(PublicKey(privateKey), groupMembership);
 	// Join the group
 	ariba::ServiceID serviceId(PublicKey(privateKey).hash());
 	groupMembership->setMcpoGroup(network->joinGroup(serviceId));
@@ -274,15 +502,13 @@ void CompilerNetwork::addGroupMembership(QString name, const PrivateKey &private
 	emit groupMembershipsChanged(groupMemberships);
 }
 void CompilerNetwork::removeGroupMembership(QString name, const PublicKey &publicKey) {
-	// TODO: Way too slow
-	foreach (GroupMembership *groupMembership, groupMemberships) {
-		if (groupMembership->getPrivateKey() == publicKey) {
-			network->leaveGroup(groupMembership->getMcpoGroup());
-			groupMemberships.removeOne(groupMembership);
-			delete groupMembership;
-			return;
-		}
+	GroupMembership *groupMembership = groupMembershipIndex.take(publicKey);
+	if (!groupMembership) {
+		return;
 	}
+	network->leaveGroup(groupMembership->getMcpoGroup());
+	groupMemberships.removeOne(groupMembership);
+	delete groupMembership;
 	saveSettings();
 	emit groupMembershipsChanged(groupMemberships);
 }
@@ -329,26 +555,44 @@ void CompilerNetwork::queryNetworkStatus() {
 void CompilerNetwork::onDelegatedJobFinished(Job *job) {
 	IncomingJob *incoming = job->getIncomingJob();
 	assert(incoming != NULL);
-	// Fetch output data
+	// Fetch output data - if there is a bulk channel, the files are sent over
+	// it after the packet instead
 	JobResult result = job->getJobResult();
-	QList<QByteArray> fileContent;
+	NetworkNode *node = incoming->getSourcePeer();
+	BulkChannel *bulkChannel = node->getBulkChannel();
+	QStringList outputFiles;
+	QStringList inputFiles;
 	if (result.returnValue == 0) {
-		QStringList outputFiles = job->getOutputFiles();
-		foreach (QString fileName, outputFiles) {
-			QFile file(fileName);
-			if (!file.open(QIODevice::ReadOnly)) {
-				qFatal("onDelegatedJobFinished(): Could not read previously created temporary file.");
+		outputFiles = job->getOutputFiles();
+	}
+	// Input files in a job directory are removed together with the directory
+	if (incoming->getJobDirectory().isEmpty()) {
+		inputFiles = job->getInputFiles();
+	} else {
+		// Paths in diagnostics and dependency files refer to the other peer
+		QByteArray root = (incoming->getJobDirectory() + "/").toLocal8Bit();
+		result.stderr.replace(root, "/");
+		QString dependencyFile = incoming->getDependencyFile();
+		if (!dependencyFile.isEmpty() && result.returnValue == 0) {
+			QFile file(dependencyFile);
+			if (file.open(QIODevice::ReadOnly)) {
+				QByteArray dependencies = file.readAll();
+				file.close();
+				dependencies.replace(root, "/");
+				if (file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+					file.write(dependencies);
+					file.close();
+				}
 			}
-			fileContent.append(file.readAll());
-			file.remove();
-		}
-		QStringList inputFiles = job->getInputFiles();
-		foreach (QString fileName, inputFiles) {
-			QFile file(fileName);
-			file.remove();
+		} else if (!dependencyFile.isEmpty()) {
+			QFile::remove(dependencyFile);
 		}
 	}
-	incomingJobs.removeOne(incoming);
+	incomingJobs.remove(JobKey(node, incoming->getId()));
+	// The .dwo file has to be available before the other peer receives the
+	// result and requests it
+	storeDebugInfo(incoming, result.returnValue == 0);
+	removeJobDirectory(incoming);
 	// Send job result
 	qDebug("Remote job finished (id: %d), %d", incoming->getId(), result.returnValue);
 	QByteArray packetData;
@@ -359,9 +603,34 @@ void CompilerNetwork::onDelegatedJobFinished(Job *job) {
 	stream << qToBigEndian(result.returnValue);
 	stream << result.stdout;
 	stream << result.stderr;
-	stream << fileContent;
+	if (!bulkChannel) {
+		stream << false;
+		// Reading the output files is done in the thread pool, the packet is
+		// sent in onJobFinishedCreated()
+		JobFileTask task(JobFileTask::Type::SendJobResult, node, incoming->getId());
+		task.inputFiles = inputFiles;
+		task.outputFiles = outputFiles;
+		pendingJobResults.insert(JobKey(node, incoming->getId()));
+		watchFileTask(QtConcurrent::run(JobFileTask::createJobFinished, task,
+			packetData));
+		delete incoming;
+		delete job;
+		return;
+	}
+	foreach (QString fileName, inputFiles) {
+		QFile::remove(fileName);
+	}
+	stream << true;
+	stream << (unsigned int)outputFiles.size();
 	Packet packet = Packet::fromData(PacketType::JobFinished, packetData);
-	network->send(incoming->getSourcePeer(), packet);
+	network->send(node, packet);
+	for (int i = 0; i < outputFiles.size(); i++) {
+		// The channel deletes the file once it has been sent
+		if (!bulkChannel->sendFile(BulkFileKind::JobOutput, incoming->getId(),
+				i, outputFiles[i], true)) {
+			qCritical("onDelegatedJobFinished(): Could not send output file.");
+		}
+	}
 	delete incoming;
 	delete job;
 }
@@ -374,54 +643,184 @@ void CompilerNetwork::onPeerConnected(NetworkNode *node) {
 	// The new peer might accept job requests
 	createJobRequests();
 }
+void CompilerNetwork::onPeerCongestionChanged(NetworkNode *node, bool congested) {
+	if (!congested) {
+		// We might have skipped free slots of this peer
+		createJobRequests();
+	}
+}
 void CompilerNetwork::onPeerDisconnected(NetworkNode *node) {
+	reconnectingNodes.remove(node);
 	if (node->getTrustedPeer()) {
 		node->getTrustedPeer()->setNetworkNode(NULL);
 	}
 	// Local jobs delegated to this node have been rejected
-	for (int i = delegatedJobs.size() - 1; i >= 0; i--) {
-		if (delegatedJobs[i]->getTargetPeer() == node) {
-			// Move job to waiting list
-			delegatedJobs[i]->getJob()->setOutgoingJob(NULL);
-			waitingPreprocessedJobs.append(delegatedJobs[i]->getJob());
-			delete delegatedJobs[i];
-			delegatedJobs.removeAt(i);
-			// We might have to create more job requests
-			createJobRequests();
+	QList<OutgoingJob*> rejectedJobs;
+	QHash<JobKey, OutgoingJob*>::iterator delegatedIt = delegatedJobs.begin();
+	while (delegatedIt != delegatedJobs.end()) {
+		if (delegatedIt.key().node == node) {
+			rejectedJobs.append(delegatedIt.value());
+			delegatedIt = delegatedJobs.erase(delegatedIt);
+		} else {
+			++delegatedIt;
 		}
 	}
+	foreach (OutgoingJob *outgoing, rejectedJobs) {
+		removeBulkJobResult(outgoing);
+		// Move job to waiting list
+		outgoing->getJob()->setOutgoingJob(NULL);
+		getWaitingQueue(outgoing->getJob()->getToolchain())->preprocessed.append(outgoing->getJob());
+		delete outgoing;
+	}
+	if (!rejectedJobs.empty()) {
+		// We might have to create more job requests
+		createJobRequests();
+	}
 	// Abort remote jobs from this node
-	for (int i = incomingJobs.size() - 1; i >= 0; i--) {
-		if (incomingJobs[i]->getSourcePeer() == node) {
+	QHash<JobKey, IncomingJob*>::iterator incomingIt = incomingJobs.begin();
+	while (incomingIt != incomingJobs.end()) {
+		if (incomingIt.key().node == node) {
+			IncomingJob *incoming = incomingIt.value();
+			incomingIt = incomingJobs.erase(incomingIt);
 			// Kill the job
-			emit incomingJobAborted(incomingJobs[i]->getJob());
+			emit incomingJobAborted(incoming->getJob());
 			// Delete the job
-			delete incomingJobs[i]->getJob();
-			delete incomingJobs[i];
-			incomingJobs.removeAt(i);
+			delete incoming->getJob();
+			storeDebugInfo(incoming, false);
+			removeJobDirectory(incoming);
+			if (!incoming->getDependencyFile().isEmpty()) {
+				QFile::remove(incoming->getDependencyFile());
+			}
+			delete incoming;
+		} else {
+			++incomingIt;
+		}
+	}
+	QHash<JobKey, IncomingJobRequest*>::iterator incomingRequestIt = incomingJobRequests.begin();
+	while (incomingRequestIt != incomingJobRequests.end()) {
+		if (incomingRequestIt.key().node == node) {
+			delete incomingRequestIt.value();
+			incomingRequestIt = incomingJobRequests.erase(incomingRequestIt);
+		} else {
+			++incomingRequestIt;
+		}
+	}
+	QHash<JobKey, IncomingBulkJob*>::iterator bulkJobIt = incomingBulkJobs.begin();
+	while (bulkJobIt != incomingBulkJobs.end()) {
+		if (bulkJobIt.key().node == node) {
+			removeBulkJobFiles(bulkJobIt.value());
+			delete bulkJobIt.value();
+			bulkJobIt = incomingBulkJobs.erase(bulkJobIt);
+		} else {
+			++bulkJobIt;
+		}
+	}
+	QHash<JobKey, ToolChainPackageRequest*>::iterator packageIt = toolChainPackageRequests.begin();
+	while (packageIt != toolChainPackageRequests.end()) {
+		if (packageIt.key().node == node) {
+			delete packageIt.value();
+			packageIt = toolChainPackageRequests.erase(packageIt);
+		} else {
+			++packageIt;
+		}
+	}
+	QHash<JobKey, PrecompiledHeaderRequest*>::iterator headerIt = precompiledHeaderRequests.begin();
+	while (headerIt != precompiledHeaderRequests.end()) {
+		if (headerIt.key().node == node) {
+			delete headerIt.value();
+			headerIt = precompiledHeaderRequests.erase(headerIt);
+		} else {
+			++headerIt;
+		}
+	}
+	QHash<JobKey, DebugInfoFile*>::iterator debugFileIt = debugInfoFiles.begin();
+	while (debugFileIt != debugInfoFiles.end()) {
+		if (debugFileIt.key().node == node) {
+			QFile::remove(debugFileIt.value()->fileName);
+			delete debugFileIt.value();
+			debugFileIt = debugInfoFiles.erase(debugFileIt);
+		} else {
+			++debugFileIt;
+		}
+	}
+	QSet<JobKey>::iterator compressingIt = compressingDebugInfo.begin();
+	while (compressingIt != compressingDebugInfo.end()) {
+		if (compressingIt->node == node) {
+			compressingIt = compressingDebugInfo.erase(compressingIt);
+		} else {
+			++compressingIt;
+		}
+	}
+	// The debug information of jobs executed by this node is lost
+	QHash<JobKey, DebugInfoRequest*>::iterator debugRequestIt = debugInfoRequests.begin();
+	while (debugRequestIt != debugInfoRequests.end()) {
+		if (debugRequestIt.key().node == node) {
+			qWarning("Could not fetch %s from a disconnected peer, the object "
+					"has no debug information.",
+					debugRequestIt.value()->fileName.toAscii().data());
+			delete debugRequestIt.value();
+			debugRequestIt = debugInfoRequests.erase(debugRequestIt);
+		} else {
+			++debugRequestIt;
+		}
+	}
+	for (int i = 0; i < queuedDebugInfoRequests.size(); i++) {
+		if (queuedDebugInfoRequests[i]->node == node) {
+			qWarning("Could not fetch %s from a disconnected peer, the object "
+					"has no debug information.",
+					queuedDebugInfoRequests[i]->fileName.toAscii().data());
+			delete queuedDebugInfoRequests.takeAt(i);
+			i--;
+		}
+	}
+	// Jobs of other peers might wait for headers requested from this node
+	bool headersLost = false;
+	foreach (HeaderRequest *request, headerRequests.values()) {
+		if (request->node == node) {
+			removeHeaderRequest(request);
+			headersLost = true;
 		}
 	}
-	for (int i = incomingJobRequests.size() - 1; i >= 0; i--) {
-		if (incomingJobRequests[i]->source == node) {
-			delete incomingJobRequests[i];
-			incomingJobRequests.removeAt(i);
+	if (headersLost) {
+		checkHeaderJobs();
+	}
+	removeReceivedBulkFiles(node);
+	QSet<JobKey>::iterator resultIt = pendingJobResults.begin();
+	while (resultIt != pendingJobResults.end()) {
+		if (resultIt->node == node) {
+			resultIt = pendingJobResults.erase(resultIt);
+		} else {
+			++resultIt;
 		}
 	}
 	// Abort job requests directed to this node
 	bool requestsRemoved = false;
-	for (int i = outgoingJobRequests.size() - 1; i >= 0; i--) {
-		if (outgoingJobRequests[i]->target == node) {
-			delete outgoingJobRequests[i];
-			outgoingJobRequests.removeAt(i);
+	QHash<JobKey, OutgoingJobRequest*>::iterator outgoingRequestIt = outgoingJobRequests.begin();
+	while (outgoingRequestIt != outgoingJobRequests.end()) {
+		if (outgoingRequestIt.key().node == node) {
+			delete outgoingRequestIt.value();
+			outgoingRequestIt = outgoingJobRequests.erase(outgoingRequestIt);
 			requestsRemoved = true;
+		} else {
+			++outgoingRequestIt;
+		}
+	}
+	foreach (WaitingJobQueue *queue, waitingQueues) {
+		for (int i = 0; i < queue->acceptedRequests.size(); i++) {
+			if (queue->acceptedRequests[i]->target == node) {
+				delete queue->acceptedRequests[i];
+				queue->acceptedRequests.removeAt(i);
+				i--;
+				requestsRemoved = true;
+			}
 		}
 	}
+	// Remove free remote slots on this peer
+	freeRemoteSlots.removeAll(node);
 	if (requestsRemoved) {
 		// Create new requests if necessary
 		createJobRequests();
 	}
-	// Remove free remote slots on this peer
-	freeRemoteSlots.removeAll(node);
 }
 void CompilerNetwork::onMessageReceived(NetworkNode *node, const Packet &packet) {
 	qDebug("Message received: %d, size %d", packet.getType(), packet.getPayloadSize());
@@ -467,6 +866,18 @@ void CompilerNetwork::onMessageReceived(NetworkNode *node, const Packet &packet)
 		case PacketType::NodeStatus:
 			onNodeStatusChanged(node, packet);
 			break;
+		case PacketType::ToolChainPackageRequest:
+			onToolChainPackageRequest(node, packet);
+			break;
+		case PacketType::PrecompiledHeaderRequest:
+			onPrecompiledHeaderRequest(node, packet);
+			break;
+		case PacketType::DebugInfoRequest:
+			onDebugInfoRequest(node, packet);
+			break;
+		case PacketType::HeaderRequest:
+			onHeaderRequest(node, packet);
+			break;
 		default:
 			qWarning("Warning: Unknown package type received: %d.", packet.getType());
 			break;
@@ -486,158 +897,644 @@ void CompilerNetwork::onGroupMessageReceived(McpoGroup *group, NetworkNode *node
 
 void CompilerNetwork::onPreprocessingFinished(Job *job) {
 	qDebug("onPreprocessingFinished");
-	int waitingJobIndex = -1;
-	for (int i = 0; i < waitingPreprocessingJobs.count(); i++) {
-		if (waitingPreprocessingJobs[i] == job) {
-			waitingJobIndex = i;
-			break;
-		}
-	}
-	if (waitingJobIndex == -1) {
+	WaitingJobQueue *queue = waitingQueues.value(job->getToolchain().getIdentity());
+	if (!queue || !queue->preprocessing.removeOne(job)) {
 		// Nothing to do here, the job was cancelled by CompilerService
 		qCritical("onPreprocessingFinished: Job already removed?");
 		return;
 	}
-	waitingPreprocessingJobs.removeAt(waitingJobIndex);
 	// If an error occurred, the job is finished
 	JobResult result = job->getPreprocessingResult();
 	if (result.returnValue != 0) {
 		job->setFinished(result.returnValue, result.stdout, result.stderr);
 		delete job;
 		qWarning("Preprocessing finished with error (%d, \"%s\").", result.returnValue, result.stderr.data());
+		dropAcceptedRequests(queue);
+		return;
+	}
+	// Other peers cannot compile the job if the precompiled header it refers to
+	// has vanished in the meantime, the original source can still be compiled
+	if (!job->getPrecompiledHeader().isEmpty()
+			&& precompiledHeaders->getHash(job->getPrecompiledHeader()).isEmpty()) {
+		job->setNotDelegatable();
+		dropAcceptedRequests(queue);
+		emit outgoingJobCancelled(job);
 		return;
 	}
-	// Insert job into waitingPreprocessedJobs if it is in waitingPreprocessingJobs
-	// or delegate the job if possible
-	if (acceptedJobRequests.size() > 0) {
-		OutgoingJobRequest *request = acceptedJobRequests.back();
+	// Delegate the job if a slot for its toolchain has already been accepted
+	// or let it wait for the next one
+	if (!queue->acceptedRequests.empty()) {
+		OutgoingJobRequest *request = queue->acceptedRequests.takeLast();
 		delegateJob(job, request);
-		acceptedJobRequests.removeLast();
 		delete request;
 	} else {
-		waitingPreprocessedJobs.append(job);
+		queue->preprocessed.append(job);
 	}
 }
-void CompilerNetwork::onOutgoingJobRequestTimeout() {
-	qWarning("OutgoingJobRequest had a timeout, check your network!");
-	// Get the request which triggered the timeout
-	int requestIndex = -1;
-	for (int i = 0; i < outgoingJobRequests.count(); i++) {
-		if (sender() == &outgoingJobRequests[i]->timeout) {
-			requestIndex = i;
+void CompilerNetwork::onTimeout(int type, void *owner) {
+	switch (type) {
+		case TimeoutType::OutgoingJobRequest:
+			onOutgoingJobRequestTimeout((OutgoingJobRequest*)owner);
+			break;
+		case TimeoutType::OutgoingJob:
+			onOutgoingJobTimeout((OutgoingJob*)owner);
+			break;
+		case TimeoutType::IncomingJobRequest:
+			onIncomingJobRequestTimeout((IncomingJobRequest*)owner);
+			break;
+		case TimeoutType::IncomingBulkJob:
+			onIncomingBulkJobTimeout((IncomingBulkJob*)owner);
+			break;
+		case TimeoutType::ToolChainPackageRequest:
+			onToolChainPackageRequestTimeout((ToolChainPackageRequest*)owner);
+			break;
+		case TimeoutType::PrecompiledHeaderRequest:
+			onPrecompiledHeaderRequestTimeout((PrecompiledHeaderRequest*)owner);
+			break;
+		case TimeoutType::DebugInfoFile:
+			onDebugInfoFileTimeout((DebugInfoFile*)owner);
+			break;
+		case TimeoutType::DebugInfoRequest:
+			onDebugInfoRequestTimeout((DebugInfoRequest*)owner);
+			break;
+		case TimeoutType::HeaderRequest:
+			onHeaderRequestTimeout((HeaderRequest*)owner);
 			break;
-		}
 	}
-	assert(requestIndex >= 0);
+}
+void CompilerNetwork::onOutgoingJobRequestTimeout(OutgoingJobRequest *request) {
+	qWarning("OutgoingJobRequest had a timeout, check your network!");
 	// Remove the request, as if it had been rejected
-	NetworkNode *node = outgoingJobRequests[requestIndex]->target;
-	delete outgoingJobRequests[requestIndex];
-	outgoingJobRequests.removeAt(requestIndex);
+	NetworkNode *node = request->target;
+	outgoingJobRequests.remove(JobKey(request->target, request->id));
+	delete request;
 	// Remove all free slots from this node as we probably keep running into timeouts
 	freeRemoteSlots.removeAll(node);
 	// Send new requests to other peers if necessary
 	createJobRequests();
 }
-void CompilerNetwork::onOutgoingJobTimeout() {
+void CompilerNetwork::onOutgoingJobTimeout(OutgoingJob *outgoing) {
 	qWarning("OutgoingJob had a timeout, are you working with a slow network connection?");
-	// Get the job which triggered the timeout
-	int jobIndex = -1;
-	for (int i = 0; i < delegatedJobs.count(); i++) {
-		if (sender() == &delegatedJobs[i]->getTimer()) {
-			jobIndex = i;
-			break;
-		}
-	}
-	assert(jobIndex >= 0);
 	// Mark the job as cancelled
-	OutgoingJob *outgoing = delegatedJobs[jobIndex];
+	delegatedJobs.remove(JobKey(outgoing->getTargetPeer(), outgoing->getId()));
+	removeBulkJobResult(outgoing);
+	removeReceivedBulkFiles(outgoing->getTargetPeer(), BulkFileKind::JobOutput,
+		outgoing->getId());
 	Job *job = outgoing->getJob();
 	emit outgoingJobCancelled(job);
 	// Delete the job
 	job->setOutgoingJob(NULL);
 	delete outgoing;
-	delegatedJobs.removeAt(jobIndex);
 }
-void CompilerNetwork::onIncomingJobRequestTimeout() {
+void CompilerNetwork::onIncomingJobRequestTimeout(IncomingJobRequest *request) {
 	qWarning("IncomingJobRequest had a timeout, are you working with a slow network connection?");
-	// Get the request which triggered the timeout
-	int requestIndex = -1;
-	for (int i = 0; i < incomingJobRequests.count(); i++) {
-		if (sender() == &incomingJobRequests[i]->timeout) {
-			requestIndex = i;
-			break;
-		}
-	}
-	assert(requestIndex >= 0);
 	// We did not execute the job
-	IncomingJobRequest *incoming = incomingJobRequests[requestIndex];
 	QByteArray packetData;
 	QDataStream stream(&packetData, QIODevice::WriteOnly);
-	stream << qToBigEndian(incoming->id);
+	stream << qToBigEndian(request->id);
 	// The job was not executed
 	stream << false;
 	Packet packet = Packet::fromData(PacketType::JobFinished, packetData);
-	network->send(incoming->source, packet);
+	network->send(request->source, packet);
+	removeReceivedBulkFiles(request->source, BulkFileKind::JobInput, request->id);
 	// Remove the request
-	delete incomingJobRequests[requestIndex];
-	incomingJobRequests.removeAt(requestIndex);
+	incomingJobRequests.remove(JobKey(request->source, request->id));
+	delete request;
+}
+void CompilerNetwork::onIncomingBulkJobTimeout(IncomingBulkJob *bulkJob) {
+	qWarning("Input files or headers of an incoming job did not arrive in time.");
+	// We did not execute the job
+	QByteArray packetData;
+	QDataStream stream(&packetData, QIODevice::WriteOnly);
+	stream << qToBigEndian(bulkJob->id);
+	// The job was not executed
+	stream << false;
+	Packet packet = Packet::fromData(PacketType::JobFinished, packetData);
+	network->send(bulkJob->source, packet);
+	removeReceivedBulkFiles(bulkJob->source, BulkFileKind::JobInput, bulkJob->id);
+	removeBulkJobFiles(bulkJob);
+	incomingBulkJobs.remove(JobKey(bulkJob->source, bulkJob->id));
+	delete bulkJob;
+}
+void CompilerNetwork::onToolChainPackageRequestTimeout(ToolChainPackageRequest *request) {
+	qWarning("Toolchain package %s did not arrive in time.",
+			request->hash.toAscii().data());
+	toolChainPackageRequests.remove(JobKey(request->node, request->id));
+	delete request;
+}
+void CompilerNetwork::onPrecompiledHeaderRequestTimeout(PrecompiledHeaderRequest *request) {
+	qWarning("Precompiled header %s did not arrive in time.",
+			request->hash.toAscii().data());
+	precompiledHeaderRequests.remove(JobKey(request->node, request->id));
+	delete request;
+}
+void CompilerNetwork::onDebugInfoFileTimeout(DebugInfoFile *file) {
+	qWarning("The .dwo file of job %u of another peer was not fetched in time.",
+			file->id);
+	debugInfoFiles.remove(JobKey(file->node, file->id));
+	QFile::remove(file->fileName);
+	delete file;
+}
+void CompilerNetwork::onDebugInfoRequestTimeout(DebugInfoRequest *request) {
+	qWarning("%s did not arrive in time, the object has no debug information.",
+			request->fileName.toAscii().data());
+	NetworkNode *node = request->node;
+	debugInfoRequests.remove(JobKey(request->node, request->id));
+	delete request;
+	requestDebugInfo(node);
+}
+void CompilerNetwork::onHeaderRequestTimeout(HeaderRequest *request) {
+	qWarning("%d headers did not arrive in time.", request->remaining);
+	// The jobs waiting for the headers time out as well
+	removeHeaderRequest(request);
 }
 
-TrustedPeer *CompilerNetwork::getTrustedPeer(const PublicKey &publicKey) {
-	// TODO: Way too slow
-	foreach (TrustedPeer *trustedPeer, trustedPeers) {
-		if (trustedPeer->getPublicKey() == publicKey) {
-			return trustedPeer;
-		}
+void CompilerNetwork::onToolChainPackageRequest(NetworkNode *node, const Packet &packet) {
+	QByteArray packetData((const char*)packet.getPayloadData(), packet.getPayloadSize());
+	QDataStream stream(packetData);
+	unsigned int id;
+	stream >> id;
+	id = qFromBigEndian(id);
+	QString hash;
+	stream >> hash;
+	QString fileName = toolChainPackages->getPackageFile(hash);
+	if (fileName.isEmpty()) {
+		qWarning("onToolChainPackageRequest(): Unknown package.");
+		return;
+	}
+	// Packages are far too large to be embedded into packets
+	BulkChannel *bulkChannel = node->getBulkChannel();
+	if (!bulkChannel || !bulkChannel->isReady()) {
+		qWarning("onToolChainPackageRequest(): No bulk channel available.");
+		return;
+	}
+	qDebug("Sending toolchain package %s.", hash.toAscii().data());
+	if (!bulkChannel->sendFile(BulkFileKind::ToolChainPackage, id, 0, fileName,
+			false)) {
+		qWarning("onToolChainPackageRequest(): Could not send the package.");
 	}
-	return NULL;
 }
-TrustedGroup *CompilerNetwork::getTrustedGroup(const PublicKey &publicKey) {
-	// TODO: Way too slow
-	foreach (TrustedGroup *trustedGroup, trustedGroups) {
-		if (trustedGroup->getPublicKey() == publicKey) {
-			return trustedGroup;
+
+void CompilerNetwork::requestToolChainPackage(NetworkNode *node, const QString &hash) {
+	// Every package is only requested once at a time
+	if (toolChainPackages->isExtracting(hash)) {
+		return;
+	}
+	foreach (ToolChainPackageRequest *request, toolChainPackageRequests) {
+		if (request->hash == hash) {
+			return;
 		}
 	}
-	return NULL;
+	ToolChainPackageRequest *request = new ToolChainPackageRequest;
+	request->node = node;
+	request->id = generateJobId();
+	request->hash = hash;
+	// Packages contain tens of megabytes, so allow for slow connections
+	timeouts.start(&request->timeout, 600000, TimeoutType::ToolChainPackageRequest,
+			request);
+	toolChainPackageRequests.insert(JobKey(node, request->id), request);
+	QByteArray packetData;
+	QDataStream stream(&packetData, QIODevice::WriteOnly);
+	stream << qToBigEndian(request->id);
+	stream << hash;
+	Packet packet = Packet::fromData(PacketType::ToolChainPackageRequest, packetData);
+	network->send(node, packet);
 }
-GroupMembership *CompilerNetwork::getGroupMembership(const PublicKey &publicKey) {
-	// TODO: Way too slow
-	foreach (GroupMembership *groupMembership, groupMemberships) {
-		if (groupMembership->getPrivateKey() == publicKey) {
-			return groupMembership;
-		}
+
+void CompilerNetwork::onPrecompiledHeaderRequest(NetworkNode *node, const Packet &packet) {
+	QByteArray packetData((const char*)packet.getPayloadData(), packet.getPayloadSize());
+	QDataStream stream(packetData);
+	unsigned int id;
+	stream >> id;
+	id = qFromBigEndian(id);
+	QString hash;
+	stream >> hash;
+	// Only headers which have been announced in a JobData packet are sent
+	QString fileName = precompiledHeaders->getLocalFile(hash);
+	if (fileName.isEmpty()) {
+		qWarning("onPrecompiledHeaderRequest(): Unknown precompiled header.");
+		return;
+	}
+	BulkChannel *bulkChannel = node->getBulkChannel();
+	if (!bulkChannel || !bulkChannel->isReady()) {
+		qWarning("onPrecompiledHeaderRequest(): No bulk channel available.");
+		return;
+	}
+	qDebug("Sending precompiled header %s.", hash.toAscii().data());
+	if (!bulkChannel->sendFile(BulkFileKind::PrecompiledHeader, id, 0, fileName,
+			false)) {
+		qWarning("onPrecompiledHeaderRequest(): Could not send the header.");
 	}
-	return NULL;
 }
 
-void CompilerNetwork::loadSettings() {
-	// Load trusted peers
-	{
-		int size = this->settings.beginReadArray("trustedPeers");
-		QStringList trustedPeerNames;
-		QList<PublicKey> trustedPeerKeys;
-		for (int i = 0; i < size; ++i) {
-			this->settings.setArrayIndex(i);
-			QString name = this->settings.value("name").toString();
-			PublicKey key = PublicKey::fromPEM(this->settings.value("key").toString());
-			if (!key.isValid()) {
-				qCritical("Invalid trusted peer key");
-				continue;
-			}
-			qDebug("Adding trusted peer: %s", key.fingerprint().toAscii().data());
-			// We have to store these values and cannot call addTrustedPeer()
-			// directly because it modifies the settings which we are currently
-			// reading
-			trustedPeerNames.append(name);
-			trustedPeerKeys.append(key);
-		}
-		this->settings.endArray();
-		for (int i = 0; i < trustedPeerNames.size(); ++i) {
-			addTrustedPeer(trustedPeerNames[i], trustedPeerKeys[i]);
+void CompilerNetwork::requestPrecompiledHeader(NetworkNode *node, const QString &hash) {
+	// Every header is only requested once at a time
+	if (precompiledHeaders->isVerifying(hash)) {
+		return;
+	}
+	foreach (PrecompiledHeaderRequest *request, precompiledHeaderRequests) {
+		if (request->hash == hash) {
+			return;
 		}
 	}
-	// Load trusted groups
+	PrecompiledHeaderRequest *request = new PrecompiledHeaderRequest;
+	request->node = node;
+	request->id = generateJobId();
+	request->hash = hash;
+	timeouts.start(&request->timeout, 120000, TimeoutType::PrecompiledHeaderRequest,
+			request);
+	precompiledHeaderRequests.insert(JobKey(node, request->id), request);
+	QByteArray packetData;
+	QDataStream stream(&packetData, QIODevice::WriteOnly);
+	stream << qToBigEndian(request->id);
+	stream << hash;
+	Packet packet = Packet::fromData(PacketType::PrecompiledHeaderRequest, packetData);
+	network->send(node, packet);
+}
+
+void CompilerNetwork::onDebugInfoRequest(NetworkNode *node, const Packet &packet) {
+	const unsigned int *idPtr = packet.getPayload<unsigned int>();
+	if (!idPtr) {
+		qWarning("onDebugInfoRequest(): Invalid packet received.");
+		return;
+	}
+	unsigned int id = qFromBigEndian(*idPtr);
+	DebugInfoFile *file = debugInfoFiles.take(JobKey(node, id));
+	if (!file) {
+		qWarning("onDebugInfoRequest(): Unknown job.");
+		return;
+	}
+	// The file is compressed in the thread pool before it is sent
+	TemporaryFile holder(".dwo.z", "ddcn_dwo_");
+	QString compressedFile = holder.getFilename();
+	delete holder.getFile();
+	JobFileTask task(JobFileTask::Type::CompressDebugInfo, node, id);
+	task.inputFiles.append(file->fileName);
+	task.outputFiles.append(compressedFile);
+	compressingDebugInfo.insert(JobKey(node, id));
+	watchFileTask(QtConcurrent::run(JobFileTask::compressDebugInfo, task));
+	delete file;
+}
+
+void CompilerNetwork::requestDebugInfo(NetworkNode *node) {
+	foreach (DebugInfoRequest *request, debugInfoRequests) {
+		if (request->node == node) {
+			return;
+		}
+	}
+	for (int i = 0; i < queuedDebugInfoRequests.size(); i++) {
+		DebugInfoRequest *request = queuedDebugInfoRequests[i];
+		if (request->node != node) {
+			continue;
+		}
+		queuedDebugInfoRequests.removeAt(i);
+		timeouts.start(&request->timeout, 120000, TimeoutType::DebugInfoRequest,
+				request);
+		debugInfoRequests.insert(JobKey(node, request->id), request);
+		Packet packet(PacketType::DebugInfoRequest, qToBigEndian(request->id));
+		network->send(node, packet);
+		return;
+	}
+}
+
+void CompilerNetwork::storeDebugInfo(IncomingJob *incoming, bool success) {
+	if (incoming->getDebugInfoFile().isEmpty()) {
+		return;
+	}
+	// The .dwo file is moved out of the job directory which is removed
+	// afterwards
+	if (success && moveFile(incoming->getDebugInfoFile(),
+			incoming->getTemporaryDebugInfoFile())) {
+		// The file is only kept for a while as the other peer might never
+		// request it
+		DebugInfoFile *file = new DebugInfoFile;
+		file->node = incoming->getSourcePeer();
+		file->id = incoming->getId();
+		file->fileName = incoming->getTemporaryDebugInfoFile();
+		timeouts.start(&file->timeout, 600000, TimeoutType::DebugInfoFile, file);
+		debugInfoFiles.insert(JobKey(file->node, file->id), file);
+	} else {
+		QFile::remove(incoming->getTemporaryDebugInfoFile());
+	}
+}
+
+void CompilerNetwork::onHeaderRequest(NetworkNode *node, const Packet &packet) {
+	QByteArray packetData((const char*)packet.getPayloadData(), packet.getPayloadSize());
+	QDataStream stream(packetData);
+	unsigned int id;
+	stream >> id;
+	id = qFromBigEndian(id);
+	QStringList hashes;
+	stream >> hashes;
+	BulkChannel *bulkChannel = node->getBulkChannel();
+	if (!bulkChannel || !bulkChannel->isReady()) {
+		qWarning("onHeaderRequest(): No bulk channel available.");
+		return;
+	}
+	qDebug("Sending %d headers.", hashes.size());
+	for (int i = 0; i < hashes.size(); i++) {
+		// Only headers which have been announced in a JobData packet are sent
+		QString fileName = headers->getLocalFile(hashes[i]);
+		if (fileName.isEmpty()) {
+			qWarning("onHeaderRequest(): Unknown header.");
+			continue;
+		}
+		if (!bulkChannel->sendFile(BulkFileKind::Header, id, i, fileName,
+				false)) {
+			qWarning("onHeaderRequest(): Could not send %s.",
+					fileName.toAscii().data());
+		}
+	}
+}
+
+void CompilerNetwork::requestHeaders(NetworkNode *node) {
+	foreach (HeaderRequest *request, headerRequests) {
+		if (request->node == node) {
+			return;
+		}
+	}
+	// Every file of a request is opened right away by the other peer, so the
+	// number of headers per request is limited
+	QStringList hashes;
+	foreach (IncomingBulkJob *bulkJob, incomingBulkJobs) {
+		if (bulkJob->source != node || !bulkJob->preprocess) {
+			continue;
+		}
+		foreach (const QString &hash, bulkJob->includeTree.hashes) {
+			if (hashes.size() == 256) {
+				break;
+			}
+			if (!headers->hasReceivedHeader(hash)
+					&& !requestedHeaders.contains(hash) && !hashes.contains(hash)) {
+				hashes.append(hash);
+			}
+		}
+	}
+	if (hashes.empty()) {
+		return;
+	}
+	HeaderRequest *request = new HeaderRequest;
+	request->node = node;
+	request->id = generateJobId();
+	request->hashes = hashes;
+	request->remaining = hashes.size();
+	timeouts.start(&request->timeout, 120000, TimeoutType::HeaderRequest, request);
+	headerRequests.insert(JobKey(node, request->id), request);
+	foreach (const QString &hash, hashes) {
+		requestedHeaders.insert(hash);
+	}
+	QByteArray packetData;
+	QDataStream stream(&packetData, QIODevice::WriteOnly);
+	stream << qToBigEndian(request->id);
+	stream << hashes;
+	Packet packet = Packet::fromData(PacketType::HeaderRequest, packetData);
+	network->send(node, packet);
+}
+
+bool CompilerNetwork::hasHeaders(const IncludeTree &includeTree) {
+	foreach (const QString &hash, includeTree.hashes) {
+		if (!headers->hasReceivedHeader(hash)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void CompilerNetwork::removeHeaderRequest(HeaderRequest *request) {
+	headerRequests.remove(JobKey(request->node, request->id));
+	foreach (const QString &hash, request->hashes) {
+		requestedHeaders.remove(hash);
+	}
+	delete request;
+}
+
+void CompilerNetwork::checkHeaderJobs() {
+	// Jobs might wait for headers which were requested for other jobs, and
+	// the headers of the next jobs can be requested now
+	QList<JobKey> waitingJobs;
+	QSet<NetworkNode*> nodes;
+	QHash<JobKey, IncomingBulkJob*>::const_iterator it;
+	for (it = incomingBulkJobs.constBegin(); it != incomingBulkJobs.constEnd(); ++it) {
+		if (it.value()->preprocess) {
+			waitingJobs.append(it.key());
+			nodes.insert(it.key().node);
+		}
+	}
+	foreach (const JobKey &key, waitingJobs) {
+		IncomingBulkJob *bulkJob = incomingBulkJobs.value(key, NULL);
+		if (!bulkJob) {
+			continue;
+		}
+		checkIncomingBulkJob(bulkJob);
+		// Jobs still waiting get more time as long as headers arrive
+		bulkJob = incomingBulkJobs.value(key, NULL);
+		if (bulkJob) {
+			timeouts.start(&bulkJob->timeout, 60000, TimeoutType::IncomingBulkJob,
+					bulkJob);
+		}
+	}
+	foreach (NetworkNode *node, nodes) {
+		requestHeaders(node);
+	}
+}
+
+void CompilerNetwork::onReconfigurationTimeout() {
+	if (restartPending) {
+		// Running jobs are lost, but new jobs keep the network busy forever
+		// on a heavily used peer
+		int gracePeriod = settings.value("network/endpoint_grace_period", 600).toInt();
+		if (!isIdle() && restartStart.elapsed() < gracePeriod * 1000) {
+			return;
+		}
+		qDebug("Restarting the network to apply the new endpoints.");
+		network->restart();
+		// All connections were recreated with the new key anyways
+		restartPending = false;
+		keyRotationPending = false;
+		reconnectingNodes.clear();
+	}
+	if (keyRotationPending) {
+		int gracePeriod = settings.value("network/key_rotation_grace_period", 600).toInt();
+		bool graceExpired = keyRotationStart.elapsed() > gracePeriod * 1000;
+		bool outdatedNodes = false;
+		foreach (NetworkNode *node, network->getOnlineNodes()) {
+			if (!network->hasOutdatedIdentity(node)) {
+				continue;
+			}
+			outdatedNodes = true;
+			// The link is dropped once, but it is dropped again if this did
+			// not have any effect after a while
+			QHash<NetworkNode*, QTime>::iterator it = reconnectingNodes.find(node);
+			if (it != reconnectingNodes.end()
+					&& it.value().elapsed() < RECONNECT_TIMEOUT) {
+				continue;
+			}
+			if (graceExpired || !isNodeBusy(node)) {
+				qDebug("Reconnecting to a peer to use the new key.");
+				network->reconnect(node);
+				QTime reconnectStart;
+				reconnectStart.start();
+				reconnectingNodes.insert(node, reconnectStart);
+			}
+		}
+		// We have to wait until the links have been recreated
+		if (!outdatedNodes) {
+			keyRotationPending = false;
+			reconnectingNodes.clear();
+		}
+	}
+	if (!restartPending && !keyRotationPending) {
+		reconfigurationTimer.stop();
+	}
+}
+
+void CompilerNetwork::onBulkFileReceived(NetworkNode *node, int kind,
+		unsigned int transferId, unsigned int index, const QString &fileName) {
+	ReceivedBulkFile file;
+	file.node = node;
+	file.kind = kind;
+	file.id = transferId;
+	file.index = index;
+	file.fileName = fileName;
+	// The job might have been finished or aborted during the transfer
+	JobKey key(node, transferId);
+	if (kind == BulkFileKind::JobInput) {
+		IncomingBulkJob *bulkJob = incomingBulkJobs.value(key, NULL);
+		if (bulkJob) {
+			receivedBulkFiles.insert(key, file);
+			checkIncomingBulkJob(bulkJob);
+			return;
+		}
+		// The file might arrive before the JobData packet
+		if (incomingJobRequests.contains(key)) {
+			receivedBulkFiles.insert(key, file);
+			return;
+		}
+	} else if (kind == BulkFileKind::ToolChainPackage) {
+		ToolChainPackageRequest *request = toolChainPackageRequests.take(key);
+		if (request) {
+			// The peer might not be trusted anymore
+			if (node->getTrustedPeer()) {
+				toolChainPackages->addReceivedPackage(request->hash, fileName);
+			} else {
+				QFile::remove(fileName);
+			}
+			delete request;
+			return;
+		}
+	} else if (kind == BulkFileKind::PrecompiledHeader) {
+		PrecompiledHeaderRequest *request = precompiledHeaderRequests.take(key);
+		if (request) {
+			precompiledHeaders->addReceivedHeader(request->hash, fileName);
+			delete request;
+			return;
+		}
+	} else if (kind == BulkFileKind::DebugInfo) {
+		DebugInfoRequest *request = debugInfoRequests.take(key);
+		if (request) {
+			// The file is decompressed in the thread pool
+			JobFileTask task(JobFileTask::Type::WriteDebugInfo, node, transferId);
+			task.inputFiles.append(fileName);
+			task.outputFiles.append(request->fileName);
+			watchFileTask(QtConcurrent::run(JobFileTask::writeDebugInfo, task));
+			delete request;
+			requestDebugInfo(node);
+			return;
+		}
+	} else if (kind == BulkFileKind::Header) {
+		HeaderRequest *request = headerRequests.value(key, NULL);
+		if (request && index < (unsigned int)request->hashes.size()
+				&& !request->hashes[index].isEmpty()) {
+			QString hash = request->hashes[index];
+			if (!headers->addReceivedHeader(hash, fileName)) {
+				qWarning("Received a corrupted header.");
+			}
+			requestedHeaders.remove(hash);
+			request->hashes[index].clear();
+			request->remaining--;
+			if (request->remaining == 0) {
+				removeHeaderRequest(request);
+				checkHeaderJobs();
+			}
+			return;
+		}
+	} else if (kind == BulkFileKind::JobOutput) {
+		BulkJobResult *result = bulkJobResults.value(key, NULL);
+		if (result) {
+			receivedBulkFiles.insert(key, file);
+			checkBulkJobResult(result);
+			return;
+		}
+		// The file might arrive before the JobFinished packet
+		if (delegatedJobs.contains(key)) {
+			receivedBulkFiles.insert(key, file);
+			return;
+		}
+	}
+	qWarning("onBulkFileReceived(): Invalid job id.");
+	QFile::remove(fileName);
+}
+
+void CompilerNetwork::onBulkFileOffered(NetworkNode *node, int kind,
+		unsigned int transferId, unsigned int index, quint64 size, bool *accept) {
+	// Only files which belong to a job or request we know about are written to
+	// disk, otherwise other peers could fill up our disk
+	JobKey key(node, transferId);
+	if (kind == BulkFileKind::JobInput) {
+		*accept = incomingBulkJobs.contains(key)
+				|| incomingJobRequests.contains(key);
+	} else if (kind == BulkFileKind::JobOutput) {
+		*accept = bulkJobResults.contains(key) || delegatedJobs.contains(key);
+	} else if (kind == BulkFileKind::ToolChainPackage) {
+		*accept = toolChainPackageRequests.contains(key);
+	} else if (kind == BulkFileKind::PrecompiledHeader) {
+		*accept = precompiledHeaderRequests.contains(key);
+	} else if (kind == BulkFileKind::DebugInfo) {
+		*accept = debugInfoRequests.contains(key);
+	} else if (kind == BulkFileKind::Header) {
+		HeaderRequest *request = headerRequests.value(key, NULL);
+		*accept = request && index < (unsigned int)request->hashes.size()
+				&& !request->hashes[index].isEmpty();
+	}
+}
+
+TrustedPeer *CompilerNetwork::getTrustedPeer(const PublicKey &publicKey) {
+	return trustedPeerIndex.value(publicKey, NULL);
+}
+TrustedGroup *CompilerNetwork::getTrustedGroup(const PublicKey &publicKey) {
+	return trustedGroupIndex.value(publicKey, NULL);
+}
+GroupMembership *CompilerNetwork::getGroupMembership(const PublicKey &publicKey) {
+	return groupMembershipIndex.value(publicKey, NULL);
+}
+
+void CompilerNetwork::loadSettings() {
+	// Load trusted peers
+	{
+		int size = this->settings.beginReadArray("trustedPeers");
+		QStringList trustedPeerNames;
+		QList<PublicKey> trustedPeerKeys;
+		for (int i = 0; i < size; ++i) {
+			this->settings.setArrayIndex(i);
+			QString name = this->settings.value("name").toString();
+			PublicKey key = PublicKey::fromPEM(this->settings.value("key").toString());
+			if (!key.isValid()) {
+				qCritical("Invalid trusted peer key");
+				continue;
+			}
+			qDebug("Adding trusted peer: %s", key.fingerprint().toAscii().data());
+			// We have to store these values and cannot call addTrustedPeer()
+			// directly because it modifies the settings which we are currently
+			// reading
+			trustedPeerNames.append(name);
+			trustedPeerKeys.append(key);
+		}
+		this->settings.endArray();
+		for (int i = 0; i < trustedPeerNames.size(); ++i) {
+			addTrustedPeer(trustedPeerNames[i], trustedPeerKeys[i]);
+		}
+	}
+	// Load trusted groups
 	{
 		int size = this->settings.beginReadArray("trustedGroups");
 		QStringList trustedGroupNames;
@@ -766,6 +1663,12 @@ void CompilerNetwork::reportNodeStatus(NetworkNode *node) {
 	Packet packet = Packet::fromData(PacketType::NodeStatus, packetData);
 	network->send(node, packet);
 }
+void CompilerNetwork::setToolChains(QList<ToolChain> toolChains) {
+	this->toolChains = toolChains;
+	toolChainIndex.setLocalToolChains(toolChains);
+	freeRemoteSlots.updateCapabilities(toolChainIndex);
+	toolChainPackages->setToolChains(toolChains);
+}
 void CompilerNetwork::reportNetworkResources(NetworkNode *node) {
 	if (freeLocalSlots <= 0) {
 		return;
@@ -776,7 +1679,10 @@ void CompilerNetwork::reportNetworkResources(NetworkNode *node) {
 	// Send toolchain info so that other peers only ask peers who have the correct toolchains
 	QStringList toolChainVersions;
 	foreach (ToolChain toolChain, toolChains) {
-		toolChainVersions.append(toolChain.getVersion());
+		toolChainVersions.append(toolChain.getIdentity());
+	}
+	if (toolChainPackages->isReceivingEnabled()) {
+		toolChainVersions.append(ToolChainPackageStore::advertisement);
 	}
 	stream << toolChainVersions;
 	Packet packet = Packet::fromData(PacketType::NetworkResourcesAvailable, packetData);
@@ -811,19 +1717,29 @@ void CompilerNetwork::reportGroupNetworkResources(NetworkNode *node, GroupMember
 	QByteArray packetData;
 	QDataStream stream(&packetData, QIODevice::WriteOnly);
 	// We have to prove that we are a member of the given group, so we sign our
-	// public key and the other peer's public key with the private group key
+	// public key and the other peer's public key with the private group key.
+	// The signature is only created once per connection as it does not change.
 	QByteArray signedText;
-	signedText.append(PublicKey(localKey).toDER());
+	signedText.append(node->getLocalPublicKey().toDER());
 	signedText.append(node->getPublicKey().toDER());
-	stream << PublicKey(group->getPrivateKey()).toDER();
+	QByteArray groupKey = PublicKey(group->getPrivateKey()).toDER();
+	QByteArray signature = node->getMembershipProof(groupKey);
+	if (signature.isEmpty()) {
+		signature = group->getPrivateKey().sign(signedText);
+		node->setMembershipProof(groupKey, signature);
+	}
+	stream << groupKey;
 	stream << signedText;
-	stream << group->getPrivateKey().sign(signedText);
+	stream << signature;
 	// Send number of available slots
 	stream << freeLocalSlots;
 	// Send toolchain info so that other peers only ask peers who have the correct toolchains
 	QStringList toolChainVersions;
 	foreach (ToolChain toolChain, toolChains) {
-		toolChainVersions.append(toolChain.getVersion());
+		toolChainVersions.append(toolChain.getIdentity());
+	}
+	if (toolChainPackages->isReceivingEnabled()) {
+		toolChainVersions.append(ToolChainPackageStore::advertisement);
 	}
 	stream << toolChainVersions;
 	Packet packet = Packet::fromData(PacketType::GroupNetworkResourcesAvailable, packetData);
@@ -904,12 +1820,17 @@ void CompilerNetwork::onGroupNetworkResourcesAvailable(NetworkNode *node, const
 	// We expect a specific and unique text so that nobody can replay this part
 	QByteArray expectedText;
 	expectedText.append(node->getPublicKey().toDER());
-	expectedText.append(PublicKey(localKey).toDER());
+	expectedText.append(node->getLocalPublicKey().toDER());
 	if (signedText != expectedText) {
 		return;
 	}
-	if (!groupKey.verify(signedText, signature)) {
-		return;
+	// The peer sends the same signature every time, so it only has to be
+	// checked once per connection
+	if (!node->isMembershipProofVerified(derGroupKey, signature)) {
+		if (!groupKey.verify(signedText, signature)) {
+			return;
+		}
+		node->setMembershipProofVerified(derGroupKey, signature);
 	}
 	// Add network resources
 	onGeneralNetworkResourcesAvailable(node, stream);
@@ -933,7 +1854,12 @@ void CompilerNetwork::onGeneralNetworkResourcesAvailable(NetworkNode *node,
 	FreeCompilerSlots freeSlots;
 	freeSlots.node = node;
 	freeSlots.slotCount = availableCount;
-	freeSlots.toolChainVersions = toolChainVersions;
+	freeSlots.acceptsPackages = toolChainVersions.removeAll(
+			ToolChainPackageStore::advertisement) > 0;
+	foreach (const QString &identity, toolChainVersions) {
+		freeSlots.toolChainIds.append(toolChainIndex.intern(identity));
+	}
+	freeSlots.capabilities = toolChainIndex.getCapabilities(freeSlots.toolChainIds);
 	freeRemoteSlots.append(freeSlots);
 	// If we have waiting jobs which can now be sent out, create a request
 	createJobRequests();
@@ -945,29 +1871,48 @@ void CompilerNetwork::createJobRequests() {
 	if (freeRemoteSlots.getFreeSlotCount() <= freeRemoteSlots.getMaxFreeSlotCount() / 4) {
 		askForFreeSlots();
 	}
-	// Send job requests for waiting jobs as long as there are free slots available
-	while (freeRemoteSlots.getFreeSlotCount() > 0 && outgoingJobRequests.size() < (int)getWaitingJobCount()) {
-		// NOTE: We always create job requests for the toolchain version of the
-		// first waiting job, this is okay as we usually compile lots of jobs
-		// for the same target architecture
-		Job *lastWaiting = NULL;
-		if (!waitingPreprocessedJobs.empty()) {
-			waitingPreprocessedJobs.last();
-		} else if (!waitingPreprocessingJobs.empty()) {
-			lastWaiting = waitingPreprocessingJobs.last();
-		} else if (!waitingJobs.empty()) {
-			lastWaiting = waitingJobs.last();
-		} else {
-			qFatal("createJobRequests(): waitingJob lists all empty!");
+	if (waitingQueues.empty() || freeRemoteSlots.getFreeSlotCount() == 0) {
+		return;
+	}
+	// Compute how many more requests every queue needs, requests which have
+	// already been sent or accepted count against the queue of their toolchain
+	QHash<QString, int> demand;
+	foreach (WaitingJobQueue *queue, waitingQueues) {
+		demand[queue->toolChain.getIdentity()] = queue->size()
+				- queue->acceptedRequests.size();
+	}
+	foreach (OutgoingJobRequest *request, outgoingJobRequests) {
+		if (demand.contains(request->toolChain)) {
+			demand[request->toolChain]--;
 		}
-		//assert(lastWaiting != NULL);
-		if (lastWaiting == NULL) {
-			// TODO: Why does this happen?
+	}
+	// Send job requests as long as there are free slots available, always for
+	// the queue with the highest remaining demand so that the slots are
+	// distributed according to the size of the queues
+	QSet<QString> blocked;
+	while (freeRemoteSlots.getFreeSlotCount() > 0) {
+		WaitingJobQueue *queue = NULL;
+		int maxDemand = 0;
+		foreach (WaitingJobQueue *candidate, waitingQueues) {
+			QString identity = candidate->toolChain.getIdentity();
+			if (demand[identity] > maxDemand && !blocked.contains(identity)) {
+				queue = candidate;
+				maxDemand = demand[identity];
+			}
+		}
+		if (!queue) {
 			break;
 		}
-		NetworkNode *target = freeRemoteSlots.removeFirst(lastWaiting->getToolchain().getVersion());
+		QString identity = queue->toolChain.getIdentity();
+		bool shippable = !toolChainPackages->getPackageHash(queue->toolChain).isEmpty();
+		NetworkNode *target = freeRemoteSlots.removeFirst(
+				toolChainIndex.getLocalIndex(identity), shippable);
 		if (!target) {
-			qDebug("createJobRequests: Cannot send job request, no target available.");
+			// The remaining slots are incompatible or belong to congested
+			// peers, try again once one of them is available again
+			qDebug("createJobRequests: No target available for %s.",
+					identity.toAscii().data());
+			blocked.insert(identity);
 			continue;
 		}
 		qDebug("createJobRequests: Sending job request.");
@@ -975,18 +1920,19 @@ void CompilerNetwork::createJobRequests() {
 		OutgoingJobRequest *request = new OutgoingJobRequest;
 		request->target = target;
 		request->id = generateJobId();
+		request->toolChain = identity;
 		// A timeout is installed so that we do not wait forever
-		connect(&request->timeout, SIGNAL(timeout()), this, SLOT(onOutgoingJobRequestTimeout()));
-		request->timeout.setSingleShot(true);
-		request->timeout.start(15000);
-		outgoingJobRequests.append(request);
+		timeouts.start(&request->timeout, 15000, TimeoutType::OutgoingJobRequest, request);
+		outgoingJobRequests.insert(JobKey(request->target, request->id), request);
 		Packet packet(PacketType::JobRequest, qToBigEndian(request->id));
 		network->send(request->target, packet);
+		demand[identity]--;
 		// If there are not enough preprocessed waiting jobs, start preprocessing
 		// for one of the waiting jobs
-		int preprocessed = getPreprocessedWaitingJobCount() + getPreprocessingWaitingJobCount();
-		if (outgoingJobRequests.size() > preprocessed) {
-			preprocessWaitingJob();
+		int requests = queue->size() - demand[identity];
+		int preprocessed = queue->preprocessed.size() + queue->preprocessing.size();
+		if (requests > preprocessed && !queue->waiting.empty()) {
+			preprocessWaitingJob(queue);
 		}
 	}
 }
@@ -1013,11 +1959,11 @@ void CompilerNetwork::onIncomingJobRequest(NetworkNode *node, const Packet &pack
 	IncomingJobRequest *request = new IncomingJobRequest;
 	request->source = node;
 	request->id = id;
-	connect(&request->timeout, SIGNAL(timeout()), this, SLOT(onIncomingJobRequestTimeout()));
-	request->timeout.setSingleShot(true);
 	// Fairly high timeout interval as we have to wait for the job data
-	request->timeout.start(60000);
-	incomingJobRequests.append(request);
+	timeouts.start(&request->timeout, 60000, TimeoutType::IncomingJobRequest, request);
+	// A peer might reuse the id of a request which timed out
+	delete incomingJobRequests.take(JobKey(node, id));
+	incomingJobRequests.insert(JobKey(node, id), request);
 	// Send a positive reply
 	Packet reply(PacketType::JobRequestAccepted, qToBigEndian(id));
 	network->send(node, reply);
@@ -1037,33 +1983,36 @@ void CompilerNetwork::onJobRequestAccepted(NetworkNode *node, const Packet &pack
 	// We have to check whether we have sent a job request to this peer
 	// to ensure that we do not accept offers from untrusted peers
 	// Also, remove the request from the list
-	bool requestFound = false;
-	for (int i = 0; i < outgoingJobRequests.size(); i++) {
-		OutgoingJobRequest *request = outgoingJobRequests[i];
-		if (request->target == node && request->id == id) {
-			requestFound = true;
-			// Really delegate the first job in the queue now
-			qDebug("Job request accepted, queue size: %d/%d/%d", waitingJobs.size(),
-				waitingPreprocessingJobs.size(), waitingPreprocessedJobs.size());
-			Job *job = removePreprocessedWaitingJob();
-			if (!job) {
-				// No job is ready, so wait until a job has been preprocessed
-				acceptedJobRequests.append(request);
-				outgoingJobRequests.removeAt(i);
-				request->timeout.stop();
-				return;
-			}
-			delegateJob(job, request);
-			// Remove the request from the list
-			delete request;
-			outgoingJobRequests.removeAt(i);
-			break;
-		}
-	}
-	if (!requestFound) {
+	OutgoingJobRequest *request = outgoingJobRequests.take(JobKey(node, id));
+	if (!request) {
 		// TODO: This is happening too often at the moment, better send less request
 		//qWarning("onJobRequestAccepted: Received unknown job id (removed because of a timeout?).");
+		return;
+	}
+	// Really delegate the first job in the queue now
+	WaitingJobQueue *queue = waitingQueues.value(request->toolChain);
+	if (!queue || queue->size() == 0) {
+		// All jobs of the toolchain have been executed locally in the
+		// meantime, the peer drops the request after a timeout
+		delete request;
+		return;
+	}
+	qDebug("Job request accepted, queue size: %d/%d/%d", queue->waiting.size(),
+		queue->preprocessing.size(), queue->preprocessed.size());
+	if (queue->preprocessed.empty()) {
+		// No job is ready, so wait until a job has been preprocessed
+		if (queue->preprocessing.size() <= queue->acceptedRequests.size()
+				&& !queue->waiting.empty()) {
+			preprocessWaitingJob(queue);
+		}
+		queue->acceptedRequests.append(request);
+		request->timeout.stop();
+		dropAcceptedRequests(queue);
+		return;
 	}
+	Job *job = queue->preprocessed.takeLast();
+	delegateJob(job, request);
+	delete request;
 }
 void CompilerNetwork::onJobRequestRejected(NetworkNode *node, const Packet &packet) {
 	qDebug("onJobRequestRejected");
@@ -1077,17 +2026,10 @@ void CompilerNetwork::onJobRequestRejected(NetworkNode *node, const Packet &pack
 		return;
 	}
 	// Remove outgoing job request
-	bool requestFound = false;
-	for (int i = 0; i < outgoingJobRequests.size(); i++) {
-		OutgoingJobRequest *request = outgoingJobRequests[i];
-		if (request->target == node && request->id == id) {
-			requestFound = true;
-			delete request;
-			outgoingJobRequests.removeAt(i);
-			break;
-		}
-	}
-	if (!requestFound) {
+	OutgoingJobRequest *request = outgoingJobRequests.take(JobKey(node, id));
+	if (request) {
+		delete request;
+	} else {
 		qWarning("onJobRequestRejected: Received unknown job id.");
 	}
 	// Remove all free slots from this node as it probably will not accept any later job now
@@ -1103,19 +2045,12 @@ void CompilerNetwork::onJobData(NetworkNode *node, const Packet &packet) {
 	unsigned int id;
 	stream >> id;
 	id = qFromBigEndian(id);
-	bool requestFound = false;
-	for (int i = 0; i < incomingJobRequests.size(); i++) {
-		if (incomingJobRequests[i]->source == node && incomingJobRequests[i]->id == id) {
-			requestFound = true;
-			delete incomingJobRequests[i];
-			incomingJobRequests.removeAt(i);
-			break;
-		}
-	}
-	if (!requestFound) {
+	IncomingJobRequest *request = incomingJobRequests.take(JobKey(node, id));
+	if (!request) {
 		qWarning("onJobData(): Invaild job id.");
 		return;
 	}
+	delete request;
 	// Parse packet data
 	QString toolchain;
 	stream >> toolchain;
@@ -1123,44 +2058,111 @@ void CompilerNetwork::onJobData(NetworkNode *node, const Packet &packet) {
 	stream >> language;
 	QStringList compilerParameters;
 	stream >> compilerParameters;
-	bool inputCompressed;
-	stream >> inputCompressed;
-	QList<QByteArray> fileContent;
-	stream >> fileContent;
-	// Create input files
-	QStringList inputFiles;
-	QStringList outputFiles;
-	for (int i = 0; i < fileContent.size(); i++) {
-		InputOutputFilePair filePair(".c", ".o");
-		inputFiles.append(filePair.getInputFilename());
-		outputFiles.append(filePair.getOutputFilename());
-		QFile inputFile(filePair.getInputFilename());
-		if (!inputFile.open(QIODevice::WriteOnly)) {
-			qFatal("Could not open previously created temporary file.");
-		}
-		if (inputCompressed) {
-			inputFile.write(qUncompress(fileContent[i]));
-		} else {
-			inputFile.write(fileContent[i]);
-		}
-		inputFile.close();
-	}
+	QString packageHash;
+	stream >> packageHash;
+	QString headerHash;
+	stream >> headerHash;
+	QString sourceDirectory;
+	stream >> sourceDirectory;
+	QStringList sourceFiles;
+	stream >> sourceFiles;
+	QString debugInfoName;
+	stream >> debugInfoName;
+	bool preprocess;
+	stream >> preprocess;
+	IncludeTree includeTree;
+	stream >> includeTree;
 	// Get toolchain path
 	bool toolchainSupported = false;
 	QStringList compatibilityParameters;
 	ToolChain toolChainInfo;
-	for (int i = 0; i < toolChains.size(); i++) {
-		if (ToolChain::isCompatible(toolchain, toolChains[i].getVersion(),
-				&compatibilityParameters)) {
-			toolChainInfo = toolChains[i];
+	int localToolChain = toolChainIndex.findLocalTarget(
+			toolChainIndex.intern(toolchain), &compatibilityParameters);
+	if (localToolChain != -1) {
+		toolChainInfo = toolChains[localToolChain];
+		toolchainSupported = true;
+	} else {
+		qDebug("Incompatible toolchain: %s", toolchain.toAscii().data());
+	}
+	compilerParameters.append(compatibilityParameters);
+	bool packaged = false;
+	if (!toolchainSupported && !packageHash.isEmpty()
+			&& toolChainPackages->isReceivingEnabled()) {
+		if (toolChainPackages->hasReceivedToolChain(packageHash)) {
+			toolChainInfo = toolChainPackages->getReceivedToolChain(packageHash);
 			toolchainSupported = true;
-			break;
+			packaged = true;
+			// The package does not contain any headers, so the compiler must
+			// not preprocess the input again
+			compilerParameters.append("-fpreprocessed");
+		} else if (node->getTrustedPeer()) {
+			// The job is rejected, but the next ones can use the package -
+			// compilers are only accepted from trusted peers as they are
+			// executed here
+			requestToolChainPackage(node, packageHash);
+		}
+	}
+	QString precompiledHeader;
+	if (toolchainSupported && !headerHash.isEmpty()) {
+		// gcc only loads precompiled headers created by the same binary, and
+		// packaged compilers cannot access files outside the working directory
+		QString fingerprint = ToolChain::fingerprintFromIdentity(toolchain);
+		if (packaged || fingerprint.isEmpty()
+				|| toolChainInfo.getFingerprint() != fingerprint
+				|| !precompiledHeaders->isEnabled()) {
+			toolchainSupported = false;
+		} else if (precompiledHeaders->hasReceivedHeader(headerHash)) {
+			precompiledHeader = precompiledHeaders->getReceivedHeader(headerHash);
+			compilerParameters.append("-fpreprocessed");
 		} else {
-			qDebug("Incompatible: %s/%s", toolchain.toAscii().data(), toolChains[i].getVersion().toAscii().data());
+			// The job is rejected, but the next ones can use the header
+			requestPrecompiledHeader(node, headerHash);
+			toolchainSupported = false;
+		}
+	}
+	// The input files and the .dwo file are placed at the same paths as on
+	// the other peer, which is not possible with packaged compilers
+	if (packaged) {
+		sourceDirectory.clear();
+	}
+	if (sourceDirectory.isEmpty() || debugInfoName.startsWith('/')
+			|| debugInfoName.contains("..") || !debugInfoName.endsWith(".dwo")) {
+		debugInfoName.clear();
+	}
+	if (toolchainSupported && compilerParameters.contains("-fltrans")) {
+		// LTO bytecode can only be read by the same version of gcc, and
+		// partitions cannot be compiled for a different target
+		QString fingerprint = ToolChain::fingerprintFromIdentity(toolchain);
+		if (packaged || fingerprint.isEmpty()
+				|| toolChainInfo.getFingerprint() != fingerprint
+				|| !compatibilityParameters.isEmpty()) {
+			toolchainSupported = false;
+		}
+	}
+	bool missingHeaders = false;
+	if (toolchainSupported && preprocess) {
+		// The shipped headers include those of the compiler, which have to
+		// match the compiler binary, and the source file has to be placed at
+		// its original path so that relative includes work
+		QString fingerprint = ToolChain::fingerprintFromIdentity(toolchain);
+		if (packaged || fingerprint.isEmpty()
+				|| toolChainInfo.getFingerprint() != fingerprint
+				|| !compatibilityParameters.isEmpty()
+				|| sourceDirectory.isEmpty() || !precompiledHeader.isEmpty()
+				|| !headers->isReceivingEnabled()
+				|| !isValidIncludeTree(includeTree)) {
+			toolchainSupported = false;
+		} else {
+			missingHeaders = !hasHeaders(includeTree);
+			// Headers can only be requested over the bulk channel
+			BulkChannel *bulkChannel = node->getBulkChannel();
+			if (missingHeaders && (!bulkChannel || !bulkChannel->isReady())) {
+				toolchainSupported = false;
+			}
 		}
 	}
-	compilerParameters.append(compatibilityParameters);
 	if (!toolchainSupported) {
+		removeReceivedBulkFiles(node, BulkFileKind::JobInput, id);
 		QByteArray packetData;
 		QDataStream stream(&packetData, QIODevice::WriteOnly);
 		stream << qToBigEndian(id);
@@ -1172,44 +2174,66 @@ void CompilerNetwork::onJobData(NetworkNode *node, const Packet &packet) {
 	} else {
 		qDebug("Toolchain chosen: %s", toolChainInfo.getPath().toAscii().data());
 	}
-	// Create job
-	Job *job = new Job(inputFiles, outputFiles, QStringList(), QStringList(),
-			compilerParameters, toolChainInfo, QDir::tempPath(), true, false,
-			QByteArray(), language);
-	IncomingJob *incoming = new IncomingJob(node, job, id);
-	job->setIncomingJob(incoming);
-	incomingJobs.append(incoming);
-	qDebug("Created remote job (id: %d)", incoming->getId());
-	emit receivedJob(job);
-	// Send packet indicating that the job was received
-	qDebug("Sending JobDataReceived...");
-	Packet reply(PacketType::JobDataReceived, qToBigEndian(id));
-	network->send(node, reply);
+	// The job waits until all input files have been received over the bulk
+	// channel or have been written by the thread pool
+	IncomingBulkJob *bulkJob = new IncomingBulkJob;
+	bulkJob->source = node;
+	bulkJob->id = id;
+	bulkJob->toolChain = toolChainInfo;
+	bulkJob->language = language;
+	bulkJob->compilerParameters = compilerParameters;
+	bulkJob->precompiledHeader = precompiledHeader;
+	bulkJob->sourceDirectory = sourceDirectory;
+	bulkJob->sourceFiles = sourceFiles;
+	bulkJob->debugInfoName = debugInfoName;
+	bulkJob->preprocess = preprocess;
+	bulkJob->includeTree = includeTree;
+	bulkJob->writingFiles = false;
+	bulkJob->inputComplete = false;
+	timeouts.start(&bulkJob->timeout, 60000, TimeoutType::IncomingBulkJob, bulkJob);
+	incomingBulkJobs.insert(JobKey(node, id), bulkJob);
+	if (missingHeaders) {
+		requestHeaders(node);
+	}
+	bool bulkTransfer;
+	stream >> bulkTransfer;
+	if (bulkTransfer) {
+		stream >> bulkJob->fileCount;
+		checkIncomingBulkJob(bulkJob);
+		return;
+	}
+	bool inputCompressed;
+	stream >> inputCompressed;
+	QList<QByteArray> fileContent;
+	stream >> fileContent;
+	bulkJob->fileCount = fileContent.size();
+	bulkJob->writingFiles = true;
+	// Create input files, they are filled in the thread pool
+	JobFileTask task(JobFileTask::Type::WriteInputFiles, node, id);
+	for (int i = 0; i < fileContent.size(); i++) {
+		InputOutputFilePair filePair(".c", ".o");
+		task.inputFiles.append(filePair.getInputFilename());
+		task.outputFiles.append(filePair.getOutputFilename());
+	}
+	watchFileTask(QtConcurrent::run(JobFileTask::writeInputFiles, task,
+		fileContent, inputCompressed));
 }
 void CompilerNetwork::onJobDataReceived(NetworkNode *node, const Packet &packet) {
 	qDebug("onJobDataReceived");
 	unsigned int id = qFromBigEndian(*packet.getPayload<unsigned int>());
 	// Restart outgoing job timeout (we can wait longer for actual compilation
 	// than for receiving the job data)
-	OutgoingJob *outgoing = NULL;
-	for (int i = 0; i < delegatedJobs.size(); i++) {
-		if (delegatedJobs[i]->getTargetPeer() == node && delegatedJobs[i]->getId() == id) {
-			outgoing = delegatedJobs[i];
-			break;
-		}
-	}
+	OutgoingJob *outgoing = delegatedJobs.value(JobKey(node, id), NULL);
 	if (outgoing == NULL) {
 		qWarning("onJobDataReceived(): Invaild job id.");
 		return;
 	}
-	connect(&outgoing->getTimer(), SIGNAL(timeout()), this, SLOT(onOutgoingJobTimeout()));
-	outgoing->getTimer().setSingleShot(true);
 	// This time we choose a longer interval as compiling might take some time
 	// for large files
 	// TODO: There still might be files which take longer than this, at least
 	// with C++ and complex templates - do we have to care about these
 	// pathologic cases? No real project should hit this
-	outgoing->getTimer().start(120000);
+	timeouts.start(&outgoing->getTimeout(), 120000, TimeoutType::OutgoingJob, outgoing);
 }
 void CompilerNetwork::onJobFinished(NetworkNode *node, const Packet &packet) {
 	qDebug("onJobFinished");
@@ -1218,15 +2242,7 @@ void CompilerNetwork::onJobFinished(NetworkNode *node, const Packet &packet) {
 	unsigned int id;
 	stream >> id;
 	id = qFromBigEndian(id);
-	OutgoingJob *outgoing = NULL;
-	int outgoingIndex = -1;
-	for (int i = 0; i < delegatedJobs.size(); i++) {
-		if (delegatedJobs[i]->getTargetPeer() == node && delegatedJobs[i]->getId() == id) {
-			outgoing = delegatedJobs[i];
-			outgoingIndex = i;
-			break;
-		}
-	}
+	OutgoingJob *outgoing = delegatedJobs.value(JobKey(node, id), NULL);
 	if (outgoing == NULL) {
 		qWarning("onJobFinished(): Invaild job id.");
 		return;
@@ -1237,11 +2253,14 @@ void CompilerNetwork::onJobFinished(NetworkNode *node, const Packet &packet) {
 	bool executed;
 	stream >> executed;
 	if (!executed) {
+		// The peer might not be able to preprocess the job, the next attempt
+		// uses the local preprocessor
+		job->disableRemotePreprocessing();
 		emit outgoingJobCancelled(job);
 		// Delete the job
 		job->setOutgoingJob(NULL);
+		delegatedJobs.remove(JobKey(node, id));
 		delete outgoing;
-		delegatedJobs.removeAt(outgoingIndex);
 		return;
 	}
 	// Get output data
@@ -1252,33 +2271,42 @@ void CompilerNetwork::onJobFinished(NetworkNode *node, const Packet &packet) {
 	stream >> stdout;
 	QByteArray stderr;
 	stream >> stderr;
+	// The job is finished once all output files have been received over the
+	// bulk channel or have been written by the thread pool
+	BulkJobResult *result = new BulkJobResult;
+	result->outgoing = outgoing;
+	result->returnValue = returnValue;
+	result->stdout = stdout;
+	result->stderr = stderr;
+	result->writingFiles = false;
+	bulkJobResults.insert(JobKey(node, id), result);
+	bool bulkTransfer;
+	stream >> bulkTransfer;
+	if (bulkTransfer) {
+		stream >> result->fileCount;
+		checkBulkJobResult(result);
+		return;
+	}
 	QList<QByteArray> outputFileContent;
 	stream >> outputFileContent;
-	// Create output files
-	if (outputFileContent.size() > job->getOutputFiles().size()) {
+	// Jobs which the other peer preprocesses return the dependency file too
+	QStringList outputFiles = job->getRemoteOutputFiles();
+	if (outputFileContent.size() > outputFiles.size()) {
 		qWarning("onJobFinished(): Received too many output files.");
-		outputFileContent = outputFileContent.mid(0, job->getOutputFiles().size());
-	}
+		outputFileContent = outputFileContent.mid(0, outputFiles.size());
+	}
+	result->fileCount = outputFileContent.size();
+	result->writingFiles = true;
+	// The data is complete, so we do not need a timeout while the files are
+	// written
+	outgoing->getTimeout().stop();
+	JobFileTask task(JobFileTask::Type::WriteOutputFiles, node, id);
 	for (int i = 0; i < outputFileContent.size(); i++) {
-		QFile file(job->getWorkingDirectory() + "/" + job->getOutputFiles()[i]);
-		if (!file.open(QIODevice::WriteOnly)) {
-			qWarning("Could not open output file.");
-			stderr.append(QString("\nddcn: Could not open output file.").toAscii());
-			if (returnValue == 0) {
-				returnValue = -1;
-			}
-			continue;
-		}
-		file.write(outputFileContent[i]);
+		task.outputFiles.append(QDir(job->getWorkingDirectory())
+				.absoluteFilePath(outputFiles[i]));
 	}
-	// Finish job
-	job->setFinished(returnValue, stdout, stderr);
-	// Delete the job
-	job->setOutgoingJob(NULL);
-	delete outgoing;
-	delegatedJobs.removeAt(outgoingIndex);
-	qDebug("Job finished (id: %d), %d delegated jobs remaining.", id, delegatedJobs.size());
-	delete job;
+	watchFileTask(QtConcurrent::run(JobFileTask::writeOutputFiles, task,
+		outputFileContent));
 }
 void CompilerNetwork::onAbortJob(NetworkNode *node, const Packet &packet) {
 	qDebug("onAbortJob");
@@ -1291,134 +2319,779 @@ void CompilerNetwork::onAbortJob(NetworkNode *node, const Packet &packet) {
 		qWarning("onAbortJob: Invalid packet received.");
 		return;
 	}
+	JobKey key(node, id);
 	// Check if the job has potentially already been started
-	for (int i = 0; i < incomingJobs.count(); i++) {
-		if (incomingJobs[i]->getSourcePeer() == node && incomingJobs[i]->getId() == id) {
-			// Kill the job
-			emit incomingJobAborted(incomingJobs[i]->getJob());
-			// Delete the job
-			delete incomingJobs[i]->getJob();
-			delete incomingJobs[i];
-			incomingJobs.removeAt(i);
-			return;
+	IncomingJob *incoming = incomingJobs.take(key);
+	if (incoming) {
+		// Kill the job
+		emit incomingJobAborted(incoming->getJob());
+		// Delete the job
+		delete incoming->getJob();
+		storeDebugInfo(incoming, false);
+		removeJobDirectory(incoming);
+		if (!incoming->getDependencyFile().isEmpty()) {
+			QFile::remove(incoming->getDependencyFile());
 		}
+		delete incoming;
+		return;
 	}
 	// Cancel an incoming job request if it has not
-	for (int i = incomingJobRequests.size() - 1; i >= 0; i--) {
-		if (incomingJobRequests[i]->source == node && incomingJobRequests[i]->id == id) {
-			delete incomingJobRequests[i];
-			incomingJobRequests.removeAt(i);
+	IncomingJobRequest *request = incomingJobRequests.take(key);
+	if (request) {
+		delete request;
+		removeReceivedBulkFiles(node, BulkFileKind::JobInput, id);
+		return;
+	}
+	IncomingBulkJob *bulkJob = incomingBulkJobs.take(key);
+	if (bulkJob) {
+		removeBulkJobFiles(bulkJob);
+		delete bulkJob;
+		removeReceivedBulkFiles(node, BulkFileKind::JobInput, id);
+		return;
+	}
+	qWarning("onAbortJob(): Invalid job id.");
+}
+
+void CompilerNetwork::startIncomingJob(const IncomingBulkJob *bulkJob) {
+	NetworkNode *node = bulkJob->source;
+	unsigned int id = bulkJob->id;
+	const QStringList &inputFiles = bulkJob->inputFiles;
+	const QStringList &outputFiles = bulkJob->outputFiles;
+	// The preprocessed files still refer to the precompiled header on the
+	// other peer
+	if (!bulkJob->precompiledHeader.isEmpty()) {
+		foreach (const QString &inputFile, inputFiles) {
+			if (!PrecompiledHeaderStore::replacePragma(inputFile,
+					bulkJob->precompiledHeader)) {
+				qWarning("Could not use the precompiled header for %s.",
+						inputFile.toAscii().data());
+			}
+		}
+	}
+	QStringList parameters = bulkJob->compilerParameters;
+	QStringList jobInputFiles = inputFiles;
+	QStringList jobOutputFiles = outputFiles;
+	QString workingDirectory;
+	QString root;
+	QStringList files;
+	QStringList searchDirectories;
+	// Packaged compilers can only access their working directory
+	if (!bulkJob->sourceDirectory.isEmpty() && outputFiles.size() == 1) {
+		workingDirectory = createJobDirectory(bulkJob->sourceDirectory,
+				bulkJob->sourceFiles, inputFiles, bulkJob->debugInfoName,
+				bulkJob->includeTree, &root, &files);
+	}
+	if (bulkJob->preprocess && workingDirectory.isEmpty()) {
+		// The source file cannot be compiled without its headers
+		foreach (const QString &fileName, inputFiles + outputFiles) {
+			QFile::remove(fileName);
+		}
+		QByteArray packetData;
+		QDataStream stream(&packetData, QIODevice::WriteOnly);
+		stream << qToBigEndian(id);
+		// The job was not executed
+		stream << false;
+		Packet packet = Packet::fromData(PacketType::JobFinished, packetData);
+		network->send(node, packet);
+		return;
+	}
+	QString temporaryDebugInfoFile;
+	QString dependencyFile;
+	if (!workingDirectory.isEmpty()) {
+		// gcc is called with the same file names as on the other peer, and
+		// the root of the tree is removed from the debug information
+		jobInputFiles = bulkJob->sourceFiles;
+		parameters << "-fdebug-prefix-map=" + root + "=";
+		if (!bulkJob->debugInfoName.isEmpty()) {
+			// gcc writes the .dwo file relative to the working directory and
+			// the skeleton object refers to it by that name - without
+			// -dumpdir, the directory of the output file would be used
+			QString debugInfoName = bulkJob->debugInfoName;
+			int separator = debugInfoName.lastIndexOf('/');
+			parameters << "-gsplit-dwarf";
+			parameters << "-dumpdir" << debugInfoName.left(separator + 1);
+			parameters << "-dumpbase" << debugInfoName.mid(separator + 1);
+			parameters << "-dumpbase-ext" << ".dwo";
+			TemporaryFile holder(".dwo", "ddcn_dwo_");
+			temporaryDebugInfoFile = holder.getFilename();
+			delete holder.getFile();
+		}
+		if (bulkJob->preprocess) {
+			// Only the search path of the other peer is used, recreated
+			// within the tree
+			const IncludeTree &includeTree = bulkJob->includeTree;
+			parameters << "-nostdinc";
+			foreach (const QString &directory, includeTree.quoteDirectories) {
+				parameters << "-iquote" << root + directory;
+			}
+			foreach (const QString &directory, includeTree.directories) {
+				parameters << "-I" << root + directory;
+			}
+			foreach (const QString &directory, includeTree.systemDirectories) {
+				parameters << "-isystem" << root + directory;
+			}
+			foreach (const QString &forcedInclude, includeTree.forcedIncludes) {
+				parameters << "-include" << root + forcedInclude;
+			}
+			parameters << "-fmacro-prefix-map=" + root + "=";
+			searchDirectories = includeTree.quoteDirectories
+					+ includeTree.directories + includeTree.systemDirectories;
+			// The dependency file is returned as an additional output file
+			if (parameters.contains("-MD") || parameters.contains("-MMD")) {
+				TemporaryFile holder(".d", "ddcn_dep_");
+				dependencyFile = holder.getFilename();
+				delete holder.getFile();
+				parameters << "-MF" << dependencyFile;
+				jobOutputFiles.append(dependencyFile);
+			}
+		}
+		parameters << "-o" << outputFiles[0];
+	} else {
+		workingDirectory = QDir::tempPath();
+	}
+	// Create job
+	Job *job = new Job(jobInputFiles, jobOutputFiles, QStringList(), QStringList(),
+			parameters, bulkJob->toolChain, workingDirectory, true, false,
+			QByteArray(), bulkJob->language);
+	IncomingJob *incoming = new IncomingJob(node, job, id);
+	if (!root.isEmpty()) {
+		incoming->setJobDirectory(root, files, searchDirectories);
+	}
+	if (!temporaryDebugInfoFile.isEmpty()) {
+		incoming->setDebugInfo(files[1], temporaryDebugInfoFile);
+	}
+	incoming->setDependencyFile(dependencyFile);
+	job->setIncomingJob(incoming);
+	incomingJobs.insert(JobKey(node, id), incoming);
+	qDebug("Created remote job (id: %d)", incoming->getId());
+	emit receivedJob(job);
+	// Send packet indicating that the job was received
+	qDebug("Sending JobDataReceived...");
+	Packet reply(PacketType::JobDataReceived, qToBigEndian(id));
+	network->send(node, reply);
+}
+QString CompilerNetwork::createJobDirectory(const QString &sourceDirectory,
+		const QStringList &sourceFiles, const QStringList &inputFiles,
+		const QString &debugInfoName, const IncludeTree &includeTree,
+		QString *root, QStringList *files) {
+	if (!isSafePath(sourceDirectory) || sourceFiles.size() != 1
+			|| inputFiles.size() != 1) {
+		return "";
+	}
+	QString directory = QDir::cleanPath(sourceDirectory);
+	QString sourceFile = sourceFiles[0];
+	if (sourceFile.isEmpty() || sourceFile == "-") {
+		return "";
+	}
+	QStringList paths;
+	if (sourceFile.startsWith('/')) {
+		paths.append(QDir::cleanPath(sourceFile));
+	} else {
+		paths.append(QDir::cleanPath(directory + "/" + sourceFile));
+	}
+	if (!debugInfoName.isEmpty()) {
+		paths.append(QDir::cleanPath(directory + "/" + debugInfoName));
+	}
+	foreach (const QString &path, paths) {
+		if (!isSafePath(path)) {
+			return "";
+		}
+	}
+	// The files of the job come first, they cannot be shared with other jobs
+	int ownFileCount = paths.size();
+	paths.append(includeTree.files);
+	// Other users must not be able to place files in the tree, the directory
+	// therefore is private and is not used if somebody else created it
+	QString jobDirectory = QDir::tempPath() + "/ddcn_jobs-"
+			+ QString::number(getuid());
+	if (!TemporaryFile::createPrivateDirectory(jobDirectory)) {
+		return "";
+	}
+	// Another tree is only used if a job with the same file names is running,
+	// unless the files are headers with the same content
+	for (int i = 0; ; i++) {
+		*root = jobDirectory + "/" + QString::number(i);
+		bool used = false;
+		for (int j = 0; j < paths.size() && !used; j++) {
+			QHash<QString, JobFile>::const_iterator it = jobFiles.find(*root + paths[j]);
+			used = it != jobFiles.end() && (j < ownFileCount
+					|| it.value().hash != includeTree.hashes[j - ownFileCount]);
+		}
+		if (!used) {
+			break;
+		}
+	}
+	files->clear();
+	foreach (const QString &path, paths) {
+		files->append(*root + path);
+	}
+	QString workingDirectory = *root + directory;
+	bool created = QDir().mkpath(workingDirectory);
+	foreach (const QString &file, *files) {
+		created = created && QDir().mkpath(QFileInfo(file).absolutePath());
+	}
+	// Empty include directories are needed as well, e.g. for "../" in
+	// include names
+	QStringList searchDirectories = includeTree.quoteDirectories
+			+ includeTree.directories + includeTree.systemDirectories;
+	foreach (const QString &searchDirectory, searchDirectories) {
+		created = created && QDir().mkpath(*root + searchDirectory);
+	}
+	// Headers which are already used by other jobs are shared
+	QStringList linkedHeaders;
+	for (int i = ownFileCount; i < files->size() && created; i++) {
+		if (jobFiles.contains(files->at(i))) {
+			continue;
+		}
+		QString hash = includeTree.hashes[i - ownFileCount];
+		// Files which are not in use anymore might be left over after a crash
+		QFile::remove(files->at(i));
+		if (!linkFile(headers->getReceivedHeader(hash), files->at(i))) {
+			created = false;
+			break;
+		}
+		linkedHeaders.append(files->at(i));
+	}
+	// Files which are not in use anymore might be left over after a crash
+	QFile::remove(files->first());
+	if (!created || !QFile::rename(inputFiles[0], files->first())) {
+		qWarning("Could not create the directories for an incoming job.");
+		foreach (const QString &header, linkedHeaders) {
+			QFile::remove(header);
+		}
+		return "";
+	}
+	for (int i = 0; i < files->size(); i++) {
+		QHash<QString, JobFile>::iterator it = jobFiles.find(files->at(i));
+		if (it != jobFiles.end()) {
+			it.value().users++;
+			continue;
+		}
+		JobFile file;
+		if (i >= ownFileCount) {
+			file.hash = includeTree.hashes[i - ownFileCount];
+		}
+		file.users = 1;
+		jobFiles.insert(files->at(i), file);
+	}
+	foreach (const QString &searchDirectory, searchDirectories) {
+		searchDirectoryUsers[*root + searchDirectory]++;
+	}
+	return workingDirectory;
+}
+void CompilerNetwork::removeJobDirectory(IncomingJob *incoming) {
+	QString root = incoming->getJobDirectory();
+	if (root.isEmpty()) {
+		return;
+	}
+	QStringList unusedDirectories;
+	foreach (const QString &searchDirectory, incoming->getSearchDirectories()) {
+		QHash<QString, unsigned int>::iterator it =
+				searchDirectoryUsers.find(root + searchDirectory);
+		if (it != searchDirectoryUsers.end() && --it.value() == 0) {
+			searchDirectoryUsers.erase(it);
+			unusedDirectories.append(root + searchDirectory);
+		}
+	}
+	foreach (const QString &file, incoming->getJobFiles()) {
+		QHash<QString, JobFile>::iterator it = jobFiles.find(file);
+		if (it != jobFiles.end() && --it.value().users > 0) {
+			continue;
+		}
+		jobFiles.remove(file);
+		QFile::remove(file);
+		unusedDirectories.append(QFileInfo(file).absolutePath());
+	}
+	// Directories are only removed if no other job uses them anymore
+	foreach (QString directory, unusedDirectories) {
+		while (directory.startsWith(root + "/")
+				&& !searchDirectoryUsers.contains(directory)
+				&& QDir().rmdir(directory)) {
+			directory = directory.left(directory.lastIndexOf('/'));
+		}
+	}
+	QDir().rmdir(root);
+}
+void CompilerNetwork::finishDelegatedJob(OutgoingJob *outgoing, int returnValue,
+		const QByteArray &stdout, const QByteArray &stderr) {
+	Job *job = outgoing->getJob();
+	// Finish job
+	job->setFinished(returnValue, stdout, stderr);
+	if (returnValue == 0 && !outgoing->getDebugInfoFile().isEmpty()) {
+		DebugInfoRequest *request = new DebugInfoRequest;
+		request->node = outgoing->getTargetPeer();
+		request->id = outgoing->getId();
+		request->fileName = outgoing->getDebugInfoFile();
+		queuedDebugInfoRequests.append(request);
+		requestDebugInfo(request->node);
+	}
+	// Delete the job
+	job->setOutgoingJob(NULL);
+	delegatedJobs.remove(JobKey(outgoing->getTargetPeer(), outgoing->getId()));
+	qDebug("Job finished (id: %d), %d delegated jobs remaining.", outgoing->getId(),
+		delegatedJobs.size());
+	delete outgoing;
+	delete job;
+}
+
+void CompilerNetwork::checkIncomingBulkJob(IncomingBulkJob *bulkJob) {
+	if (bulkJob->writingFiles) {
+		return;
+	}
+	if (!bulkJob->inputComplete) {
+		QStringList receivedFiles;
+		if (!takeReceivedBulkFiles(bulkJob->source, BulkFileKind::JobInput,
+				bulkJob->id, bulkJob->fileCount, &receivedFiles)) {
 			return;
 		}
+		// Move the files to the places where the job expects them
+		for (int i = 0; i < receivedFiles.size(); i++) {
+			InputOutputFilePair filePair(".c", ".o");
+			bulkJob->inputFiles.append(filePair.getInputFilename());
+			bulkJob->outputFiles.append(filePair.getOutputFilename());
+			if (!moveFile(receivedFiles[i], filePair.getInputFilename())) {
+				qFatal("Could not move received input file.");
+			}
+		}
+		bulkJob->inputComplete = true;
 	}
-	qWarning("onAbortJob(): Invalid job id.");
+	// Jobs which are preprocessed here wait for the headers as well
+	if (bulkJob->preprocess && !hasHeaders(bulkJob->includeTree)) {
+		return;
+	}
+	incomingBulkJobs.remove(JobKey(bulkJob->source, bulkJob->id));
+	startIncomingJob(bulkJob);
+	delete bulkJob;
+}
+void CompilerNetwork::checkBulkJobResult(BulkJobResult *result) {
+	if (result->writingFiles) {
+		return;
+	}
+	OutgoingJob *outgoing = result->outgoing;
+	QStringList receivedFiles;
+	if (!takeReceivedBulkFiles(outgoing->getTargetPeer(), BulkFileKind::JobOutput,
+			outgoing->getId(), result->fileCount, &receivedFiles)) {
+		return;
+	}
+	bulkJobResults.remove(JobKey(outgoing->getTargetPeer(), outgoing->getId()));
+	// Move the output files to their final location
+	Job *job = outgoing->getJob();
+	// Jobs which the other peer preprocesses return the dependency file too
+	QStringList outputFiles = job->getRemoteOutputFiles();
+	if (receivedFiles.size() > outputFiles.size()) {
+		qWarning("checkBulkJobResult(): Received too many output files.");
+	}
+	for (int i = 0; i < receivedFiles.size(); i++) {
+		if (i >= outputFiles.size()) {
+			QFile::remove(receivedFiles[i]);
+			continue;
+		}
+		// LTRANS calls use absolute output file names
+		QString outputFile = QDir(job->getWorkingDirectory())
+				.absoluteFilePath(outputFiles[i]);
+		if (!moveFile(receivedFiles[i], outputFile)) {
+			qWarning("Could not open output file.");
+			result->stderr.append(QString("\nddcn: Could not open output file.").toAscii());
+			if (result->returnValue == 0) {
+				result->returnValue = -1;
+			}
+		}
+	}
+	finishDelegatedJob(outgoing, result->returnValue, result->stdout, result->stderr);
+	delete result;
+}
+void CompilerNetwork::removeBulkJobResult(OutgoingJob *outgoing) {
+	delete bulkJobResults.take(JobKey(outgoing->getTargetPeer(), outgoing->getId()));
+}
+bool CompilerNetwork::takeReceivedBulkFiles(NetworkNode *node, int kind,
+		unsigned int id, unsigned int count, QStringList *files) {
+	JobKey key(node, id);
+	// Sort the files by their index, the channel does not guarantee any order
+	// between different jobs
+	QStringList sortedFiles;
+	for (unsigned int i = 0; i < count; i++) {
+		sortedFiles.append(QString());
+	}
+	unsigned int fileCount = 0;
+	foreach (const ReceivedBulkFile &file, receivedBulkFiles.values(key)) {
+		if (file.kind == kind && file.index < count
+				&& sortedFiles[file.index].isEmpty()) {
+			sortedFiles[file.index] = file.fileName;
+			fileCount++;
+		}
+	}
+	if (fileCount < count) {
+		return false;
+	}
+	QMultiHash<JobKey, ReceivedBulkFile>::iterator it = receivedBulkFiles.find(key);
+	while (it != receivedBulkFiles.end() && it.key() == key) {
+		if (it.value().kind == kind) {
+			if (!sortedFiles.contains(it.value().fileName)) {
+				// Duplicate or invalid index
+				QFile::remove(it.value().fileName);
+			}
+			it = receivedBulkFiles.erase(it);
+		} else {
+			++it;
+		}
+	}
+	*files = sortedFiles;
+	return true;
+}
+void CompilerNetwork::removeReceivedBulkFiles(NetworkNode *node, int kind,
+		unsigned int id) {
+	JobKey key(node, id);
+	QMultiHash<JobKey, ReceivedBulkFile>::iterator it = receivedBulkFiles.find(key);
+	while (it != receivedBulkFiles.end() && it.key() == key) {
+		if (it.value().kind == kind) {
+			QFile::remove(it.value().fileName);
+			it = receivedBulkFiles.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+void CompilerNetwork::removeReceivedBulkFiles(NetworkNode *node) {
+	QMultiHash<JobKey, ReceivedBulkFile>::iterator it = receivedBulkFiles.begin();
+	while (it != receivedBulkFiles.end()) {
+		if (it.key().node == node) {
+			QFile::remove(it.value().fileName);
+			it = receivedBulkFiles.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void CompilerNetwork::watchFileTask(const QFuture<JobFileTask> &future) {
+	QFutureWatcher<JobFileTask> *watcher = new QFutureWatcher<JobFileTask>(this);
+	connect(watcher, SIGNAL(finished()), this, SLOT(onFileTaskFinished()));
+	watcher->setFuture(future);
+}
+void CompilerNetwork::onFileTaskFinished() {
+	QFutureWatcher<JobFileTask> *watcher = static_cast<QFutureWatcher<JobFileTask>*>(sender());
+	JobFileTask task = watcher->result();
+	watcher->deleteLater();
+	switch (task.type) {
+		case JobFileTask::Type::SendJobData:
+			onJobDataCreated(task);
+			break;
+		case JobFileTask::Type::WriteInputFiles:
+			onInputFilesWritten(task);
+			break;
+		case JobFileTask::Type::WriteOutputFiles:
+			onOutputFilesWritten(task);
+			break;
+		case JobFileTask::Type::SendJobResult:
+			onJobFinishedCreated(task);
+			break;
+		case JobFileTask::Type::CompressDebugInfo:
+			onDebugInfoCompressed(task);
+			break;
+		case JobFileTask::Type::WriteDebugInfo:
+			onDebugInfoWritten(task);
+			break;
+	}
+}
+void CompilerNetwork::onJobDataCreated(const JobFileTask &task) {
+	// The job might have been cancelled in the meantime
+	if (!delegatedJobs.contains(JobKey(task.node, task.id))) {
+		return;
+	}
+	qDebug("Outgoing job size: %d bytes", task.packet.getPayloadSize());
+	network->send(task.node, task.packet);
+}
+void CompilerNetwork::onInputFilesWritten(const JobFileTask &task) {
+	IncomingBulkJob *bulkJob = incomingBulkJobs.value(JobKey(task.node, task.id), NULL);
+	if (!bulkJob) {
+		// The job was aborted in the meantime
+		foreach (QString fileName, task.inputFiles + task.outputFiles) {
+			QFile::remove(fileName);
+		}
+		return;
+	}
+	bulkJob->writingFiles = false;
+	bulkJob->inputComplete = true;
+	bulkJob->inputFiles = task.inputFiles;
+	bulkJob->outputFiles = task.outputFiles;
+	checkIncomingBulkJob(bulkJob);
+}
+void CompilerNetwork::onOutputFilesWritten(const JobFileTask &task) {
+	BulkJobResult *result = bulkJobResults.take(JobKey(task.node, task.id));
+	if (!result) {
+		// The job was cancelled because the peer disconnected
+		return;
+	}
+	if (!task.success) {
+		result->stderr.append(task.errors);
+		if (result->returnValue == 0) {
+			result->returnValue = -1;
+		}
+	}
+	finishDelegatedJob(result->outgoing, result->returnValue, result->stdout,
+		result->stderr);
+	delete result;
+}
+void CompilerNetwork::onJobFinishedCreated(const JobFileTask &task) {
+	// Do not send anything if the peer has disconnected in the meantime
+	if (!pendingJobResults.remove(JobKey(task.node, task.id))) {
+		return;
+	}
+	network->send(task.node, task.packet);
+}
+void CompilerNetwork::onDebugInfoCompressed(const JobFileTask &task) {
+	QString fileName = task.outputFiles[0];
+	// The peer might have disconnected in the meantime
+	if (!compressingDebugInfo.remove(JobKey(task.node, task.id))) {
+		QFile::remove(fileName);
+		return;
+	}
+	BulkChannel *bulkChannel = task.node->getBulkChannel();
+	if (!task.success) {
+		qWarning("onDebugInfoCompressed(): Could not compress the .dwo file.");
+		QFile::remove(fileName);
+	} else if (!bulkChannel || !bulkChannel->isReady()) {
+		qWarning("onDebugInfoCompressed(): No bulk channel available.");
+		QFile::remove(fileName);
+	} else if (!bulkChannel->sendFile(BulkFileKind::DebugInfo, task.id, 0,
+			fileName, true)) {
+		qWarning("onDebugInfoCompressed(): Could not send the .dwo file.");
+		QFile::remove(fileName);
+	}
+}
+void CompilerNetwork::onDebugInfoWritten(const JobFileTask &task) {
+	if (!task.success) {
+		qWarning("Could not write %s (%s), the object has no debug information.",
+				task.outputFiles[0].toAscii().data(), task.errors.data());
+	}
+}
+
+void CompilerNetwork::startReconfiguration() {
+	if (!reconfigurationTimer.isActive()) {
+		reconfigurationTimer.start(5000);
+	}
+	// Apply the changes immediately if possible
+	onReconfigurationTimeout();
+}
+bool CompilerNetwork::isIdle() {
+	foreach (WaitingJobQueue *queue, waitingQueues) {
+		if (!queue->acceptedRequests.empty()) {
+			return false;
+		}
+	}
+	return delegatedJobs.empty() && incomingJobs.empty()
+			&& outgoingJobRequests.empty() && incomingJobRequests.empty()
+			&& incomingBulkJobs.empty() && pendingJobResults.empty();
+}
+bool CompilerNetwork::isNodeBusy(NetworkNode *node) {
+	foreach (OutgoingJob *outgoing, delegatedJobs) {
+		if (outgoing->getTargetPeer() == node) {
+			return true;
+		}
+	}
+	foreach (IncomingJob *incoming, incomingJobs) {
+		if (incoming->getSourcePeer() == node) {
+			return true;
+		}
+	}
+	foreach (OutgoingJobRequest *request, outgoingJobRequests) {
+		if (request->target == node) {
+			return true;
+		}
+	}
+	foreach (WaitingJobQueue *queue, waitingQueues) {
+		foreach (OutgoingJobRequest *request, queue->acceptedRequests) {
+			if (request->target == node) {
+				return true;
+			}
+		}
+	}
+	foreach (IncomingJobRequest *request, incomingJobRequests) {
+		if (request->source == node) {
+			return true;
+		}
+	}
+	foreach (IncomingBulkJob *bulkJob, incomingBulkJobs) {
+		if (bulkJob->source == node) {
+			return true;
+		}
+	}
+	foreach (const JobKey &key, pendingJobResults) {
+		if (key.node == node) {
+			return true;
+		}
+	}
+	foreach (const JobKey &key, compressingDebugInfo) {
+		if (key.node == node) {
+			return true;
+		}
+	}
+	return false;
 }
 
+WaitingJobQueue *CompilerNetwork::getWaitingQueue(const ToolChain &toolChain) {
+	QString identity = toolChain.getIdentity();
+	WaitingJobQueue *queue = waitingQueues.value(identity);
+	if (!queue) {
+		// Queues are kept once created, there usually are only a few
+		// toolchains in use
+		queue = new WaitingJobQueue;
+		queue->toolChain = toolChain;
+		waitingQueues.insert(identity, queue);
+	}
+	return queue;
+}
 void CompilerNetwork::addWaitingJob(Job *job) {
+	WaitingJobQueue *queue = getWaitingQueue(job->getToolchain());
 	if (job->wasPreprocessed()) {
-		waitingPreprocessedJobs.append(job);
+		queue->preprocessed.append(job);
 	} else if (job->isPreprocessing()) {
 		// We do not need to connect to the preprocessingFinished() signal as
 		// we are already connected to it, CompilerNetwork started preprocessing
 		// anyways
-		waitingPreprocessingJobs.append(job);
+		queue->preprocessing.append(job);
 	} else {
-		waitingJobs.append(job);
+		queue->waiting.append(job);
 	}
 }
 Job *CompilerNetwork::removeWaitingJob() {
+	// Take the job from the largest queue as the others are more likely to
+	// get remote slots for all their jobs
+	WaitingJobQueue *queue = NULL;
+	foreach (WaitingJobQueue *candidate, waitingQueues) {
+		if (candidate->size() > 0 && (!queue || candidate->size() > queue->size())) {
+			queue = candidate;
+		}
+	}
+	if (!queue) {
+		return NULL;
+	}
 	// Prefer to pick a job from one of the lists where little work has already
 	// been done
-	if (!waitingJobs.empty()) {
-		Job *job = waitingJobs.last();
-		waitingJobs.removeLast();
-		return job;
-	} else if (!waitingPreprocessingJobs.empty()) {
-		Job *job = waitingPreprocessingJobs.last();
-		waitingPreprocessingJobs.removeLast();
-		return job;
-	} else if (!waitingPreprocessedJobs.empty()) {
-		Job *job = waitingPreprocessedJobs.last();
-		waitingPreprocessedJobs.removeLast();
-		return job;
+	Job *job;
+	if (!queue->waiting.empty()) {
+		job = queue->waiting.takeLast();
+	} else if (!queue->preprocessing.empty()) {
+		job = queue->preprocessing.takeLast();
 	} else {
-		return NULL;
-	}
-}
-Job *CompilerNetwork::removePreprocessedWaitingJob() {
-	if (waitingPreprocessedJobs.empty()) {
-		return NULL;
+		job = queue->preprocessed.takeLast();
 	}
-	Job *job = waitingPreprocessedJobs.last();
-	waitingPreprocessedJobs.removeLast();
+	dropAcceptedRequests(queue);
 	return job;
 }
 unsigned int CompilerNetwork::getWaitingJobCount() {
-	return waitingJobs.count() + waitingPreprocessedJobs.count()
-			+ waitingPreprocessingJobs.count();
-}
-unsigned int CompilerNetwork::getPreprocessingWaitingJobCount() {
-	return waitingPreprocessedJobs.size();
-}
-unsigned int CompilerNetwork::getPreprocessedWaitingJobCount() {
-	return waitingPreprocessedJobs.size();
+	unsigned int count = 0;
+	foreach (WaitingJobQueue *queue, waitingQueues) {
+		count += queue->size();
+	}
+	return count;
 }
 
-void CompilerNetwork::preprocessWaitingJob() {
+void CompilerNetwork::preprocessWaitingJob(WaitingJobQueue *queue) {
 	qDebug("preprocessWaitingJob");
-	if (waitingJobs.empty()) {
+	if (queue->waiting.empty()) {
 		// This should not happen, should be checked in createJobRequests()
 		qCritical("preprocessWaitingJob() called without unpreprocessed waiting jobs!");
 		return;
 	}
 	// We pick the first job because it has been waiting for the longest time
 	// to avoid timeouts
-	Job *job = waitingJobs.first();
-	waitingJobs.removeFirst();
-	waitingPreprocessingJobs.append(job);
+	Job *job = queue->waiting.takeFirst();
+	queue->preprocessing.append(job);
 	// Start preprocessing
 	connect(job, SIGNAL(preprocessingFinished(Job*)),
 			this, SLOT(onPreprocessingFinished(Job*)));
 	job->preProcess();
 }
+void CompilerNetwork::dropAcceptedRequests(WaitingJobQueue *queue) {
+	// Accepted requests only wait for jobs which are being preprocessed
+	while (queue->acceptedRequests.size() > queue->preprocessing.size()) {
+		delete queue->acceptedRequests.takeLast();
+	}
+}
 
 void CompilerNetwork::delegateJob(Job *job, OutgoingJobRequest *request) {
 	qDebug("delegateJob");
-	// Collect input data
+	// Collect input data - if there is a bulk channel to the peer, the files
+	// are sent directly from disk over it instead of being embedded into the
+	// packet
 	QStringList inputFiles = job->getPreprocessedFiles();
-	QList<QByteArray> fileContent;
-	foreach (QString fileName, inputFiles) {
-		QFile file(fileName);
-		if (!file.open(QIODevice::ReadOnly)) {
-			qFatal("Could not open previously created temporary file.");
-		}
-		if (compressionEnabled) {
-			fileContent.append(qCompress(file.readAll()));
-		} else {
-			fileContent.append(file.readAll());
-		}
-	}
-	// Get parameters
+	BulkChannel *bulkChannel = request->target->getBulkChannel();
+	// Get parameters - jobs which the other peer preprocesses get their
+	// search path from the include tree
 	QStringList compilerParameters = job->getCompilerParameters();
+	if (job->isPreprocessedRemotely()) {
+		compilerParameters = job->getRemotePreprocessingParameters();
+	}
 	ToolChain toolchain = job->getToolchain();
 	// Create job data packet
 	QByteArray packetData;
 	QDataStream stream(&packetData, QIODevice::WriteOnly);
 	stream << qToBigEndian(request->id);
-	stream << toolchain.getVersion();
+	stream << toolchain.getIdentity();
 	stream << job->getLanguage();
+	// With split DWARF, only the skeleton object is returned with the result
+	// and the .dwo file is fetched afterwards over the bulk channel
+	QString debugInfoName;
+	if (splitDwarf && bulkChannel) {
+		debugInfoName = getDebugInfoName(job);
+	}
+	// Without a fixed seed, gcc generates random symbol names (e.g., for LTO
+	// sections), so the objects would differ between runs
+	if (job->getOutputFiles().size() == 1
+			&& !hasOption(compilerParameters, "-frandom-seed")) {
+		compilerParameters.append("-frandom-seed=" + job->getOutputFiles()[0]);
+	}
 	stream << compilerParameters;
-	stream << compressionEnabled;
-	stream << fileContent;
-	Packet packet = Packet::fromData(PacketType::JobData, packetData);
-	qDebug("Outgoing job size: %d bytes", packetData.size());
-	network->send(request->target, packet);
+	// Peers without a compatible toolchain can request this package, LTRANS
+	// jobs need lto1 which is not contained in the packages though
+	if (compilerParameters.contains("-fltrans")) {
+		stream << QString();
+	} else {
+		stream << toolChainPackages->getPackageHash(toolchain);
+	}
+	// Peers which do not have the precompiled header yet can request it
+	QString headerHash;
+	if (!job->getPrecompiledHeader().isEmpty()) {
+		headerHash = precompiledHeaders->getHash(job->getPrecompiledHeader());
+	}
+	stream << headerHash;
+	// The other peer compiles the files at the same paths so that the paths
+	// in the debug information match those of a local build
+	stream << QDir(job->getWorkingDirectory()).absolutePath();
+	stream << job->getInputFiles();
+	stream << debugInfoName;
+	stream << job->isPreprocessedRemotely();
+	stream << job->getIncludeTree();
+	if (bulkChannel) {
+		stream << true;
+		stream << (unsigned int)inputFiles.size();
+		Packet packet = Packet::fromData(PacketType::JobData, packetData);
+		network->send(request->target, packet);
+		for (int i = 0; i < inputFiles.size(); i++) {
+			if (!bulkChannel->sendFile(BulkFileKind::JobInput, request->id, i,
+					inputFiles[i], false)) {
+				qFatal("Could not open previously created temporary file.");
+			}
+		}
+	} else {
+		stream << false;
+		stream << compressionEnabled;
+		// Reading and compressing the files is done in the thread pool, the
+		// packet is sent in onJobDataCreated()
+		JobFileTask task(JobFileTask::Type::SendJobData, request->target, request->id);
+		task.inputFiles = inputFiles;
+		watchFileTask(QtConcurrent::run(JobFileTask::createJobData, task,
+			packetData, compressionEnabled));
+	}
 	// Store outgoing job info
 	OutgoingJob *outgoing = new OutgoingJob(request->target, job, request->id);
-	connect(&outgoing->getTimer(), SIGNAL(timeout()), this, SLOT(onOutgoingJobTimeout()));
-	outgoing->getTimer().setSingleShot(true);
-	outgoing->getTimer().start(60000);
+	timeouts.start(&outgoing->getTimeout(), 60000, TimeoutType::OutgoingJob, outgoing);
+	if (!debugInfoName.isEmpty()) {
+		outgoing->setDebugInfoFile(
+				QDir(job->getWorkingDirectory()).absoluteFilePath(debugInfoName));
+	}
 	job->setOutgoingJob(outgoing);
-	delegatedJobs.append(outgoing);
+	delegatedJobs.insert(JobKey(outgoing->getTargetPeer(), outgoing->getId()), outgoing);
 	qDebug("Delegated job (id: %d)", outgoing->getId());
 }
@@ -36,9 +36,24 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "NodeStatus.h"
 #include "IncomingJob.h"
 #include "JobRequest.h"
+#include "BulkJob.h"
+#include "JobKey.h"
+#include "TimerWheel.h"
+#include "JobFileTask.h"
 #include "ToolChain.h"
+#include "ToolChainPackageStore.h"
+#include "PrecompiledHeaderStore.h"
+#include "HeaderStore.h"
+#include "IncludeScanner.h"
+#include "ToolChainIndex.h"
 
 #include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QFuture>
+#include <QTimer>
+#include <QTime>
 
 /**
  * Contains the number of free remote slots after the network node has adverised
@@ -47,7 +62,19 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 struct FreeCompilerSlots {
 	NetworkNode *node;
 	unsigned int slotCount;
-	QStringList toolChainVersions;
+	/**
+	 * Interned ids of the toolchains advertised by the peer.
+	 */
+	QList<int> toolChainIds;
+	/**
+	 * Local toolchains whose jobs the peer can compile, see ToolChainIndex.
+	 */
+	QBitArray capabilities;
+	/**
+	 * True if the peer accepts toolchain packages for jobs with toolchains it
+	 * does not have.
+	 */
+	bool acceptsPackages;
 };
 
 /**
@@ -63,27 +90,38 @@ public:
 	}
 
 	/**
-	 * Appends a number of free remote slots to the list.
+	 * Appends a number of free remote slots to the list. An offer replaces
+	 * all earlier offers of the same peer as it contains the current number
+	 * of free slots on the peer.
 	 */
 	void append(const FreeCompilerSlots &freeSlots);
 	/**
 	 * Pops a random free remote slot from the list whose toolchain is
 	 * compatible to this toolchain version.
 	 *
-	 * This removes free slots with an incompatible toolchain from the list if
-	 * it encounters them.
+	 * Slots with other toolchains are kept in the list as they can still be
+	 * used for jobs of other toolchains. Slots of congested peers are
+	 * skipped.
 	 *
-	 * @param toolChain Tool chain version which has to be supported.
+	 * @param toolChain Position of the local toolchain of the job in the
+	 * toolchain list (see ToolChainIndex::getLocalIndex()).
+	 * @param shippable True if a package for the toolchain can be sent to
+	 * peers which accept packages.
 	 * @return NetworkNode which has had a free remote slot available. Might be
 	 * NULL if no slot was found.
 	 */
-	NetworkNode *removeFirst(QString toolChain);
+	NetworkNode *removeFirst(int toolChain, bool shippable = false);
 
 	/**
 	 * Removes all slots advertised by a certain node, e.g. when the node
 	 * disconnects.
 	 */
 	void removeAll(NetworkNode *node);
+	/**
+	 * Recomputes the capabilities of all slots after the local toolchains
+	 * have changed.
+	 */
+	void updateCapabilities(ToolChainIndex &index);
 
 	/**
 	 * Returns the overall number of free remove slots in the list.
@@ -91,6 +129,14 @@ public:
 	unsigned int getFreeSlotCount() {
 		return freeSlotCount;
 	}
+	/**
+	 * Returns the number of free remote slots which can be used for jobs of
+	 * a certain toolchain.
+	 *
+	 * @param toolChain Position of the local toolchain in the toolchain list.
+	 * @param shippable True if a package for the toolchain can be sent.
+	 */
+	unsigned int getFreeSlotCount(int toolChain, bool shippable);
 	/**
 	 * Returns the number of slots after the last call to append(). This is used
 	 * to compute the amount of slots used after this peer has received the last
@@ -101,13 +147,56 @@ public:
 		return maxFreeSlotCount;
 	}
 private:
-	static bool isCompatible(QString toolChain, FreeCompilerSlots &freeSlots);
+	static bool isCompatible(int toolChain, bool shippable,
+			FreeCompilerSlots &freeSlots) {
+		return (toolChain >= 0 && toolChain < freeSlots.capabilities.size()
+				&& freeSlots.capabilities.testBit(toolChain))
+				|| (shippable && freeSlots.acceptsPackages);
+	}
+	/**
+	 * Returns true if the slots cannot be used for any local toolchain.
+	 */
+	static bool isUseless(const FreeCompilerSlots &freeSlots) {
+		return !freeSlots.acceptsPackages
+				&& freeSlots.capabilities.count(true) == 0;
+	}
 
 	QList<FreeCompilerSlots> slotList;
 	unsigned int freeSlotCount;
 	unsigned int maxFreeSlotCount;
 };
 
+/**
+ * Contains the local jobs of one toolchain which are waiting for a remote
+ * slot. Jobs only move from one list to the next while they are preprocessed,
+ * so that jobs of one toolchain never end up in the remote slot which has been
+ * requested for another toolchain.
+ */
+struct WaitingJobQueue {
+	ToolChain toolChain;
+	/**
+	 * Jobs which have not been preprocessed yet.
+	 */
+	QList<Job*> waiting;
+	/**
+	 * Jobs which are currently being preprocessed.
+	 */
+	QList<Job*> preprocessing;
+	/**
+	 * Jobs which can be sent to other peers immediately.
+	 */
+	QList<Job*> preprocessed;
+	/**
+	 * Job requests which have been accepted by other peers while no job of
+	 * the queue was preprocessed yet.
+	 */
+	QList<OutgoingJobRequest*> acceptedRequests;
+
+	unsigned int size() const {
+		return waiting.size() + preprocessing.size() + preprocessed.size();
+	}
+};
+
 /**
  * Class which communicates with peers in the compiler network and receives
  * and sends compiler jobs.
@@ -156,18 +245,39 @@ public:
 	 * @return True if outgoing text fules are sent compressed.
 	 */
 	bool getCompression();
+	/**
+	 * Sets whether connections to other peers have to be encrypted. If
+	 * disabled, connections to peers which have disabled encryption as well
+	 * are only authenticated. Bulk channels are encrypted either way. This
+	 * only saves CPU time on CPUs without AES instructions and should only be
+	 * used in fully trusted networks. The setting is stored in
+	 * "network/encryption" and only affects new connections.
+	 * @param encryptionEnabled False if connections may be unencrypted.
+	 */
+	void setEncryption(bool encryptionEnabled);
+	/**
+	 * Returns whether connections to other peers have to be encrypted.
+	 * @return True if encryption is required.
+	 */
+	bool getEncryption();
 
 	/**
 	 * Sets the private key of the local node.
 	 * This key is used to authenticate this peer at other peers.
 	 *
-	 * @note This causes all connections to drop as their key are invalidated.
+	 * New connections use the new key immediately. Existing connections are
+	 * closed and recreated as soon as no jobs are running on them, or at the
+	 * latest after the grace period set in "network/key_rotation_grace_period"
+	 * (in seconds).
 	 * @param privateKey New private key for this peer.
 	 */
 	void setLocalKey(const PrivateKey &privateKey);
 	/**
-	 * Automatically generates a new RSA private key for this network node.
-	 * @param keyLength The key length in bits of the new key.
+	 * Automatically generates a new private key for this network node. The
+	 * key has the same type as the one created on the first start (see
+	 * PrivateKey::getDefaultType()).
+	 * @param keyLength The key length in bits of the new key, only used if
+	 * the OpenSSL version in use only supports RSA keys.
 	 */
 	void generateLocalKey(int keyLength);
 	/**
@@ -182,7 +292,8 @@ public:
 	 * The format is the one documented at
 	 * http://www.ariba-underlay.org/wiki/Documentation/Configuration
 	 *
-	 * @note This causes all connections to drop as ariba is reinitialized.
+	 * New hints are passed to the running ariba instance, existing
+	 * connections are not affected.
 	 * @param bootstrapHints New bootstrap hints.
 	 */
 	void setBootstrapHints(const QString &bootstrapHints);
@@ -199,7 +310,11 @@ public:
 	 * The format is the one documented at
 	 * http://www.ariba-underlay.org/wiki/Documentation/Configuration
 	 *
-	 * @note This causes all connections to drop as ariba is reinitialized.
+	 * @note Ariba cannot change its endpoints at runtime, so this causes all
+	 * connections to drop as ariba is reinitialized. This is delayed until no
+	 * jobs are delegated to or received from other peers, or at the latest
+	 * until the grace period set in "network/endpoint_grace_period" (in
+	 * seconds) has passed.
 	 * @param bootstrapHints New endpoints.
 	 */
 	void setEndpoints(const QString &endpoints);
@@ -252,6 +367,37 @@ public:
 
 	void setFreeLocalSlots(unsigned int localSlots);
 	unsigned int getFreeLocalSlots();
+	/**
+	 * Returns the number of jobs which can currently be executed by other
+	 * peers, that is, the free slots advertised by other peers plus the
+	 * slots which have already been requested or are executing one of our
+	 * jobs.
+	 */
+	unsigned int getRemoteCapacity() {
+		return freeRemoteSlots.getFreeSlotCount() + outgoingJobRequests.count()
+			+ delegatedJobs.count();
+	}
+	/**
+	 * Returns the store which manages the precompiled headers used by local
+	 * and incoming jobs.
+	 */
+	PrecompiledHeaderStore *getPrecompiledHeaders() {
+		return precompiledHeaders;
+	}
+	/**
+	 * Returns the store which manages the headers of jobs which are
+	 * preprocessed by the peer compiling them.
+	 */
+	HeaderStore *getHeaders() {
+		return headers;
+	}
+	/**
+	 * Returns the scanner which collects the headers of local jobs which are
+	 * preprocessed remotely.
+	 */
+	IncludeScanner *getIncludeScanner() {
+		return includeScanner;
+	}
 
 	/**
 	 * Asks all connected peers in the network for their identity, load and
@@ -270,9 +416,7 @@ public:
 	/**
 	 * Updates the list of the toolchains this node supports.
 	 */
-	void setToolChains(QList<ToolChain> toolChains) {
-		this->toolChains = toolChains;
-	}
+	void setToolChains(QList<ToolChain> toolChains);
 
 	/**
 	 * Updates the statistics which are sent out when another peer queries the
@@ -285,17 +429,25 @@ public:
 private slots:
 	void onPeerConnected(NetworkNode *node);
 	void onPeerDisconnected(NetworkNode *node);
+	void onPeerCongestionChanged(NetworkNode *node, bool congested);
 	void onMessageReceived(NetworkNode *node, const Packet &packet);
 	void onGroupMessageReceived(McpoGroup *group, NetworkNode *node,
 		const Packet &packet);
 
 	void onPreprocessingFinished(Job *job);
-	void onOutgoingJobRequestTimeout();
-	void onOutgoingJobTimeout();
-	void onIncomingJobRequestTimeout();
+	void onTimeout(int type, void *owner);
+	void onReconfigurationTimeout();
+
+	void onBulkFileReceived(NetworkNode *node, int kind, unsigned int transferId,
+		unsigned int index, const QString &fileName);
+	void onBulkFileOffered(NetworkNode *node, int kind, unsigned int transferId,
+		unsigned int index, quint64 size, bool *accept);
+
+	void onFileTaskFinished();
 signals:
 	void peerNameChanged(QString peerName);
 	void compressionChanged(bool compressionEnabled);
+	void encryptionChanged(bool encryptionEnabled);
 	void localKeyChanged(const PrivateKey &privateKey);
 	void bootstrapHintsChanged(const QString &bootstrapHints);
 	void endpointsChanged(const QString &endpoints);
@@ -308,6 +460,23 @@ signals:
 			NodeStatus nodeStatus, QStringList groupNames, QStringList groupKeys);
 	void outgoingJobCancelled(Job *job);
 private:
+	/**
+	 * Types of the deadlines managed by the timer wheel.
+	 */
+	struct TimeoutType {
+		enum List {
+			OutgoingJobRequest,
+			OutgoingJob,
+			IncomingJobRequest,
+			IncomingBulkJob,
+			ToolChainPackageRequest,
+			PrecompiledHeaderRequest,
+			DebugInfoFile,
+			DebugInfoRequest,
+			HeaderRequest
+		};
+	};
+
 	TrustedPeer *getTrustedPeer(const PublicKey &publicKey);
 	TrustedGroup *getTrustedGroup(const PublicKey &publicKey);
 	GroupMembership *getGroupMembership(const PublicKey &publicKey);
@@ -338,13 +507,104 @@ private:
 	void onJobFinished(NetworkNode *node, const Packet &packet);
 	void onAbortJob(NetworkNode *node, const Packet &packet);
 
+	void onOutgoingJobRequestTimeout(OutgoingJobRequest *request);
+	void onOutgoingJobTimeout(OutgoingJob *outgoing);
+	void onIncomingJobRequestTimeout(IncomingJobRequest *request);
+	void onIncomingBulkJobTimeout(IncomingBulkJob *bulkJob);
+	void onToolChainPackageRequestTimeout(ToolChainPackageRequest *request);
+	void onPrecompiledHeaderRequestTimeout(PrecompiledHeaderRequest *request);
+	void onDebugInfoFileTimeout(DebugInfoFile *file);
+	void onDebugInfoRequestTimeout(DebugInfoRequest *request);
+	void onHeaderRequestTimeout(HeaderRequest *request);
+
+	void onToolChainPackageRequest(NetworkNode *node, const Packet &packet);
+	void requestToolChainPackage(NetworkNode *node, const QString &hash);
+	void onPrecompiledHeaderRequest(NetworkNode *node, const Packet &packet);
+	void requestPrecompiledHeader(NetworkNode *node, const QString &hash);
+	void onDebugInfoRequest(NetworkNode *node, const Packet &packet);
+	/**
+	 * Sends the next queued DebugInfoRequest to a peer unless the .dwo file
+	 * of another job is still being transferred from it.
+	 */
+	void requestDebugInfo(NetworkNode *node);
+	/**
+	 * Keeps the .dwo file of a finished incoming job until it is requested,
+	 * or removes it if the job failed.
+	 */
+	void storeDebugInfo(IncomingJob *incoming, bool success);
+	void onHeaderRequest(NetworkNode *node, const Packet &packet);
+	/**
+	 * Requests the missing headers of the jobs from a peer which are
+	 * preprocessed here unless headers are still being transferred from it.
+	 */
+	void requestHeaders(NetworkNode *node);
+	/**
+	 * Returns true if all headers of a job which is preprocessed here have
+	 * been received.
+	 */
+	bool hasHeaders(const IncludeTree &includeTree);
+	void removeHeaderRequest(HeaderRequest *request);
+	/**
+	 * Starts the jobs which have received all their headers and requests
+	 * the headers of the others.
+	 */
+	void checkHeaderJobs();
+	/**
+	 * Creates the directories for an incoming job which mirror the paths on
+	 * the source peer below a common root and moves the input file there.
+	 * Jobs share the tree as long as their file names do not collide, so the
+	 * paths and thereby the output do not depend on the job. The headers of
+	 * jobs which are preprocessed here are linked into the tree as well and
+	 * are shared by all jobs which use the same version of the header.
+	 * @return the working directory of the job, or "" if the paths cannot be
+	 * mirrored.
+	 */
+	QString createJobDirectory(const QString &sourceDirectory,
+		const QStringList &sourceFiles, const QStringList &inputFiles,
+		const QString &debugInfoName, const IncludeTree &includeTree,
+		QString *root, QStringList *files);
+	/**
+	 * Removes the files and directories created by createJobDirectory().
+	 */
+	void removeJobDirectory(IncomingJob *incoming);
+
+	void startIncomingJob(const IncomingBulkJob *bulkJob);
+	void finishDelegatedJob(OutgoingJob *outgoing, int returnValue,
+		const QByteArray &stdout, const QByteArray &stderr);
+	void checkIncomingBulkJob(IncomingBulkJob *bulkJob);
+	void checkBulkJobResult(BulkJobResult *result);
+	void removeBulkJobResult(OutgoingJob *outgoing);
+	bool takeReceivedBulkFiles(NetworkNode *node, int kind, unsigned int id,
+		unsigned int count, QStringList *files);
+	void removeReceivedBulkFiles(NetworkNode *node, int kind, unsigned int id);
+	void removeReceivedBulkFiles(NetworkNode *node);
+
+	/**
+	 * Calls onFileTaskFinished() once the task running in the thread pool
+	 * is done.
+	 */
+	void watchFileTask(const QFuture<JobFileTask> &future);
+	void onJobDataCreated(const JobFileTask &task);
+	void onInputFilesWritten(const JobFileTask &task);
+	void onOutputFilesWritten(const JobFileTask &task);
+	void onJobFinishedCreated(const JobFileTask &task);
+	void onDebugInfoCompressed(const JobFileTask &task);
+	void onDebugInfoWritten(const JobFileTask &task);
+
+	void startReconfiguration();
+	bool isIdle();
+	bool isNodeBusy(NetworkNode *node);
+
+	WaitingJobQueue *getWaitingQueue(const ToolChain &toolChain);
 	void addWaitingJob(Job *job);
 	Job *removeWaitingJob();
-	Job *removePreprocessedWaitingJob();
 	unsigned int getWaitingJobCount();
-	unsigned int getPreprocessingWaitingJobCount();
-	unsigned int getPreprocessedWaitingJobCount();
-	void preprocessWaitingJob();
+	void preprocessWaitingJob(WaitingJobQueue *queue);
+	/**
+	 * Drops the accepted job requests of a queue which cannot be served
+	 * anymore because the jobs were taken back for local execution.
+	 */
+	void dropAcceptedRequests(WaitingJobQueue *queue);
 
 	void delegateJob(Job *job, OutgoingJobRequest *request);
 
@@ -357,38 +617,129 @@ private:
 	bool compressionEnabled;
 	PrivateKey localKey;
 
-	// TODO: Do we need much lookups here? A hash map then would be faster.
-	// We could need public-key based lookups a lot.
 	QList<TrustedPeer*> trustedPeers;
 	QList<TrustedGroup*> trustedGroups;
 	QList<GroupMembership*> groupMemberships;
+	// Indices for the lists above, every incoming packet from a group or a
+	// peer needs a lookup by key
+	QHash<PublicKey, TrustedPeer*> trustedPeerIndex;
+	QHash<PublicKey, TrustedGroup*> trustedGroupIndex;
+	QHash<PublicKey, GroupMembership*> groupMembershipIndex;
 
 	NetworkInterface *network;
 
-	QList<Job*> waitingJobs;
-	QList<Job*> waitingPreprocessingJobs;
-	QList<Job*> waitingPreprocessedJobs;
+	// Waiting jobs indexed by the identity of their toolchain, every queue
+	// gets remote slots according to its size
+	QMap<QString, WaitingJobQueue*> waitingQueues;
 
 	FreeCompilerSlotList freeRemoteSlots;
 	unsigned int freeLocalSlots;
 
-	QList<OutgoingJob*> delegatedJobs;
+	// All jobs and job requests which are exchanged with other peers are
+	// indexed by the peer and the job id as every packet refers to them
+	QHash<JobKey, OutgoingJob*> delegatedJobs;
 
-	QList<OutgoingJobRequest*> outgoingJobRequests;
-	QList<IncomingJobRequest*> incomingJobRequests;
+	QHash<JobKey, OutgoingJobRequest*> outgoingJobRequests;
+	QHash<JobKey, IncomingJobRequest*> incomingJobRequests;
 
-	QList<OutgoingJobRequest*> acceptedJobRequests;
+	QHash<JobKey, IncomingJob*> incomingJobs;
 
-	QList<IncomingJob*> incomingJobs;
+	// Jobs which are waiting for files from bulk channels
+	QHash<JobKey, IncomingBulkJob*> incomingBulkJobs;
+	QHash<JobKey, BulkJobResult*> bulkJobResults;
+	QMultiHash<JobKey, ReceivedBulkFile> receivedBulkFiles;
+
+	// Results of remote jobs whose JobFinished packet is still being created
+	// in the thread pool
+	QSet<JobKey> pendingJobResults;
+
+	// Timeouts of all jobs and job requests
+	TimerWheel timeouts;
 
 	unsigned int lastJobId;
 
 	QList<ToolChain> toolChains;
+	ToolChainIndex toolChainIndex;
+	ToolChainPackageStore *toolChainPackages;
+	/**
+	 * Toolchain packages which have been requested from other peers.
+	 */
+	QHash<JobKey, ToolChainPackageRequest*> toolChainPackageRequests;
+	PrecompiledHeaderStore *precompiledHeaders;
+	/**
+	 * Precompiled headers which have been requested from other peers.
+	 */
+	QHash<JobKey, PrecompiledHeaderRequest*> precompiledHeaderRequests;
+	/**
+	 * If true, delegated jobs with debug information are compiled with
+	 * -gsplit-dwarf, only the skeleton object is returned with the result.
+	 */
+	bool splitDwarf;
+	/**
+	 * .dwo files of incoming jobs which have not been fetched yet.
+	 */
+	QHash<JobKey, DebugInfoFile*> debugInfoFiles;
+	/**
+	 * Requested .dwo files which are being compressed in the thread pool.
+	 */
+	QSet<JobKey> compressingDebugInfo;
+	/**
+	 * .dwo files which are being fetched from other peers, at most one per
+	 * peer so that they do not delay the input files of other jobs.
+	 */
+	QHash<JobKey, DebugInfoRequest*> debugInfoRequests;
+	/**
+	 * .dwo files which still have to be fetched.
+	 */
+	QList<DebugInfoRequest*> queuedDebugInfoRequests;
+	HeaderStore *headers;
+	IncludeScanner *includeScanner;
+	/**
+	 * Headers which are being fetched from other peers, at most one request
+	 * per peer so that the files of the next request can be opened once
+	 * the previous ones have been sent.
+	 */
+	QHash<JobKey, HeaderRequest*> headerRequests;
+	/**
+	 * Hashes of all headers in headerRequests.
+	 */
+	QSet<QString> requestedHeaders;
+	/**
+	 * Files of incoming jobs within the job directories.
+	 */
+	struct JobFile {
+		/**
+		 * Hash of the content if the file is a header, which can be shared
+		 * by jobs, or "".
+		 */
+		QString hash;
+		unsigned int users;
+	};
+	QHash<QString, JobFile> jobFiles;
+	/**
+	 * Include directories within the job directories and the number of jobs
+	 * using them, they must not be removed while they are in use even if
+	 * they are empty.
+	 */
+	QHash<QString, unsigned int> searchDirectoryUsers;
 
 	QSettings settings;
 
 	BootstrapConfig bootstrapConfig;
 
+	// Settings changes which are applied once the network is idle
+	QTimer reconfigurationTimer;
+	bool restartPending;
+	QTime restartStart;
+	QTime keyRotationStart;
+	bool keyRotationPending;
+	/**
+	 * Nodes which have been told to reconnect with the new key and the time
+	 * when this was done. The links are dropped asynchronously, so this
+	 * prevents reconnecting them again on every timeout.
+	 */
+	QHash<NetworkNode*, QTime> reconnectingNodes;
+
 	// Statistics which are sent with NodeStatus packets
 	unsigned int maxThreads;
 	unsigned int currentThreads;
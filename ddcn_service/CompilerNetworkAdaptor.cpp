@@ -34,6 +34,10 @@ CompilerNetworkAdaptor::CompilerNetworkAdaptor(CompilerNetwork *network)
 	        SIGNAL(peerNameChanged(QString)),
 	        this,
 	        SLOT(onPeerNameChanged(QString)));
+	connect(network,
+	        SIGNAL(encryptionChanged(bool)),
+	        this,
+	        SLOT(onEncryptionChanged(bool)));
 	connect(network,
 	        SIGNAL(localKeyChanged(PrivateKey)),
 	        this,
@@ -78,6 +82,13 @@ bool CompilerNetworkAdaptor::getCompression() {
 	return network->getCompression();
 }
 
+void CompilerNetworkAdaptor::setEncryption(bool encryptionEnabled) {
+	network->setEncryption(encryptionEnabled);
+}
+bool CompilerNetworkAdaptor::getEncryption() {
+	return network->getEncryption();
+}
+
 void CompilerNetworkAdaptor::setLocalKey(QString privateKey) {
 	PrivateKey key = PrivateKey::fromPEM(privateKey);
 	if (!key.isValid()) {
@@ -172,6 +183,9 @@ void CompilerNetworkAdaptor::onPeerNameChanged(QString peerName) {
 void CompilerNetworkAdaptor::onCompressionChanged(bool compressionEnabled) {
 	emit compressionChanged(compressionEnabled);
 }
+void CompilerNetworkAdaptor::onEncryptionChanged(bool encryptionEnabled) {
+	emit encryptionChanged(encryptionEnabled);
+}
 void CompilerNetworkAdaptor::onLocalKeyChanged(const PrivateKey &privateKey) {
 	emit publicKeyChanged(PublicKey(privateKey).toPEM());
 }
@@ -55,6 +55,9 @@ public slots:
 	void setCompression(bool compressionEnabled);
 	bool getCompression();
 
+	void setEncryption(bool encryptionEnabled);
+	bool getEncryption();
+
 	void setLocalKey(QString privateKey);
 	void generateLocalKey(int keyLength = 2048);
 	QString getLocalKey();
@@ -83,6 +86,7 @@ private slots:
 	// used to forward the signals of the encapsulated class to dbus
 	void onPeerNameChanged(QString peerName);
 	void onCompressionChanged(bool compressionEnabled);
+	void onEncryptionChanged(bool encryptionEnabled);
 	void onLocalKeyChanged(const PrivateKey &privateKey);
 	void onBootstrapHintsChanged(const QString &bootstrapHints);
 	void onEndpointsChanged(const QString &endpoints);
@@ -94,6 +98,7 @@ private slots:
 signals:
 	void peerNameChanged(QString peerName);
 	void compressionChanged(bool compressionEnabled);
+	void encryptionChanged(bool encryptionEnabled);
 	void publicKeyChanged(QString publicKey);
 	void bootstrapHintsChanged(const QString &bootstrapHints);
 	void endpointsChanged(const QString &endpoints);
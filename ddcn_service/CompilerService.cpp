@@ -25,11 +25,19 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "CompilerService.h"
+#include "ParameterParser.h"
 
 
 QString CompilerService::settingToolChains("toolChains");
 QString CompilerService::settingToolChainPath("path");
 QString CompilerService::settingToolChainVersion("version");
+QString CompilerService::settingToolChainFingerprint("fingerprint");
+QString CompilerService::settingIgnoredToolChains("service/ignored_toolchains");
+QString CompilerService::settingToolChainMappings("toolChainMappings");
+QString CompilerService::settingMappingSource("source");
+QString CompilerService::settingMappingTarget("target");
+QString CompilerService::settingMappingParameters("parameters");
+QString CompilerService::settingDefaultMappings("service/default_toolchain_mappings");
 QString CompilerService::settingMaxThreadCount("maxThreadCount");
 
 CompilerService::CompilerService(CompilerNetwork *network)
@@ -37,6 +45,11 @@ CompilerService::CompilerService(CompilerNetwork *network)
 	this->network = network;
 	setCurrentThreadCount(0);
 	loadMaxThreadCount();
+	toolChainRegistry = new ToolChainRegistry(this);
+	connect(toolChainRegistry, SIGNAL(toolChainFound(const ToolChain&)),
+			this, SLOT(onToolChainFound(const ToolChain&)));
+	connect(toolChainRegistry, SIGNAL(discoveryFinished()),
+			this, SLOT(onToolChainDiscoveryFinished()));
 	loadToolChains();
 	// Connect network signals
 	connect(network, SIGNAL(receivedJob(Job*)), this, SLOT(onReceivedJob(Job*)));
@@ -46,6 +59,10 @@ CompilerService::CompilerService(CompilerNetwork *network)
 }
 
 void CompilerService::addJob(Job *job) {
+	if (splitJobs.contains(job)) {
+		addJobs(splitJobs.value(job)->parts);
+		return;
+	}
 	if (job->isRemoteJob()) {
 		connect(job,
 			SIGNAL(finished(Job*)),
@@ -67,7 +84,119 @@ void CompilerService::addJob(Job *job) {
 	network->setFreeLocalSlots(computeFreeLocalSlotCount());
 	manageJobs();
 }
+void CompilerService::addJobs(const QList<Job*> &jobs) {
+	foreach (Job *job, expandSplitJobs(jobs)) {
+		connect(job,
+			SIGNAL(finished(Job*)),
+			this,
+			SLOT(onLocalCompileFinished(Job*))
+		);
+		this->localJobQueue.append(job);
+	}
+	emit numberOfJobsInLocalQueueChanged(this->localJobQueue.count());
+	network->setFreeLocalSlots(computeFreeLocalSlotCount());
+	manageJobs();
+}
 
+Job *CompilerService::createJob(QStringList parameters, QString toolChain,
+		QString workingPath, const QByteArray &stdinData, QString language) {
+	// Fetch the toolchain path
+	ToolChain toolChainInfo;
+	if (toolChain.isEmpty() && !toolChains.isEmpty()) {
+		toolChainInfo = toolChains[0];
+	}
+	for (int i = 0; i < toolChains.size(); i++) {
+		if (toolChains[i].getVersion() == toolChain
+				|| toolChains[i].getIdentity() == toolChain) {
+			toolChainInfo = toolChains[i];
+			break;
+		}
+	}
+	// Error checking - toolchain unsupported?
+	if (toolChainInfo.getPath() == "") {
+		return NULL;
+	}
+	ParameterParser parser(parameters, workingPath);
+	if (parser.isSplittable()) {
+		// The original job is never executed, it only collects the results
+		Job *job = new Job(parser.getInputFiles(), parser.getOutputFiles(),
+		                   parser.getOriginalParameters(), QStringList(),
+		                   parser.getCompilerParameters(), toolChainInfo,
+		                   workingPath, false, false, stdinData, language);
+		SplitJob *split = new SplitJob;
+		split->job = job;
+		foreach (const QStringList &partParameters, parser.getSplitParameters()) {
+			Job *part = createJob(partParameters, toolChainInfo.getIdentity(),
+				workingPath, stdinData, language);
+			split->parts.append(part);
+			splitJobParts.insert(part, split);
+		}
+		split->unfinishedParts = split->parts.count();
+		splitJobs.insert(job, split);
+		return job;
+	}
+	QStringList preprocessingParameters = parser.getPreprocessingParameters();
+	if (parser.isDelegatable() && !parser.isLtrans()
+			&& network->getPrecompiledHeaders()->isEnabled()) {
+		// Let the preprocessor refer to precompiled headers instead of
+		// expanding them, so that other peers can use them as well
+		preprocessingParameters.append("-fpch-preprocess");
+	}
+	Job *job = new Job(parser.getInputFiles(), parser.getOutputFiles(),
+	                   parser.getOriginalParameters(),
+	                   preprocessingParameters,
+	                   parser.getCompilerParameters(),
+	                   toolChainInfo, workingPath, false, parser.isDelegatable(),
+	                   stdinData, language);
+	if (parser.isLtrans()) {
+		job->setPreprocessingRequired(false);
+	} else if (parser.isLtoLink()) {
+		QString execPrefix;
+		QString wrapper = ltoLinkWrapper.getWrapper(toolChainInfo, language,
+				&execPrefix);
+		if (!wrapper.isEmpty()) {
+			job->setLinkWrapper(wrapper, execPrefix);
+		}
+	} else if (parser.isRemotelyPreprocessable()
+			&& network->getHeaders()->isEnabled()) {
+		// Only the headers are collected before the job is delegated
+		job->setRemotePreprocessing(network->getIncludeScanner(),
+				parser.getRemotePreprocessingParameters(),
+				parser.getIncludeDirectories(), parser.getForcedIncludes(),
+				parser.getDependencyFile());
+	}
+	return job;
+}
+
+QList<Job*> CompilerService::expandSplitJobs(const QList<Job*> &jobs) {
+	QList<Job*> expanded;
+	foreach (Job *job, jobs) {
+		if (splitJobs.contains(job)) {
+			expanded.append(splitJobs.value(job)->parts);
+		} else {
+			expanded.append(job);
+		}
+	}
+	return expanded;
+}
+void CompilerService::finishSplitJob(SplitJob *split) {
+	JobResult result;
+	result.returnValue = 0;
+	foreach (Job *part, split->parts) {
+		JobResult partResult = part->getJobResult();
+		result.stdout.append(partResult.stdout);
+		result.stderr.append(partResult.stderr);
+		// gcc fails if any of the files could not be compiled
+		if (result.returnValue == 0) {
+			result.returnValue = partResult.returnValue;
+		}
+		part->deleteLater();
+	}
+	split->job->setJobResult(result);
+	splitJobs.remove(split->job);
+	emit localJobCompilationFinished(split->job);
+	delete split;
+}
 
 //SLOTS
 void CompilerService::onIncomingJob(Job *job) {
@@ -140,7 +269,11 @@ void CompilerService::executeFirstJobFromList(QList<Job*> *jobList) {
 
 void CompilerService::executeJobLocally(Job* job) {
 	job->execute();
-	setCurrentThreadCount(this->currentThreadCount + 1);
+	// The LTRANS calls of a wrapped link are queued as separate jobs, if the
+	// link kept its thread they could not run locally with a single thread
+	if (!job->hasLinkWrapper()) {
+		setCurrentThreadCount(this->currentThreadCount + 1);
+	}
 }
 
 void CompilerService::manageOutgoingJobs() {
@@ -162,33 +295,87 @@ void CompilerService::manageOutgoingJobs() {
 
 
 void CompilerService::loadToolChains() {
+	ignoredToolChains = this->settings.value(settingIgnoredToolChains).toStringList();
+	// Configured cross-target mappings take precedence over the built-in ones
+	QList<ToolChainMapping> mappings;
+	int mappingCount = this->settings.beginReadArray(this->settingToolChainMappings);
+	for (int i = 0; i < mappingCount; ++i) {
+		this->settings.setArrayIndex(i);
+		ToolChainMapping mapping(
+				this->settings.value(this->settingMappingSource).toString(),
+				this->settings.value(this->settingMappingTarget).toString(),
+				this->settings.value(this->settingMappingParameters).toString());
+		if (mapping.source.isEmpty() || mapping.target.isEmpty()) {
+			qWarning("Ignoring incomplete toolchain mapping %d.", i + 1);
+			continue;
+		}
+		mappings.append(mapping);
+	}
+	this->settings.endArray();
+	if (this->settings.value(this->settingDefaultMappings, true).toBool()) {
+		mappings.append(ToolChain::getDefaultMappings());
+	}
+	ToolChain::setMappings(mappings);
+	QStringList paths;
 	int size = this->settings.beginReadArray(this->settingToolChains);
 	for (int i = 0; i < size; ++i) {
 		this->settings.setArrayIndex(i);
 		QString version = this->settings.value(this->settingToolChainVersion).toString();
 		QString path = this->settings.value(this->settingToolChainPath).toString();
+		QString fingerprint = this->settings.value(this->settingToolChainFingerprint).toString();
 		QString gccPath = QString(path).replace("*", "gcc");
 		if (QFile(gccPath).exists()) {
-			ToolChain toolChain(version, path);
+			ToolChain toolChain(version, path, fingerprint);
 			this->toolChains.append(toolChain);
+			paths.append(path);
 		}
 	}
 	this->settings.endArray();
 	if (this->toolChains.count() < 1) {
-		qWarning("No toolchains loaded, creating default toolchain entry.");
-		// Try to fetch the default compiler
-		ToolChain defaultToolChain("/usr/bin/*");
-		if (defaultToolChain.getVersion() != "") {
-			this->toolChains.append(defaultToolChain);
+		qWarning("No toolchains loaded, waiting for toolchain discovery.");
+	}
+	// The saved toolchains can be used right away, they are updated when
+	// probing finishes
+	emit toolChainsChanged();
+	network->setToolChains(toolChains);
+	toolChainRegistry->discover(paths);
+}
+
+void CompilerService::onToolChainFound(const ToolChain &toolChain) {
+	if (ignoredToolChains.contains(toolChain.getPath())) {
+		return;
+	}
+	int index = -1;
+	for (int i = 0; i < toolChains.count(); i++) {
+		if (toolChains[i].getPath() == toolChain.getPath()) {
+			index = i;
+			break;
+		}
+		// Symlinks to the same compiler are only added once
+		if (toolChains[i].getFingerprint() == toolChain.getFingerprint()) {
+			return;
 		}
-		// Save the updated toolchain list
-		saveToolChains();
 	}
+	if (index != -1) {
+		if (toolChains[index].getVersion() == toolChain.getVersion()
+				&& toolChains[index].getFingerprint() == toolChain.getFingerprint()) {
+			return;
+		}
+		toolChains[index] = toolChain;
+	} else {
+		toolChains.append(toolChain);
+	}
+	saveToolChains();
+	network->setToolChains(toolChains);
+	emit toolChainsChanged();
+}
+
+void CompilerService::onToolChainDiscoveryFinished() {
+	qDebug("Toolchain discovery finished, %d toolchains available.",
+			toolChains.count());
 	if (this->toolChains.count() < 1) {
 		qFatal("No ToolChains available!");
 	}
-	emit toolChainsChanged();
-	network->setToolChains(toolChains);
 }
 
 void CompilerService::saveToolChains()  {
@@ -197,6 +384,7 @@ void CompilerService::saveToolChains()  {
 		this->settings.setArrayIndex(i);
 		this->settings.setValue(this->settingToolChainVersion, this->toolChains.at(i).getVersion());
 		this->settings.setValue(this->settingToolChainPath, this->toolChains.at(i).getPath());
+		this->settings.setValue(this->settingToolChainFingerprint, this->toolChains.at(i).getFingerprint());
 	}
 	this->settings.endArray();
 }
@@ -227,10 +415,20 @@ bool CompilerService::isToolChainAvailable(ToolChain target) {
 
 // PRIVATE SLOTS
 void CompilerService::onLocalCompileFinished(Job* job) {
-	emit localJobCompilationFinished(job);
+	SplitJob *split = splitJobParts.take(job);
+	if (split) {
+		split->unfinishedParts--;
+		if (split->unfinishedParts == 0) {
+			finishSplitJob(split);
+		}
+	} else {
+		emit localJobCompilationFinished(job);
+	}
 	if (!job->wasDelegated()) {
 		emit numberOfJobsInLocalQueueChanged(this->localJobQueue.count());
-		setCurrentThreadCount(this->currentThreadCount - 1);
+		if (!job->hasLinkWrapper()) {
+			setCurrentThreadCount(this->currentThreadCount - 1);
+		}
 	}
 	manageJobs();
 }
@@ -29,15 +29,28 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "Job.h"
 #include "ToolChain.h"
+#include "ToolChainRegistry.h"
 #include "JobRequest.h"
 #include "CompilerNetwork.h"
+#include "LtoLinkWrapper.h"
 #include <QList>
+#include <QHash>
 #include <QObject>
 #include <QSettings>
 #include <QThread>
 
 using namespace std;
 
+/**
+ * Local compiler call with several input files which has been split up into
+ * one job per input file.
+ */
+struct SplitJob {
+	Job *job;
+	QList<Job*> parts;
+	int unfinishedParts;
+};
+
 /**
  * The CompilerService manages, executes and delegates compiler jobs.
  */
@@ -57,6 +70,29 @@ public:
 	 * @param job The job to append to the list.
 	 */
     void addJob(Job *job);
+	/**
+	 * Adds a number of local jobs at once. The jobs are queued in the order of
+	 * the list and are only scheduled after all of them have been added, so
+	 * that surplus jobs can be delegated to the network right away.
+	 * @param jobs the jobs to append to the local queue.
+	 */
+	void addJobs(const QList<Job*> &jobs);
+
+	/**
+	 * Creates a local job for a compiler call from a client, the job still has
+	 * to be passed to addJob().
+	 * If the call compiles several files, it is split up into one job per file
+	 * which are scheduled and delegated independently. The returned job then
+	 * only receives the merged result of these jobs.
+	 * @param parameters the parameters that will be passed on to the gcc/g++ compiler.
+	 * @param toolChain the version or network identity of the toolchain, the first toolchain is used if this is empty.
+	 * @param workingPath the directory in which the compiler was executed.
+	 * @param stdinData input data for the compiler.
+	 * @param language the programming language of the code to be compiled.
+	 * @return the job or NULL if the toolchain is not supported.
+	 */
+	Job *createJob(QStringList parameters, QString toolChain,
+		QString workingPath, const QByteArray &stdinData, QString language);
 
 	/**
 	 * Returns a list of ToolChains.
@@ -83,27 +119,18 @@ public:
     }
 
     /**
-	 * Returns true if a given ToolChain could be added to the list of ToolChains.
-	 * If the ToolChain already exists in the set of ToolChains administrated, the ToolChain will not be added.
-	 * In case the given path can not be executed, the ToolChain will also not be added.
-	 * @return true if a given ToolChain could be added to the list of ToolChains.
+	 * Adds a ToolChain to the list of ToolChains. The compiler is probed in
+	 * the background, the ToolChain is added afterwards if it is valid and not
+	 * already in the list.
+	 * @return false if there is no compiler at the given path.
 	 * @param path The path to the ToolChain (compiler) to add.
-	 * @emit toolChainsChanged
+	 * @emit toolChainsChanged once the ToolChain has been added.
 	 */
-    bool addToolChain(QString path) {
-        ToolChain toolChain(path);
-		if (toolChain.getPath() == "") {
-			return false;
-		}
-		path.replace("*", "gcc");
-        if (this->toolChains.indexOf(toolChain) < 0 && QFile(path).exists()) {
-            this->toolChains.append(toolChain);
-            saveToolChains();
-        }
-        network->setToolChains(toolChains);
-        emit toolChainsChanged();
-		return true;
-    }
+	bool addToolChain(QString path) {
+		ignoredToolChains.removeAll(path);
+		settings.setValue(settingIgnoredToolChains, ignoredToolChains);
+		return toolChainRegistry->probe(path);
+	}
 
 	/**
 	 * Sets the maximum number of threads executed on this machine to the given value and saves it.
@@ -119,20 +146,31 @@ public:
 
 	/**
 	 * Returns true if the given ToolChain (identified by path) could be removed from the list of
-	 * administrated ToolChains.
+	 * administrated ToolChains. The ToolChain is not added again by toolchain
+	 * discovery until it is added explicitly.
 	 * @return true if the ToolChain could be removed.
 	 * @emit toolChainsChanged
 	 */
-    bool removeToolChain(QString path) {
-        ToolChain toolChain(path);
+	bool removeToolChain(QString path) {
 		bool returnValue = false;
-        if (this->toolChains.removeOne(toolChain)) {
-            saveToolChains();
-			returnValue = true;
-        }
-        emit toolChainsChanged();
+		for (int i = 0; i < toolChains.count(); i++) {
+			if (toolChains[i].getPath() == path) {
+				toolChains.removeAt(i);
+				returnValue = true;
+				break;
+			}
+		}
+		if (!ignoredToolChains.contains(path)) {
+			ignoredToolChains.append(path);
+			settings.setValue(settingIgnoredToolChains, ignoredToolChains);
+		}
+		if (returnValue) {
+			saveToolChains();
+			network->setToolChains(toolChains);
+		}
+		emit toolChainsChanged();
 		return returnValue;
-    }
+	}
 
 	int getNumberOfJobsInLocalQueue() {
 		return localJobQueue.count();
@@ -195,6 +233,8 @@ private slots:
     	void onLocalCompileFinished(Job *job);
     	void onRemoteCompileFinished(Job *job);
 	void onOutgoingJobCancelled(Job *job);
+	void onToolChainFound(const ToolChain &toolChain);
+	void onToolChainDiscoveryFinished();
 private:
 	/**
 	 * Returns true if the given job could be removed from the list successfully.
@@ -223,7 +263,9 @@ private:
     void manageOutgoingJobs();
 
 	/**
-	 * Loads the toolchains saved in the configuration file.
+	 * Loads the toolchains saved in the configuration file and starts
+	 * toolchain discovery, which probes them again and adds all other
+	 * compilers installed on this machine.
 	 */
     void loadToolChains();
 
@@ -284,16 +326,42 @@ private:
 	 */
 	Job *extractLocalDelegatableJob();
 
+	/**
+	 * Replaces jobs which have been split up with their parts.
+	 */
+	QList<Job*> expandSplitJobs(const QList<Job*> &jobs);
+	/**
+	 * Merges the results of the parts of a split job in order and signals that
+	 * the original job has finished.
+	 */
+	void finishSplitJob(SplitJob *split);
+
     int currentThreadCount;
     int maxThreadCount;
     QList<ToolChain> toolChains;
+	ToolChainRegistry *toolChainRegistry;
+	LtoLinkWrapper ltoLinkWrapper;
+	/**
+	 * Paths of toolchains which have been removed by the user and shall not
+	 * be added again by toolchain discovery.
+	 */
+	QStringList ignoredToolChains;
     CompilerNetwork *network;
     QList<Job*> localJobQueue;
     QList<Job*> remoteJobQueue;
+	QHash<Job*, SplitJob*> splitJobs;
+	QHash<Job*, SplitJob*> splitJobParts;
 	QSettings settings;
 	static QString settingToolChains;
 	static QString settingToolChainPath;
 	static QString settingToolChainVersion;
+	static QString settingToolChainFingerprint;
+	static QString settingIgnoredToolChains;
+	static QString settingToolChainMappings;
+	static QString settingMappingSource;
+	static QString settingMappingTarget;
+	static QString settingMappingParameters;
+	static QString settingDefaultMappings;
 	static QString settingMaxThreadCount;
 };
 
@@ -25,15 +25,15 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "CompilerServiceAdaptor.h"
-#include "ParameterParser.h"
 #include "LogWriter.h"
 
 #include <QDBusConnection>
 #include <QDBusMessage>
+#include <QSet>
 #include <QVariant>
 
 CompilerServiceAdaptor::CompilerServiceAdaptor(CompilerService *service)
-		: QDBusAbstractAdaptor(service), service(service) {
+		: QDBusAbstractAdaptor(service), service(service), nextBatchId(1) {
 	connect(service,
 			SIGNAL(currentThreadCountChanged(int)),
 			this,
@@ -93,30 +93,16 @@ JobResult CompilerServiceAdaptor::executeJob(QStringList parameters,
 		QString toolChain, QString workingPath,
 		const QByteArray &stdinData, QString language,
 		const QDBusMessage &message) {
-	// Fetch the toolchain path
-	QList<ToolChain> toolChains = *service->getToolChains();
-	ToolChain toolChainInfo;
-	for (int i = 0; i < toolChains.size(); i++) {
-		if (toolChains[i].getVersion() == toolChain) {
-			toolChainInfo = toolChains[i];
-			break;
-		}
-	}
+	// Create a job
+	Job *job = service->createJob(parameters, toolChain, workingPath,
+		stdinData, language);
 	// Error checking - toolchain unsupported?
-	if (toolChainInfo.getPath() == "") {
+	if (!job) {
 		JobResult result;
 		result.stderr = QString("Error: ddcn: Unsupported toolchain.").toAscii();
 		result.returnValue = -1;
 		return result;
 	}
-	// Create a job
-	ParameterParser parser(parameters);
-	Job *job = new Job(parser.getInputFiles(), parser.getOutputFiles(),
-	                   parser.getOriginalParameters(),
-	                   parser.getPreprocessingParameters(),
-	                   parser.getCompilerParameters(),
-	                   toolChainInfo, workingPath, false, parser.isDelegatable(),
-	                   stdinData, language);
 	message.setDelayedReply(true);
 	QDBusMessage *dBusMessage = new QDBusMessage(message.createReply());
 	this->jobDBusMessageMap.insert(job, dBusMessage);
@@ -125,6 +111,49 @@ JobResult CompilerServiceAdaptor::executeJob(QStringList parameters,
 	return JobResult();
 }
 
+uint CompilerServiceAdaptor::executeJobs(QList<JobDescription> jobs,
+		QString toolChain, QList<uint> order) {
+	// Sort the jobs according to the hint
+	QList<uint> indices;
+	QSet<uint> added;
+	foreach (uint index, order) {
+		if (index < (uint)jobs.count() && !added.contains(index)) {
+			indices.append(index);
+			added.insert(index);
+		}
+	}
+	for (int i = 0; i < jobs.count(); i++) {
+		if (!added.contains(i)) {
+			indices.append(i);
+		}
+	}
+	// Create all jobs before passing them to the service so that the service
+	// sees the whole batch at once
+	uint batch = nextBatchId++;
+	QList<Job*> batchList;
+	foreach (uint index, indices) {
+		const JobDescription &description = jobs[index];
+		Job *job = service->createJob(description.parameters, toolChain,
+			description.workingPath, QByteArray(), description.language);
+		if (!job) {
+			// Unsupported toolchain
+			qDeleteAll(batchList);
+			return 0;
+		}
+		BatchJob batchJob;
+		batchJob.batch = batch;
+		batchJob.index = index;
+		batchJobs.insert(job, batchJob);
+		batchList.append(job);
+	}
+	if (batchList.isEmpty()) {
+		return 0;
+	}
+	batchJobCounts.insert(batch, batchList.count());
+	service->addJobs(batchList);
+	return batch;
+}
+
 void CompilerServiceAdaptor::requestShutdown() {
 	shutdown();
 }
@@ -152,6 +181,22 @@ void CompilerServiceAdaptor::clearLog() {
 }
 
 void CompilerServiceAdaptor::localCompilationJobFinished(Job *job) {
+	if (batchJobs.contains(job)) {
+		BatchJob batchJob = batchJobs.take(job);
+		emit jobFinished(batchJob.batch, batchJob.index, job->getJobResult());
+		uint remaining = batchJobCounts.value(batchJob.batch) - 1;
+		if (remaining == 0) {
+			batchJobCounts.remove(batchJob.batch);
+			emit batchFinished(batchJob.batch);
+		} else {
+			batchJobCounts.insert(batchJob.batch, remaining);
+		}
+		return;
+	}
+	// Jobs from the local socket are answered by LocalJobServer
+	if (!this->jobDBusMessageMap.contains(job)) {
+		return;
+	}
 	QDBusMessage *message(this->jobDBusMessageMap.value(job));
 	QDBusArgument argument;
 	QVariant variant = QVariant::fromValue(job->getJobResult());
@@ -30,6 +30,7 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "CompilerService.h"
 #include "Job.h"
 #include <QList>
+#include <QHash>
 #include <QDBusAbstractAdaptor>
 #include <QStringList>
 #include <QDBusMessage>
@@ -87,6 +88,18 @@ public slots:
 	JobResult executeJob(QStringList parameters, QString toolChain,
 		QString workingPath, const QByteArray &stdinData,
 		QString language, const QDBusMessage &message);
+	/**
+	 * Submits a whole batch of jobs at once, e.g. all compiler calls of a
+	 * build. The results are not returned by this call, instead jobFinished()
+	 * is emitted for each job as soon as it has finished, and batchFinished()
+	 * once all jobs of the batch have finished.
+	 * @param jobs the compiler calls, none of them may read from stdin.
+	 * @param toolChain the toolChain that will used for compiling, the default toolchain is used if this is empty.
+	 * @param order the preferred order in which the jobs are started as indices into jobs, e.g. the longest jobs first. Jobs which are missing are appended in their original order.
+	 * @return the id of the batch, or 0 if the toolchain is not supported.
+	 */
+	uint executeJobs(QList<JobDescription> jobs, QString toolChain,
+		QList<uint> order);
 
 	/**
 	 * Adds a ToolChain to the list of supported ToolChains if the given path is valid.
@@ -181,6 +194,18 @@ signals:
 	 * @return the updated list of ToolChains.
 	 */
 	void toolChainsChanged(QList<ToolChainInfo> toolChains);
+	/**
+	 * Triggered when a job submitted via executeJobs() has finished.
+	 * @param batch the id returned by executeJobs().
+	 * @param index the index of the job in the list passed to executeJobs().
+	 * @param result the result of the job.
+	 */
+	void jobFinished(uint batch, uint index, JobResult result);
+	/**
+	 * Triggered when all jobs of a batch have finished.
+	 * @param batch the id returned by executeJobs().
+	 */
+	void batchFinished(uint batch);
 private:
 	/**
 	 * Converts a given ToolChain to a dbus compatible ToolChainInfo struct.
@@ -190,6 +215,17 @@ private:
 	ToolChainInfo toToolChainInfo(ToolChain toolChain);
 	CompilerService *service;
 	QMap<Job*, QDBusMessage*> jobDBusMessageMap;
+
+	struct BatchJob {
+		uint batch;
+		uint index;
+	};
+	QHash<Job*, BatchJob> batchJobs;
+	/**
+	 * Number of unfinished jobs for each batch.
+	 */
+	QHash<uint, uint> batchJobCounts;
+	uint nextBatchId;
 };
 
 #endif
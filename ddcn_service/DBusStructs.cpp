@@ -102,6 +102,21 @@ const QDBusArgument &operator>>(const QDBusArgument &argument, JobResult &jobRes
 	return argument;
 }
 
+QDBusArgument &operator<<(QDBusArgument &argument, const JobDescription &description) {
+	argument.beginStructure();
+	argument << description.parameters << description.workingPath
+		<< description.language;
+	argument.endStructure();
+	return argument;
+}
+const QDBusArgument &operator>>(const QDBusArgument &argument, JobDescription &description) {
+	argument.beginStructure();
+	argument >> description.parameters >> description.workingPath
+		>> description.language;
+	argument.endStructure();
+	return argument;
+}
+
 QDBusArgument &operator<<(QDBusArgument &argument, const NodeStatus &nodeStatusInfo) {
 	argument.beginStructure();
 	argument << nodeStatusInfo.maxThreads;
@@ -134,4 +149,6 @@ void registerCustomDBusTypes() {
 	qDBusRegisterMetaType<QList<ToolChainInfo> >();
 	qDBusRegisterMetaType<NodeStatus>();
 	qDBusRegisterMetaType<JobResult>();
+	qDBusRegisterMetaType<JobDescription>();
+	qDBusRegisterMetaType<QList<JobDescription> >();
 }
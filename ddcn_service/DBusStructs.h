@@ -101,6 +101,22 @@ Q_DECLARE_METATYPE(JobResult)
 QDBusArgument &operator<<(QDBusArgument &argument, const JobResult &jobResult);
 const QDBusArgument &operator>>(const QDBusArgument &argument, JobResult &jobResult);
 
+/**
+ * Describes one compiler call of a batch submitted via
+ * CompilerServiceAdaptor::executeJobs().
+ */
+struct JobDescription {
+	QStringList parameters;
+	QString workingPath;
+	QString language;
+};
+
+Q_DECLARE_METATYPE(JobDescription)
+Q_DECLARE_METATYPE(QList<JobDescription>)
+
+QDBusArgument &operator<<(QDBusArgument &argument, const JobDescription &description);
+const QDBusArgument &operator>>(const QDBusArgument &argument, JobDescription &description);
+
 Q_DECLARE_METATYPE(NodeStatus)
 
 QDBusArgument &operator<<(QDBusArgument &argument, const NodeStatus &nodeStatusInfo);
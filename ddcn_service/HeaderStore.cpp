@@ -0,0 +1,155 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "HeaderStore.h"
+#include "ToolChainRegistry.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRegExp>
+#include <QSettings>
+#include <sys/stat.h>
+
+HeaderStore::HeaderStore() : receivingEnabled(true) {
+	QSettings settings(QSettings::IniFormat, QSettings::UserScope, "ddcn", "ddcn");
+	enabled = settings.value("service/remote_preprocessing", false).toBool();
+	cacheSize = settings.value("service/header_cache_size", 50000).toInt();
+	directory = settings.value("service/header_cache_dir",
+			QDir::homePath() + "/.cache/ddcn/headers").toString();
+	if (!QDir().mkpath(directory)) {
+		qWarning("Could not create the header directory \"%s\".",
+				directory.toAscii().data());
+		receivingEnabled = false;
+		return;
+	}
+	// Headers received during earlier runs can be used right away
+	QRegExp hashName("^[0-9a-f]{40}\\.h$");
+	QStringList entries = QDir(directory).entryList(QStringList(), QDir::Files);
+	foreach (QString entry, entries) {
+		if (hashName.exactMatch(entry)) {
+			receivedHeaders.insert(entry.left(40));
+		}
+	}
+}
+
+QString HeaderStore::getHash(const QString &fileName) {
+	QString stamp = createStamp(fileName);
+	if (stamp.isEmpty()) {
+		return "";
+	}
+	QMutexLocker locker(&mutex);
+	QHash<QString, LocalHeader>::iterator it = localHeaders.find(fileName);
+	if (it != localHeaders.end() && it.value().stamp == stamp) {
+		return it.value().hash;
+	}
+	locker.unlock();
+	LocalHeader header;
+	header.stamp = stamp;
+	header.hash = ToolChainRegistry::hashFile(fileName).toHex();
+	if (header.hash.isEmpty()) {
+		return "";
+	}
+	locker.relock();
+	localHeaders.insert(fileName, header);
+	localFiles.insert(header.hash, fileName);
+	return header.hash;
+}
+QString HeaderStore::getLocalFile(const QString &hash) {
+	QMutexLocker locker(&mutex);
+	QString fileName = localFiles.value(hash);
+	if (fileName.isEmpty()) {
+		return "";
+	}
+	// Do not send a file whose content does not match the hash anymore
+	if (localHeaders.value(fileName).stamp != createStamp(fileName)) {
+		localFiles.remove(hash);
+		return "";
+	}
+	return fileName;
+}
+
+bool HeaderStore::addReceivedHeader(const QString &hash,
+		const QString &fileName) {
+	if (!receivingEnabled || receivedHeaders.contains(hash)) {
+		QFile::remove(fileName);
+		return receivedHeaders.contains(hash);
+	}
+	// Headers are small, so they are verified right here
+	bool valid = ToolChainRegistry::hashFile(fileName).toHex() == hash.toAscii();
+	// The file is moved under a temporary name first, the received file is
+	// usually on a different file system
+	QString target = getReceivedHeader(hash);
+	QFile::remove(target + ".tmp");
+	if (!valid || !QFile::rename(fileName, target + ".tmp")
+			|| !QFile::rename(target + ".tmp", target)) {
+		QFile::remove(target + ".tmp");
+		QFile::remove(fileName);
+		return false;
+	}
+	receivedHeaders.insert(hash);
+	removeOldHeaders();
+	return true;
+}
+
+bool HeaderStore::isValidHash(const QString &hash) {
+	return QRegExp("^[0-9a-f]{40}$").exactMatch(hash);
+}
+
+QString HeaderStore::createStamp(const QString &fileName) {
+	struct stat info;
+	if (stat(QFile::encodeName(fileName).data(), &info) != 0
+			|| !S_ISREG(info.st_mode)) {
+		return "";
+	}
+	return QString("%1:%2:%3:%4.%5:%6.%7")
+			.arg((qulonglong)info.st_dev)
+			.arg((qulonglong)info.st_ino)
+			.arg((qulonglong)info.st_size)
+			.arg((qulonglong)info.st_mtim.tv_sec)
+			.arg((qulonglong)info.st_mtim.tv_nsec)
+			.arg((qulonglong)info.st_ctim.tv_sec)
+			.arg((qulonglong)info.st_ctim.tv_nsec);
+}
+void HeaderStore::removeOldHeaders() {
+	if (receivedHeaders.size() <= cacheSize) {
+		return;
+	}
+	// Listing the directory is expensive with many files, so a tenth of the
+	// cache is removed at once
+	int targetSize = cacheSize - cacheSize / 10;
+	// Sorted by modification time, newest first
+	QFileInfoList entries = QDir(directory).entryInfoList(
+			QStringList("*.h"), QDir::Files, QDir::Time);
+	for (int i = entries.size() - 1; i >= 0 && receivedHeaders.size() > targetSize; i--) {
+		QString hash = entries[i].fileName().left(40);
+		if (receivedHeaders.remove(hash)) {
+			QFile::remove(entries[i].absoluteFilePath());
+		}
+	}
+}
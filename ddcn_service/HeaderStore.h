@@ -0,0 +1,137 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef HEADERSTORE_H_INCLUDED
+#define HEADERSTORE_H_INCLUDED
+
+#include <QHash>
+#include <QMutex>
+#include <QSet>
+#include <QString>
+
+/**
+ * Manages the headers which are shipped to other peers for jobs which are
+ * preprocessed by the peer compiling them (see IncludeScanner).
+ *
+ * Headers are identified on the network by the SHA-1 hash of their content,
+ * which is cached as long as the stamp of the file (see createStamp()) does
+ * not change. A peer which receives a job requests the headers it does not
+ * have yet over the bulk channel, so every header is only transferred once
+ * per peer. Received files are verified and stored in
+ * "service/header_cache_dir", the oldest files are removed if there are more
+ * than "service/header_cache_size" of them.
+ *
+ * "service/remote_preprocessing" (disabled by default) only controls whether
+ * the jobs of this peer are preprocessed remotely, jobs of other peers are
+ * always accepted.
+ */
+class HeaderStore {
+public:
+	HeaderStore();
+
+	/**
+	 * Returns true if the jobs of this peer shall be preprocessed by the
+	 * peers which compile them.
+	 */
+	bool isEnabled() {
+		return enabled;
+	}
+	/**
+	 * Returns true if headers can be received from other peers.
+	 */
+	bool isReceivingEnabled() {
+		return receivingEnabled;
+	}
+
+	/**
+	 * Returns the hash of a local header, or "" if the file cannot be read.
+	 * The file can then be found via getLocalFile(). This function is called
+	 * from the thread pool.
+	 */
+	QString getHash(const QString &fileName);
+	/**
+	 * Returns the name of a local header with the given hash, or "" if there
+	 * is no such file or if it has been changed in the meantime.
+	 */
+	QString getLocalFile(const QString &hash);
+
+	/**
+	 * Returns true if a header received from another peer is available.
+	 */
+	bool hasReceivedHeader(const QString &hash) {
+		return receivedHeaders.contains(hash);
+	}
+	/**
+	 * Returns the file name of a received header.
+	 */
+	QString getReceivedHeader(const QString &hash) {
+		return directory + "/" + hash + ".h";
+	}
+	/**
+	 * Verifies a header which has been received from another peer and moves
+	 * it into the cache directory.
+	 * @return true if the content of the file matches the hash.
+	 */
+	bool addReceivedHeader(const QString &hash, const QString &fileName);
+
+	/**
+	 * Returns true if the string can be the hash of a header.
+	 */
+	static bool isValidHash(const QString &hash);
+	/**
+	 * Returns a string which changes whenever the content of the file
+	 * changes, or "" if the file does not exist. Besides the size, it
+	 * contains the modification and change times with nanoseconds and the
+	 * inode, as files are often rewritten within the same second and the
+	 * modification time can be set back.
+	 */
+	static QString createStamp(const QString &fileName);
+private:
+	struct LocalHeader {
+		QString stamp;
+		QString hash;
+	};
+
+	void removeOldHeaders();
+
+	bool enabled;
+	bool receivingEnabled;
+	QString directory;
+	int cacheSize;
+	QMutex mutex;
+	/**
+	 * Hash of every local header, indexed by file name.
+	 */
+	QHash<QString, LocalHeader> localHeaders;
+	/**
+	 * File name of every hash in localHeaders.
+	 */
+	QHash<QString, QString> localFiles;
+	QSet<QString> receivedHeaders;
+};
+
+#endif
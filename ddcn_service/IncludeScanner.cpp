@@ -0,0 +1,392 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "IncludeScanner.h"
+#include "HeaderStore.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QProcess>
+#include <QRegExp>
+#include <QSet>
+#include <cctype>
+#include <cstring>
+
+QDataStream &operator<<(QDataStream &stream, const IncludeTree &tree) {
+	stream << tree.quoteDirectories;
+	stream << tree.directories;
+	stream << tree.systemDirectories;
+	stream << tree.forcedIncludes;
+	stream << tree.files;
+	stream << tree.hashes;
+	return stream;
+}
+QDataStream &operator>>(QDataStream &stream, IncludeTree &tree) {
+	stream >> tree.quoteDirectories;
+	stream >> tree.directories;
+	stream >> tree.systemDirectories;
+	stream >> tree.forcedIncludes;
+	stream >> tree.files;
+	stream >> tree.hashes;
+	return stream;
+}
+
+/**
+ * Returns true if the directive starts with the keyword, and returns the rest
+ * of the directive.
+ */
+static bool startsWithKeyword(const QByteArray &directive, const char *keyword,
+		QByteArray *rest) {
+	if (!directive.startsWith(keyword)) {
+		return false;
+	}
+	QByteArray remainder = directive.mid(strlen(keyword));
+	if (!remainder.isEmpty() && (isalnum(remainder[0]) || remainder[0] == '_')) {
+		return false;
+	}
+	*rest = remainder.trimmed();
+	return true;
+}
+
+IncludeScanner::IncludeScanner(HeaderStore *headers) : headers(headers) {
+}
+
+bool IncludeScanner::scan(const ToolChain &toolChain, const QString &language,
+		const QString &workingDirectory, const QStringList &parameters,
+		const QStringList &includeDirectories,
+		const QStringList &forcedIncludes, const QString &inputFile,
+		IncludeTree *tree) {
+	QString sourceLanguage = getSourceLanguage(parameters, inputFile);
+	QString driver = toolChain.getPath(language);
+	if (sourceLanguage.isEmpty() || driver.isEmpty()) {
+		return false;
+	}
+	if (!getSearchPath(driver, workingDirectory, parameters, includeDirectories,
+			sourceLanguage, tree)) {
+		return false;
+	}
+	QStringList bracketDirectories = tree->directories + tree->systemDirectories;
+	QStringList quoteDirectories = tree->quoteDirectories + bracketDirectories;
+	// Most candidates are checked for many files
+	QHash<QString, bool> existing;
+	QStringList pending;
+	// gcc looks for forced includes in the working directory first
+	foreach (const QString &forcedInclude, forcedIncludes) {
+		QStringList candidates;
+		candidates.append(QDir(workingDirectory).absoluteFilePath(forcedInclude));
+		if (!forcedInclude.startsWith('/')) {
+			foreach (const QString &directory, quoteDirectories) {
+				candidates.append(directory + "/" + forcedInclude);
+			}
+		}
+		QString found;
+		foreach (const QString &candidate, candidates) {
+			if (QFileInfo(candidate).isFile()) {
+				found = QDir::cleanPath(candidate);
+				break;
+			}
+		}
+		if (found.isEmpty()) {
+			// gcc fails, which is reported by the local preprocessor
+			return false;
+		}
+		tree->forcedIncludes.append(found);
+		pending.append(found);
+	}
+	pending.append(inputFile);
+	QSet<QString> visited;
+	while (!pending.isEmpty()) {
+		QString fileName = pending.takeLast();
+		if (visited.contains(fileName)) {
+			continue;
+		}
+		visited.insert(fileName);
+		if (fileName != inputFile) {
+			tree->files.append(fileName);
+		}
+		QList<Include> includes;
+		if (!getIncludes(fileName, &includes)) {
+			qDebug("%s has to be preprocessed locally.",
+					fileName.toLocal8Bit().data());
+			return false;
+		}
+		QString currentDirectory = QFileInfo(fileName).path();
+		foreach (const Include &include, includes) {
+			QStringList searched;
+			if (include.name.startsWith('/')) {
+				searched.append("");
+			} else {
+				if (include.quoted && !include.next) {
+					searched.append(currentDirectory);
+				}
+				searched.append(include.quoted ? quoteDirectories
+						: bracketDirectories);
+			}
+			foreach (const QString &directory, searched) {
+				QString candidate = QDir::cleanPath(directory + "/" + include.name);
+				QHash<QString, bool>::iterator it = existing.find(candidate);
+				if (it == existing.end()) {
+					it = existing.insert(candidate, QFileInfo(candidate).isFile());
+				}
+				if (!it.value()) {
+					continue;
+				}
+				pending.append(candidate);
+				// #include_next continues after the directory the current
+				// file was found in, which is not tracked, so all matching
+				// files are used
+				if (!include.next) {
+					break;
+				}
+			}
+		}
+	}
+	foreach (const QString &fileName, tree->files) {
+		QString hash = headers->getHash(fileName);
+		if (hash.isEmpty()) {
+			return false;
+		}
+		tree->hashes.append(hash);
+	}
+	return true;
+}
+
+bool IncludeScanner::getSearchPath(const QString &driver,
+		const QString &workingDirectory, const QStringList &parameters,
+		const QStringList &includeDirectories, const QString &sourceLanguage,
+		IncludeTree *tree) {
+	// Dependency options would overwrite the dependency file of the job and
+	// contain the name of the output file, which would make caching useless
+	QStringList searchParameters;
+	for (int i = 0; i < parameters.size(); i++) {
+		if (parameters[i] == "-MF" || parameters[i] == "-MT"
+				|| parameters[i] == "-MQ") {
+			i++;
+		} else if (!parameters[i].startsWith("-M")) {
+			searchParameters.append(parameters[i]);
+		}
+	}
+	QString key = driver + "\n" + workingDirectory + "\n" + sourceLanguage
+			+ "\n" + searchParameters.join("\n");
+	QMutexLocker locker(&mutex);
+	if (searchPaths.contains(key)) {
+		IncludeTree searchPath = searchPaths.value(key);
+		tree->quoteDirectories = searchPath.quoteDirectories;
+		tree->directories = searchPath.directories;
+		tree->systemDirectories = searchPath.systemDirectories;
+		return true;
+	}
+	locker.unlock();
+	QProcess gcc;
+	gcc.setWorkingDirectory(workingDirectory);
+	searchParameters << "-E" << "-v" << "-x" << sourceLanguage << "/dev/null"
+			<< "-o" << "/dev/null";
+	gcc.start(driver, searchParameters);
+	if (!gcc.waitForFinished() || gcc.exitCode() != 0) {
+		qWarning("Could not get the include search path from %s.",
+				driver.toLocal8Bit().data());
+		return false;
+	}
+	QByteArray output = gcc.readAllStandardError();
+	QStringList lines = QString::fromLocal8Bit(output.constData(),
+			output.size()).split('\n');
+	QStringList quoteDirectories;
+	QStringList bracketDirectories;
+	QStringList *current = NULL;
+	bool complete = false;
+	foreach (const QString &line, lines) {
+		if (line.startsWith("#include \"...\" search starts here:")) {
+			current = &quoteDirectories;
+		} else if (line.startsWith("#include <...> search starts here:")) {
+			current = &bracketDirectories;
+		} else if (line.startsWith("End of search list.")) {
+			complete = true;
+			break;
+		} else if (current && line.startsWith(' ')) {
+			QString directory = QDir(workingDirectory).absoluteFilePath(line.mid(1));
+			QString cleanDirectory = QDir::cleanPath(directory);
+			// The other peer only gets the normalized path, which has to
+			// refer to the same directory, and frameworks are not supported
+			if (QFileInfo(cleanDirectory).canonicalFilePath()
+					!= QFileInfo(directory).canonicalFilePath()
+					|| directory.endsWith(" (framework directory)")) {
+				return false;
+			}
+			current->append(cleanDirectory);
+		}
+	}
+	if (!complete) {
+		return false;
+	}
+	// gcc searches "-I" before any system directory, but drops directories
+	// which are system directories as well
+	QStringList userDirectories;
+	foreach (const QString &directory, includeDirectories) {
+		userDirectories.append(QDir::cleanPath(
+				QDir(workingDirectory).absoluteFilePath(directory)));
+	}
+	IncludeTree searchPath;
+	searchPath.quoteDirectories = quoteDirectories;
+	int userDirectoryCount = 0;
+	while (userDirectoryCount < bracketDirectories.size()
+			&& userDirectories.contains(bracketDirectories[userDirectoryCount])) {
+		userDirectoryCount++;
+	}
+	searchPath.directories = bracketDirectories.mid(0, userDirectoryCount);
+	searchPath.systemDirectories = bracketDirectories.mid(userDirectoryCount);
+	locker.relock();
+	// Builds only use a few sets of parameters, so this only happens if
+	// something goes wrong
+	if (searchPaths.size() >= 1000) {
+		searchPaths.clear();
+	}
+	searchPaths.insert(key, searchPath);
+	tree->quoteDirectories = searchPath.quoteDirectories;
+	tree->directories = searchPath.directories;
+	tree->systemDirectories = searchPath.systemDirectories;
+	return true;
+}
+
+bool IncludeScanner::getIncludes(const QString &fileName,
+		QList<Include> *includes) {
+	QString stamp = HeaderStore::createStamp(fileName);
+	if (stamp.isEmpty()) {
+		return false;
+	}
+	QMutexLocker locker(&mutex);
+	QHash<QString, ScannedFile>::iterator it = scannedFiles.find(fileName);
+	if (it != scannedFiles.end() && it.value().stamp == stamp) {
+		*includes = it.value().includes;
+		return it.value().valid;
+	}
+	locker.unlock();
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	ScannedFile scanned;
+	scanned.stamp = stamp;
+	scanned.valid = parseIncludes(file.readAll(), &scanned.includes);
+	locker.relock();
+	if (scannedFiles.size() >= 100000) {
+		scannedFiles.clear();
+	}
+	scannedFiles.insert(fileName, scanned);
+	*includes = scanned.includes;
+	return scanned.valid;
+}
+bool IncludeScanner::parseIncludes(const QByteArray &content,
+		QList<Include> *includes) {
+	QRegExp hasInclude("__has_include(_next)?\\s*\\(");
+	QRegExp literalHasInclude(
+			"__has_include(_next)?\\s*\\(\\s*(<[^>]*>|\"[^\"]*\")\\s*\\)");
+	foreach (QByteArray line, content.split('\n')) {
+		line = line.trimmed();
+		if (!line.startsWith('#')) {
+			continue;
+		}
+		QByteArray directive = line.mid(1).trimmed();
+		QByteArray rest;
+		Include include;
+		include.next = startsWithKeyword(directive, "include_next", &rest);
+		if (include.next || startsWithKeyword(directive, "include", &rest)
+				|| startsWithKeyword(directive, "import", &rest)) {
+			int end = -1;
+			if (rest.startsWith('<')) {
+				end = rest.indexOf('>');
+			} else if (rest.startsWith('"')) {
+				end = rest.indexOf('"', 1);
+			}
+			if (end == -1) {
+				// The name is computed by a macro
+				return false;
+			}
+			include.name = QString::fromLocal8Bit(rest.mid(1, end - 1).constData());
+			include.quoted = rest.startsWith('"');
+			includes->append(include);
+			continue;
+		}
+		if (startsWithKeyword(directive, "embed", &rest)) {
+			return false;
+		}
+		// __has_include changes the result of conditions depending on which
+		// files exist, so these have to be available on the other peer
+		if (!line.contains("__has_include")) {
+			continue;
+		}
+		QString text = QString::fromLocal8Bit(line.constData());
+		int uses = text.count(hasInclude);
+		int position = 0;
+		while ((position = literalHasInclude.indexIn(text, position)) != -1) {
+			QString name = literalHasInclude.cap(2);
+			include.name = name.mid(1, name.length() - 2);
+			include.quoted = name.startsWith('"');
+			include.next = !literalHasInclude.cap(1).isEmpty();
+			includes->append(include);
+			position += literalHasInclude.matchedLength();
+			uses--;
+		}
+		if (uses != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+QString IncludeScanner::getSourceLanguage(const QStringList &parameters,
+		const QString &inputFile) {
+	QString language;
+	for (int i = 0; i < parameters.size(); i++) {
+		if (parameters[i] == "-x" && i + 1 < parameters.size()) {
+			i++;
+			language = parameters[i];
+		} else if (parameters[i].startsWith("-x")) {
+			language = parameters[i].mid(2);
+		}
+	}
+	if (language.isEmpty() || language == "none") {
+		QString suffix = QFileInfo(inputFile).suffix();
+		if (suffix == "c") {
+			language = "c";
+		} else if (suffix == "cc" || suffix == "cp" || suffix == "cxx"
+				|| suffix == "cpp" || suffix == "CPP" || suffix == "c++"
+				|| suffix == "C") {
+			language = "c++";
+		} else if (suffix == "m") {
+			language = "objective-c";
+		} else if (suffix == "mm" || suffix == "M") {
+			language = "objective-c++";
+		}
+	}
+	if (language != "c" && language != "c++" && language != "objective-c"
+			&& language != "objective-c++") {
+		return "";
+	}
+	return language;
+}
@@ -0,0 +1,154 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef INCLUDESCANNER_H_INCLUDED
+#define INCLUDESCANNER_H_INCLUDED
+
+#include "ToolChain.h"
+
+#include <QDataStream>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QStringList>
+
+class HeaderStore;
+
+/**
+ * Include search path and headers of a job which is preprocessed by the peer
+ * compiling it. All paths are absolute paths on the peer which delegated the
+ * job, the other peer recreates them below the directory of the job.
+ */
+struct IncludeTree {
+	/**
+	 * Directories which are only searched for #include "..." ("-iquote").
+	 */
+	QStringList quoteDirectories;
+	/**
+	 * Directories passed via "-I".
+	 */
+	QStringList directories;
+	/**
+	 * System directories, i.e., "-isystem", the default directories of the
+	 * toolchain and "-idirafter".
+	 */
+	QStringList systemDirectories;
+	/**
+	 * Files passed via "-include".
+	 */
+	QStringList forcedIncludes;
+	/**
+	 * Headers the job might include and the hashes of their content (see
+	 * HeaderStore).
+	 */
+	QStringList files;
+	QStringList hashes;
+};
+
+QDataStream &operator<<(QDataStream &stream, const IncludeTree &tree);
+QDataStream &operator>>(QDataStream &stream, IncludeTree &tree);
+
+/**
+ * Finds the headers a source file includes, so that the job can be
+ * preprocessed and compiled by another peer instead of being preprocessed
+ * locally first.
+ *
+ * The search path is taken from the output of "gcc -E -v" with the
+ * preprocessor parameters of the job and is cached. The scanner does not
+ * evaluate any conditionals, so it collects every header which might be
+ * included, and it ignores includes which cannot be resolved as these are
+ * either in branches which are never taken or cause the same error on the
+ * other peer. If a file contains an include with a computed name or uses
+ * __has_include with a macro, the job is preprocessed locally instead. The
+ * directives found in a file are cached as long as the size and the
+ * modification time of the file do not change.
+ */
+class IncludeScanner {
+public:
+	IncludeScanner(HeaderStore *headers);
+
+	/**
+	 * Collects the headers of a job. This function is called from the thread
+	 * pool.
+	 * @param toolChain Toolchain used for the job.
+	 * @param language Language of the driver ("c" or "c++").
+	 * @param workingDirectory Directory the job was started in.
+	 * @param parameters Preprocessor parameters of the job.
+	 * @param includeDirectories Directories passed via "-I".
+	 * @param forcedIncludes Files passed via "-include".
+	 * @param inputFile Absolute path of the source file.
+	 * @param tree Is filled with the search path and the headers.
+	 * @return false if the job has to be preprocessed locally.
+	 */
+	bool scan(const ToolChain &toolChain, const QString &language,
+			const QString &workingDirectory, const QStringList &parameters,
+			const QStringList &includeDirectories,
+			const QStringList &forcedIncludes, const QString &inputFile,
+			IncludeTree *tree);
+private:
+	struct Include {
+		QString name;
+		bool quoted;
+		bool next;
+	};
+	struct ScannedFile {
+		QString stamp;
+		/**
+		 * False if the file contains includes which cannot be resolved
+		 * without preprocessing it.
+		 */
+		bool valid;
+		QList<Include> includes;
+	};
+
+	/**
+	 * Fills the directories of the tree, the search path is cached for every
+	 * combination of parameters.
+	 */
+	bool getSearchPath(const QString &driver, const QString &workingDirectory,
+			const QStringList &parameters, const QStringList &includeDirectories,
+			const QString &sourceLanguage, IncludeTree *tree);
+	/**
+	 * Returns the includes of a file, the result is cached.
+	 */
+	bool getIncludes(const QString &fileName, QList<Include> *includes);
+	static bool parseIncludes(const QByteArray &content,
+			QList<Include> *includes);
+	/**
+	 * Returns the language the source file is compiled as, or "" if the file
+	 * is not C, C++ or Objective-C source code.
+	 */
+	static QString getSourceLanguage(const QStringList &parameters,
+			const QString &inputFile);
+
+	HeaderStore *headers;
+	QMutex mutex;
+	QHash<QString, IncludeTree> searchPaths;
+	QHash<QString, ScannedFile> scannedFiles;
+};
+
+#endif
@@ -28,6 +28,7 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #define INCOMINGJOB_H_INCLUDED
 
 #include <QString>
+#include <QStringList>
 #include "NetworkNode.h"
 #include "Job.h"
 /**
@@ -70,10 +71,69 @@ public:
 	unsigned int getId() {
 		return id;
 	}
+
+	/**
+	 * Sets the directory tree the job is executed in, which mirrors the paths
+	 * on the source peer.
+	 * @param jobDirectory root of the tree.
+	 * @param jobFiles files of the job within the tree.
+	 * @param searchDirectories include directories which were created within
+	 * the tree if the job is preprocessed on this peer.
+	 */
+	void setJobDirectory(const QString &jobDirectory,
+			const QStringList &jobFiles, const QStringList &searchDirectories) {
+		this->jobDirectory = jobDirectory;
+		this->jobFiles = jobFiles;
+		this->searchDirectories = searchDirectories;
+	}
+	QString getJobDirectory() {
+		return jobDirectory;
+	}
+	QStringList getJobFiles() {
+		return jobFiles;
+	}
+	QStringList getSearchDirectories() {
+		return searchDirectories;
+	}
+
+	/**
+	 * Sets the files used if the job is compiled with -gsplit-dwarf.
+	 * @param debugInfoFile .dwo file created by gcc.
+	 * @param temporaryFile file the .dwo file is moved to once the job has
+	 * finished.
+	 */
+	void setDebugInfo(const QString &debugInfoFile,
+			const QString &temporaryFile) {
+		this->debugInfoFile = debugInfoFile;
+		this->temporaryDebugInfoFile = temporaryFile;
+	}
+	QString getDebugInfoFile() {
+		return debugInfoFile;
+	}
+	QString getTemporaryDebugInfoFile() {
+		return temporaryDebugInfoFile;
+	}
+
+	/**
+	 * Sets the dependency file written by gcc if the job is preprocessed on
+	 * this peer, it is returned as the last output file.
+	 */
+	void setDependencyFile(const QString &dependencyFile) {
+		this->dependencyFile = dependencyFile;
+	}
+	QString getDependencyFile() {
+		return dependencyFile;
+	}
 private:
 	NetworkNode *sourcePeer;
 	Job *job;
 	unsigned int id;
+	QString jobDirectory;
+	QStringList jobFiles;
+	QStringList searchDirectories;
+	QString debugInfoFile;
+	QString temporaryDebugInfoFile;
+	QString dependencyFile;
 };
 
 #endif
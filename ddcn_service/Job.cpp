@@ -25,10 +25,13 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "Job.h"
+#include <QDir>
 #include <QProcess>
 #include <QTemporaryFile>
+#include <QtConcurrentRun>
 #include "InputOutputFilePair.h"
 #include "TemporaryFile.h"
+#include "PrecompiledHeaderStore.h"
 
 #include <cassert>
 
@@ -37,8 +40,10 @@ Job::Job(QStringList inputFiles, QStringList outputFiles,
 		QStringList compilerParameters,ToolChain toolChain,
 		QString workingDir, bool isRemoteJob, bool delegatable,
 		const QByteArray &stdinData, QString language) :
-		preProcessListPosition(0), preprocessing(false), preprocessed(false),
-		compiling(false), delegated(false), incomingJob(NULL), outgoingJob(NULL) {
+		preprocessingRequired(true), preProcessListPosition(0),
+		preprocessing(false), preprocessed(false),
+		compiling(false), delegated(false), incomingJob(NULL), outgoingJob(NULL),
+		includeScanner(NULL), scanWatcher(NULL), remotePreprocessing(false) {
 	this->inputFiles = inputFiles;
 	this->outputFiles = outputFiles;
 	this->fullParameters = fullParameters;
@@ -50,12 +55,17 @@ Job::Job(QStringList inputFiles, QStringList outputFiles,
 	this->workingDir = workingDir;
 	this->stdinData = stdinData;
 	this->language = language;
+	preprocessingResult.returnValue = 0;
 	qDebug("in: %s, param: %s, tool: %s, delegatable: %d",
 			(inputFiles.count() <= 0) ? "[no inputFiles]" : inputFiles[0].toAscii().data(),
 			(fullParameters.count() <= 0) ? "[no parameters]" : fullParameters[0].toAscii().data(),
 			toolChain.getVersion().toAscii().data(), (int)this->delegatable);
 }
 Job::~Job() {
+	// The scanner writes into the watcher's result
+	if (scanWatcher) {
+		scanWatcher->waitForFinished();
+	}
 	// Remove temporary files created for preprocessing
 	foreach (QString fileName, preprocessedFiles) {
 		QFile file(fileName);
@@ -66,17 +76,43 @@ Job::~Job() {
 
 //will be called by the CompilerNetwork
 void Job::preProcess() {
+	if (includeScanner) {
+		// Only the headers are collected, which is done in the thread pool
+		IncludeScan scan;
+		scan.scanner = includeScanner;
+		scan.toolChain = toolChain;
+		scan.language = language;
+		scan.workingDirectory = workingDir;
+		scan.parameters = preprocessorParameters;
+		scan.includeDirectories = includeDirectories;
+		scan.forcedIncludes = forcedIncludes;
+		scan.inputFile = QDir::cleanPath(
+				QDir(workingDir).absoluteFilePath(inputFiles[0]));
+		scan.success = false;
+		includeScanner = NULL;
+		scanWatcher = new QFutureWatcher<IncludeScan>(this);
+		connect(scanWatcher, SIGNAL(finished()), this, SLOT(onScanFinished()));
+		scanWatcher->setFuture(QtConcurrent::run(scanIncludes, scan));
+		preprocessing = true;
+		return;
+	}
 	QStringList preProcessParameter;
-	if (this->preProcessListPosition < this->inputFiles.count()) {
+	if (preprocessingRequired
+			&& this->preProcessListPosition < this->inputFiles.count()) {
 		QString inputFile = this->inputFiles[this->preProcessListPosition];
 		QString baseName = QFileInfo(inputFile).fileName();
+		if (inputFile == "-") {
+			// The language is given via -x, so the suffix does not matter
+			baseName = "stdin.i";
+		}
 		TemporaryFile tmpFile(
 			baseName.right(baseName.length() - baseName.lastIndexOf(".")),
 			"ddcn_tmp_",
 			baseName.left(baseName.lastIndexOf(".")));
-		preProcessParameter << "-E" << inputFile << "-o"
-									<< tmpFile.getFilename()
-									<< this->preprocessorParameters;
+		// The parameters have to come first as "-x" only applies to the input
+		// files following it
+		preProcessParameter << "-E" << this->preprocessorParameters
+		                    << inputFile << "-o" << tmpFile.getFilename();
 		this->preprocessedFiles.append(tmpFile.getFilename());
 		gccPreProcess = new QProcess(this);
 		connect(gccPreProcess,
@@ -91,6 +127,10 @@ void Job::preProcess() {
 		);
 		gccPreProcess->setWorkingDirectory(this->workingDir);
 		gccPreProcess->start(toolChain.getPath(language), preProcessParameter);
+		if (inputFile == "-") {
+			gccPreProcess->write(stdinData);
+		}
+		gccPreProcess->closeWriteChannel();
 		preprocessing = true;
 	} else {
 		preprocessing = false;
@@ -99,14 +139,67 @@ void Job::preProcess() {
 	}
 }
 
+Job::IncludeScan Job::scanIncludes(IncludeScan scan) {
+	scan.success = scan.scanner->scan(scan.toolChain, scan.language,
+			scan.workingDirectory, scan.parameters, scan.includeDirectories,
+			scan.forcedIncludes, scan.inputFile, &scan.tree);
+	return scan;
+}
+
+void Job::onScanFinished() {
+	IncludeScan scan = scanWatcher->result();
+	scanWatcher->deleteLater();
+	scanWatcher = NULL;
+	if (!scan.success) {
+		// preProcess() does not scan again and runs the preprocessor instead
+		preProcess();
+		return;
+	}
+	includeTree = scan.tree;
+	remotePreprocessing = true;
+	preprocessing = false;
+	preprocessed = true;
+	emit preprocessingFinished(this);
+}
+
+void Job::disableRemotePreprocessing() {
+	if (!remotePreprocessing) {
+		return;
+	}
+	remotePreprocessing = false;
+	preprocessed = false;
+	includeTree = IncludeTree();
+}
+
+QStringList Job::getRemoteOutputFiles() {
+	QStringList files = outputFiles;
+	if (remotePreprocessing && !dependencyFile.isEmpty()) {
+		files.append(dependencyFile);
+	}
+	return files;
+}
+
+QStringList Job::getPreprocessedFiles() {
+	if (preprocessingRequired && !remotePreprocessing) {
+		return preprocessedFiles;
+	}
+	// The input files are sent as they are and must not be deleted
+	QStringList files;
+	foreach (QString fileName, inputFiles) {
+		files.append(QDir(workingDir).absoluteFilePath(fileName));
+	}
+	return files;
+}
+
 void Job::execute() {
 	QStringList parameters;
 	if (isRemoteJob()) {
 		parameters = compilerParameters;
 		parameters << inputFiles;
-		// We do not need to set the output files here as they need to be in the
-		// same directory and have the same name as the input files
-		assert(outputFiles.count() == inputFiles.count());
+		// The output files are named after the input files or are passed via
+		// "-o" by CompilerNetwork, jobs which are preprocessed here can also
+		// write a dependency file
+		assert(outputFiles.count() >= inputFiles.count());
 	} else {
 		parameters = fullParameters;
 	}
@@ -124,7 +217,35 @@ void Job::execute() {
 	);
 	gccProcess->setWorkingDirectory(this->workingDir);
 	gccProcess->setProcessChannelMode(QProcess::SeparateChannels);
-	gccProcess->start(toolChain.getPath(language), parameters);
+	if (isRemoteJob()) {
+		// The wrappers of shipped compilers only mount these files (see
+		// ToolChainPackageStore)
+		QStringList jobInputFiles;
+		foreach (const QString &file, inputFiles) {
+			jobInputFiles.append(QDir(workingDir).absoluteFilePath(file));
+		}
+		QStringList jobOutputFiles;
+		foreach (const QString &file, outputFiles) {
+			jobOutputFiles.append(QDir(workingDir).absoluteFilePath(file));
+		}
+		QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+		environment.insert("DDCN_JOB_INPUT_FILES", jobInputFiles.join("\n"));
+		environment.insert("DDCN_JOB_OUTPUT_FILES", jobOutputFiles.join("\n"));
+		gccProcess->setProcessEnvironment(environment);
+	}
+	if (!isRemoteJob() && !linkWrapper.isEmpty()) {
+		// lto-wrapper starts the driver named in argv[0] for the LTRANS calls
+		QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+		environment.insert("GCC_EXEC_PREFIX", linkExecPrefix);
+		gccProcess->setProcessEnvironment(environment);
+		parameters.prepend(toolChain.getPath(language));
+		parameters.prepend(linkWrapper);
+		parameters.prepend("exec -a \"$0\" \"$@\"");
+		parameters.prepend("-c");
+		gccProcess->start("/bin/bash", parameters);
+	} else {
+		gccProcess->start(toolChain.getPath(language), parameters);
+	}
 	gccProcess->write(stdinData);
 	gccProcess->closeWriteChannel();
 	compiling = true;
@@ -160,6 +281,14 @@ void Job::onPreProcessFinished(int exitCode, QProcess::ExitStatus exitStatus)
 		preprocessed = true;
 		emit preprocessingFinished(this);
 	} else {
+		if (precompiledHeader.isEmpty()
+				&& preprocessorParameters.contains("-fpch-preprocess")) {
+			QString header = PrecompiledHeaderStore::findPragma(
+					preprocessedFiles.last());
+			if (!header.isEmpty()) {
+				precompiledHeader = QDir(workingDir).absoluteFilePath(header);
+			}
+		}
 		this->preProcessListPosition++;
 		this->preProcess();
 	}
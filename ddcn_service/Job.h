@@ -30,7 +30,9 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QObject>
 #include <QStringList>
 #include <QProcess>
+#include <QFutureWatcher>
 #include "InputOutputFilePair.h"
+#include "IncludeScanner.h"
 #include "ToolChain.h"
 
 /**
@@ -117,6 +119,91 @@ public:
 	bool isDelegatable() {
 		return this->delegatable;
 	}
+	/**
+	 * Prevents the job from being delegated again, e.g. if its preprocessed
+	 * files cannot be used by other peers.
+	 */
+	void setNotDelegatable() {
+		this->delegatable = false;
+	}
+	/**
+	 * Marks the input files as compiler input which is sent to other peers
+	 * as it is, e.g. the partitions compiled by LTRANS calls.
+	 */
+	void setPreprocessingRequired(bool required) {
+		this->preprocessingRequired = required;
+	}
+
+	/**
+	 * Lets lto-wrapper pass the LTRANS calls of this link job to ddcn (see
+	 * LtoLinkWrapper).
+	 * @param wrapper Script which is passed to gcc as argv[0].
+	 * @param execPrefix Value of GCC_EXEC_PREFIX for the real driver.
+	 */
+	void setLinkWrapper(const QString &wrapper, const QString &execPrefix) {
+		this->linkWrapper = wrapper;
+		this->linkExecPrefix = execPrefix;
+	}
+	/**
+	 * Returns true if the job is a link whose LTRANS calls are separate jobs.
+	 * The link itself mostly waits for these jobs.
+	 */
+	bool hasLinkWrapper() {
+		return !linkWrapper.isEmpty();
+	}
+
+	/**
+	 * Lets the peer which compiles the job preprocess it as well. Instead of
+	 * running the preprocessor, preProcess() only collects the headers of the
+	 * job, and the job is preprocessed locally if that fails.
+	 * @param includeScanner Scanner used to collect the headers.
+	 * @param parameters Parameters for the other peer, without the options
+	 * which change the include search path.
+	 * @param includeDirectories Directories passed via "-I".
+	 * @param forcedIncludes Files passed via "-include".
+	 * @param dependencyFile Dependency file which is written by the other
+	 * peer, or "".
+	 */
+	void setRemotePreprocessing(IncludeScanner *includeScanner,
+			const QStringList &parameters, const QStringList &includeDirectories,
+			const QStringList &forcedIncludes, const QString &dependencyFile) {
+		this->includeScanner = includeScanner;
+		this->remoteParameters = parameters;
+		this->includeDirectories = includeDirectories;
+		this->forcedIncludes = forcedIncludes;
+		this->dependencyFile = dependencyFile;
+	}
+	/**
+	 * Returns true if the headers of the job have been collected and the job
+	 * is preprocessed by the peer which compiles it.
+	 */
+	bool isPreprocessedRemotely() {
+		return remotePreprocessing;
+	}
+	/**
+	 * Makes the job use the local preprocessor the next time it is delegated,
+	 * e.g. because another peer could not preprocess it.
+	 */
+	void disableRemotePreprocessing();
+	/**
+	 * Returns the compiler parameters for a peer which preprocesses the job.
+	 */
+	QStringList getRemotePreprocessingParameters() {
+		return remoteParameters;
+	}
+	/**
+	 * Returns the headers collected by preProcess() if the job is
+	 * preprocessed remotely.
+	 */
+	const IncludeTree &getIncludeTree() {
+		return includeTree;
+	}
+	/**
+	 * Returns the files which are returned by the peer compiling the job,
+	 * which includes the dependency file if the job is preprocessed
+	 * remotely.
+	 */
+	QStringList getRemoteOutputFiles();
 
 	/**
 	 * Executes this job.
@@ -200,8 +287,16 @@ public:
 	 * Returns the list of preprocessed files.
 	 * @return the list of preprocessed files.
 	 */
-	QStringList getPreprocessedFiles() {
-		return preprocessedFiles;
+	QStringList getPreprocessedFiles();
+
+	/**
+	 * Returns the precompiled header which the preprocessed files refer to
+	 * instead of containing the header text, or "" if no precompiled header
+	 * was used (see PrecompiledHeaderStore).
+	 * @return the absolute path of the ".gch" file.
+	 */
+	QString getPrecompiledHeader() {
+		return precompiledHeader;
 	}
 
 	/**
@@ -209,7 +304,7 @@ public:
 	 * @return the list of input files.
 	 */
 	QStringList getInputFiles() {
-		return outputFiles;
+		return inputFiles;
 	}
 
 	/**
@@ -260,6 +355,13 @@ public:
 	 * @param stderr the errors occured while executing the job.
 	 */
 	void setFinished(int returnValue, const QByteArray &stdout, const QByteArray &stderr);
+	/**
+	 * Sets the result of a job which has not been executed itself, e.g.
+	 * because it has been split up into several jobs.
+	 */
+	void setJobResult(const JobResult &jobResult) {
+		this->jobResult = jobResult;
+	}
 signals:
 	/**
 	 * Triggered when the job has been compiled.
@@ -286,6 +388,11 @@ private slots:
 	 */
 	void onPreProcessExecuteError(QProcess::ProcessError error);
 
+	/**
+	 * Called when the headers of the job have been collected.
+	 */
+	void onScanFinished();
+
 	/**
 	 * Called when the compiling has finished.
 	 * @param exitCode the status code returned by the spawned process.
@@ -304,6 +411,25 @@ private:
 	 * @param error the error that might has occured while trying to execute this Job.
 	 */
 	QString getQProcessErrorDescription(QProcess::ProcessError error);
+	/**
+	 * Input and result of IncludeScanner::scan() for a job.
+	 */
+	struct IncludeScan {
+		IncludeScanner *scanner;
+		ToolChain toolChain;
+		QString language;
+		QString workingDirectory;
+		QStringList parameters;
+		QStringList includeDirectories;
+		QStringList forcedIncludes;
+		QString inputFile;
+		bool success;
+		IncludeTree tree;
+	};
+	/**
+	 * Collects the headers of a job, called in the thread pool.
+	 */
+	static IncludeScan scanIncludes(IncludeScan scan);
 	QByteArray compilerStdout;
 	QByteArray compilerStderr;
 	QStringList inputFiles;
@@ -318,6 +444,10 @@ private:
 	QByteArray stdinData;
 
 	QStringList preprocessedFiles;
+	bool preprocessingRequired;
+	QString precompiledHeader;
+	QString linkWrapper;
+	QString linkExecPrefix;
 	ToolChain toolChain;
 	QString workingDir;
 	JobResult jobResult;
@@ -334,6 +464,15 @@ private:
 	bool delegated;
 	IncomingJob *incomingJob;
 	OutgoingJob *outgoingJob;
+
+	IncludeScanner *includeScanner;
+	QStringList remoteParameters;
+	QStringList includeDirectories;
+	QStringList forcedIncludes;
+	QString dependencyFile;
+	IncludeTree includeTree;
+	QFutureWatcher<IncludeScan> *scanWatcher;
+	bool remotePreprocessing;
 };
 
 #endif
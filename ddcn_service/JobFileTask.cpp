@@ -0,0 +1,135 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JobFileTask.h"
+
+#include <QFile>
+#include <QDataStream>
+
+JobFileTask JobFileTask::createJobData(JobFileTask task, QByteArray packetData,
+		bool compress) {
+	QList<QByteArray> fileContent;
+	foreach (QString fileName, task.inputFiles) {
+		QFile file(fileName);
+		if (!file.open(QIODevice::ReadOnly)) {
+			qFatal("Could not open previously created temporary file.");
+		}
+		if (compress) {
+			fileContent.append(qCompress(file.readAll()));
+		} else {
+			fileContent.append(file.readAll());
+		}
+	}
+	QDataStream stream(&packetData, QIODevice::WriteOnly | QIODevice::Append);
+	stream << fileContent;
+	task.packet = Packet::fromData(PacketType::JobData, packetData);
+	return task;
+}
+JobFileTask JobFileTask::writeInputFiles(JobFileTask task,
+		QList<QByteArray> fileContent, bool compressed) {
+	for (int i = 0; i < fileContent.size(); i++) {
+		QFile inputFile(task.inputFiles[i]);
+		if (!inputFile.open(QIODevice::WriteOnly)) {
+			qFatal("Could not open previously created temporary file.");
+		}
+		if (compressed) {
+			inputFile.write(qUncompress(fileContent[i]));
+		} else {
+			inputFile.write(fileContent[i]);
+		}
+	}
+	return task;
+}
+JobFileTask JobFileTask::writeOutputFiles(JobFileTask task,
+		QList<QByteArray> fileContent) {
+	for (int i = 0; i < fileContent.size(); i++) {
+		QFile file(task.outputFiles[i]);
+		if (!file.open(QIODevice::WriteOnly)) {
+			qWarning("Could not open output file.");
+			task.errors.append(QString("\nddcn: Could not open output file.").toAscii());
+			task.success = false;
+			continue;
+		}
+		file.write(fileContent[i]);
+	}
+	return task;
+}
+JobFileTask JobFileTask::createJobFinished(JobFileTask task,
+		QByteArray packetData) {
+	QList<QByteArray> fileContent;
+	foreach (QString fileName, task.outputFiles) {
+		QFile file(fileName);
+		if (!file.open(QIODevice::ReadOnly)) {
+			qFatal("onDelegatedJobFinished(): Could not read previously created temporary file.");
+		}
+		fileContent.append(file.readAll());
+		file.remove();
+	}
+	foreach (QString fileName, task.inputFiles) {
+		QFile::remove(fileName);
+	}
+	QDataStream stream(&packetData, QIODevice::WriteOnly | QIODevice::Append);
+	stream << fileContent;
+	task.packet = Packet::fromData(PacketType::JobFinished, packetData);
+	return task;
+}
+JobFileTask JobFileTask::compressDebugInfo(JobFileTask task) {
+	QFile file(task.inputFiles[0]);
+	if (!file.open(QIODevice::ReadOnly)) {
+		task.success = false;
+		return task;
+	}
+	QByteArray data = qCompress(file.readAll());
+	file.remove();
+	QFile compressedFile(task.outputFiles[0]);
+	if (!compressedFile.open(QIODevice::WriteOnly)
+			|| compressedFile.write(data) != data.size()) {
+		task.success = false;
+	}
+	return task;
+}
+JobFileTask JobFileTask::writeDebugInfo(JobFileTask task) {
+	QFile file(task.inputFiles[0]);
+	QByteArray data;
+	if (file.open(QIODevice::ReadOnly)) {
+		data = qUncompress(file.readAll());
+	}
+	file.remove();
+	// qUncompress() returns an empty array for corrupted data, .dwo files are
+	// never empty
+	if (data.isEmpty()) {
+		task.errors = "the received file is corrupted";
+		task.success = false;
+		return task;
+	}
+	QFile debugInfoFile(task.outputFiles[0]);
+	if (!debugInfoFile.open(QIODevice::WriteOnly)
+			|| debugInfoFile.write(data) != data.size()) {
+		task.errors = "the file could not be written";
+		task.success = false;
+	}
+	return task;
+}
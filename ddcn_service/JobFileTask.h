@@ -0,0 +1,116 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef JOBFILETASK_H_INCLUDED
+#define JOBFILETASK_H_INCLUDED
+
+#include "Protocol.h"
+
+#include <QStringList>
+
+class NetworkNode;
+
+/**
+ * Describes a blocking file operation of CompilerNetwork which is executed in
+ * the global thread pool via QtConcurrent::run(). The task is passed to one of
+ * the functions below which fill in the result, CompilerNetwork then finishes
+ * the operation in the main thread.
+ *
+ * Only the data in this structure is accessed by the worker thread, the node
+ * is never dereferenced there and only identifies the job.
+ */
+struct JobFileTask {
+	struct Type {
+		enum List {
+			SendJobData,
+			WriteInputFiles,
+			WriteOutputFiles,
+			SendJobResult,
+			CompressDebugInfo,
+			WriteDebugInfo
+		};
+	};
+
+	JobFileTask() : type(Type::SendJobData), node(NULL), id(0), success(true) {
+	}
+	JobFileTask(Type::List type, NetworkNode *node, unsigned int id)
+			: type(type), node(node), id(id), success(true) {
+	}
+
+	Type::List type;
+	NetworkNode *node;
+	unsigned int id;
+
+	QStringList inputFiles;
+	QStringList outputFiles;
+
+	/**
+	 * Packet which has to be sent to the node once the task is finished.
+	 */
+	Packet packet;
+	/**
+	 * False if some files could not be written, errors then contains messages
+	 * for the user.
+	 */
+	bool success;
+	QByteArray errors;
+
+	/**
+	 * Reads (and optionally compresses) the input files and appends them to
+	 * the already serialized header of a JobData packet.
+	 */
+	static JobFileTask createJobData(JobFileTask task, QByteArray packetData,
+		bool compress);
+	/**
+	 * Writes the files received in a JobData packet to the input files.
+	 */
+	static JobFileTask writeInputFiles(JobFileTask task,
+		QList<QByteArray> fileContent, bool compressed);
+	/**
+	 * Writes the files received in a JobFinished packet to the output files.
+	 */
+	static JobFileTask writeOutputFiles(JobFileTask task,
+		QList<QByteArray> fileContent);
+	/**
+	 * Reads and deletes the output files and appends them to the already
+	 * serialized header of a JobFinished packet. The input files are deleted
+	 * as well.
+	 */
+	static JobFileTask createJobFinished(JobFileTask task,
+		QByteArray packetData);
+	/**
+	 * Compresses the .dwo file in the first input file into the first output
+	 * file and deletes the input file.
+	 */
+	static JobFileTask compressDebugInfo(JobFileTask task);
+	/**
+	 * Decompresses the received .dwo file in the first input file into the
+	 * first output file and deletes the input file.
+	 */
+	static JobFileTask writeDebugInfo(JobFileTask task);
+};
+
+#endif
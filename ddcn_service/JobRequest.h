@@ -27,7 +27,9 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef JOBREQUEST_H_INCLUDED
 #define JOBREQUEST_H_INCLUDED
 
-#include <QTimer>
+#include "TimerWheel.h"
+
+#include <QString>
 
 class NetworkNode;
 
@@ -38,7 +40,7 @@ class NetworkNode;
 struct IncomingJobRequest {
 	NetworkNode *source;
 	unsigned int id;
-	QTimer timeout;
+	Deadline timeout;
 };
 
 /**
@@ -48,7 +50,12 @@ struct IncomingJobRequest {
 struct OutgoingJobRequest {
 	NetworkNode *target;
 	unsigned int id;
-	QTimer timeout;
+	/**
+	 * Identity of the toolchain of the waiting jobs the slot was requested
+	 * for (see ToolChain::getIdentity()).
+	 */
+	QString toolChain;
+	Deadline timeout;
 };
 
 #endif
@@ -0,0 +1,144 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "JobServer.h"
+#include "CompilerService.h"
+#include "CompilerNetwork.h"
+#include "LocalJobServer.h"
+#include "TemporaryFile.h"
+
+#include <QSettings>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Interval in which the capacity of the network is checked, in milliseconds.
+ */
+static const int UPDATE_INTERVAL = 1000;
+
+/**
+ * Byte used as a token, make writes back whatever it has read.
+ */
+static const char TOKEN = '+';
+
+JobServer::JobServer(CompilerService *service, CompilerNetwork *network)
+		: service(service), network(network), fd(-1), issuedTokens(0),
+		maxTokens(0) {
+	connect(&updateTimer, SIGNAL(timeout()), this, SLOT(updateTokens()));
+	connect(service, SIGNAL(maxThreadCountChanged(int)),
+		this, SLOT(updateTokens()));
+}
+JobServer::~JobServer() {
+	if (fd != -1) {
+		::close(fd);
+		unlink(fifoPath.toLocal8Bit().data());
+	}
+}
+
+bool JobServer::start() {
+	QSettings settings(QSettings::IniFormat, QSettings::UserScope, "ddcn", "ddcn");
+	if (!settings.value("service/jobserver", true).toBool()) {
+		return false;
+	}
+	maxTokens = settings.value("service/jobserver_max_tokens", 256).toInt();
+	if (!TemporaryFile::createPrivateDirectory(LocalJobServer::getRuntimeDirectory())) {
+		return false;
+	}
+	fifoPath = getFifoPath();
+	QByteArray path = fifoPath.toLocal8Bit();
+	// A leftover pipe of a crashed instance might still contain tokens of the
+	// old capacity
+	unlink(path.data());
+	if (mkfifo(path.data(), 0600) != 0) {
+		qWarning("JobServer: Could not create %s: %s", path.data(), strerror(errno));
+		return false;
+	}
+	// Opening the pipe for reading and writing does not block and keeps it
+	// open even if no make instance is attached
+	fd = open(path.data(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+	if (fd == -1) {
+		qWarning("JobServer: Could not open %s: %s", path.data(), strerror(errno));
+		unlink(path.data());
+		return false;
+	}
+	updateTokens();
+	updateTimer.start(UPDATE_INTERVAL);
+	return true;
+}
+
+QString JobServer::getFifoPath() {
+	return LocalJobServer::getRuntimeDirectory() + "/ddcn.jobserver";
+}
+
+void JobServer::updateTokens() {
+	if (fd == -1) {
+		return;
+	}
+	// If no make instance is attached, all tokens have to be in the pipe. make
+	// cannot attach while we hold the exclusive lock.
+	if (flock(fd, LOCK_EX | LOCK_NB) == 0) {
+		int available;
+		if (ioctl(fd, FIONREAD, &available) == 0 && available != issuedTokens) {
+			qDebug("JobServer: %d tokens were not returned by make.",
+				issuedTokens - available);
+			issuedTokens = available;
+		}
+		flock(fd, LOCK_UN);
+	}
+	// Every make instance can run one job without a token
+	int targetTokens = service->getMaxThreadCount()
+		+ (int)network->getRemoteCapacity() - 1;
+	if (targetTokens > maxTokens) {
+		targetTokens = maxTokens;
+	}
+	if (targetTokens < 0) {
+		targetTokens = 0;
+	}
+	if (targetTokens > issuedTokens) {
+		QByteArray tokens(targetTokens - issuedTokens, TOKEN);
+		ssize_t written = write(fd, tokens.data(), tokens.size());
+		if (written > 0) {
+			issuedTokens += written;
+		}
+	} else if (targetTokens < issuedTokens) {
+		// Only tokens which are in the pipe right now can be removed, the rest
+		// is removed in later updates once make has returned them
+		char buffer[256];
+		int count = issuedTokens - targetTokens;
+		if (count > (int)sizeof(buffer)) {
+			count = sizeof(buffer);
+		}
+		ssize_t received = read(fd, buffer, count);
+		if (received > 0) {
+			issuedTokens -= received;
+		}
+	}
+}
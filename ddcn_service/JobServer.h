@@ -0,0 +1,90 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef JOBSERVER_H_INCLUDED
+#define JOBSERVER_H_INCLUDED
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+
+class CompilerService;
+class CompilerNetwork;
+
+/**
+ * GNU make jobserver whose number of tokens follows the number of jobs which
+ * can currently be executed locally and by other peers.
+ *
+ * The jobserver is a named pipe which contains one byte per token. make takes
+ * a token before starting a job (apart from the first job, which needs no
+ * token) and writes it back once the job has finished. If the capacity grows,
+ * more tokens are written into the pipe. If it shrinks, tokens are read back
+ * from the pipe as soon as make returns them, so tokens which are held by make
+ * are never revoked.
+ *
+ * make is attached to the pipe with the ddcn_make script, which holds a shared
+ * flock() on the pipe while make is running. If make is killed, the tokens it
+ * held are never returned, so whenever no make instance holds the lock, the
+ * number of issued tokens is reset to the number of tokens in the pipe.
+ */
+class JobServer : public QObject {
+	Q_OBJECT
+public:
+	JobServer(CompilerService *service, CompilerNetwork *network);
+	~JobServer();
+
+	/**
+	 * Creates the named pipe and fills in the initial tokens.
+	 *
+	 * @return False if the jobserver is disabled or the pipe could not be
+	 * created.
+	 */
+	bool start();
+
+	/**
+	 * Returns the path of the named pipe, this has to match the path used by
+	 * ddcn_make.
+	 */
+	static QString getFifoPath();
+private slots:
+	void updateTokens();
+private:
+	CompilerService *service;
+	CompilerNetwork *network;
+
+	QString fifoPath;
+	int fd;
+	QTimer updateTimer;
+
+	/**
+	 * Number of tokens which have been written into the pipe and have not
+	 * been read back yet, including the tokens currently held by make.
+	 */
+	int issuedTokens;
+	int maxTokens;
+};
+
+#endif
@@ -0,0 +1,432 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "LocalJobServer.h"
+#include "CompilerService.h"
+#include "Job.h"
+#include "TemporaryFile.h"
+
+#include <QDir>
+#include <QFutureInterface>
+#include <QFutureWatcher>
+#include <QRunnable>
+#include <QSettings>
+#include <QSocketNotifier>
+#include <QtEndian>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Maximum size of a request, larger requests are rejected.
+ */
+static const int MAX_REQUEST_SIZE = 1024 * 1024;
+
+/**
+ * Maximum number of threads which read stdin of clients or write results to
+ * them. Every thread might be blocked by a client for a long time, e.g. if its
+ * terminal is stopped, so there is one thread per client as long as possible.
+ */
+static const int MAX_CLIENT_THREADS = 512;
+
+struct LocalJobResult {
+	int socket;
+	int fds[3];
+	QByteArray stdout;
+	QByteArray stderr;
+	int returnValue;
+};
+
+static bool writeAll(int fd, const char *data, int size) {
+	while (size > 0) {
+		ssize_t written = write(fd, data, size);
+		if (written == -1 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+/**
+ * Reads the complete stdin of a client, executed in the thread pool for client
+ * I/O.
+ */
+static QByteArray readStdin(int fd) {
+	QByteArray data;
+	char buffer[65536];
+	while (true) {
+		ssize_t count = read(fd, buffer, sizeof(buffer));
+		if (count == -1 && errno == EINTR) {
+			continue;
+		}
+		if (count <= 0) {
+			break;
+		}
+		data.append(buffer, count);
+	}
+	return data;
+}
+
+/**
+ * Writes the output of a job to the terminal of the client and then sends the
+ * return value, executed in the thread pool for client I/O as the client's
+ * pipes might block.
+ */
+static void writeResult(LocalJobResult result) {
+	writeAll(result.fds[1], result.stdout.constData(), result.stdout.size());
+	writeAll(result.fds[2], result.stderr.constData(), result.stderr.size());
+	send(result.socket, &result.returnValue, sizeof(result.returnValue),
+		MSG_NOSIGNAL);
+	for (int i = 0; i < 3; i++) {
+		close(result.fds[i]);
+	}
+	close(result.socket);
+}
+
+/**
+ * Executes readStdin() in the thread pool for client I/O.
+ */
+class StdinReader : public QRunnable, public QFutureInterface<QByteArray> {
+public:
+	StdinReader(int fd) : fd(fd) {
+	}
+
+	QFuture<QByteArray> start(QThreadPool *pool) {
+		reportStarted();
+		QFuture<QByteArray> future = this->future();
+		pool->start(this);
+		return future;
+	}
+	void run() {
+		reportResult(readStdin(fd));
+		reportFinished();
+	}
+private:
+	int fd;
+};
+
+/**
+ * Executes writeResult() in the thread pool for client I/O.
+ */
+class ResultWriter : public QRunnable {
+public:
+	ResultWriter(const LocalJobResult &result) : result(result) {
+	}
+
+	void run() {
+		writeResult(result);
+	}
+private:
+	LocalJobResult result;
+};
+
+LocalJobServer::LocalJobServer(CompilerService *service) : service(service),
+		listenFd(-1), listenNotifier(NULL) {
+	// The blocking I/O must not use the global thread pool, where it would
+	// stall the file tasks of all other jobs
+	clientThreads.setMaxThreadCount(MAX_CLIENT_THREADS);
+	connect(service, SIGNAL(localJobCompilationFinished(Job*)),
+		this, SLOT(onJobFinished(Job*)));
+}
+LocalJobServer::~LocalJobServer() {
+	foreach (Client *client, clients) {
+		closeClient(client);
+	}
+	foreach (Client *client, jobs) {
+		closeClient(client);
+	}
+	if (listenFd != -1) {
+		delete listenNotifier;
+		::close(listenFd);
+		unlink(socketPath.toLocal8Bit().data());
+	}
+}
+
+bool LocalJobServer::listen() {
+	QSettings settings(QSettings::IniFormat, QSettings::UserScope, "ddcn", "ddcn");
+	if (!settings.value("service/local_socket", true).toBool()) {
+		return false;
+	}
+	// Writing to the terminal of a client which has been killed must not kill
+	// the service
+	signal(SIGPIPE, SIG_IGN);
+	if (!TemporaryFile::createPrivateDirectory(getRuntimeDirectory())) {
+		return false;
+	}
+	socketPath = getSocketPath();
+	QByteArray path = socketPath.toLocal8Bit();
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (path.size() >= (int)sizeof(address.sun_path)) {
+		qWarning("LocalJobServer: Socket path too long.");
+		return false;
+	}
+	strcpy(address.sun_path, path.data());
+	listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (listenFd == -1) {
+		qWarning("LocalJobServer: Could not create socket: %s", strerror(errno));
+		return false;
+	}
+	// Only one instance of the service is running (it is registered at D-Bus
+	// before), so an existing socket is a leftover from a crashed instance
+	unlink(path.data());
+	if (bind(listenFd, (struct sockaddr*)&address, sizeof(address)) != 0
+			|| ::listen(listenFd, 128) != 0) {
+		qWarning("LocalJobServer: Could not listen on %s: %s", path.data(),
+			strerror(errno));
+		::close(listenFd);
+		listenFd = -1;
+		return false;
+	}
+	listenNotifier = new QSocketNotifier(listenFd, QSocketNotifier::Read, this);
+	connect(listenNotifier, SIGNAL(activated(int)),
+		this, SLOT(onConnectionPending()));
+	return true;
+}
+
+QString LocalJobServer::getSocketPath() {
+	return getRuntimeDirectory() + "/ddcn.sock";
+}
+QString LocalJobServer::getRuntimeDirectory() {
+	const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+	if (runtimeDir && runtimeDir[0] != 0) {
+		return QString::fromLocal8Bit(runtimeDir);
+	}
+	return QDir::tempPath() + "/ddcn-" + QString::number(getuid());
+}
+
+void LocalJobServer::onConnectionPending() {
+	int fd;
+	while ((fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+		// Only processes of our own user may submit jobs
+		struct ucred credentials;
+		socklen_t length = sizeof(credentials);
+		if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0
+				|| credentials.uid != getuid()) {
+			qWarning("LocalJobServer: Rejected connection from a different user.");
+			::close(fd);
+			continue;
+		}
+		Client *client = new Client;
+		client->socket = fd;
+		client->notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+		connect(client->notifier, SIGNAL(activated(int)),
+			this, SLOT(onClientReadable(int)));
+		clients.insert(fd, client);
+	}
+}
+void LocalJobServer::onClientReadable(int socket) {
+	Client *client = clients.value(socket, NULL);
+	if (!client) {
+		return;
+	}
+	if (!receiveRequest(client)) {
+		clients.remove(socket);
+		closeClient(client);
+		return;
+	}
+	if (client->parameters.isEmpty()) {
+		// The request is not complete yet
+		return;
+	}
+	// The connection is idle until the job has finished
+	clients.remove(socket);
+	client->notifier->setEnabled(false);
+	if (client->readStdin) {
+		QFutureWatcher<QByteArray> *watcher = new QFutureWatcher<QByteArray>(this);
+		connect(watcher, SIGNAL(finished()), this, SLOT(onStdinRead()));
+		stdinReaders.insert(watcher, client);
+		StdinReader *reader = new StdinReader(client->fds[0]);
+		watcher->setFuture(reader->start(&clientThreads));
+	} else {
+		startJob(client, QByteArray());
+	}
+}
+void LocalJobServer::onStdinRead() {
+	QFutureWatcher<QByteArray> *watcher = static_cast<QFutureWatcher<QByteArray>*>(sender());
+	Client *client = stdinReaders.take(watcher);
+	startJob(client, watcher->result());
+	watcher->deleteLater();
+}
+void LocalJobServer::onJobFinished(Job *job) {
+	// Jobs from D-Bus are answered by CompilerServiceAdaptor
+	Client *client = jobs.take(job);
+	if (!client) {
+		return;
+	}
+	JobResult result = job->getJobResult();
+	finishClient(client, result.stdout, result.stderr, result.returnValue);
+}
+
+bool LocalJobServer::receiveRequest(Client *client) {
+	char buffer[65536];
+	union {
+		struct cmsghdr header;
+		char data[CMSG_SPACE(3 * sizeof(int))];
+	} control;
+	struct iovec vector;
+	vector.iov_base = buffer;
+	vector.iov_len = sizeof(buffer);
+	struct msghdr message;
+	memset(&message, 0, sizeof(message));
+	message.msg_iov = &vector;
+	message.msg_iovlen = 1;
+	message.msg_control = control.data;
+	message.msg_controllen = sizeof(control.data);
+	ssize_t received = recvmsg(client->socket, &message, MSG_CMSG_CLOEXEC);
+	if (received == -1) {
+		return errno == EAGAIN || errno == EINTR;
+	}
+	if (received == 0) {
+		// The client closed the connection before sending the request
+		return false;
+	}
+	for (struct cmsghdr *header = CMSG_FIRSTHDR(&message); header != NULL;
+			header = CMSG_NXTHDR(&message, header)) {
+		if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) {
+			continue;
+		}
+		int count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		int *fds = (int*)CMSG_DATA(header);
+		for (int i = 0; i < count; i++) {
+			if (i < 3 && client->fds[i] == -1) {
+				client->fds[i] = fds[i];
+			} else {
+				::close(fds[i]);
+			}
+		}
+	}
+	client->request.append(buffer, received);
+	if (client->request.size() < (int)sizeof(quint32)) {
+		return true;
+	}
+	quint32 size = qFromBigEndian<quint32>((const uchar*)client->request.constData());
+	if (size > (quint32)MAX_REQUEST_SIZE) {
+		qWarning("LocalJobServer: Request too large.");
+		return false;
+	}
+	if ((quint32)client->request.size() < sizeof(quint32) + size) {
+		return true;
+	}
+	if (client->fds[0] == -1 || client->fds[1] == -1 || client->fds[2] == -1) {
+		qWarning("LocalJobServer: Client did not pass stdin/stdout/stderr.");
+		return false;
+	}
+	if (!parseRequest(client, client->request.mid(sizeof(quint32), size))
+			|| client->parameters.isEmpty()) {
+		qWarning("LocalJobServer: Received invalid request.");
+		return false;
+	}
+	client->request.clear();
+	return true;
+}
+static bool readInt(const QByteArray &request, int *position, quint32 *value) {
+	if (*position + (int)sizeof(quint32) > request.size()) {
+		return false;
+	}
+	*value = qFromBigEndian<quint32>((const uchar*)request.constData() + *position);
+	*position += sizeof(quint32);
+	return true;
+}
+static bool readString(const QByteArray &request, int *position, QString *value) {
+	quint32 length;
+	if (!readInt(request, position, &length)
+			|| length > (quint32)(request.size() - *position)) {
+		return false;
+	}
+	*value = QString::fromLocal8Bit(request.constData() + *position, length);
+	*position += length;
+	return true;
+}
+bool LocalJobServer::parseRequest(Client *client, const QByteArray &request) {
+	int position = 0;
+	quint32 parameterCount;
+	if (!readInt(request, &position, &parameterCount)) {
+		return false;
+	}
+	for (quint32 i = 0; i < parameterCount; i++) {
+		QString parameter;
+		if (!readString(request, &position, &parameter)) {
+			return false;
+		}
+		client->parameters.append(parameter);
+	}
+	if (!readString(request, &position, &client->toolChain)
+			|| !readString(request, &position, &client->workingPath)
+			|| !readString(request, &position, &client->language)
+			|| position + 1 != request.size()) {
+		return false;
+	}
+	client->readStdin = request[position] != 0;
+	return true;
+}
+void LocalJobServer::startJob(Client *client, const QByteArray &stdinData) {
+	Job *job = service->createJob(client->parameters, client->toolChain,
+		client->workingPath, stdinData, client->language);
+	if (!job) {
+		finishClient(client, QByteArray(),
+			QString("Error: ddcn: Unsupported toolchain.\n").toAscii(), -1);
+		return;
+	}
+	jobs.insert(job, client);
+	service->addJob(job);
+}
+void LocalJobServer::finishClient(Client *client, const QByteArray &stdout,
+		const QByteArray &stderr, int returnValue) {
+	LocalJobResult result;
+	result.socket = client->socket;
+	for (int i = 0; i < 3; i++) {
+		result.fds[i] = client->fds[i];
+	}
+	result.stdout = stdout;
+	result.stderr = stderr;
+	result.returnValue = returnValue;
+	// The descriptors are closed by writeResult()
+	client->notifier->deleteLater();
+	delete client;
+	clientThreads.start(new ResultWriter(result));
+}
+void LocalJobServer::closeClient(Client *client) {
+	// We might be called from within the notifier's signal
+	client->notifier->setEnabled(false);
+	client->notifier->deleteLater();
+	for (int i = 0; i < 3; i++) {
+		if (client->fds[i] != -1) {
+			::close(client->fds[i]);
+		}
+	}
+	::close(client->socket);
+	delete client;
+}
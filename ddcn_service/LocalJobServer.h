@@ -0,0 +1,147 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef LOCALJOBSERVER_H_INCLUDED
+#define LOCALJOBSERVER_H_INCLUDED
+
+#include <QObject>
+#include <QHash>
+#include <QByteArray>
+#include <QStringList>
+#include <QThreadPool>
+
+class CompilerService;
+class Job;
+class QSocketNotifier;
+
+/**
+ * Unix domain socket which accepts jobs from ddcn_gcc without going through
+ * the D-Bus daemon.
+ *
+ * A client sends a single request which contains the whole job so that the
+ * client does not need to initialize Qt (see LocalClient in ddcn_gcc). All
+ * integers are 32 bit in network byte order, strings are sent as their length
+ * followed by the local 8-bit encoded characters:
+ *
+ * - size of the rest of the request
+ * - number of compiler parameters, followed by the parameters
+ * - toolchain version hint, empty for the default toolchain
+ * - working directory
+ * - language
+ * - one byte which is 1 if the compiler reads from stdin
+ *
+ * The toolchain is resolved and validated by the service. The client's stdin,
+ * stdout and stderr are attached to the request as SCM_RIGHTS file
+ * descriptors.
+ *
+ * stdin is read directly from the passed descriptor, and the output of the
+ * compiler is written directly to the passed stdout and stderr descriptors.
+ * Afterwards the return value of the job is sent back over the socket as a
+ * native int and the connection is closed.
+ *
+ * Only processes of the same user are accepted.
+ */
+class LocalJobServer : public QObject {
+	Q_OBJECT
+public:
+	LocalJobServer(CompilerService *service);
+	~LocalJobServer();
+
+	/**
+	 * Opens the socket.
+	 *
+	 * @return False if the socket could not be created, in this case clients
+	 * fall back to D-Bus.
+	 */
+	bool listen();
+
+	/**
+	 * Returns the path of the socket, this has to match the path used by
+	 * ddcn_gcc.
+	 */
+	static QString getSocketPath();
+	/**
+	 * Returns the directory which contains the socket and the jobserver pipe.
+	 * This is $XDG_RUNTIME_DIR or a directory in the temporary directory
+	 * named after the user, it has to be created with
+	 * TemporaryFile::createPrivateDirectory() so that no other user can
+	 * replace the files within it.
+	 */
+	static QString getRuntimeDirectory();
+private slots:
+	void onConnectionPending();
+	void onClientReadable(int socket);
+	void onStdinRead();
+	void onJobFinished(Job *job);
+private:
+	struct Client {
+		Client() : socket(-1), notifier(NULL), readStdin(false) {
+			fds[0] = fds[1] = fds[2] = -1;
+		}
+
+		int socket;
+		QSocketNotifier *notifier;
+		QByteArray request;
+		/**
+		 * stdin, stdout and stderr of the client.
+		 */
+		int fds[3];
+
+		QStringList parameters;
+		QString toolChain;
+		QString workingPath;
+		QString language;
+		bool readStdin;
+	};
+
+	bool receiveRequest(Client *client);
+	bool parseRequest(Client *client, const QByteArray &request);
+	void startJob(Client *client, const QByteArray &stdinData);
+	/**
+	 * Writes the result to the client in a separate thread, closes the file
+	 * descriptors and deletes the client.
+	 */
+	void finishClient(Client *client, const QByteArray &stdout,
+		const QByteArray &stderr, int returnValue);
+	void closeClient(Client *client);
+
+	CompilerService *service;
+
+	int listenFd;
+	QSocketNotifier *listenNotifier;
+	QString socketPath;
+
+	QHash<int, Client*> clients;
+	QHash<QObject*, Client*> stdinReaders;
+	QHash<Job*, Client*> jobs;
+
+	/**
+	 * Threads for the blocking I/O on the descriptors passed by clients.
+	 */
+	QThreadPool clientThreads;
+};
+
+#endif
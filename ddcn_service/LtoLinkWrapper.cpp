@@ -0,0 +1,148 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "LtoLinkWrapper.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QProcess>
+#include <QSettings>
+
+LtoLinkWrapper::LtoLinkWrapper() {
+	QSettings settings(QSettings::IniFormat, QSettings::UserScope, "ddcn", "ddcn");
+	enabled = settings.value("service/distribute_ltrans", true).toBool();
+	directory = settings.value("service/lto_wrapper_dir",
+			QDir::homePath() + "/.cache/ddcn/lto").toString();
+	if (enabled && !QDir().mkpath(directory)) {
+		qWarning("Could not create the LTO wrapper directory \"%s\".",
+				directory.toAscii().data());
+		enabled = false;
+	}
+}
+
+QString LtoLinkWrapper::getWrapper(const ToolChain &toolChain,
+		const QString &language, QString *execPrefix) {
+	if (!enabled) {
+		return "";
+	}
+	QString driver = toolChain.getPath(language);
+	if (driver.isEmpty()) {
+		return "";
+	}
+	*execPrefix = getExecPrefix(driver);
+	if (execPrefix->isEmpty()) {
+		return "";
+	}
+	QString key = toolChain.getVersion() + " " + driver;
+	if (wrappers.contains(key)) {
+		return wrappers.value(key);
+	}
+	QString fileName = directory + "/"
+			+ QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Sha1).toHex()
+			+ ".sh";
+	QString script = "#!/bin/sh\n"
+			"# Created by ddcn_service, passes LTRANS calls of gcc -flto to ddcn\n"
+			"for parameter in \"$@\"; do\n"
+			"\tif [ \"$parameter\" = \"-fltrans\" ]; then\n"
+			"\t\tDDCN_TOOLCHAIN=" + quote(toolChain.getVersion())
+			+ " DDCN_LANGUAGE=" + quote(language) + " exec ddcn_gcc \"$@\"\n"
+			"\tfi\n"
+			"done\n"
+			"exec " + quote(driver) + " \"$@\"\n";
+	QByteArray content = script.toLocal8Bit();
+	// Links which are still running may use an existing script, so it is only
+	// replaced if the content changed
+	QFile existing(fileName);
+	if (!existing.open(QIODevice::ReadOnly) || existing.readAll() != content) {
+		existing.close();
+		QFile file(fileName + ".tmp");
+		if (!file.open(QIODevice::WriteOnly)
+				|| file.write(content) != content.size()) {
+			qWarning("Could not write the LTO wrapper \"%s\".",
+					fileName.toAscii().data());
+			file.remove();
+			return "";
+		}
+		file.close();
+		file.setPermissions(QFile::ReadOwner | QFile::WriteOwner
+				| QFile::ExeOwner | QFile::ReadGroup | QFile::ExeGroup
+				| QFile::ReadOther | QFile::ExeOther);
+		QFile::remove(fileName);
+		if (!file.rename(fileName)) {
+			file.remove();
+			return "";
+		}
+	}
+	wrappers.insert(key, fileName);
+	return fileName;
+}
+
+QString LtoLinkWrapper::getExecPrefix(const QString &driver) {
+	if (execPrefixes.contains(driver)) {
+		return execPrefixes.value(driver);
+	}
+	// This is only done once per driver and takes a few milliseconds, so it
+	// is done synchronously
+	QProcess process;
+	process.start(driver, QStringList("-print-search-dirs"));
+	QString execPrefix;
+	if (process.waitForStarted(5000) && process.waitForFinished(5000)) {
+		QStringList lines = QString::fromLocal8Bit(
+				process.readAllStandardOutput().constData()).split('\n');
+		foreach (QString line, lines) {
+			if (!line.startsWith("install: ")) {
+				continue;
+			}
+			// The installation directory is <prefix>/<machine>/<version>/
+			QString installDir = line.mid(9).trimmed();
+			while (installDir.endsWith('/')) {
+				installDir.chop(1);
+			}
+			for (int i = 0; i < 2 && installDir.contains('/'); i++) {
+				installDir = installDir.left(installDir.lastIndexOf('/'));
+			}
+			if (!installDir.isEmpty()) {
+				execPrefix = installDir + "/";
+			}
+			break;
+		}
+	} else {
+		process.kill();
+		process.waitForFinished(1000);
+	}
+	if (execPrefix.isEmpty()) {
+		qWarning("Could not determine the installation directory of \"%s\".",
+				driver.toAscii().data());
+	}
+	execPrefixes.insert(driver, execPrefix);
+	return execPrefix;
+}
+
+QString LtoLinkWrapper::quote(const QString &string) {
+	return "'" + QString(string).replace("'", "'\\''") + "'";
+}
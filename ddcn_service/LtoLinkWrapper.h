@@ -0,0 +1,93 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef LTOLINKWRAPPER_H_INCLUDED
+#define LTOLINKWRAPPER_H_INCLUDED
+
+#include "ToolChain.h"
+
+#include <QHash>
+#include <QStringList>
+
+/**
+ * Lets the LTRANS stage of link-time optimization run as ordinary ddcn jobs.
+ *
+ * When gcc links with "-flto", lto-wrapper first runs the whole program
+ * analysis (WPA) which splits the program into partitions, and then compiles
+ * every partition with a separate "gcc -xlto -c -fltrans" call. Both are
+ * started via the driver named in COLLECT_GCC, which gcc sets to its own
+ * argv[0]. Link jobs with "-flto" are therefore executed with argv[0] pointing
+ * to a small shell script which passes LTRANS calls to ddcn_gcc and everything
+ * else to the real driver. The LTRANS partitions already are compiler input,
+ * so these jobs are delegated without preprocessing.
+ *
+ * As gcc derives its installation directory from argv[0], GCC_EXEC_PREFIX is
+ * set to the prefix reported by "gcc -print-search-dirs" so that the driver
+ * still finds the linker plugin.
+ *
+ * The scripts are stored in "service/lto_wrapper_dir", the feature is
+ * controlled by "service/distribute_ltrans" (enabled by default).
+ */
+class LtoLinkWrapper {
+public:
+	LtoLinkWrapper();
+
+	/**
+	 * Returns true if LTRANS calls shall be passed to ddcn.
+	 */
+	bool isEnabled() {
+		return enabled;
+	}
+
+	/**
+	 * Returns the script which is used as argv[0] for a link with the given
+	 * toolchain, or "" if the toolchain cannot be wrapped. The script is
+	 * created if necessary.
+	 * @param toolChain Toolchain used for the link.
+	 * @param language Language of the driver ("c" or "c++").
+	 * @param execPrefix Is set to the value of GCC_EXEC_PREFIX for the link.
+	 */
+	QString getWrapper(const ToolChain &toolChain, const QString &language,
+			QString *execPrefix);
+private:
+	/**
+	 * Returns the GCC_EXEC_PREFIX of a compiler driver, or "" if it cannot be
+	 * determined. The result is cached.
+	 */
+	QString getExecPrefix(const QString &driver);
+	/**
+	 * Quotes a string for use in a shell script.
+	 */
+	static QString quote(const QString &string);
+
+	bool enabled;
+	QString directory;
+	QHash<QString, QString> execPrefixes;
+	QHash<QString, QString> wrappers;
+};
+
+#endif
@@ -0,0 +1,138 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef MESSAGERING_H_INCLUDED
+#define MESSAGERING_H_INCLUDED
+
+#include <QAtomicInt>
+#include <QList>
+
+/**
+ * Lock-free queue which passes messages from exactly one producer thread to
+ * exactly one consumer thread.
+ *
+ * The messages are stored in a fixed-size ring buffer. If the ring is full,
+ * push() keeps the messages in an overflow list which is only accessed by the
+ * producer and which is moved into the ring by the next call to push() or
+ * flush().
+ *
+ * The ring also tracks whether the consumer has to be woken up: push() only
+ * returns true for the first message after the consumer has called
+ * takeAll(), so that the producer only has to signal the consumer once per
+ * batch of messages.
+ */
+template<typename T> class MessageRing {
+public:
+	/**
+	 * Creates a ring which can hold size - 1 messages. size has to be a power
+	 * of two.
+	 */
+	MessageRing(int size = 4096) : size(size), messages(new T[size]),
+			readIndex(0), writeIndex(0), wakeupPending(0) {
+	}
+	~MessageRing() {
+		delete[] messages;
+	}
+
+	/**
+	 * Adds a message to the ring. Must only be called from the producer
+	 * thread.
+	 *
+	 * @return True if the consumer has to be woken up.
+	 */
+	bool push(const T &message) {
+		if (overflow.isEmpty() && tryPush(message)) {
+			return wakeupPending.testAndSetOrdered(0, 1);
+		}
+		overflow.append(message);
+		return flush();
+	}
+	/**
+	 * Tries to move messages from the overflow list into the ring. Must only
+	 * be called from the producer thread.
+	 *
+	 * @return True if the consumer has to be woken up.
+	 */
+	bool flush() {
+		bool pushed = false;
+		while (!overflow.isEmpty() && tryPush(overflow.first())) {
+			overflow.removeFirst();
+			pushed = true;
+		}
+		return pushed && wakeupPending.testAndSetOrdered(0, 1);
+	}
+	/**
+	 * Returns true if the producer still holds messages which did not fit
+	 * into the ring. Must only be called from the producer thread.
+	 */
+	bool hasOverflow() const {
+		return !overflow.isEmpty();
+	}
+
+	/**
+	 * Removes all messages from the ring and appends them to the list. Must
+	 * only be called from the consumer thread.
+	 */
+	void takeAll(QList<T> &list) {
+		// Reset the flag first, so that messages pushed while we are reading
+		// the ring cause another wakeup
+		wakeupPending.fetchAndStoreOrdered(0);
+		// Only the consumer changes readIndex, so no barrier is needed here
+		int read = readIndex;
+		int write = writeIndex.fetchAndAddAcquire(0);
+		while (read != write) {
+			list.append(messages[read]);
+			// Release the memory held by the message early
+			messages[read] = T();
+			read = (read + 1) & (size - 1);
+		}
+		readIndex.fetchAndStoreRelease(read);
+	}
+private:
+	MessageRing(const MessageRing &other);
+	MessageRing &operator=(const MessageRing &other);
+
+	bool tryPush(const T &message) {
+		int write = writeIndex;
+		int next = (write + 1) & (size - 1);
+		if (next == readIndex.fetchAndAddAcquire(0)) {
+			return false;
+		}
+		messages[write] = message;
+		writeIndex.fetchAndStoreRelease(next);
+		return true;
+	}
+
+	int size;
+	T *messages;
+	QAtomicInt readIndex;
+	QAtomicInt writeIndex;
+	QAtomicInt wakeupPending;
+
+	QList<T> overflow;
+};
+
+#endif
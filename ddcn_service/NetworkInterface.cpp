@@ -25,29 +25,26 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "NetworkInterface.h"
+#include "BulkChannel.h"
 
 #include <ariba/utility/system/StartupWrapper.h>
 #include <QDebug>
 #include <QtEndian>
 #include <QThread>
+#include <QSettings>
+#include <QSocketNotifier>
+#include <QTimer>
+#include <QDataStream>
+#include <openssl/rand.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include <log4cxx/appenderskeleton.h>
 
-uint qHash(ariba::utility::NodeID nodeId) {
-	return qHash(nodeId.toString().c_str());
-}
-
 struct GroupMessage {
 	ariba::utility::NodeID nodeId;
 	ariba::ServiceID serviceId;
 	Packet packet;
 };
-struct PeerMessage {
-	ariba::utility::NodeID nodeId;
-	ariba::utility::LinkID linkId;
-	// This is an encrypted stream, so no Packet here
-	QByteArray message;
-	unsigned short serial;
-};
 
 class DdcnMessage : public ariba::Message {
 	VSERIALIZEABLE;
@@ -184,20 +181,47 @@ const ariba::ServiceID NetworkInterface::SERVICE_ID = ariba::ServiceID(42);
 
 NetworkInterface::NetworkInterface(QString name,
 		const PrivateKey &privateKey) : name(name), privateKey(privateKey),
-		discoveryTimer(this) {
+		bulkListenFd(-1), bulkPort(0), maxBulkFileSize(0), bulkListenNotifier(NULL),
+		encryptionRequired(true), discoveryTimer(this), nextTLSThread(0),
+		aribaEventFd(-1), aribaEventNotifier(NULL),
+		aribaEventFlushScheduled(false), outgoingFlushScheduled(false),
+		identityGeneration(0) {
 	certificate = Certificate::createSelfSigned(privateKey);
-	// We use signals/slots to pass data from the Ariba thread to the Qt thread
-	connect(this, SIGNAL(aribaMessage(QByteArray, unsigned short, ariba::utility::NodeID, ariba::utility::LinkID)),
-		SLOT(onAribaMessage(QByteArray, unsigned short, ariba::utility::NodeID, ariba::utility::LinkID)),
-		Qt::QueuedConnection);
-	connect(this, SIGNAL(aribaLinkUp(ariba::utility::LinkID, ariba::utility::NodeID)),
-		SLOT(onAribaLinkUp(ariba::utility::LinkID, ariba::utility::NodeID)), Qt::QueuedConnection);
-	connect(this, SIGNAL(aribaLinkDown(ariba::utility::LinkID, ariba::utility::NodeID)),
-		SLOT(onAribaLinkDown(ariba::utility::LinkID, ariba::utility::NodeID)), Qt::QueuedConnection);
-	connect(this, SIGNAL(aribaLinkChanged(ariba::utility::LinkID, ariba::utility::NodeID)),
-		SLOT(onAribaLinkChanged(ariba::utility::LinkID, ariba::utility::NodeID)), Qt::QueuedConnection);
-	connect(this, SIGNAL(aribaLinkFail(ariba::utility::LinkID, ariba::utility::NodeID)),
-		SLOT(onAribaLinkFail(ariba::utility::LinkID, ariba::utility::NodeID)), Qt::QueuedConnection);
+	// Encryption is done in worker threads so that the main thread is not
+	// limited to the throughput of a single core
+	int tlsThreadCount = qMax(1, QThread::idealThreadCount());
+	for (int i = 0; i < tlsThreadCount; i++) {
+		QThread *thread = new QThread;
+		thread->start();
+		tlsThreads.append(thread);
+	}
+	// Open the socket for direct connections which transfer job files
+	QSettings settings(QSettings::IniFormat, QSettings::UserScope, "ddcn", "ddcn");
+	if (settings.value("network/bulk_channel", true).toBool()) {
+		quint16 port = settings.value("network/bulk_port", 0).toUInt();
+		// Limit for received files in MiB
+		maxBulkFileSize = settings.value("network/max_bulk_file_size",
+			1024).toULongLong() * 1024 * 1024;
+		bulkListenFd = BulkChannel::listen(port, &bulkPort);
+		if (bulkListenFd != -1) {
+			bulkListenNotifier = new QSocketNotifier(bulkListenFd,
+				QSocketNotifier::Read, this);
+			connect(bulkListenNotifier, SIGNAL(activated(int)),
+				this, SLOT(onBulkConnectionPending()));
+		} else {
+			qWarning("Could not create bulk channel socket, sending all data via ariba.");
+		}
+	}
+	// Events from the Ariba thread are passed to the Qt thread through a ring,
+	// the eventfd wakes up the Qt thread once for each batch
+	aribaEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (aribaEventFd == -1) {
+		qFatal("Could not create eventfd.");
+	}
+	aribaEventNotifier = new QSocketNotifier(aribaEventFd,
+		QSocketNotifier::Read, this);
+	connect(aribaEventNotifier, SIGNAL(activated(int)),
+		this, SLOT(onAribaEventsAvailable()));
 	// Start networking
 	ariba::utility::StartupWrapper::startSystem();
 #ifdef HAVE_LOG4CXX_LOGGER_H
@@ -213,11 +237,37 @@ NetworkInterface::NetworkInterface(QString name,
 NetworkInterface::~NetworkInterface() {
 	ariba::utility::StartupWrapper::shutdown(this, true);
 	ariba::utility::StartupWrapper::stopSystem();
+	foreach (BulkChannel *channel, connectingBulkChannels.keys()) {
+		delete channel;
+	}
+	foreach (BulkChannel *channel, acceptedBulkChannels) {
+		delete channel;
+	}
+	if (bulkListenFd != -1) {
+		delete bulkListenNotifier;
+		::close(bulkListenFd);
+	}
+	foreach (QThread *thread, tlsThreads) {
+		thread->quit();
+		thread->wait();
+		delete thread;
+	}
+	delete aribaEventNotifier;
+	::close(aribaEventFd);
 }
 
 void NetworkInterface::changeIdentity(QString name, const PrivateKey &privateKey) {
 	this->name = name;
 	this->privateKey = privateKey;
+	certificate = Certificate::createSelfSigned(privateKey);
+	identityGeneration++;
+	// Resumed sessions would still use the old certificate
+	TLS::clearSessionCache();
+}
+void NetworkInterface::setEncryptionRequired(bool required) {
+	encryptionRequired = required;
+	// Stored sessions might use cipher suites which are not allowed anymore
+	TLS::clearSessionCache();
 }
 void NetworkInterface::restart() {
 	// Stop the system
@@ -225,17 +275,16 @@ void NetworkInterface::restart() {
 	ariba::utility::StartupWrapper::stopSystem();
 	// Kill all existing connections
 	knownNodes.clear();
-	QMapIterator<QString, NetworkNode*> it(onlineNodes);
-	while (it.hasNext()) {
-		it.next();
-		emit peerDisconnected(it.value());
-		delete it.value();
+	foreach (NetworkNode *networkNode, onlineNodes.getAll()) {
+		emit peerDisconnected(networkNode);
+		removeBulkChannels(networkNode);
+		delete networkNode;
 	}
-	it = QMapIterator<QString, NetworkNode*>(pendingNodes);
-	while (it.hasNext()) {
-		it.next();
-		delete it.value();
+	foreach (NetworkNode *networkNode, pendingNodes) {
+		delete networkNode;
 	}
+	onlineNodes.clear();
+	pendingNodes.clear();
 	// Start the system
 	ariba::utility::StartupWrapper::startSystem();
 #ifdef HAVE_LOG4CXX_LOGGER_H
@@ -249,6 +298,15 @@ void NetworkInterface::restart() {
 #endif
 }
 
+void NetworkInterface::addBootstrapHints(const QString &bootstrapHints) {
+	SystemQueue::instance().scheduleEvent(SystemEvent(this,
+		ADD_BOOTSTRAP_HINTS_EVENT, new std::string(bootstrapHints.toStdString())));
+}
+void NetworkInterface::reconnect(NetworkNode *node) {
+	SystemQueue::instance().scheduleEvent(SystemEvent(this,
+		DROP_LINK_EVENT, new ariba::utility::LinkID(node->aribaLink)));
+}
+
 void NetworkInterface::send(NetworkNode *node, const Packet &packet) {
 	qDebug("Sending packet.");
 	node->sendPacket(packet);
@@ -264,10 +322,8 @@ void NetworkInterface::send(McpoGroup *group, const Packet &packet) {
 }
 void NetworkInterface::sendToAll(const Packet &packet) {
 	// TODO: Use an MCPO broadcast here?
-	QMap<QString, NetworkNode*>::Iterator it = onlineNodes.begin();
-	while (it != onlineNodes.end()) {
-		send(it.value(), packet);
-		it++;
+	foreach (NetworkNode *networkNode, onlineNodes.getAll()) {
+		send(networkNode, packet);
 	}
 }
 McpoGroup *NetworkInterface::joinGroup(ariba::ServiceID group) {
@@ -295,22 +351,14 @@ void NetworkInterface::leaveGroup(McpoGroup *group) {
 }
 
 NetworkNode *NetworkInterface::getNetworkNode(const PublicKey &publicKey) {
-	// TODO: Too slow
-	QMap<QString, NetworkNode*>::Iterator it = onlineNodes.begin();
-	while (it != onlineNodes.end()) {
-		if (it.value()->getPublicKey() == publicKey) {
-			return it.value();
-		}
-		it++;
-	}
-	return NULL;
+	return onlineNodes.get(publicKey);
 }
 
 bool NetworkInterface::onLinkRequest(const ariba::utility::NodeID &remote) {
-	if (knownNodes.contains(remote.toString().c_str())) {
+	if (knownNodes.contains(remote)) {
 		return false;
 	}
-	knownNodes.insert(remote.toString().c_str());
+	knownNodes.insert(remote);
 	return true;
 }
 void NetworkInterface::onMessage(const ariba::DataMessage &msg,
@@ -322,26 +370,82 @@ void NetworkInterface::onMessage(const ariba::DataMessage &msg,
 	DdcnMessage* ddcnMessage = msg.getMessage()->convert<DdcnMessage>();
 	if (ddcnMessage->getData().size() == 0) {
 		qCritical("Received empty message.");
+		delete ddcnMessage;
 		return;
 	}
-	emit aribaMessage(ddcnMessage->getData(), ddcnMessage->getSerial(), remote, link);
+	AribaEvent event;
+	event.type = AribaEvent::Type::Message;
+	event.remote = remote;
+	event.link = link;
+	event.data = ddcnMessage->getData();
+	event.serial = ddcnMessage->getSerial();
+	postAribaEvent(event);
 	delete ddcnMessage;
 }
 void NetworkInterface::onLinkUp(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote) {
-	emit aribaLinkUp(link, remote);
+	AribaEvent event;
+	event.type = AribaEvent::Type::LinkUp;
+	event.remote = remote;
+	event.link = link;
+	postAribaEvent(event);
 }
 void NetworkInterface::onLinkDown(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote) {
 	qCritical("onLinkDown");
-	emit aribaLinkDown(link, remote);
-	knownNodes.remove(remote.toString().c_str());
+	AribaEvent event;
+	event.type = AribaEvent::Type::LinkDown;
+	event.remote = remote;
+	event.link = link;
+	postAribaEvent(event);
+	knownNodes.remove(remote);
 }
 void NetworkInterface::onLinkChanged(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote) {
-	emit aribaLinkChanged(link, remote);
+	AribaEvent event;
+	event.type = AribaEvent::Type::LinkChanged;
+	event.remote = remote;
+	event.link = link;
+	postAribaEvent(event);
 }
 void NetworkInterface::onLinkFail(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote) {
 	qCritical("onLinkFail");
-	emit aribaLinkFail(link, remote);
-	knownNodes.remove(remote.toString().c_str());
+	AribaEvent event;
+	event.type = AribaEvent::Type::LinkFail;
+	event.remote = remote;
+	event.link = link;
+	postAribaEvent(event);
+	knownNodes.remove(remote);
+}
+
+void NetworkInterface::postAribaEvent(const AribaEvent &event) {
+	if (aribaEvents.push(event)) {
+		wakeMainThread();
+	}
+	scheduleAribaEventFlush();
+}
+void NetworkInterface::wakeMainThread() {
+	quint64 value = 1;
+	if (write(aribaEventFd, &value, sizeof(value)) != sizeof(value)) {
+		qCritical("Could not wake up the main thread.");
+	}
+}
+void NetworkInterface::scheduleAribaEventFlush() {
+	// If the main thread is lagging behind, the remaining events are moved
+	// into the ring later
+	if (aribaEvents.hasOverflow() && !aribaEventFlushScheduled) {
+		aribaEventFlushScheduled = true;
+		SystemQueue::instance().scheduleEvent(SystemEvent(this,
+			FLUSH_ARIBA_EVENTS_EVENT, &aribaEvents), 1);
+	}
+}
+void NetworkInterface::sendPeerMessages() {
+	QList<PeerMessage> messages;
+	outgoingMessages.takeAll(messages);
+	foreach (const PeerMessage &peerMessage, messages) {
+		DdcnMessage message(peerMessage.serial);
+		message.getData() = peerMessage.message;
+		/*qDebug("Outgoing: %d (serial: %d, checksum: %X)",
+			peerMessage.message.size(), peerMessage.serial, message.getChecksum());*/
+		node->sendMessage(message, peerMessage.linkId);
+	}
 }
 
 void NetworkInterface::onJoinCompleted(const ariba::SpoVNetID &vid) {
@@ -429,31 +533,60 @@ void NetworkInterface::handleSystemEvent(const ariba::utility::SystemEvent &even
 		// TODO: This function is still unimplemented
 		mcpo->sendToGroup(ddcnMessage, groupMessage->serviceId);
 		delete groupMessage;
-	} else if (event.getType() == SEND_PEER_MESSAGE_EVENT) {
-		PeerMessage *peerMessage = event.getData<PeerMessage>();
-		DdcnMessage message(peerMessage->serial);
-		message.getData() = peerMessage->message;
-		/*qDebug("Outgoing: %d (serial: %d, checksum: %X)",
-			peerMessage->message.size(), peerMessage->serial, message.getChecksum());*/
-		node->sendMessage(message, peerMessage->linkId);
-		delete peerMessage;
+	} else if (event.getType() == SEND_PEER_MESSAGES_EVENT) {
+		sendPeerMessages();
+	} else if (event.getType() == FLUSH_ARIBA_EVENTS_EVENT) {
+		aribaEventFlushScheduled = false;
+		if (aribaEvents.flush()) {
+			wakeMainThread();
+		}
+		scheduleAribaEventFlush();
+	} else if (event.getType() == ADD_BOOTSTRAP_HINTS_EVENT) {
+		std::string *bootstrapHints = event.getData<std::string>();
+		aribaModule->addBootstrapHints(*bootstrapHints);
+		delete bootstrapHints;
+	} else if (event.getType() == DROP_LINK_EVENT) {
+		ariba::utility::LinkID *linkId = event.getData<ariba::utility::LinkID>();
+		node->dropLink(*linkId);
+		delete linkId;
 	} else {
 		qCritical("NetworkInterface: Unknown event type.");
 	}
 }
 
+void NetworkInterface::onAribaEventsAvailable() {
+	// Reset the eventfd counter, the ring is drained in any case
+	quint64 value;
+	if (read(aribaEventFd, &value, sizeof(value)) != sizeof(value)) {
+		qDebug("onAribaEventsAvailable: Spurious wakeup.");
+	}
+	QList<AribaEvent> events;
+	aribaEvents.takeAll(events);
+	foreach (const AribaEvent &event, events) {
+		switch (event.type) {
+			case AribaEvent::Type::Message:
+				onAribaMessage(event.data, event.serial, event.remote, event.link);
+				break;
+			case AribaEvent::Type::LinkUp:
+				onAribaLinkUp(event.link, event.remote);
+				break;
+			case AribaEvent::Type::LinkDown:
+				onAribaLinkDown(event.link, event.remote);
+				break;
+			case AribaEvent::Type::LinkChanged:
+				onAribaLinkChanged(event.link, event.remote);
+				break;
+			case AribaEvent::Type::LinkFail:
+				onAribaLinkFail(event.link, event.remote);
+				break;
+		}
+	}
+}
 void NetworkInterface::onAribaMessage(const QByteArray &data, unsigned short serial,
 		const ariba::utility::NodeID &remote, const ariba::utility::LinkID &link) {
-	qDebug("onAribaMessage");
-	NetworkNode *networkNode = NULL;
-	QMap<QString, NetworkNode*>::Iterator it = onlineNodes.find(remote.toString().c_str());
-	if (it != onlineNodes.end()) {
-		networkNode = it.value();
-	} else {
-		it = pendingNodes.find(remote.toString().c_str());
-		if (it != pendingNodes.end()) {
-			networkNode = it.value();
-		}
+	NetworkNode *networkNode = onlineNodes.get(remote);
+	if (!networkNode) {
+		networkNode = pendingNodes.value(remote, NULL);
 	}
 	if (!networkNode) {
 		qWarning("Message from unknown node.");
@@ -467,38 +600,46 @@ void NetworkInterface::onAribaMessage(const QByteArray &data, unsigned short ser
 }
 void NetworkInterface::onAribaLinkUp(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote) {
 	qDebug("onAribaLinkUp");
-	NetworkNode *networkNode = new NetworkNode(remote, link);
-	connect(networkNode, SIGNAL(outgoingDataAvailable(NetworkNode*)),
-		this, SLOT(onNodeOutgoingDataAvailable(NetworkNode*)));
+	NetworkNode *networkNode = new NetworkNode(remote, link, identityGeneration);
+	connect(networkNode, SIGNAL(outgoingDataAvailable(NetworkNode*, QByteArray)),
+		this, SLOT(onNodeOutgoingDataAvailable(NetworkNode*, QByteArray)));
+	connect(networkNode, SIGNAL(congestionChanged(NetworkNode*, bool)),
+		this, SIGNAL(peerCongestionChanged(NetworkNode*, bool)));
 	connect(networkNode, SIGNAL(packetReceived(NetworkNode*, Packet)),
 		this, SLOT(onNodePacketReceived(NetworkNode*, Packet)));
 	connect(networkNode, SIGNAL(connectionReady(NetworkNode*)),
 		this, SLOT(onNodeConnectionReady(NetworkNode*)));
-	TLS *tls = &networkNode->getTLS();
+	connect(networkNode, SIGNAL(protocolError(NetworkNode*)),
+		this, SLOT(onNodeProtocolError(NetworkNode*)));
+	connect(networkNode, SIGNAL(bulkFileReceived(NetworkNode*, int, unsigned int, unsigned int, QString)),
+		this, SIGNAL(bulkFileReceived(NetworkNode*, int, unsigned int, unsigned int, QString)));
+	connect(networkNode, SIGNAL(bulkFileOffered(NetworkNode*, int, unsigned int, unsigned int, quint64, bool*)),
+		this, SIGNAL(bulkFileOffered(NetworkNode*, int, unsigned int, unsigned int, quint64, bool*)),
+		Qt::DirectConnection);
+	TLSPipeline *tls = &networkNode->getTLS();
 	tls->setPrivateKey(privateKey);
 	tls->setCertificate(certificate);
-	if (remote > node->getNodeId()) {
-		tls->startServer();
-	} else {
-		tls->startClient();
-	}
+	tls->setEncryptionRequired(encryptionRequired);
+	// Reconnecting peers can skip the full handshake
+	tls->setResumptionKey(QByteArray(remote.toString().c_str()));
+	tls->start(remote > node->getNodeId(), getTLSThread());
 	// Add the node to the pending nodes, we have to wait for encryption
-	pendingNodes.insert(remote.toString().c_str(), networkNode);
+	pendingNodes.insert(remote, networkNode);
 }
 void NetworkInterface::onAribaLinkDown(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote) {
 	qDebug("onAribaLinkDown");
 	// Find NetworkNode for this node id
-	QMap<QString, NetworkNode*>::Iterator it = onlineNodes.find(remote.toString().c_str());
-	if (it != onlineNodes.end()) {
-		emit peerDisconnected(it.value());
-		delete it.value();
-		onlineNodes.erase(it);
+	NetworkNode *networkNode = onlineNodes.get(remote);
+	if (networkNode) {
+		emit peerDisconnected(networkNode);
+		removeBulkChannels(networkNode);
+		onlineNodes.remove(networkNode);
+		delete networkNode;
 		return;
 	}
-	it = pendingNodes.find(remote.toString().c_str());
-	if (it != pendingNodes.end()) {
-		delete it.value();
-		pendingNodes.erase(it);
+	networkNode = pendingNodes.take(remote);
+	if (networkNode) {
+		delete networkNode;
 		return;
 	}
 }
@@ -522,38 +663,122 @@ void NetworkInterface::onMcpoReceiveData(const ariba::DataMessage &msg) {
 		return;
 	}
 	// Find the sender
-	QMap<QString, NetworkNode*>::Iterator it = onlineNodes.find(ddcnMessage->getNodeId().c_str());
-	if (it == onlineNodes.end()) {
+	NetworkNode *networkNode = onlineNodes.get(QString::fromStdString(ddcnMessage->getNodeId()));
+	if (!networkNode) {
 		return;
 	}
 	// Find the group
-	QMap<ariba::ServiceID, McpoGroup*>::Iterator it2 = mcpoGroups.find(groupId);
-	if (it2 == mcpoGroups.end()) {
+	QMap<ariba::ServiceID, McpoGroup*>::Iterator it = mcpoGroups.find(groupId);
+	if (it == mcpoGroups.end()) {
 		return;
 	}
-	emit groupMessageReceived(it2.value(), it.value(), packet);
+	emit groupMessageReceived(it.value(), networkNode, packet);
 }
 
-void NetworkInterface::onNodeOutgoingDataAvailable(NetworkNode *node) {
-	QByteArray outgoingData = node->getTLS().readOutgoing();
+void NetworkInterface::onNodeOutgoingDataAvailable(NetworkNode *node,
+		const QByteArray &outgoingData) {
 	//qCritical("onNodeOutgoingDataAvailable: %d", (int)outgoingData.size());
 	// Inject data into the ariba thread
-	PeerMessage *peerMessage = new PeerMessage;
-	peerMessage->nodeId = node->aribaNode;
-	peerMessage->linkId = node->aribaLink;
-	peerMessage->message = outgoingData;
-	peerMessage->serial = node->getNextOutgoingSerial();
-	SystemQueue::instance().scheduleEvent(SystemEvent(this,
-		SEND_PEER_MESSAGE_EVENT, peerMessage));
+	PeerMessage peerMessage;
+	peerMessage.nodeId = node->aribaNode;
+	peerMessage.linkId = node->aribaLink;
+	peerMessage.message = outgoingData;
+	peerMessage.serial = node->getNextOutgoingSerial();
+	if (outgoingMessages.push(peerMessage)) {
+		SystemQueue::instance().scheduleEvent(SystemEvent(this,
+			SEND_PEER_MESSAGES_EVENT, &outgoingMessages));
+	}
+	if (outgoingMessages.hasOverflow() && !outgoingFlushScheduled) {
+		// The ariba thread is lagging behind, try again later
+		outgoingFlushScheduled = true;
+		QTimer::singleShot(1, this, SLOT(flushOutgoingMessages()));
+	}
+}
+void NetworkInterface::flushOutgoingMessages() {
+	outgoingFlushScheduled = false;
+	if (outgoingMessages.flush()) {
+		SystemQueue::instance().scheduleEvent(SystemEvent(this,
+			SEND_PEER_MESSAGES_EVENT, &outgoingMessages));
+	}
+	if (outgoingMessages.hasOverflow()) {
+		outgoingFlushScheduled = true;
+		QTimer::singleShot(1, this, SLOT(flushOutgoingMessages()));
+	}
 }
 void NetworkInterface::onNodePacketReceived(NetworkNode *node, const Packet &packet) {
+	if (packet.getType() == PacketType::BulkChannelOffer) {
+		// Bulk channels are completely handled within the network layer
+		onBulkChannelOffer(node, packet);
+		return;
+	}
 	emit messageReceived(node, packet);
 }
 void NetworkInterface::onNodeConnectionReady(NetworkNode *node) {
-	QMap<QString, NetworkNode*>::Iterator it = pendingNodes.find(node->aribaNode.toString().c_str());
-	pendingNodes.erase(it);
-	onlineNodes.insert(node->aribaNode.toString().c_str(), node);
+	pendingNodes.remove(node->aribaNode);
+	onlineNodes.insert(node);
 	emit peerConnected(node);
+	// Only the TLS server offers a bulk channel, so that only one channel is
+	// created for each pair of peers
+	if (node->aribaNode > this->node->getNodeId()) {
+		offerBulkChannel(node);
+	}
+}
+void NetworkInterface::onNodeProtocolError(NetworkNode *node) {
+	qWarning("Dropping the connection to a peer which sent invalid data.");
+	reconnect(node);
+}
+
+void NetworkInterface::onBulkConnectionPending() {
+	int fd;
+	while ((fd = BulkChannel::acceptConnection(bulkListenFd)) != -1) {
+		// We do not know which peer this is until the token has been received
+		BulkChannel *channel = new BulkChannel(fd);
+		channel->setMaxFileSize(maxBulkFileSize);
+		acceptedBulkChannels.append(channel);
+		connect(channel, SIGNAL(tokenReceived(BulkChannel*, QByteArray)),
+			this, SLOT(onBulkChannelTokenReceived(BulkChannel*, QByteArray)));
+		connect(channel, SIGNAL(closed(BulkChannel*)),
+			this, SLOT(onBulkChannelClosed(BulkChannel*)));
+	}
+}
+void NetworkInterface::onBulkChannelConnected(BulkChannel *channel) {
+	QMap<BulkChannel*, PendingBulkChannel>::Iterator it = connectingBulkChannels.find(channel);
+	if (it == connectingBulkChannels.end()) {
+		return;
+	}
+	PendingBulkChannel pending = it.value();
+	connectingBulkChannels.erase(it);
+	channel->disconnect(this);
+	if (!enableBulkChannelEncryption(channel, pending.node, false)) {
+		channel->deleteLater();
+		return;
+	}
+	qDebug("Bulk channel connected.");
+	pending.node->setBulkChannel(channel);
+}
+void NetworkInterface::onBulkChannelTokenReceived(BulkChannel *channel,
+		const QByteArray &token) {
+	acceptedBulkChannels.removeOne(channel);
+	channel->disconnect(this);
+	QMap<QByteArray, PendingBulkChannel>::Iterator it = bulkChannelOffers.find(token);
+	if (it == bulkChannelOffers.end()) {
+		qWarning("Bulk channel with unknown token.");
+		channel->deleteLater();
+		return;
+	}
+	PendingBulkChannel pending = it.value();
+	bulkChannelOffers.erase(it);
+	if (!enableBulkChannelEncryption(channel, pending.node, true)) {
+		channel->deleteLater();
+		return;
+	}
+	qDebug("Bulk channel accepted.");
+	pending.node->setBulkChannel(channel);
+}
+void NetworkInterface::onBulkChannelClosed(BulkChannel *channel) {
+	connectingBulkChannels.remove(channel);
+	acceptedBulkChannels.removeOne(channel);
+	channel->deleteLater();
 }
 
 void NetworkInterface::peerDiscovery() {
@@ -562,7 +787,7 @@ void NetworkInterface::peerDiscovery() {
 	knownNodesMutex.lock();
 	//qCritical("Known nodes before: %d", knownNodes.size());
 	BOOST_FOREACH(ariba::utility::NodeID nodeId, nodes) {
-		if (knownNodes.contains(nodeId.toString().c_str())) {
+		if (knownNodes.contains(nodeId)) {
 			//qCritical("Node already known: %s.", nodeId.toString().c_str());
 			continue;
 		}
@@ -575,16 +800,131 @@ void NetworkInterface::peerDiscovery() {
 		}
 		qDebug("New neighbor %s", nodeId.toString().c_str());
 		// Only create the link once
-		knownNodes.insert(nodeId.toString().c_str());
+		knownNodes.insert(nodeId);
 		// Only one side of the connection shall create a link
 		// Establish link to the new node
 		node->establishLink(nodeId, SERVICE_ID);
-		assert(knownNodes.contains(nodeId.toString().c_str()));
+		assert(knownNodes.contains(nodeId));
 	}
 	//qCritical("Known nodes after: %d", knownNodes.size());
 	knownNodesMutex.unlock();
 }
 
+void NetworkInterface::offerBulkChannel(NetworkNode *networkNode) {
+	if (bulkListenFd == -1) {
+		return;
+	}
+	// Plain TCP would not even protect the integrity of the files, so bulk
+	// channels always use kernel TLS, also if encryption is not required
+	if (!BulkChannel::isKernelTLSSupported()) {
+		// Use the ariba connection instead
+		return;
+	}
+	QByteArray token;
+	token.resize(BulkChannel::TOKEN_SIZE);
+	if (RAND_bytes((unsigned char*)token.data(), token.size()) != 1) {
+		qWarning("Could not create a bulk channel token.");
+		return;
+	}
+	PendingBulkChannel pending;
+	pending.node = networkNode;
+	bulkChannelOffers.insert(token, pending);
+	QByteArray packetData;
+	QDataStream stream(&packetData, QIODevice::WriteOnly);
+	stream << bulkPort;
+	stream << BulkChannel::getLocalAddresses();
+	stream << token;
+	send(networkNode, Packet::fromData(PacketType::BulkChannelOffer, packetData));
+}
+void NetworkInterface::onBulkChannelOffer(NetworkNode *networkNode, const Packet &packet) {
+	QByteArray packetData((const char*)packet.getPayloadData(), packet.getPayloadSize());
+	QDataStream stream(packetData);
+	quint16 port;
+	QStringList addresses;
+	QByteArray token;
+	stream >> port;
+	stream >> addresses;
+	stream >> token;
+	if (stream.status() != QDataStream::Ok || token.size() != BulkChannel::TOKEN_SIZE) {
+		qWarning("Received invalid bulk channel offer.");
+		return;
+	}
+	if (bulkListenFd == -1) {
+		// Bulk channels were disabled in the settings
+		return;
+	}
+	if (!BulkChannel::isKernelTLSSupported()) {
+		return;
+	}
+	// Offers are only accepted over established connections, and the
+	// addresses must not make us connect to arbitrary hosts or services of
+	// this machine
+	if (onlineNodes.get(networkNode->getNodeId()) != networkNode) {
+		qWarning("Ignoring bulk channel offer from a peer which is not online.");
+		return;
+	}
+	addresses = BulkChannel::filterOfferedAddresses(addresses);
+	if (addresses.empty() || port == 0) {
+		qWarning("Received bulk channel offer without usable addresses.");
+		return;
+	}
+	BulkChannel *channel = new BulkChannel(addresses, port, token);
+	channel->setMaxFileSize(maxBulkFileSize);
+	PendingBulkChannel pending;
+	pending.node = networkNode;
+	connectingBulkChannels.insert(channel, pending);
+	connect(channel, SIGNAL(connected(BulkChannel*)),
+		this, SLOT(onBulkChannelConnected(BulkChannel*)));
+	connect(channel, SIGNAL(closed(BulkChannel*)),
+		this, SLOT(onBulkChannelClosed(BulkChannel*)));
+	channel->connectToPeer();
+}
+bool NetworkInterface::enableBulkChannelEncryption(BulkChannel *channel,
+		NetworkNode *networkNode, bool listening) {
+	// Both peers derive the same keys from the ariba TLS session, the token
+	// makes sure that a key is never used for two channels
+	QByteArray keys = networkNode->getTLS().exportKeyingMaterial(
+		"EXPORTER-ddcn-bulk-channel", 2 * BulkChannel::KEY_MATERIAL_SIZE,
+		channel->getToken());
+	if (keys.isEmpty()) {
+		qWarning("Could not derive keys for the bulk channel.");
+		return false;
+	}
+	QByteArray listenerKey = keys.left(BulkChannel::KEY_MATERIAL_SIZE);
+	QByteArray connectorKey = keys.mid(BulkChannel::KEY_MATERIAL_SIZE);
+	if (listening) {
+		return channel->enableKernelTLS(listenerKey, connectorKey);
+	} else {
+		return channel->enableKernelTLS(connectorKey, listenerKey);
+	}
+}
+void NetworkInterface::removeBulkChannels(NetworkNode *networkNode) {
+	QMap<QByteArray, PendingBulkChannel>::Iterator it = bulkChannelOffers.begin();
+	while (it != bulkChannelOffers.end()) {
+		if (it.value().node == networkNode) {
+			it = bulkChannelOffers.erase(it);
+		} else {
+			it++;
+		}
+	}
+	QMap<BulkChannel*, PendingBulkChannel>::Iterator it2 = connectingBulkChannels.begin();
+	while (it2 != connectingBulkChannels.end()) {
+		if (it2.value().node == networkNode) {
+			it2.key()->deleteLater();
+			it2 = connectingBulkChannels.erase(it2);
+		} else {
+			it2++;
+		}
+	}
+}
+
+QThread *NetworkInterface::getTLSThread() {
+	// The peers are simply distributed evenly over the threads
+	QThread *thread = tlsThreads[nextTLSThread];
+	nextTLSThread = (nextTLSThread + 1) % tlsThreads.size();
+	return thread;
+}
+
 void NetworkInterface::PeerDiscoveryTimer::eventFunction() {
 	network->peerDiscovery();
 }
@@ -592,4 +932,7 @@ void NetworkInterface::PeerDiscoveryTimer::eventFunction() {
 const ariba::utility::SystemEventType NetworkInterface::JOIN_GROUP_EVENT("JoinGroup");
 const ariba::utility::SystemEventType NetworkInterface::LEAVE_GROUP_EVENT("LeaveGroup");
 const ariba::utility::SystemEventType NetworkInterface::SEND_GROUP_MESSAGE_EVENT("SendGroupMessage");
-const ariba::utility::SystemEventType NetworkInterface::SEND_PEER_MESSAGE_EVENT("SendPeerMessage");
+const ariba::utility::SystemEventType NetworkInterface::SEND_PEER_MESSAGES_EVENT("SendPeerMessages");
+const ariba::utility::SystemEventType NetworkInterface::FLUSH_ARIBA_EVENTS_EVENT("FlushAribaEvents");
+const ariba::utility::SystemEventType NetworkInterface::ADD_BOOTSTRAP_HINTS_EVENT("AddBootstrapHints");
+const ariba::utility::SystemEventType NetworkInterface::DROP_LINK_EVENT("DropLink");
@@ -29,8 +29,10 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "McpoGroup.h"
 #include "NetworkNode.h"
+#include "NodeRegistry.h"
 #include "BootstrapConfig.h"
 #include "Protocol.h"
+#include "MessageRing.h"
 
 #include <ariba/ariba.h>
 #include <ariba/utility/system/StartupInterface.h>
@@ -38,7 +40,9 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QMutex>
 #include <QSet>
 
-uint qHash(ariba::utility::NodeID nodeId);
+class BulkChannel;
+class QSocketNotifier;
+class QThread;
 
 using ariba::services::mcpo::MCPO;
 
@@ -51,10 +55,13 @@ Q_DECLARE_METATYPE(ariba::DataMessage);
  * main thread and the Ariba system queue thread.
  *
  * If data needs to be passed into the ariba thread, this is done via posting an
- * event to the ariba system queue.
+ * event to the ariba system queue. Messages to peers are passed through a
+ * lock-free ring instead, and only a single event is posted for each batch of
+ * messages.
  *
- * If data needs to be passed to the main qt thread, this is done via emitting a
- * signal connected to an object created in the main thread.
+ * Messages and link events from the ariba thread are passed to the main qt
+ * thread through another ring. The main thread is woken up via an eventfd once
+ * for each batch.
  *
  * Note that the private key cannot be changed, if you want to do this, you have
  * to shutdown all networking and recreate the NetworkInterface object.
@@ -71,10 +78,43 @@ public:
 	~NetworkInterface();
 
 	/**
-	 * @note Needs restart() to take effect.
+	 * Changes the name and the key of this peer.
+	 *
+	 * The key is used for all connections created afterwards, existing
+	 * connections keep using the old key until they are closed, see
+	 * hasOutdatedIdentity() and reconnect().
+	 *
+	 * @note The name is only passed to ariba in restart().
 	 */
 	void changeIdentity(QString name, const PrivateKey &privateKey);
 	void restart();
+	/**
+	 * Passes additional bootstrap hints to the running ariba instance.
+	 *
+	 * @note Ariba cannot forget hints which have been removed, these are only
+	 * dropped in restart().
+	 */
+	void addBootstrapHints(const QString &bootstrapHints);
+
+	/**
+	 * Returns all peers with an established TLS connection.
+	 */
+	QList<NetworkNode*> getOnlineNodes() {
+		return onlineNodes.getAll();
+	}
+	/**
+	 * Returns true if the connection to the node was created before the last
+	 * call to changeIdentity() and therefore still uses the old key.
+	 */
+	bool hasOutdatedIdentity(NetworkNode *node) {
+		return node->getIdentityGeneration() != identityGeneration;
+	}
+	/**
+	 * Closes the link to a node. The node is deleted and peerDisconnected()
+	 * is emitted as soon as ariba has closed the link, afterwards the link is
+	 * created again by the normal peer discovery.
+	 */
+	void reconnect(NetworkNode *node);
 
 	void send(NetworkNode *node, const Packet &packet);
 	void send(McpoGroup *group, const Packet &packet);
@@ -83,12 +123,50 @@ public:
 	void leaveGroup(McpoGroup *group);
 
 	NetworkNode *getNetworkNode(const PublicKey &publicKey);
+
+	/**
+	 * Sets whether connections to other peers have to be encrypted. If not,
+	 * TLS connections only authenticate the data if the other peer does not
+	 * require encryption either. This should only be disabled in fully
+	 * trusted networks.
+	 *
+	 * Bulk channels are always encrypted with kernel TLS, which also protects
+	 * the integrity of the files. If kernel TLS is not available, no bulk
+	 * channels are created and all data is sent via the TLS connection over
+	 * ariba instead.
+	 *
+	 * @note Only affects connections which are established later.
+	 */
+	void setEncryptionRequired(bool required);
 signals:
 	void peerConnected(NetworkNode *node);
 	void peerDisconnected(NetworkNode *node);
 	void messageReceived(NetworkNode *node, const Packet &packet);
 	void groupMessageReceived(McpoGroup *group, NetworkNode *node,
 		const Packet &packet);
+	/**
+	 * Triggered when a file has been received over the bulk channel of a
+	 * node.
+	 *
+	 * @see NetworkNode::bulkFileReceived()
+	 */
+	void bulkFileReceived(NetworkNode *node, int kind, unsigned int transferId,
+		unsigned int index, const QString &fileName);
+	/**
+	 * Triggered when the header of a file has been received over the bulk
+	 * channel of a node. Has to be connected with Qt::DirectConnection.
+	 *
+	 * @see NetworkNode::bulkFileOffered()
+	 */
+	void bulkFileOffered(NetworkNode *node, int kind, unsigned int transferId,
+		unsigned int index, quint64 size, bool *accept);
+	/**
+	 * Triggered when the send queue of a node becomes full or has been
+	 * drained again.
+	 *
+	 * @see NetworkNode::isCongested()
+	 */
+	void peerCongestionChanged(NetworkNode *node, bool congested);
 protected:
 	// Communication listener interface
 	virtual bool onLinkRequest(const ariba::utility::NodeID &remote);
@@ -116,28 +194,79 @@ protected:
 	// System event listener interface
 	virtual void handleSystemEvent(const ariba::utility::SystemEvent &event);
 signals:
-	void aribaMessage(const QByteArray &data, unsigned short serial, const ariba::utility::NodeID &remote,
-		const ariba::utility::LinkID &link);
-	void aribaLinkUp(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote);
-	void aribaLinkDown(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote);
-	void aribaLinkChanged(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote);
-	void aribaLinkFail(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote);
 	void mcpoReceiveData(const ariba::DataMessage &msg);
 private slots:
+	void onAribaEventsAvailable();
+	void onMcpoReceiveData(const ariba::DataMessage &msg);
+	void flushOutgoingMessages();
+
+	void onNodeOutgoingDataAvailable(NetworkNode *node, const QByteArray &data);
+	void onNodePacketReceived(NetworkNode *node, const Packet &packet);
+	void onNodeConnectionReady(NetworkNode *node);
+	void onNodeProtocolError(NetworkNode *node);
+
+	void onBulkConnectionPending();
+	void onBulkChannelConnected(BulkChannel *channel);
+	void onBulkChannelTokenReceived(BulkChannel *channel, const QByteArray &token);
+	void onBulkChannelClosed(BulkChannel *channel);
+private:
+	/**
+	 * Message or link event which is passed from the ariba thread to the main
+	 * thread.
+	 */
+	struct AribaEvent {
+		struct Type {
+			enum List {
+				Message,
+				LinkUp,
+				LinkDown,
+				LinkChanged,
+				LinkFail
+			};
+		};
+		int type;
+		ariba::utility::NodeID remote;
+		ariba::utility::LinkID link;
+		QByteArray data;
+		unsigned short serial;
+	};
+	/**
+	 * Message which is passed from the main thread to the ariba thread.
+	 */
+	struct PeerMessage {
+		ariba::utility::NodeID nodeId;
+		ariba::utility::LinkID linkId;
+		// This is an encrypted stream, so no Packet here
+		QByteArray message;
+		unsigned short serial;
+	};
+
 	void onAribaMessage(const QByteArray &data, unsigned short serial, const ariba::utility::NodeID &remote,
 		const ariba::utility::LinkID &link);
 	void onAribaLinkUp(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote);
 	void onAribaLinkDown(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote);
 	void onAribaLinkChanged(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote);
 	void onAribaLinkFail(const ariba::utility::LinkID &link, const ariba::utility::NodeID &remote);
-	void onMcpoReceiveData(const ariba::DataMessage &msg);
 
-	void onNodeOutgoingDataAvailable(NetworkNode *node);
-	void onNodePacketReceived(NetworkNode *node, const Packet &packet);
-	void onNodeConnectionReady(NetworkNode *node);
-private:
+	/**
+	 * Passes an event to the main thread. Must only be called from the ariba
+	 * thread.
+	 */
+	void postAribaEvent(const AribaEvent &event);
+	void wakeMainThread();
+	void scheduleAribaEventFlush();
+	void sendPeerMessages();
+
 	void peerDiscovery();
 
+	void offerBulkChannel(NetworkNode *networkNode);
+	void onBulkChannelOffer(NetworkNode *networkNode, const Packet &packet);
+	bool enableBulkChannelEncryption(BulkChannel *channel,
+		NetworkNode *networkNode, bool listening);
+	void removeBulkChannels(NetworkNode *networkNode);
+
+	QThread *getTLSThread();
+
 	ariba::AribaModule *aribaModule;
 	ariba::Node *node;
 
@@ -148,21 +277,29 @@ private:
 	Certificate certificate;
 
 	QMap<ariba::ServiceID, McpoGroup*> mcpoGroups;
-	// TODO: Fix this!
-	//QMap<ariba::utility::NodeID, NetworkNode*> onlineNodes;
-	//QMap<ariba::utility::NodeID, NetworkNode*> pendingNodes;
-	QMap<QString, NetworkNode*> onlineNodes;
-	QMap<QString, NetworkNode*> pendingNodes;
+	NodeRegistry onlineNodes;
+	QHash<ariba::utility::NodeID, NetworkNode*> pendingNodes;
 
 	QMutex knownNodesMutex;
-	// TODO: Why doesn't this work?
-	//QSet<ariba::utility::NodeID> knownNodes;
-	QSet<QString> knownNodes;
+	QSet<ariba::utility::NodeID> knownNodes;
 
 	static const ariba::ServiceID SERVICE_ID;
 
 	BootstrapConfig bootstrapConfig;
 
+	struct PendingBulkChannel {
+		NetworkNode *node;
+	};
+
+	int bulkListenFd;
+	quint16 bulkPort;
+	quint64 maxBulkFileSize;
+	QSocketNotifier *bulkListenNotifier;
+	bool encryptionRequired;
+	QMap<QByteArray, PendingBulkChannel> bulkChannelOffers;
+	QMap<BulkChannel*, PendingBulkChannel> connectingBulkChannels;
+	QList<BulkChannel*> acceptedBulkChannels;
+
 	class PeerDiscoveryTimer : public ariba::utility::Timer {
 	public:
 		PeerDiscoveryTimer(NetworkInterface *network) : network(network) {
@@ -175,10 +312,39 @@ private:
 
 	PeerDiscoveryTimer discoveryTimer;
 
+	/**
+	 * Worker threads which run the TLS pipelines of the peers.
+	 */
+	QList<QThread*> tlsThreads;
+	int nextTLSThread;
+
+	/**
+	 * Events from the ariba thread, consumed by the main thread.
+	 */
+	MessageRing<AribaEvent> aribaEvents;
+	int aribaEventFd;
+	QSocketNotifier *aribaEventNotifier;
+	/**
+	 * True if the ariba thread has scheduled an event to move events from the
+	 * overflow list of aribaEvents into the ring. Only accessed by the ariba
+	 * thread.
+	 */
+	bool aribaEventFlushScheduled;
+	/**
+	 * Messages to other peers, consumed by the ariba thread.
+	 */
+	MessageRing<PeerMessage> outgoingMessages;
+	bool outgoingFlushScheduled;
+
 	static const ariba::utility::SystemEventType JOIN_GROUP_EVENT;
 	static const ariba::utility::SystemEventType LEAVE_GROUP_EVENT;
 	static const ariba::utility::SystemEventType SEND_GROUP_MESSAGE_EVENT;
-	static const ariba::utility::SystemEventType SEND_PEER_MESSAGE_EVENT;
+	static const ariba::utility::SystemEventType SEND_PEER_MESSAGES_EVENT;
+	static const ariba::utility::SystemEventType FLUSH_ARIBA_EVENTS_EVENT;
+	static const ariba::utility::SystemEventType ADD_BOOTSTRAP_HINTS_EVENT;
+	static const ariba::utility::SystemEventType DROP_LINK_EVENT;
+
+	unsigned int identityGeneration;
 };
 
 #endif
@@ -26,18 +26,30 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "NetworkNode.h"
 #include "NetworkInterface.h"
+#include "BulkChannel.h"
 
-#include <QtEndian>
-
-NetworkNode::NetworkNode(ariba::utility::NodeID nodeId, ariba::utility::LinkID linkId) : aribaNode(nodeId),
-		aribaLink(linkId), trustedPeer(NULL), lastExpectedSerial(0), lastOutgoingSerial(0) {
-	connect(&tls, SIGNAL(readyReadOutgoing()), this,
-		SLOT(onOutgoingDataAvailable()));
-	connect(&tls, SIGNAL(readyRead()), this,
-		SLOT(onIncomingDataAvailable()));
-	connect(&tls, SIGNAL(handshakeComplete()), this,
+NetworkNode::NetworkNode(ariba::utility::NodeID nodeId, ariba::utility::LinkID linkId,
+		unsigned int identityGeneration) : aribaNode(nodeId), aribaLink(linkId),
+		trustedPeer(NULL), tls(new TLSPipeline), bulkChannel(NULL),
+		congested(false), unacknowledgedBytes(0),
+		lastExpectedSerial(0), lastOutgoingSerial(0),
+		identityGeneration(identityGeneration) {
+	connect(tls, SIGNAL(outgoingDataAvailable(QByteArray)), this,
+		SLOT(onOutgoingDataAvailable(QByteArray)));
+	connect(tls, SIGNAL(packetReceived(Packet)), this,
+		SLOT(onPacketReceived(Packet)));
+	connect(tls, SIGNAL(framesReceived(unsigned int)), this,
+		SLOT(onFramesReceived(unsigned int)));
+	connect(tls, SIGNAL(protocolError()), this,
+		SLOT(onProtocolError()));
+	connect(tls, SIGNAL(handshakeComplete()), this,
 		SLOT(onHandshakeComplete()));
-	// TODO: Connect to TLS error signal?
+}
+NetworkNode::~NetworkNode() {
+	delete bulkChannel;
+	// The pipeline might still be processing data in its thread
+	tls->disconnect(this);
+	tls->deleteLater();
 }
 
 void NetworkNode::sendPacket(const Packet &packet) {
@@ -45,47 +57,65 @@ void NetworkNode::sendPacket(const Packet &packet) {
 		// This must not happen, so crash here
 		qFatal("Sending invalid packet.");
 	}
-	// TODO: We can optimize away one or two data copies here
-	// (the second one would be within TLS)
-	QByteArray packetData((const char*)packet.getRawData(), packet.getRawSize());
-	tls.write(packetData);
+	sendLanes.append(packet);
+	sendFrames();
+}
+
+BulkChannel *NetworkNode::getBulkChannel() {
+	if (bulkChannel && bulkChannel->isReady()) {
+		return bulkChannel;
+	} else {
+		return NULL;
+	}
+}
+void NetworkNode::setBulkChannel(BulkChannel *channel) {
+	delete bulkChannel;
+	bulkChannel = channel;
+	connect(channel, SIGNAL(fileReceived(BulkChannel*, int, unsigned int, unsigned int, QString)),
+		this, SLOT(onBulkFileReceived(BulkChannel*, int, unsigned int, unsigned int, QString)));
+	connect(channel, SIGNAL(fileOffered(BulkChannel*, int, unsigned int, unsigned int, quint64, bool*)),
+		this, SLOT(onBulkFileOffered(BulkChannel*, int, unsigned int, unsigned int, quint64, bool*)),
+		Qt::DirectConnection);
+	connect(channel, SIGNAL(closed(BulkChannel*)),
+		this, SLOT(onBulkChannelClosed(BulkChannel*)));
 }
 
-void NetworkNode::onOutgoingDataAvailable() {
-	emit outgoingDataAvailable(this);
+void NetworkNode::onOutgoingDataAvailable(const QByteArray &data) {
+	emit outgoingDataAvailable(this, data);
 }
-void NetworkNode::onIncomingDataAvailable() {
-	//qDebug("Incoming data available.");
-	incomingData += tls.read();
-	// Read packets until not enough data is left
-	PacketHeader header;
-	while ((size_t)incomingData.size() >= sizeof(PacketHeader)) {
-		uint32_t dataSize = incomingData.size();
-		memcpy(&header, incomingData.data(), sizeof(header));
-		uint32_t packetSize = qFromBigEndian(header.size);
-		//qDebug("packet: %d/%d (type: %d).", dataSize, packetSize, header.type);
-		if (dataSize >= packetSize + sizeof(header)) {
-			if (dataSize == packetSize + sizeof(header)) {
-				Packet packet = Packet::fromRawData(incomingData);
-				// TODO: Disconnect if packet is invalid
-				emit packetReceived(this, packet);
-				incomingData = QByteArray();
-			} else {
-				// Leave bytes which do not form a complete packet in the queue
-				Packet packet = Packet::fromRawData(incomingData.left(sizeof(header) + packetSize));
-				// TODO: Disconnect if packet is invalid
-				emit packetReceived(this, packet);
-				incomingData = incomingData.mid(sizeof(header) + packetSize);
-			}
-		} else {
-			break;
+void NetworkNode::onPacketReceived(const Packet &packet) {
+	if (packet.getType() == PacketType::FramesReceived) {
+		const unsigned int *frameBytes = packet.getPayload<unsigned int>();
+		if (!frameBytes) {
+			qWarning("NetworkNode: Received invalid FramesReceived packet.");
+			emit protocolError(this);
+			return;
 		}
+		sendLanes.onFramesAcknowledged(qFromBigEndian(*frameBytes));
+		sendFrames();
+		return;
 	}
+	emit packetReceived(this, packet);
+}
+void NetworkNode::onFramesReceived(unsigned int frameBytes) {
+	unacknowledgedBytes += frameBytes;
+	if (unacknowledgedBytes < SendLanes::ACKNOWLEDGE_THRESHOLD) {
+		return;
+	}
+	// The acknowledgement bypasses the send lanes, otherwise two peers with
+	// full send windows would wait for each other. Control packets always
+	// fit into a single frame, so this cannot split another packet.
+	Packet packet(PacketType::FramesReceived, qToBigEndian(unacknowledgedBytes));
+	tls->writeFrame(packet, SendLane::Control, 0, packet.getRawSize(), true);
+	unacknowledgedBytes = 0;
+}
+void NetworkNode::onProtocolError() {
+	emit protocolError(this);
 }
 
 void NetworkNode::onHandshakeComplete() {
 	qDebug("Handshaken!");
-	Certificate cert = tls.getPeerCertificate();
+	Certificate cert = tls->getPeerCertificate();
 	if (!cert.isValid()) {
 		qCritical("Remote cert is null!");
 	} else {
@@ -93,3 +123,39 @@ void NetworkNode::onHandshakeComplete() {
 	}
 	emit connectionReady(this);
 }
+
+void NetworkNode::sendFrames() {
+	SendLanes::Frame frame;
+	while (sendLanes.takeFrame(frame)) {
+		tls->writeFrame(frame.packet, frame.lane, frame.offset, frame.size,
+			frame.last);
+	}
+	updateCongestion();
+}
+void NetworkNode::updateCongestion() {
+	unsigned int bufferedBytes = sendLanes.getBufferedBytes();
+	if (!congested && bufferedBytes >= CONGESTION_LIMIT) {
+		congested = true;
+		emit congestionChanged(this, true);
+	} else if (congested && bufferedBytes < CONGESTION_LIMIT / 2) {
+		congested = false;
+		emit congestionChanged(this, false);
+	}
+}
+
+void NetworkNode::onBulkFileReceived(BulkChannel *channel, int kind,
+		unsigned int transferId, unsigned int index, const QString &fileName) {
+	emit bulkFileReceived(this, kind, transferId, index, fileName);
+}
+void NetworkNode::onBulkFileOffered(BulkChannel *channel, int kind,
+		unsigned int transferId, unsigned int index, quint64 size, bool *accept) {
+	emit bulkFileOffered(this, kind, transferId, index, size, accept);
+}
+void NetworkNode::onBulkChannelClosed(BulkChannel *channel) {
+	qDebug("Bulk channel closed.");
+	if (channel == bulkChannel) {
+		bulkChannel = NULL;
+	}
+	// We are called by the channel itself, so we cannot delete it here
+	channel->deleteLater();
+}
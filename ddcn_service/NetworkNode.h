@@ -27,13 +27,17 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef NETWORKNODE_H_INCLUDED
 #define NETWORKNODE_H_INCLUDED
 
-#include "TLS.h"
+#include "TLSPipeline.h"
 #include "Protocol.h"
+#include "SendLanes.h"
 
 #include <QString>
+#include <QHash>
+#include <QList>
 #include <ariba/ariba.h>
 
 class TrustedPeer;
+class BulkChannel;
 
 /**
  * Holds the information about the connection to another peer in the network.
@@ -44,7 +48,19 @@ public:
 	/**
 	 * Constructor.
 	 */
-	NetworkNode(ariba::utility::NodeID nodeId, ariba::utility::LinkID linkId);
+	NetworkNode(ariba::utility::NodeID nodeId, ariba::utility::LinkID linkId,
+		unsigned int identityGeneration);
+	/**
+	 * Destructor. Closes the bulk channel to the peer and deletes the TLS
+	 * pipeline once the worker thread is done with it.
+	 */
+	~NetworkNode();
+	/**
+	 * Returns the ariba node id of this peer.
+	 */
+	const ariba::NodeID &getNodeId() {
+		return aribaNode;
+	}
 	/**
 	 * Returns the public key of this peer. This key is always correct and has
 	 * been verified in the TLS handshake.
@@ -52,6 +68,14 @@ public:
 	PublicKey getPublicKey() {
 		return publicKey;
 	}
+	/**
+	 * Returns the public key the local peer used to authenticate itself on
+	 * this connection. This is not the current local key if the key has been
+	 * changed after the connection was established.
+	 */
+	PublicKey getLocalPublicKey() {
+		return PublicKey(tls->getPrivateKey());
+	}
 	/**
 	 * Marks the peer as trusted.
 	 */
@@ -67,8 +91,27 @@ public:
 	}
 	/**
 	 * Sends a packet to the peer. Use NetworkInterface::send() instead.
+	 *
+	 * Packets which fit into a single frame are sent in the control lane,
+	 * larger packets in the bulk lane. The frames of both lanes are
+	 * interleaved, and only SendLanes::SEND_WINDOW bytes which the peer has
+	 * not acknowledged yet are passed to ariba, the rest is queued here.
 	 */
 	void sendPacket(const Packet &packet);
+	/**
+	 * Returns true if so much data is queued for this peer that no further
+	 * jobs should be delegated to it. The peer is congested once
+	 * CONGESTION_LIMIT bytes are queued or have not been acknowledged by the
+	 * peer yet, and is not congested anymore once less than half of that is
+	 * left.
+	 */
+	bool isCongested() {
+		return congested;
+	}
+	/**
+	 * Number of queued bytes at which the peer is considered congested.
+	 */
+	static const unsigned int CONGESTION_LIMIT = 8 * 1024 * 1024;
 
 	/**
 	 * Returns the next expected serial number for the next packet from this
@@ -84,11 +127,76 @@ public:
 	unsigned short getNextOutgoingSerial() {
 		return ++lastOutgoingSerial;
 	}
+
+	/**
+	 * Returns the value of the identity counter of NetworkInterface at the time
+	 * the connection was created.
+	 */
+	unsigned int getIdentityGeneration() {
+		return identityGeneration;
+	}
+
+	/**
+	 * Returns the signature we have created for this peer to prove that we
+	 * are a member of a group, or an empty array if there is none yet. The
+	 * signature only depends on the keys of both peers and the group, so it
+	 * can be reused for the lifetime of the connection.
+	 *
+	 * @param groupKey DER encoded public key of the group.
+	 */
+	QByteArray getMembershipProof(const QByteArray &groupKey) {
+		return membershipProofs.value(groupKey);
+	}
+	/**
+	 * Stores a signature created for getMembershipProof().
+	 */
+	void setMembershipProof(const QByteArray &groupKey,
+			const QByteArray &signature) {
+		membershipProofs.insert(groupKey, signature);
+	}
+	/**
+	 * Returns true if the peer already has sent this signature for the group
+	 * and it has been verified.
+	 *
+	 * @param groupKey DER encoded public key of the group.
+	 * @param signature Signature sent by the peer.
+	 */
+	bool isMembershipProofVerified(const QByteArray &groupKey,
+			const QByteArray &signature) {
+		QHash<QByteArray, QByteArray>::const_iterator it
+				= verifiedMembershipProofs.find(groupKey);
+		return it != verifiedMembershipProofs.end() && it.value() == signature;
+	}
+	/**
+	 * Remembers that a membership proof of the peer has been verified so that
+	 * the signature does not have to be checked again.
+	 */
+	void setMembershipProofVerified(const QByteArray &groupKey,
+			const QByteArray &signature) {
+		verifiedMembershipProofs.insert(groupKey, signature);
+	}
+
+	/**
+	 * Returns the direct connection to the peer which is used for large files
+	 * or NULL if there is no such connection (yet). In this case, the data has
+	 * to be sent via sendPacket().
+	 */
+	BulkChannel *getBulkChannel();
+	/**
+	 * Sets the bulk channel of this peer. Called by NetworkInterface once the
+	 * channel has been negotiated. The node takes over ownership of the
+	 * channel.
+	 */
+	void setBulkChannel(BulkChannel *channel);
 signals:
 	/**
 	 * Triggered when there is data which should be sent by NetworkInterface.
 	 */
-	void outgoingDataAvailable(NetworkNode *node);
+	void outgoingDataAvailable(NetworkNode *node, const QByteArray &data);
+	/**
+	 * Triggered when isCongested() changes.
+	 */
+	void congestionChanged(NetworkNode *node, bool congested);
 	/**
 	 * Triggered if a complete packet was received from the TLS connection.
 	 */
@@ -97,27 +205,74 @@ signals:
 	 * Triggered when the TLS stream is ready.
 	 */
 	void connectionReady(NetworkNode *node);
+	/**
+	 * Triggered if the peer has sent invalid data. The connection has to be
+	 * dropped.
+	 */
+	void protocolError(NetworkNode *node);
+	/**
+	 * Triggered when a file has been received over the bulk channel.
+	 *
+	 * @see BulkChannel::fileReceived()
+	 */
+	void bulkFileReceived(NetworkNode *node, int kind, unsigned int transferId,
+		unsigned int index, const QString &fileName);
+	/**
+	 * Triggered when the header of a file has been received over the bulk
+	 * channel. Has to be connected with Qt::DirectConnection.
+	 *
+	 * @see BulkChannel::fileOffered()
+	 */
+	void bulkFileOffered(NetworkNode *node, int kind, unsigned int transferId,
+		unsigned int index, quint64 size, bool *accept);
 private slots:
-	void onOutgoingDataAvailable();
-	void onIncomingDataAvailable();
+	void onOutgoingDataAvailable(const QByteArray &data);
+	void onPacketReceived(const Packet &packet);
+	void onFramesReceived(unsigned int frameBytes);
+	void onProtocolError();
 	void onHandshakeComplete();
+	void onBulkFileReceived(BulkChannel *channel, int kind,
+		unsigned int transferId, unsigned int index, const QString &fileName);
+	void onBulkFileOffered(BulkChannel *channel, int kind,
+		unsigned int transferId, unsigned int index, quint64 size, bool *accept);
+	void onBulkChannelClosed(BulkChannel *channel);
 private:
-	TLS &getTLS() {
-		return tls;
+	TLSPipeline &getTLS() {
+		return *tls;
 	}
 
+	void sendFrames();
+	void updateCongestion();
+
 	ariba::NodeID aribaNode;
 	ariba::LinkID aribaLink;
 	PublicKey publicKey;
 	TrustedPeer *trustedPeer;
 
-	TLS tls;
+	TLSPipeline *tls;
+	BulkChannel *bulkChannel;
 
-	QByteArray incomingData;
+	/**
+	 * Packets which have not been completely passed to the TLS pipeline yet.
+	 * The frames in flight are the ones which the peer has not acknowledged
+	 * yet.
+	 */
+	SendLanes sendLanes;
+	bool congested;
+	/**
+	 * Size of the frames received from the peer since the last
+	 * FramesReceived packet.
+	 */
+	unsigned int unacknowledgedBytes;
+
+	QHash<QByteArray, QByteArray> membershipProofs;
+	QHash<QByteArray, QByteArray> verifiedMembershipProofs;
 
 	unsigned short lastExpectedSerial;
 	unsigned short lastOutgoingSerial;
 
+	unsigned int identityGeneration;
+
 	friend class NetworkInterface;
 };
 
@@ -0,0 +1,136 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef NODEREGISTRY_H_INCLUDED
+#define NODEREGISTRY_H_INCLUDED
+
+#include "NetworkNode.h"
+
+#include <QHash>
+
+namespace ariba {
+namespace utility {
+	/**
+	 * Hash function for node ids so that they can be used in QHash and QSet.
+	 * This has to be in the namespace of NodeID, otherwise it is not found
+	 * when the templates are instantiated.
+	 */
+	inline uint qHash(const NodeID &nodeId) {
+		return (uint)nodeId.hash();
+	}
+}
+}
+
+/**
+ * Index of all peers with an established connection.
+ *
+ * Every incoming message has to be mapped to its NetworkNode, and the trust
+ * management looks up nodes by their public key, so the nodes are indexed
+ * both by their binary ariba node id and by their key. The string form of the
+ * node id is only needed for group messages, where ariba does not give us the
+ * binary id.
+ */
+class NodeRegistry {
+public:
+	/**
+	 * Adds a node to the registry. The public key of the node has to be
+	 * known, i.e. the TLS handshake has to be complete. If there already is a
+	 * node with the same public key, lookups by key return the newer node.
+	 */
+	void insert(NetworkNode *node) {
+		nodesById.insert(node->getNodeId(), node);
+		nodesByKey.insert(node->getPublicKey(), node);
+		nodesByName.insert(QString::fromStdString(node->getNodeId().toString()), node);
+	}
+	/**
+	 * Removes a node from the registry.
+	 */
+	void remove(NetworkNode *node) {
+		nodesById.remove(node->getNodeId());
+		QString name = QString::fromStdString(node->getNodeId().toString());
+		nodesByName.remove(name);
+		// Another connection to the same peer might have replaced this one
+		QHash<PublicKey, NetworkNode*>::iterator it
+				= nodesByKey.find(node->getPublicKey());
+		if (it != nodesByKey.end() && it.value() == node) {
+			nodesByKey.erase(it);
+			// Fall back to the other connection if there is one
+			foreach (NetworkNode *other, nodesById) {
+				if (other->getPublicKey() == node->getPublicKey()) {
+					nodesByKey.insert(other->getPublicKey(), other);
+					break;
+				}
+			}
+		}
+	}
+	/**
+	 * Removes all nodes from the registry. The nodes are not deleted.
+	 */
+	void clear() {
+		nodesById.clear();
+		nodesByKey.clear();
+		nodesByName.clear();
+	}
+
+	/**
+	 * Returns the node with the given ariba node id or NULL if there is none.
+	 */
+	NetworkNode *get(const ariba::utility::NodeID &nodeId) const {
+		return nodesById.value(nodeId, NULL);
+	}
+	/**
+	 * Returns the node with the given public key or NULL if there is none.
+	 */
+	NetworkNode *get(const PublicKey &publicKey) const {
+		return nodesByKey.value(publicKey, NULL);
+	}
+	/**
+	 * Returns the node with the given node id in string form or NULL if there
+	 * is none.
+	 */
+	NetworkNode *get(const QString &nodeId) const {
+		return nodesByName.value(nodeId, NULL);
+	}
+
+	/**
+	 * Returns all nodes in the registry.
+	 */
+	QList<NetworkNode*> getAll() const {
+		return nodesById.values();
+	}
+	/**
+	 * Returns the number of nodes in the registry.
+	 */
+	int size() const {
+		return nodesById.size();
+	}
+private:
+	QHash<ariba::utility::NodeID, NetworkNode*> nodesById;
+	QHash<PublicKey, NetworkNode*> nodesByKey;
+	QHash<QString, NetworkNode*> nodesByName;
+};
+
+#endif
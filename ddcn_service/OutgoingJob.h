@@ -30,7 +30,7 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "NetworkNode.h"
 #include "Job.h"
 
-#include <QTimer>
+#include "TimerWheel.h"
 
 /**
  * Class contains information about an outgoing Job
@@ -53,14 +53,26 @@ public:
 		return id;
 	}
 
-	QTimer &getTimer() {
-		return timer;
+	Deadline &getTimeout() {
+		return timeout;
+	}
+
+	/**
+	 * Sets the .dwo file which is fetched from the other peer after the job
+	 * has finished, the job was compiled with -gsplit-dwarf then.
+	 */
+	void setDebugInfoFile(const QString &debugInfoFile) {
+		this->debugInfoFile = debugInfoFile;
+	}
+	QString getDebugInfoFile() {
+		return debugInfoFile;
 	}
 private:
 	NetworkNode *targetPeer;
 	Job *job;
 	unsigned int id;
-	QTimer timer;
+	QString debugInfoFile;
+	Deadline timeout;
 };
 
 #endif
@@ -26,126 +26,448 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "ParameterParser.h"
 
-ParameterParser::ParameterParser(const QStringList &rawParameters) {
-	parse(rawParameters);
+#include <QDir>
+#include <QFile>
+#include <cstring>
+
+/**
+ * Describes how an option takes its argument.
+ */
+struct OptionArgument {
+	enum List {
+		/**
+		 * The option does not take an argument.
+		 */
+		None,
+		/**
+		 * The argument is the next parameter ("-o file").
+		 */
+		Separate,
+		/**
+		 * The argument is appended to the option ("-O2", "-Wl,-x").
+		 */
+		Joined,
+		/**
+		 * Both forms are accepted ("-I dir", "-Idir").
+		 */
+		JoinedOrSeparate
+	};
+};
+
+/**
+ * Describes which stage of the compilation an option is passed to.
+ */
+struct OptionFlags {
+	enum List {
+		/**
+		 * The option is only needed for local preprocessing.
+		 */
+		Preprocessor = 0x1,
+		/**
+		 * The option is needed when compiling the preprocessed file.
+		 */
+		Compiler = 0x2,
+		Both = Preprocessor | Compiler,
+		/**
+		 * Linker options are dropped as linking is never delegated.
+		 */
+		Linker = 0x4,
+		/**
+		 * The call cannot be delegated if the option is present.
+		 */
+		Local = 0x8,
+		/**
+		 * The option applies to the whole call and prevents splitting it into
+		 * one job per input file.
+		 */
+		PerCall = 0x10,
+		/**
+		 * The option changes the include search path. Peers which preprocess
+		 * the job receive the resulting search path instead (see
+		 * IncludeScanner).
+		 */
+		SearchPath = 0x20,
+		/**
+		 * The job has to be preprocessed locally if the option is present.
+		 */
+		LocalPreprocessing = 0x40
+	};
+};
+
+struct OptionInfo {
+	const char *name;
+	OptionArgument::List argument;
+	int flags;
+};
+
+/**
+ * Classification of the gcc options. Options are matched exactly first, then
+ * the longest matching prefix of an option with a joined argument is used.
+ * Unknown options starting with "-" are passed to both the preprocessor and
+ * the compiler, but prevent splitting the call as they might take a separate
+ * argument which would then be taken for an input file.
+ */
+static const OptionInfo options[] = {
+	// Output and mode selection
+	{ "-o", OptionArgument::JoinedOrSeparate, 0 },
+	{ "-c", OptionArgument::None, OptionFlags::Compiler },
+	{ "-x", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Both | OptionFlags::PerCall },
+	{ "-E", OptionArgument::None, OptionFlags::Local | OptionFlags::PerCall },
+	{ "-S", OptionArgument::None, OptionFlags::Local | OptionFlags::PerCall },
+	{ "-M", OptionArgument::None, OptionFlags::Local | OptionFlags::PerCall },
+	{ "-MM", OptionArgument::None, OptionFlags::Local | OptionFlags::PerCall },
+	{ "-fsyntax-only", OptionArgument::None, OptionFlags::Local },
+	{ "-###", OptionArgument::None, OptionFlags::Local },
+	{ "-v", OptionArgument::None, OptionFlags::Local },
+	{ "--help", OptionArgument::Joined, OptionFlags::Local },
+	{ "--version", OptionArgument::None, OptionFlags::Local },
+	{ "-dumpversion", OptionArgument::None, OptionFlags::Local },
+	{ "-dumpfullversion", OptionArgument::None, OptionFlags::Local },
+	{ "-dumpmachine", OptionArgument::None, OptionFlags::Local },
+	{ "-dumpspecs", OptionArgument::None, OptionFlags::Local },
+	{ "-dumpbase", OptionArgument::Separate, OptionFlags::Local },
+	{ "-dumpdir", OptionArgument::Separate, OptionFlags::Local },
+	{ "-dumpbase-ext", OptionArgument::Separate, OptionFlags::Local },
+	{ "-print-", OptionArgument::Joined, OptionFlags::Local },
+	{ "-save-temps", OptionArgument::Joined, OptionFlags::Local },
+	{ "-aux-info", OptionArgument::Separate, OptionFlags::Local },
+	// Options which depend on the local machine or toolchain installation
+	{ "-march=native", OptionArgument::None, OptionFlags::Local },
+	{ "-mcpu=native", OptionArgument::None, OptionFlags::Local },
+	{ "-mtune=native", OptionArgument::None, OptionFlags::Local },
+	{ "-B", OptionArgument::JoinedOrSeparate, OptionFlags::Local },
+	{ "-specs=", OptionArgument::Joined, OptionFlags::Local },
+	{ "-wrapper", OptionArgument::Separate, OptionFlags::Local },
+	{ "-fplugin", OptionArgument::Joined, OptionFlags::Local },
+	{ "-fprofile-use", OptionArgument::Joined, OptionFlags::Local },
+	{ "-fauto-profile", OptionArgument::Joined, OptionFlags::Local },
+	{ "-fprofile-generate", OptionArgument::Joined, OptionFlags::Local },
+	// Preprocessor options
+	{ "-I", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "-iquote", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "-isystem", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "-idirafter", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "-iprefix", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "-iwithprefix", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "-iwithprefixbefore", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "-isysroot", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "-imultilib", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "-include", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "-imacros", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::LocalPreprocessing },
+	{ "--sysroot", OptionArgument::Separate,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "--sysroot=", OptionArgument::Joined,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "-D", OptionArgument::JoinedOrSeparate, OptionFlags::Preprocessor },
+	{ "-U", OptionArgument::JoinedOrSeparate, OptionFlags::Preprocessor },
+	{ "-A", OptionArgument::JoinedOrSeparate, OptionFlags::Preprocessor },
+	{ "-Wp,", OptionArgument::Joined,
+		OptionFlags::Preprocessor | OptionFlags::LocalPreprocessing },
+	{ "-Xpreprocessor", OptionArgument::Separate,
+		OptionFlags::Preprocessor | OptionFlags::LocalPreprocessing },
+	{ "-nostdinc", OptionArgument::None,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "-nostdinc++", OptionArgument::None,
+		OptionFlags::Preprocessor | OptionFlags::SearchPath },
+	{ "-undef", OptionArgument::None, OptionFlags::Preprocessor },
+	{ "-C", OptionArgument::None, OptionFlags::Preprocessor },
+	{ "-CC", OptionArgument::None, OptionFlags::Preprocessor },
+	{ "-P", OptionArgument::None, OptionFlags::Preprocessor },
+	{ "-H", OptionArgument::None, OptionFlags::Preprocessor },
+	{ "-trigraphs", OptionArgument::None, OptionFlags::Preprocessor },
+	{ "-traditional-cpp", OptionArgument::None, OptionFlags::Preprocessor },
+	{ "-remap", OptionArgument::None,
+		OptionFlags::Preprocessor | OptionFlags::LocalPreprocessing },
+	{ "-finput-charset=", OptionArgument::Joined, OptionFlags::Preprocessor },
+	{ "-fworking-directory", OptionArgument::None, OptionFlags::Preprocessor },
+	{ "-fno-working-directory", OptionArgument::None, OptionFlags::Preprocessor },
+	// Dependency generation is done by whichever peer preprocesses the job
+	{ "-MD", OptionArgument::None, OptionFlags::Preprocessor },
+	{ "-MMD", OptionArgument::None, OptionFlags::Preprocessor },
+	{ "-MP", OptionArgument::None, OptionFlags::Preprocessor },
+	{ "-MG", OptionArgument::None,
+		OptionFlags::Preprocessor | OptionFlags::LocalPreprocessing },
+	{ "-MF", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::PerCall },
+	{ "-MT", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::PerCall },
+	{ "-MQ", OptionArgument::JoinedOrSeparate,
+		OptionFlags::Preprocessor | OptionFlags::PerCall },
+	// Families of options which only take joined arguments, their arguments
+	// cannot be mistaken for input files
+	{ "-O", OptionArgument::Joined, OptionFlags::Both },
+	{ "-W", OptionArgument::Joined, OptionFlags::Both },
+	{ "-f", OptionArgument::Joined, OptionFlags::Both },
+	{ "-m", OptionArgument::Joined, OptionFlags::Both },
+	{ "-g", OptionArgument::Joined, OptionFlags::Both },
+	{ "-d", OptionArgument::Joined, OptionFlags::Both },
+	{ "-std=", OptionArgument::Joined, OptionFlags::Both },
+	{ "-pedantic", OptionArgument::Joined, OptionFlags::Both },
+	{ "-ansi", OptionArgument::None, OptionFlags::Both },
+	{ "-pthread", OptionArgument::None, OptionFlags::Both },
+	{ "-pipe", OptionArgument::None, OptionFlags::Both },
+	{ "-w", OptionArgument::None, OptionFlags::Both },
+	{ "-p", OptionArgument::None, OptionFlags::Both },
+	{ "-pg", OptionArgument::None, OptionFlags::Both },
+	// Compiler and assembler options
+	{ "-fltrans", OptionArgument::None, OptionFlags::Compiler },
+	{ "--param", OptionArgument::Separate, OptionFlags::Compiler },
+	{ "--param=", OptionArgument::Joined, OptionFlags::Compiler },
+	{ "-Wa,", OptionArgument::Joined, OptionFlags::Compiler },
+	{ "-Xassembler", OptionArgument::Separate, OptionFlags::Compiler },
+	// Linker options
+	{ "-L", OptionArgument::JoinedOrSeparate, OptionFlags::Linker },
+	{ "-l", OptionArgument::JoinedOrSeparate, OptionFlags::Linker },
+	{ "-Wl,", OptionArgument::Joined, OptionFlags::Linker },
+	{ "-Xlinker", OptionArgument::Separate, OptionFlags::Linker },
+	{ "-T", OptionArgument::JoinedOrSeparate, OptionFlags::Linker },
+	{ "-u", OptionArgument::JoinedOrSeparate, OptionFlags::Linker },
+	{ "-z", OptionArgument::JoinedOrSeparate, OptionFlags::Linker },
+	{ "-e", OptionArgument::JoinedOrSeparate, OptionFlags::Linker },
+	{ "-shared", OptionArgument::None, OptionFlags::Linker },
+	{ "-static", OptionArgument::None, OptionFlags::Linker },
+	{ "-static-libgcc", OptionArgument::None, OptionFlags::Linker },
+	{ "-static-libstdc++", OptionArgument::None, OptionFlags::Linker },
+	{ "-shared-libgcc", OptionArgument::None, OptionFlags::Linker },
+	{ "-rdynamic", OptionArgument::None, OptionFlags::Linker },
+	{ "-pie", OptionArgument::None, OptionFlags::Linker },
+	{ "-no-pie", OptionArgument::None, OptionFlags::Linker },
+	{ "-nostdlib", OptionArgument::None, OptionFlags::Linker },
+	{ "-nostartfiles", OptionArgument::None, OptionFlags::Linker },
+	{ "-nodefaultlibs", OptionArgument::None, OptionFlags::Linker },
+	{ "-s", OptionArgument::None, OptionFlags::Linker }
+};
+
+static const OptionInfo *findOption(const QString &parameter) {
+	const int optionCount = sizeof(options) / sizeof(options[0]);
+	const OptionInfo *prefixMatch = NULL;
+	for (int i = 0; i < optionCount; i++) {
+		if (parameter == options[i].name) {
+			return &options[i];
+		}
+		if (options[i].argument != OptionArgument::Joined
+				&& options[i].argument != OptionArgument::JoinedOrSeparate) {
+			continue;
+		}
+		if (!parameter.startsWith(options[i].name)) {
+			continue;
+		}
+		if (prefixMatch == NULL
+				|| strlen(options[i].name) > strlen(prefixMatch->name)) {
+			prefixMatch = &options[i];
+		}
+	}
+	return prefixMatch;
 }
-ParameterParser::ParameterParser() : delegatable(false) {
+
+/**
+ * Languages passed via "-x" and the names gcc uses for the same languages once
+ * the input is preprocessed.
+ */
+static const char *preprocessedLanguages[][2] = {
+	{ "c", "cpp-output" },
+	{ "c++", "c++-cpp-output" },
+	{ "objective-c", "objective-c-cpp-output" },
+	{ "objective-c++", "objective-c++-cpp-output" },
+	{ "assembler-with-cpp", "assembler" }
+};
+
+/**
+ * Returns the language of the preprocessed input for a language passed via
+ * "-x". Other languages are returned unchanged.
+ */
+static QString getPreprocessedLanguage(const QString &language) {
+	const int languageCount = sizeof(preprocessedLanguages)
+		/ sizeof(preprocessedLanguages[0]);
+	for (int i = 0; i < languageCount; i++) {
+		if (language == preprocessedLanguages[i][0]) {
+			return preprocessedLanguages[i][1];
+		}
+	}
+	return language;
 }
 
-void ParameterParser::parse(const QStringList &rawParameters) {
+ParameterParser::ParameterParser(const QStringList &rawParameters,
+		const QString &workingDirectory) {
+	parse(rawParameters, workingDirectory);
+}
+ParameterParser::ParameterParser() : delegatable(false), splittable(false),
+		ltrans(false), ltoLink(false), remotePreprocessing(false) {
+}
+
+void ParameterParser::parse(const QStringList &rawParameters,
+		const QString &workingDirectory) {
+	// The expanded parameters can be much longer than the original command
+	// line, local execution therefore uses the original response files
 	originalParameters = rawParameters;
+	expandedParameters = expandResponseFiles(rawParameters, workingDirectory, 0);
+	bool responseFiles = expandedParameters != rawParameters;
 	preprocessingParameters.clear();
 	compilerParameters.clear();
+	remotePreprocessingParameters.clear();
+	includeDirectories.clear();
+	forcedIncludes.clear();
+	dependencyFile.clear();
 	inputFiles.clear();
 	outputFiles.clear();
-	// We cannot delegate the job if we are either linking, only running the
-	// preprocessor or
+	inputFileIndices.clear();
+	// Only if "-c" is given we can actually offload this command to the
+	// network as linking has to be done locally
 	bool compilingOnly = false;
-	bool nativeOptimization = false;
-	foreach (QString parameter, rawParameters) {
-		// Only if "-c" is given we can actually offload this command to the
-		// network as linking has to be done locally
-		if (parameter == "-c") {
-			compilingOnly = true;
-		}
-		// If we are supposed to optimize for the host architecture, this cannot
-		// easily be done on other computers, so leave this out for now
-		if (parameter == "-mcpu=native") {
-			nativeOptimization = true;
-		}
-		if (parameter == "-mtune=native") {
-			nativeOptimization = true;
-		}
-	}
-	delegatable = compilingOnly && !nativeOptimization;
+	// Options which need the local machine, e.g. -march=native
+	bool localOptions = false;
+	// Parameters which only work for the whole call prevent splitting it
+	bool perCallParameters = false;
+	// Options which are not in the table
+	bool unknownOptions = false;
+	// "-x" after an input file changes the language of the following files
+	// only, which we cannot express in a single delegated call
+	bool languageAfterInput = false;
+	bool readsStdin = false;
+	bool dependencies = false;
+	bool dependencyTarget = false;
+	// lto-wrapper passes -dumpbase and -dumpdir to every LTRANS call
+	bool auxiliaryNames = false;
+	bool linkTimeOptimization = false;
+	// Options which other peers cannot reproduce when preprocessing the job
+	bool localPreprocessing = false;
+	ltrans = false;
 
-	for (int i = 0; i < rawParameters.size(); i++) {
-		QString parameter = rawParameters[i];
-		if (parameter == "-I" || parameter == "-iquote") {
-			if (i == parameter.count() - 1) {
-				delegatable = false;
-				continue;
+	for (int i = 0; i < expandedParameters.size(); i++) {
+		QString parameter = expandedParameters[i];
+		if (parameter == "-" || !parameter.startsWith('-')) {
+			// This is an input file, "-" means stdin
+			if (parameter == "-") {
+				readsStdin = true;
 			}
-			preprocessingParameters.append(parameter);
-			i++;
-			preprocessingParameters.append(rawParameters[i]);
-		} else if (parameter.startsWith("-I") || parameter.startsWith("-iquote")) {
-			preprocessingParameters.append(parameter);
-		} else if (parameter == "-L") {
-			// We do not need to care about any linker paths
-			if (i == parameter.count() - 1) {
-				delegatable = false;
+			inputFiles.append(parameter);
+			inputFileIndices.append(i);
+			continue;
+		}
+		const OptionInfo *option = findOption(parameter);
+		int flags = option ? option->flags : (int)OptionFlags::Both;
+		if (!option) {
+			unknownOptions = true;
+		}
+		QStringList optionParameters;
+		optionParameters.append(parameter);
+		QString argument;
+		if (option && (option->argument == OptionArgument::Separate
+				|| (option->argument == OptionArgument::JoinedOrSeparate
+				&& parameter == option->name))) {
+			if (i == expandedParameters.size() - 1) {
+				// gcc will fail anyway, let it print the error message
+				localOptions = true;
 				continue;
 			}
 			i++;
-		} else if (parameter.startsWith("-L")) {
-			// Drop linker path again
-		} else if (parameter == "-o") {
-			if (i == parameter.count() - 1) {
-				delegatable = false;
-				continue;
+			argument = expandedParameters[i];
+			optionParameters.append(argument);
+		} else if (option) {
+			argument = parameter.mid(strlen(option->name));
+		}
+		// The compiler gets the preprocessed input, some options have to be
+		// changed for it
+		QStringList compilerOptionParameters = optionParameters;
+		QString name = option ? QString(option->name) : parameter;
+		if (name == "-o") {
+			outputFiles.append(argument);
+			continue;
+		} else if (name == "-c") {
+			compilingOnly = true;
+		} else if (name == "-x") {
+			if (!inputFiles.empty()) {
+				languageAfterInput = true;
 			}
-			i++;
-			outputFiles.append(rawParameters[i]);
-		} else if (parameter == "-c") {
-			compilerParameters.append(parameter);
-		} else if (parameter == "-x") {
-			// Do not delegate jobs where we have to store file types per file
-			// TODO: This could easily be implemented
-			delegatable = false;
-			preprocessingParameters.append(parameter);
-			compilerParameters.append(parameter);
-		} else if (parameter == "-") {
-			// Do not delegate job which reads from stdin
-			// TODO: This can easily be implemented
-			delegatable = false;
-			preprocessingParameters.append(parameter);
-			compilerParameters.append(parameter);
-		} else if (parameter == "-MF"
-				|| parameter == "-MT"
-				|| parameter == "-MQ") {
-			// Dependency generation parameters with additional parameter
-			preprocessingParameters.append(parameter);
-			if (i == parameter.count() - 1) {
-				delegatable = false;
-				continue;
+			// "-x c" would make the compiler preprocess the file again
+			compilerOptionParameters.clear();
+			compilerOptionParameters.append("-x");
+			compilerOptionParameters.append(getPreprocessedLanguage(argument));
+		} else if (name == "-MD" || name == "-MMD") {
+			dependencies = true;
+		} else if (name == "-MF") {
+			dependencyFile = argument;
+		} else if (name == "-MT" || name == "-MQ") {
+			dependencyTarget = true;
+		} else if (name == "-fltrans") {
+			ltrans = true;
+		} else if (parameter == "-flto" || parameter.startsWith("-flto=")) {
+			linkTimeOptimization = true;
+		} else if (parameter == "-fno-lto") {
+			linkTimeOptimization = false;
+		} else if (name == "-I") {
+			// "-I-" splits the search path in a way the include scanner does
+			// not support
+			if (argument == "-") {
+				localPreprocessing = true;
 			}
-			i++;
-			preprocessingParameters.append(rawParameters[i]);
-		} else if (parameter == "-MG"
-				|| parameter == "-MP"
-				|| parameter == "-MD"
-				|| parameter == "-MMD") {
-			// Dependency generation parameters
-			preprocessingParameters.append(parameter);
-		} else if (parameter == "E"
-				|| parameter == "-M"
-				|| parameter == "-MM") {
-			// Do not delegate jobs which only perform preprocessing
-			delegatable = false;
-			preprocessingParameters.append(parameter);
-			compilerParameters.append(parameter);
-		} else if (parameter.startsWith("-D")) {
-			// Defining a preprocessor macro
-			preprocessingParameters.append(parameter);
-		} else if (parameter.at(0) == '-'){
-			// TODO: Other parameters which do not have any "-" in front of them
-			preprocessingParameters.append(parameter);
-			compilerParameters.append(parameter);
-		} else {
-			// This is an input file
-			inputFiles.append(parameter);
+			includeDirectories.append(argument);
+		} else if (name == "-include") {
+			forcedIncludes.append(argument);
+		}
+		if (name == "-dumpbase" || name == "-dumpbase-ext" || name == "-dumpdir") {
+			// These only name auxiliary output files which are not returned
+			// by delegated jobs anyway
+			auxiliaryNames = true;
+			continue;
+		}
+		if (flags & OptionFlags::Local) {
+			localOptions = true;
+		}
+		if (flags & OptionFlags::PerCall) {
+			perCallParameters = true;
 		}
+		if (flags & OptionFlags::Preprocessor) {
+			preprocessingParameters.append(optionParameters);
+		}
+		if (flags & OptionFlags::Compiler) {
+			compilerParameters.append(compilerOptionParameters);
+		}
+		if (flags & OptionFlags::LocalPreprocessing) {
+			localPreprocessing = true;
+		}
+		// A peer which preprocesses the job gets its own search path and
+		// dependency file
+		if ((flags & OptionFlags::Compiler) || ((flags & OptionFlags::Preprocessor)
+				&& !(flags & OptionFlags::SearchPath) && name != "-MF")) {
+			remotePreprocessingParameters.append(optionParameters);
+		}
+	}
+	if (auxiliaryNames && !ltrans) {
+		localOptions = true;
 	}
+	delegatable = compilingOnly && !localOptions && !languageAfterInput;
+	ltoLink = linkTimeOptimization && !compilingOnly && !localOptions
+		&& !inputFiles.empty();
+	// gcc -c a.c b.c compiles the files independently, so we can run one job
+	// per file and delegate each of them. The parts are executed with the
+	// expanded parameters, so calls with response files are not split.
+	splittable = compilingOnly && !localOptions && !perCallParameters
+		&& !unknownOptions && !responseFiles && !readsStdin
+		&& outputFiles.empty() && inputFiles.count() > 1;
 	if (inputFiles.empty() || outputFiles.count() > 1
 			|| (!outputFiles.empty() && inputFiles.count() != 1)) {
 		delegatable = false;
 	}
+	bool explicitOutput = !outputFiles.empty();
 	if (outputFiles.empty()) {
 		// No output file was specified, so we have to derive output names from
-		// the input files
+		// the input files like gcc, which places them in the working directory
 		for (int i = 0; i < inputFiles.count(); i++) {
 			QString fileName = inputFiles[i];
+			fileName = fileName.mid(fileName.lastIndexOf('/') + 1);
 			if (fileName.contains(".")) {
 				fileName = fileName.left(fileName.lastIndexOf('.'));
 			}
@@ -153,12 +475,129 @@ void ParameterParser::parse(const QStringList &rawParameters) {
 			outputFiles.append(fileName);
 		}
 	}
+	if (delegatable && dependencies) {
+		// The dependency file is written by the local preprocessor, but gcc -E
+		// derives its name and the target from the temporary output file, so
+		// we have to pass the names a normal compiler call would use
+		if (dependencyFile.isEmpty()) {
+			QString dependencyFileName;
+			if (explicitOutput) {
+				dependencyFileName = outputFiles[0];
+				int suffix = dependencyFileName.lastIndexOf('.');
+				if (suffix > dependencyFileName.lastIndexOf('/')) {
+					dependencyFileName = dependencyFileName.left(suffix);
+				}
+			} else {
+				dependencyFileName = outputFiles[0];
+				dependencyFileName.chop(2);
+			}
+			dependencyFileName.append(".d");
+			preprocessingParameters << "-MF" << dependencyFileName;
+			dependencyFile = dependencyFileName;
+		}
+		if (!dependencyTarget) {
+			preprocessingParameters << "-MQ" << outputFiles[0];
+			remotePreprocessingParameters << "-MQ" << outputFiles[0];
+		}
+	} else {
+		dependencyFile.clear();
+	}
+	remotePreprocessing = delegatable && !ltrans && !localPreprocessing
+		&& !readsStdin && inputFiles.count() == 1;
 }
 
+QStringList ParameterParser::expandResponseFiles(const QStringList &parameters,
+		const QString &workingDirectory, int depth) {
+	// Response files can include each other, limit the depth to prevent loops
+	if (depth >= 10) {
+		return parameters;
+	}
+	QStringList expanded;
+	foreach (QString parameter, parameters) {
+		if (!parameter.startsWith('@') || parameter.length() == 1) {
+			expanded.append(parameter);
+			continue;
+		}
+		QFile file(QDir(workingDirectory).filePath(parameter.mid(1)));
+		if (!file.open(QIODevice::ReadOnly)) {
+			expanded.append(parameter);
+			continue;
+		}
+		QByteArray data = file.readAll();
+		QString content = QString::fromLocal8Bit(data.constData(), data.size());
+		expanded.append(expandResponseFiles(splitResponseFile(content),
+				workingDirectory, depth + 1));
+	}
+	return expanded;
+}
+
+QStringList ParameterParser::splitResponseFile(const QString &content) {
+	QStringList parameters;
+	QString current;
+	bool inParameter = false;
+	QChar quote = '\0';
+	for (int i = 0; i < content.length(); i++) {
+		QChar c = content.at(i);
+		if (c == '\\' && i + 1 < content.length()) {
+			// A backslash escapes the next character, also within quotes
+			i++;
+			current.append(content.at(i));
+			inParameter = true;
+		} else if (quote != '\0') {
+			if (c == quote) {
+				quote = '\0';
+			} else {
+				current.append(c);
+			}
+		} else if (c == '\'' || c == '"') {
+			quote = c;
+			inParameter = true;
+		} else if (c.isSpace()) {
+			if (inParameter) {
+				parameters.append(current);
+				current.clear();
+				inParameter = false;
+			}
+		} else {
+			current.append(c);
+			inParameter = true;
+		}
+	}
+	if (inParameter) {
+		parameters.append(current);
+	}
+	return parameters;
+}
 bool ParameterParser::isDelegatable() {
 	return delegatable;
 }
 
+bool ParameterParser::isSplittable() {
+	return splittable;
+}
+bool ParameterParser::isLtrans() {
+	return ltrans;
+}
+bool ParameterParser::isLtoLink() {
+	return ltoLink;
+}
+QList<QStringList> ParameterParser::getSplitParameters() {
+	QList<QStringList> splitParameters;
+	if (!splittable) {
+		return splitParameters;
+	}
+	for (int i = 0; i < inputFileIndices.count(); i++) {
+		QStringList parameters;
+		for (int j = 0; j < expandedParameters.count(); j++) {
+			if (j == inputFileIndices[i] || !inputFileIndices.contains(j)) {
+				parameters.append(expandedParameters[j]);
+			}
+		}
+		splitParameters.append(parameters);
+	}
+	return splitParameters;
+}
+
 QStringList ParameterParser::getOriginalParameters() {
 	return originalParameters;
 }
@@ -173,6 +612,22 @@ QStringList ParameterParser::getCompilerParameters() {
 	return compilerParameters;
 }
 
+bool ParameterParser::isRemotelyPreprocessable() {
+	return remotePreprocessing;
+}
+QStringList ParameterParser::getRemotePreprocessingParameters() {
+	return remotePreprocessingParameters;
+}
+QStringList ParameterParser::getIncludeDirectories() {
+	return includeDirectories;
+}
+QStringList ParameterParser::getForcedIncludes() {
+	return forcedIncludes;
+}
+QString ParameterParser::getDependencyFile() {
+	return dependencyFile;
+}
+
 QStringList ParameterParser::getInputFiles() {
 	return inputFiles;
 }
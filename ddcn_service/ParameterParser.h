@@ -44,8 +44,11 @@ public:
 	 *
 	 * @param rawParameters Set of parameters passed to gcc, shall not contain
 	 * the first parameter which contains the program name only.
+	 * @param workingDirectory Directory gcc is called in, used to resolve
+	 * response files ("@file").
 	 */
-	ParameterParser(const QStringList &rawParameters);
+	ParameterParser(const QStringList &rawParameters,
+			const QString &workingDirectory = QString());
 	/**
 	 * Constructor. Creates empty parameter lists.
 	 */
@@ -55,7 +58,8 @@ public:
 	 * Parses a set of parameters. This is called implicitly from the
 	 * constructor which takes a string list parameter.
 	 */
-	void parse(const QStringList &rawParameters);
+	void parse(const QStringList &rawParameters,
+			const QString &workingDirectory = QString());
 
 	/**
 	 * Returns true if the job can be delegated to a different peer. This is the
@@ -63,9 +67,34 @@ public:
 	 * parser encounters parameters which are not yet supported.
 	 */
 	bool isDelegatable();
+	/**
+	 * Returns true if the call compiles several input files without linking
+	 * them, so that it can be split up into one job per input file (see
+	 * getSplitParameters()). Calls with "-x", with response files or with
+	 * options which are not known to the parser are never split.
+	 */
+	bool isSplittable();
+	/**
+	 * Returns one set of parameters per input file, each of which only
+	 * compiles that input file. The output files are derived by gcc, so the
+	 * results are the same as for the original call.
+	 */
+	QList<QStringList> getSplitParameters();
+	/**
+	 * Returns true if the call compiles a partition written by lto-wrapper
+	 * ("-fltrans"). The input files already are compiler input and must not
+	 * be preprocessed.
+	 */
+	bool isLtrans();
+	/**
+	 * Returns true if the call links with link-time optimization ("-flto").
+	 */
+	bool isLtoLink();
 
 	/**
-	 * Returns the original unaltered set of parameters.
+	 * Returns the original set of parameters, which is used when the job is
+	 * executed locally. Response files ("@file") are not expanded, as the
+	 * expanded command line might exceed the limit of the system.
 	 */
 	QStringList getOriginalParameters();
 
@@ -76,10 +105,39 @@ public:
 	QStringList getPreprocessingParameters();
 	/**
 	 * Returns the set of compiler parameters which shall be used by other
-	 * peers.
+	 * peers. They compile the preprocessed input, so a language selected via
+	 * "-x" is replaced by its preprocessed variant ("-x c" by
+	 * "-x cpp-output", for example).
 	 */
 	QStringList getCompilerParameters();
 
+	/**
+	 * Returns true if the job can be preprocessed by the peer which compiles
+	 * it, which is the case for delegatable jobs with a single input file if
+	 * no options are used which other peers cannot reproduce.
+	 */
+	bool isRemotelyPreprocessable();
+	/**
+	 * Returns the parameters for a peer which preprocesses and compiles the
+	 * job. Options which change the include search path and the name of the
+	 * dependency file are left out, the peer gets them from the
+	 * IncludeScanner.
+	 */
+	QStringList getRemotePreprocessingParameters();
+	/**
+	 * Returns the directories passed via "-I", in the original order.
+	 */
+	QStringList getIncludeDirectories();
+	/**
+	 * Returns the files passed via "-include", in the original order.
+	 */
+	QStringList getForcedIncludes();
+	/**
+	 * Returns the dependency file written with "-MD" or "-MMD", or "" if no
+	 * dependency file is generated.
+	 */
+	QString getDependencyFile();
+
 	/**
 	 * Returns a list with the input file names which have to be preprocessed.
 	 */
@@ -89,16 +147,46 @@ public:
 	 * has to be as long as the array returned by getInputFiles().
 	 */
 	QStringList getOutputFiles();
+
+	/**
+	 * Splits the contents of a response file into parameters, using the same
+	 * quoting rules as gcc.
+	 */
+	static QStringList splitResponseFile(const QString &content);
 private:
+	/**
+	 * Replaces all "@file" parameters with the contents of the response file.
+	 * Parameters referring to files which cannot be read are kept unaltered,
+	 * just like gcc does.
+	 */
+	QStringList expandResponseFiles(const QStringList &parameters,
+			const QString &workingDirectory, int depth);
+
 	bool delegatable;
+	bool splittable;
+	bool ltrans;
+	bool ltoLink;
+	bool remotePreprocessing;
 
 	QStringList originalParameters;
+	/**
+	 * The original parameters with response files expanded.
+	 */
+	QStringList expandedParameters;
 
 	QStringList preprocessingParameters;
 	QStringList compilerParameters;
+	QStringList remotePreprocessingParameters;
+	QStringList includeDirectories;
+	QStringList forcedIncludes;
+	QString dependencyFile;
 
 	QStringList inputFiles;
 	QStringList outputFiles;
+	/**
+	 * Position of the input files in expandedParameters.
+	 */
+	QList<int> inputFileIndices;
 };
 
 #endif
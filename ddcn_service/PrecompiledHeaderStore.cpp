@@ -0,0 +1,225 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "PrecompiledHeaderStore.h"
+#include "ToolChainRegistry.h"
+
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QRegExp>
+#include <QtConcurrentRun>
+#include <cstring>
+
+static const char *pragmaPrefix = "#pragma GCC pch_preprocess ";
+
+PrecompiledHeaderStore::PrecompiledHeaderStore(QObject *parent) : QObject(parent),
+		settings(QSettings::IniFormat, QSettings::UserScope, "ddcn", "ddcn") {
+	enabled = settings.value("service/distribute_pch", true).toBool();
+	cacheSize = settings.value("service/pch_cache_size", 32).toInt();
+	directory = settings.value("service/pch_cache_dir",
+			QDir::homePath() + "/.cache/ddcn/pch").toString();
+	if (!QDir().mkpath(directory)) {
+		qWarning("Could not create the precompiled header directory \"%s\".",
+				directory.toAscii().data());
+		enabled = false;
+		return;
+	}
+	// Headers received during earlier runs can be used right away
+	QRegExp hashName("^[0-9a-f]{40}\\.gch$");
+	QStringList entries = QDir(directory).entryList(QStringList(), QDir::Files);
+	foreach (QString entry, entries) {
+		if (hashName.exactMatch(entry)) {
+			receivedHeaders.insert(entry.left(40));
+		}
+	}
+}
+PrecompiledHeaderStore::~PrecompiledHeaderStore() {
+	foreach (QObject *child, children()) {
+		QFutureWatcher<ReceivedHeader> *watcher =
+				dynamic_cast<QFutureWatcher<ReceivedHeader>*>(child);
+		if (watcher) {
+			watcher->waitForFinished();
+		}
+	}
+}
+
+QString PrecompiledHeaderStore::getHash(const QString &fileName) {
+	QString stamp = createStamp(fileName);
+	if (stamp.isEmpty()) {
+		return "";
+	}
+	QHash<QString, LocalHeader>::iterator it = localHeaders.find(fileName);
+	if (it != localHeaders.end() && it.value().stamp == stamp) {
+		return it.value().hash;
+	}
+	// This only happens once after every rebuild of the header, so the file
+	// is hashed right here instead of delaying the job
+	LocalHeader header;
+	header.stamp = stamp;
+	header.hash = ToolChainRegistry::hashFile(fileName).toHex();
+	if (header.hash.isEmpty()) {
+		return "";
+	}
+	localHeaders.insert(fileName, header);
+	localFiles.insert(header.hash, fileName);
+	return header.hash;
+}
+QString PrecompiledHeaderStore::getLocalFile(const QString &hash) {
+	QString fileName = localFiles.value(hash);
+	if (fileName.isEmpty()) {
+		return "";
+	}
+	// Do not send a file whose content does not match the hash anymore
+	if (localHeaders.value(fileName).stamp != createStamp(fileName)) {
+		localFiles.remove(hash);
+		return "";
+	}
+	return fileName;
+}
+
+void PrecompiledHeaderStore::addReceivedHeader(const QString &hash,
+		const QString &fileName) {
+	if (!enabled || verifying.contains(hash) || receivedHeaders.contains(hash)) {
+		QFile::remove(fileName);
+		return;
+	}
+	verifying.insert(hash);
+	QFutureWatcher<ReceivedHeader> *watcher = new QFutureWatcher<ReceivedHeader>(this);
+	connect(watcher, SIGNAL(finished()), this, SLOT(onHeaderVerified()));
+	watcher->setFuture(QtConcurrent::run(verifyHeader, hash, fileName,
+			directory));
+}
+
+QString PrecompiledHeaderStore::findPragma(const QString &preprocessedFile) {
+	QFile file(preprocessedFile);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return "";
+	}
+	// The pragma replaces the first include, so it comes before any code and
+	// only line markers can precede it
+	while (!file.atEnd()) {
+		QByteArray line = file.readLine().trimmed();
+		if (line.startsWith(pragmaPrefix)) {
+			QByteArray quoted = line.mid(strlen(pragmaPrefix));
+			if (quoted.size() < 2 || !quoted.startsWith('"') || !quoted.endsWith('"')) {
+				return "";
+			}
+			QString name = QString::fromLocal8Bit(quoted.mid(1, quoted.size() - 2).constData());
+			return name.replace("\\\"", "\"").replace("\\\\", "\\");
+		}
+		if (!line.isEmpty() && !line.startsWith('#')) {
+			break;
+		}
+	}
+	return "";
+}
+bool PrecompiledHeaderStore::replacePragma(const QString &preprocessedFile,
+		const QString &headerFile) {
+	QFile file(preprocessedFile);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	// The files are small as the header text is not part of them
+	QByteArray content = file.readAll();
+	file.close();
+	int start = content.indexOf(pragmaPrefix);
+	if (start == -1) {
+		return false;
+	}
+	int end = content.indexOf('\n', start);
+	if (end == -1) {
+		end = content.size();
+	}
+	QString quoted = QString(headerFile).replace("\\", "\\\\").replace("\"", "\\\"");
+	QByteArray pragma = QByteArray(pragmaPrefix) + "\"" + quoted.toLocal8Bit() + "\"";
+	content.replace(start, end - start, pragma);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return false;
+	}
+	bool success = file.write(content) == content.size();
+	file.close();
+	return success;
+}
+
+void PrecompiledHeaderStore::onHeaderVerified() {
+	QFutureWatcher<ReceivedHeader> *watcher =
+			static_cast<QFutureWatcher<ReceivedHeader>*>(sender());
+	ReceivedHeader header = watcher->result();
+	watcher->deleteLater();
+	verifying.remove(header.hash);
+	if (!header.valid) {
+		qWarning("Received precompiled header %s does not match its hash.",
+				header.hash.toAscii().data());
+		return;
+	}
+	qDebug("Received precompiled header %s.", header.hash.toAscii().data());
+	receivedHeaders.insert(header.hash);
+	removeOldHeaders();
+}
+
+QString PrecompiledHeaderStore::createStamp(const QString &fileName) {
+	QFileInfo info(fileName);
+	if (!info.exists()) {
+		return "";
+	}
+	return QString("%1:%2").arg((qulonglong)info.size())
+			.arg((qulonglong)info.lastModified().toTime_t());
+}
+PrecompiledHeaderStore::ReceivedHeader PrecompiledHeaderStore::verifyHeader(
+		const QString &hash, const QString &fileName, const QString &directory) {
+	ReceivedHeader header;
+	header.hash = hash;
+	header.valid = ToolChainRegistry::hashFile(fileName).toHex() == hash.toAscii();
+	// The file is moved under a temporary name first, the received file is
+	// usually on a different file system
+	QString target = directory + "/" + hash + ".gch";
+	QFile::remove(target + ".tmp");
+	if (!header.valid || !QFile::rename(fileName, target + ".tmp")
+			|| !QFile::rename(target + ".tmp", target)) {
+		header.valid = false;
+		QFile::remove(target + ".tmp");
+	}
+	QFile::remove(fileName);
+	return header;
+}
+void PrecompiledHeaderStore::removeOldHeaders() {
+	if (receivedHeaders.size() <= cacheSize) {
+		return;
+	}
+	// Sorted by modification time, newest first
+	QFileInfoList entries = QDir(directory).entryInfoList(
+			QStringList("*.gch"), QDir::Files, QDir::Time);
+	for (int i = entries.size() - 1; i >= 0 && receivedHeaders.size() > cacheSize; i--) {
+		QString hash = entries[i].fileName().left(40);
+		if (receivedHeaders.remove(hash)) {
+			QFile::remove(entries[i].absoluteFilePath());
+		}
+	}
+}
@@ -0,0 +1,151 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef PRECOMPILEDHEADERSTORE_H_INCLUDED
+#define PRECOMPILEDHEADERSTORE_H_INCLUDED
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QSettings>
+
+template<typename T> class QFutureWatcher;
+
+/**
+ * Manages precompiled headers (".gch" files) which are shipped to other peers
+ * so that delegated jobs keep the speedup of the precompiled header.
+ *
+ * If "service/distribute_pch" is enabled (the default), jobs are preprocessed
+ * with "-fpch-preprocess". If gcc finds a valid precompiled header, the
+ * preprocessed output then does not contain the header text but a
+ * "#pragma GCC pch_preprocess" line which names the ".gch" file. Such a file is
+ * identified on the network by the SHA-1 hash of its content, which is cached
+ * as long as the size and modification time of the file do not change.
+ *
+ * A peer which receives a job referring to a precompiled header it does not
+ * have yet requests the file over the bulk channel once and rejects the job in
+ * the meantime. Received files are verified and stored in
+ * "service/pch_cache_dir", the oldest files are removed if there are more than
+ * "service/pch_cache_size" of them. Before the job is compiled with
+ * "-fpreprocessed", the pragma is changed to point to the cached file. As gcc
+ * only loads precompiled headers created by the very same compiler binary,
+ * these jobs are only executed with a toolchain with the same fingerprint.
+ */
+class PrecompiledHeaderStore : public QObject {
+	Q_OBJECT
+public:
+	PrecompiledHeaderStore(QObject *parent = NULL);
+	~PrecompiledHeaderStore();
+
+	/**
+	 * Returns true if jobs shall be preprocessed with "-fpch-preprocess".
+	 */
+	bool isEnabled() {
+		return enabled;
+	}
+
+	/**
+	 * Returns the hash of a local precompiled header, or "" if the file
+	 * cannot be read. The file can then be found via getLocalFile().
+	 */
+	QString getHash(const QString &fileName);
+	/**
+	 * Returns the name of a local precompiled header with the given hash, or
+	 * "" if there is no such file or if it has been changed in the meantime.
+	 */
+	QString getLocalFile(const QString &hash);
+
+	/**
+	 * Returns true if a precompiled header received from another peer is
+	 * available.
+	 */
+	bool hasReceivedHeader(const QString &hash) {
+		return receivedHeaders.contains(hash);
+	}
+	/**
+	 * Returns the file name of a received precompiled header.
+	 */
+	QString getReceivedHeader(const QString &hash) {
+		return directory + "/" + hash + ".gch";
+	}
+	/**
+	 * Verifies a precompiled header which has been received from another peer
+	 * in the thread pool and moves it into the cache directory.
+	 */
+	void addReceivedHeader(const QString &hash, const QString &fileName);
+	/**
+	 * Returns true if a received precompiled header is currently being
+	 * verified.
+	 */
+	bool isVerifying(const QString &hash) {
+		return verifying.contains(hash);
+	}
+
+	/**
+	 * Returns the precompiled header referenced by a file preprocessed with
+	 * "-fpch-preprocess" as written by gcc, or "" if gcc did not use one.
+	 */
+	static QString findPragma(const QString &preprocessedFile);
+	/**
+	 * Changes the precompiled header referenced by a preprocessed file.
+	 */
+	static bool replacePragma(const QString &preprocessedFile,
+			const QString &headerFile);
+private slots:
+	void onHeaderVerified();
+private:
+	struct LocalHeader {
+		QString stamp;
+		QString hash;
+	};
+	struct ReceivedHeader {
+		QString hash;
+		bool valid;
+	};
+
+	static QString createStamp(const QString &fileName);
+	static ReceivedHeader verifyHeader(const QString &hash,
+			const QString &fileName, const QString &directory);
+	void removeOldHeaders();
+
+	QSettings settings;
+	bool enabled;
+	QString directory;
+	int cacheSize;
+	/**
+	 * Hash of every local precompiled header, indexed by file name.
+	 */
+	QHash<QString, LocalHeader> localHeaders;
+	/**
+	 * File name of every hash in localHeaders.
+	 */
+	QHash<QString, QString> localFiles;
+	QSet<QString> receivedHeaders;
+	QSet<QString> verifying;
+};
+
+#endif
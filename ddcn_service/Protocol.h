@@ -32,6 +32,7 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cstring>
 #include <QByteArray>
 #include <QtEndian>
+#include <QMetaType>
 #include <stdint.h>
 
 struct PacketType {
@@ -118,7 +119,50 @@ struct PacketType {
 		 * QueryGroupNetworkResources packet.
 		 */
 		GroupNetworkResourcesAvailable,
-		LastType = GroupNetworkResourcesAvailable
+		/**
+		 * Sent by the peer which acted as the TLS server after the connection
+		 * is ready. Contains the TCP port and the addresses the peer can be
+		 * reached at and a random token.
+		 * The other peer then opens a direct TCP connection which is used to
+		 * transfer job input and output files (see BulkChannel).
+		 */
+		BulkChannelOffer,
+		/**
+		 * Sent by a peer which has received a job for a toolchain it does not
+		 * have. Contains a transfer id and the hash of the toolchain package
+		 * which was announced in the JobData packet. The package is then sent
+		 * over the bulk channel (see ToolChainPackageStore).
+		 */
+		ToolChainPackageRequest,
+		/**
+		 * Sent by a peer which has received a job referring to a precompiled
+		 * header it does not have. Contains a transfer id and the hash of the
+		 * header which was announced in the JobData packet. The header is
+		 * then sent over the bulk channel (see PrecompiledHeaderStore).
+		 */
+		PrecompiledHeaderRequest,
+		/**
+		 * Sent by a peer after a job compiled with -gsplit-dwarf has
+		 * finished. Contains the id of the job, the .dwo file is then sent over
+		 * the bulk channel.
+		 */
+		DebugInfoRequest,
+		/**
+		 * Sent by a peer which has received a job which it preprocesses
+		 * itself. Contains a transfer id and the hashes of headers which were
+		 * announced in the JobData packet but which the peer does not have.
+		 * The headers are then sent over the bulk channel, the index of each
+		 * file is the index of its hash (see HeaderStore).
+		 */
+		HeaderRequest,
+		/**
+		 * Sent by a peer after it has received frames from the other peer.
+		 * Contains the total size of the frames including their headers, the
+		 * other peer then removes them from its send window (see SendLanes).
+		 * These packets are not part of the send window themselves.
+		 */
+		FramesReceived,
+		LastType = FramesReceived
 	};
 };
 
@@ -138,6 +182,31 @@ struct NodeStatusPacket {
 	unsigned short groupCount;
 } __attribute__((packed));
 
+/**
+ * Lanes of the send queue of a peer. Packets in different lanes are split
+ * into frames which are interleaved on the connection, so that small control
+ * packets do not have to wait until large packets with job data have been
+ * sent.
+ */
+struct SendLane {
+	enum List {
+		Control,
+		Bulk,
+		Count
+	};
+};
+
+/**
+ * Header of a frame on the TLS connection to a peer. The frame payload is a
+ * part of a packet in the specified lane, the frames of one lane are
+ * concatenated until a frame with the last flag set is received.
+ */
+struct FrameHeader {
+	unsigned char lane;
+	unsigned char last;
+	unsigned short size;
+} __attribute__((packed));
+
 class PacketData : public QSharedData {
 public:
 	PacketData(const PacketData &other) : QSharedData(other) {
@@ -409,4 +478,6 @@ private:
 	QSharedDataPointer<PacketData> data;
 };
 
+Q_DECLARE_METATYPE(Packet)
+
 #endif
@@ -0,0 +1,73 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "SendLanes.h"
+
+void SendLanes::append(const Packet &packet) {
+	SendLane::List lane = SendLane::Control;
+	if (packet.getRawSize() > MAX_FRAME_SIZE) {
+		lane = SendLane::Bulk;
+	}
+	sendQueues[lane].packets.append(packet);
+	queuedBytes += packet.getRawSize();
+}
+bool SendLanes::takeFrame(Frame &frame) {
+	if (bytesInFlight >= SEND_WINDOW) {
+		return false;
+	}
+	// Take turns between all lanes which have data
+	int lane = -1;
+	for (int i = 0; i < SendLane::Count; i++) {
+		int candidate = (nextLane + i) % SendLane::Count;
+		if (!sendQueues[candidate].packets.empty()) {
+			lane = candidate;
+			break;
+		}
+	}
+	if (lane == -1) {
+		return false;
+	}
+	nextLane = (lane + 1) % SendLane::Count;
+	SendQueue &queue = sendQueues[lane];
+	frame.packet = queue.packets.first();
+	frame.lane = lane;
+	frame.offset = queue.offset;
+	frame.size = frame.packet.getRawSize() - queue.offset;
+	if (frame.size > MAX_FRAME_SIZE) {
+		frame.size = MAX_FRAME_SIZE;
+	}
+	frame.last = queue.offset + frame.size == frame.packet.getRawSize();
+	if (frame.last) {
+		queue.packets.removeFirst();
+		queue.offset = 0;
+	} else {
+		queue.offset += frame.size;
+	}
+	queuedBytes -= frame.size;
+	bytesInFlight += frame.size + sizeof(FrameHeader);
+	return true;
+}
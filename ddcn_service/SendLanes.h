@@ -0,0 +1,121 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef SENDLANES_H_INCLUDED
+#define SENDLANES_H_INCLUDED
+
+#include "Protocol.h"
+
+#include <QList>
+
+/**
+ * Queues the packets which are sent to one peer and splits them into frames.
+ *
+ * Packets which fit into a single frame are sent in the control lane, larger
+ * packets in the bulk lane. The frames of both lanes are interleaved, so a
+ * large packet delays a small one by at most one frame. Only SEND_WINDOW bytes
+ * of frames are in flight at a time, the rest stays queued here. Frames are in
+ * flight until the other peer has acknowledged them with a FramesReceived
+ * packet, so this includes data which is still buffered within ariba.
+ */
+class SendLanes {
+public:
+	/**
+	 * Part of a packet which is sent as one frame.
+	 */
+	struct Frame {
+		Packet packet;
+		int lane;
+		unsigned int offset;
+		unsigned int size;
+		bool last;
+	};
+
+	SendLanes() : nextLane(0), queuedBytes(0), bytesInFlight(0) {
+	}
+
+	/**
+	 * Queues a packet in the lane matching its size.
+	 */
+	void append(const Packet &packet);
+	/**
+	 * Takes the next frame which has to be sent. The frame counts as being in
+	 * flight until onFramesAcknowledged() is called for it.
+	 *
+	 * @return False if nothing is queued or if the send window is full.
+	 */
+	bool takeFrame(Frame &frame);
+	/**
+	 * Removes frames which the other peer has received from the send window.
+	 *
+	 * @param frameBytes Total size of the frames including their headers.
+	 */
+	void onFramesAcknowledged(unsigned int frameBytes) {
+		bytesInFlight -= qMin(frameBytes, bytesInFlight);
+	}
+	/**
+	 * Returns the number of bytes which are queued or in flight.
+	 */
+	unsigned int getBufferedBytes() {
+		return queuedBytes + bytesInFlight;
+	}
+
+	/**
+	 * Maximum size of the payload of a single frame.
+	 */
+	static const unsigned int MAX_FRAME_SIZE = 16384 - sizeof(FrameHeader);
+	/**
+	 * Maximum number of bytes which are in flight at a time.
+	 */
+	static const unsigned int SEND_WINDOW = 256 * 1024;
+	/**
+	 * Number of received bytes after which a peer sends a FramesReceived
+	 * packet. This has to be well below SEND_WINDOW so that the other peer
+	 * can keep sending while the acknowledgement is on its way.
+	 */
+	static const unsigned int ACKNOWLEDGE_THRESHOLD = SEND_WINDOW / 4;
+private:
+	/**
+	 * Packets of one lane which have not been completely sent yet.
+	 */
+	struct SendQueue {
+		SendQueue() : offset(0) {
+		}
+
+		QList<Packet> packets;
+		/**
+		 * Number of bytes of the first packet which have already been sent.
+		 */
+		unsigned int offset;
+	};
+	SendQueue sendQueues[SendLane::Count];
+	int nextLane;
+	unsigned int queuedBytes;
+	unsigned int bytesInFlight;
+};
+
+#endif
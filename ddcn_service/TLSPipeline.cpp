@@ -0,0 +1,192 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "TLSPipeline.h"
+
+#include <QThread>
+#include <QMutexLocker>
+#include <QtEndian>
+#include <cstring>
+
+TLSPipeline::TLSPipeline() : encryptionRequired(true), tls(NULL),
+		handshaken(false), failed(false) {
+	// The data is always queued, even if the pipeline has not been moved into
+	// a different thread yet, so that the order of the packets is kept
+	connect(this, SIGNAL(incomingDataQueued(QByteArray)),
+		this, SLOT(onIncomingDataQueued(QByteArray)), Qt::QueuedConnection);
+	connect(this, SIGNAL(frameQueued(Packet, int, unsigned int, unsigned int, bool)),
+		this, SLOT(onFrameQueued(Packet, int, unsigned int, unsigned int, bool)),
+		Qt::QueuedConnection);
+	connect(this, SIGNAL(startQueued(bool)),
+		this, SLOT(onStart(bool)), Qt::QueuedConnection);
+}
+TLSPipeline::~TLSPipeline() {
+	delete tls;
+}
+
+void TLSPipeline::start(bool server, QThread *thread) {
+	moveToThread(thread);
+	emit startQueued(server);
+}
+
+void TLSPipeline::writeIncoming(const QByteArray &data) {
+	emit incomingDataQueued(data);
+}
+void TLSPipeline::writeFrame(const Packet &packet, int lane,
+		unsigned int offset, unsigned int size, bool last) {
+	emit frameQueued(packet, lane, offset, size, last);
+}
+
+Certificate TLSPipeline::getPeerCertificate() {
+	QMutexLocker lock(&mutex);
+	if (!handshaken) {
+		return Certificate();
+	}
+	return tls->getPeerCertificate();
+}
+bool TLSPipeline::isEncrypted() {
+	QMutexLocker lock(&mutex);
+	return tls && tls->isEncrypted();
+}
+QByteArray TLSPipeline::exportKeyingMaterial(const QByteArray &label,
+		int length, const QByteArray &context) {
+	QMutexLocker lock(&mutex);
+	if (!tls) {
+		return QByteArray();
+	}
+	return tls->exportKeyingMaterial(label, length, context);
+}
+
+void TLSPipeline::onStart(bool server) {
+	QMutexLocker lock(&mutex);
+	// The TLS object is created here so that it belongs to the worker thread
+	tls = new TLS;
+	connect(tls, SIGNAL(readyReadOutgoing()), this,
+		SLOT(onTLSOutgoingDataAvailable()));
+	connect(tls, SIGNAL(readyRead()), this,
+		SLOT(onTLSIncomingDataAvailable()));
+	connect(tls, SIGNAL(handshakeComplete()), this,
+		SLOT(onTLSHandshakeComplete()));
+	// TODO: Connect to TLS error signal?
+	tls->setPrivateKey(key);
+	tls->setCertificate(cert);
+	tls->setEncryptionRequired(encryptionRequired);
+	tls->setResumptionKey(resumptionKey);
+	if (server) {
+		tls->startServer();
+	} else {
+		tls->startClient();
+	}
+}
+void TLSPipeline::onIncomingDataQueued(const QByteArray &data) {
+	QMutexLocker lock(&mutex);
+	if (!tls) {
+		qWarning("TLSPipeline: Data received before the pipeline was started.");
+		return;
+	}
+	tls->writeIncoming(data);
+}
+void TLSPipeline::onFrameQueued(const Packet &packet, int lane,
+		unsigned int offset, unsigned int size, bool last) {
+	QMutexLocker lock(&mutex);
+	if (!handshaken) {
+		// NetworkInterface only sends packets to nodes which are online
+		qFatal("TLSPipeline: Packet sent before the handshake was done.");
+	}
+	QByteArray frame;
+	frame.resize(sizeof(FrameHeader) + size);
+	FrameHeader *header = (FrameHeader*)frame.data();
+	header->lane = lane;
+	header->last = last ? 1 : 0;
+	header->size = qToBigEndian((unsigned short)size);
+	memcpy(frame.data() + sizeof(FrameHeader),
+		(const char*)packet.getRawData() + offset, size);
+	tls->write(frame);
+}
+
+void TLSPipeline::onTLSOutgoingDataAvailable() {
+	emit outgoingDataAvailable(tls->readOutgoing());
+}
+void TLSPipeline::onTLSIncomingDataAvailable() {
+	QByteArray data = tls->read();
+	if (failed) {
+		return;
+	}
+	incomingData += data;
+	// Read frames until not enough data is left
+	int position = 0;
+	unsigned int frameBytes = 0;
+	FrameHeader header;
+	while (incomingData.size() - position >= (int)sizeof(FrameHeader)) {
+		memcpy(&header, incomingData.constData() + position, sizeof(header));
+		unsigned int size = qFromBigEndian(header.size);
+		if ((unsigned int)(incomingData.size() - position) < sizeof(header) + size) {
+			// Leave bytes which do not form a complete frame in the queue
+			break;
+		}
+		if (header.lane >= SendLane::Count) {
+			qWarning("TLSPipeline: Received frame with invalid lane %d.", header.lane);
+			failConnection();
+			return;
+		}
+		QByteArray &packetData = incomingPackets[header.lane];
+		packetData.append(incomingData.constData() + position + sizeof(header), size);
+		position += sizeof(header) + size;
+		frameBytes += sizeof(header) + size;
+		if (header.last) {
+			Packet packet = Packet::fromRawData(packetData);
+			packetData.clear();
+			if (!packet.isValid()) {
+				qWarning("TLSPipeline: Received invalid packet.");
+				failConnection();
+				return;
+			}
+			// Acknowledgements are always sent as a single frame and are not
+			// part of the send window of the other peer
+			if (packet.getType() == PacketType::FramesReceived) {
+				frameBytes -= sizeof(header) + size;
+			}
+			emit packetReceived(packet);
+		}
+	}
+	incomingData.remove(0, position);
+	if (frameBytes != 0) {
+		emit framesReceived(frameBytes);
+	}
+}
+void TLSPipeline::onTLSHandshakeComplete() {
+	handshaken = true;
+	emit handshakeComplete();
+}
+
+void TLSPipeline::failConnection() {
+	failed = true;
+	incomingData.clear();
+	for (int i = 0; i < SendLane::Count; i++) {
+		incomingPackets[i].clear();
+	}
+	emit protocolError();
+}
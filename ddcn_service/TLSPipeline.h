@@ -0,0 +1,195 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TLSPIPELINE_H_INCLUDED
+#define TLSPIPELINE_H_INCLUDED
+
+#include "TLS.h"
+#include "Protocol.h"
+
+#include <QMutex>
+
+class QThread;
+
+/**
+ * Runs the TLS connection to a single peer in a worker thread.
+ *
+ * Encryption, decryption, framing and reassembling the packets from the frames
+ * are done in the thread the pipeline has been moved to in start(), so that
+ * the main thread only has to pass the data between ariba and CompilerNetwork.
+ * Data is passed in and out only via queued signals, which keeps the order
+ * of the frames intact.
+ *
+ * The getters which access the TLS session itself may be called from any
+ * thread, they are synchronized with the worker thread.
+ */
+class TLSPipeline : public QObject {
+	Q_OBJECT
+public:
+	/**
+	 * Constructor.
+	 */
+	TLSPipeline();
+	/**
+	 * Destructor. Must be called in the worker thread, use deleteLater()
+	 * once the pipeline has been started.
+	 */
+	~TLSPipeline();
+
+	/**
+	 * Sets the certificate of the local peer. Has to be called before the
+	 * pipeline is started.
+	 */
+	void setCertificate(const Certificate &cert) {
+		this->cert = cert;
+	}
+	/**
+	 * Sets the private key of the local peer. Has to be called before the
+	 * pipeline is started.
+	 */
+	void setPrivateKey(const PrivateKey &key) {
+		this->key = key;
+	}
+	/**
+	 * Returns the private key of the local peer.
+	 */
+	PrivateKey getPrivateKey() {
+		return key;
+	}
+	/**
+	 * @see TLS::setResumptionKey()
+	 */
+	void setResumptionKey(const QByteArray &resumptionKey) {
+		this->resumptionKey = resumptionKey;
+	}
+	/**
+	 * @see TLS::setEncryptionRequired()
+	 */
+	void setEncryptionRequired(bool required) {
+		encryptionRequired = required;
+	}
+
+	/**
+	 * Moves the pipeline into a worker thread and starts the handshake there.
+	 *
+	 * @param server True if this peer is the server side of the connection.
+	 * @param thread Thread which does all TLS processing for this peer.
+	 */
+	void start(bool server, QThread *thread);
+
+	/**
+	 * Passes encrypted data received from the network into the pipeline.
+	 */
+	void writeIncoming(const QByteArray &data);
+	/**
+	 * Sends a part of a packet to the peer.
+	 *
+	 * @param packet Packet which is sent.
+	 * @param lane Lane of the packet, see SendLane.
+	 * @param offset Offset of the part within the raw packet data.
+	 * @param size Size of the part, has to fit into FrameHeader::size.
+	 * @param last True if this is the last part of the packet.
+	 */
+	void writeFrame(const Packet &packet, int lane, unsigned int offset,
+		unsigned int size, bool last);
+
+	/**
+	 * @see TLS::getPeerCertificate()
+	 */
+	Certificate getPeerCertificate();
+	/**
+	 * @see TLS::isEncrypted()
+	 */
+	bool isEncrypted();
+	/**
+	 * @see TLS::exportKeyingMaterial()
+	 */
+	QByteArray exportKeyingMaterial(const QByteArray &label, int length,
+		const QByteArray &context = QByteArray());
+signals:
+	/**
+	 * Triggered when encrypted data has to be sent over the network.
+	 *
+	 * @param data Encrypted data.
+	 */
+	void outgoingDataAvailable(const QByteArray &data);
+	/**
+	 * Triggered for every complete packet received from the peer.
+	 */
+	void packetReceived(const Packet &packet);
+	/**
+	 * Triggered after packetReceived() for the frames which have been
+	 * received in one batch.
+	 *
+	 * @param frameBytes Size of the frames including their headers. Frames of
+	 * FramesReceived packets are not included.
+	 */
+	void framesReceived(unsigned int frameBytes);
+	/**
+	 * Triggered if the peer has sent a frame with an invalid lane or an
+	 * invalid packet. All further data from the peer is ignored.
+	 */
+	void protocolError();
+	/**
+	 * Triggered when the handshake is complete and packets can be sent.
+	 */
+	void handshakeComplete();
+
+	// Internal signals used to pass data into the worker thread
+	void incomingDataQueued(const QByteArray &data);
+	void frameQueued(const Packet &packet, int lane, unsigned int offset,
+		unsigned int size, bool last);
+	void startQueued(bool server);
+private slots:
+	void onStart(bool server);
+	void onIncomingDataQueued(const QByteArray &data);
+	void onFrameQueued(const Packet &packet, int lane, unsigned int offset,
+		unsigned int size, bool last);
+
+	void onTLSOutgoingDataAvailable();
+	void onTLSIncomingDataAvailable();
+	void onTLSHandshakeComplete();
+private:
+	void failConnection();
+
+	Certificate cert;
+	PrivateKey key;
+	QByteArray resumptionKey;
+	bool encryptionRequired;
+
+	/**
+	 * Protects the TLS object against concurrent access from the getters.
+	 */
+	QMutex mutex;
+	TLS *tls;
+	bool handshaken;
+	bool failed;
+
+	QByteArray incomingData;
+	QByteArray incomingPackets[SendLane::Count];
+};
+
+#endif
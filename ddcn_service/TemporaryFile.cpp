@@ -29,6 +29,10 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <QSettings>
 #include "TemporaryFile.h"
 
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 TemporaryFile::TemporaryFile(QString extension, QString templateName,
 							 QString filename) {
 	QSettings settings(QSettings::IniFormat, QSettings::UserScope, "ddcn", "ddcn");
@@ -68,3 +72,16 @@ QString TemporaryFile::getFilename() {
 	return this->path + this->name + this->extension;
 }
 
+bool TemporaryFile::createPrivateDirectory(const QString &path) {
+	QByteArray encodedPath = QFile::encodeName(path);
+	if (mkdir(encodedPath.data(), 0700) != 0 && errno != EEXIST) {
+		return false;
+	}
+	struct stat info;
+	if (lstat(encodedPath.data(), &info) != 0 || !S_ISDIR(info.st_mode)
+			|| info.st_uid != getuid() || (info.st_mode & 0077) != 0) {
+		qWarning("%s is not a private directory of this user.", encodedPath.data());
+		return false;
+	}
+	return true;
+}
@@ -63,6 +63,16 @@ public:
 	 * @return the file.
 	 */
 	QFile *getFile();
+
+	/**
+	 * Creates a directory which is only accessible by the current user.
+	 * Fails if the directory already exists but belongs to another user or
+	 * can be accessed by others, as they could then replace the files within
+	 * it.
+	 * @param path the path of the directory.
+	 * @return true if the directory is private.
+	 */
+	static bool createPrivateDirectory(const QString &path);
 private:
 	/**
 	 * Generates a new unique (meaning: not yet existent in the temporary files folder) filename
@@ -0,0 +1,160 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "TimerWheel.h"
+
+void Deadline::stop() {
+	if (wheel) {
+		wheel->remove(this);
+	}
+}
+
+TimerWheel::TimerWheel(int resolution) : resolution(resolution),
+		currentTick(0), activeCount(0) {
+	for (int level = 0; level < LEVELS; level++) {
+		for (int slot = 0; slot < SLOTS; slot++) {
+			wheels[level][slot] = NULL;
+		}
+	}
+	connect(&timer, SIGNAL(timeout()), this, SLOT(onTick()));
+	clock.start();
+}
+TimerWheel::~TimerWheel() {
+	for (int level = 0; level < LEVELS; level++) {
+		for (int slot = 0; slot < SLOTS; slot++) {
+			while (wheels[level][slot]) {
+				remove(wheels[level][slot]);
+			}
+		}
+	}
+}
+
+void TimerWheel::start(Deadline *deadline, int msecs, int type, void *owner) {
+	deadline->stop();
+	if (activeCount == 0) {
+		// The wheel did not turn while it was empty
+		currentTick = getElapsedTicks();
+		timer.start(resolution);
+	}
+	// Round up, a deadline must never expire too early. The wheel might lag
+	// behind if the event loop was blocked, so the expiry is calculated from
+	// the current time instead of the current tick.
+	quint64 expiry = (clock.elapsed() + msecs + resolution - 1) / resolution;
+	// Always expire in a later tick so that the current slot can be emptied
+	// safely
+	if (expiry <= currentTick) {
+		expiry = currentTick + 1;
+	}
+	deadline->expiry = expiry;
+	deadline->type = type;
+	deadline->owner = owner;
+	insert(deadline);
+	activeCount++;
+}
+
+void TimerWheel::onTick() {
+	quint64 targetTick = getElapsedTicks();
+	// The event loop might have been blocked, so catch up with all ticks which
+	// have passed since the last call
+	while (currentTick < targetTick && activeCount > 0) {
+		currentTick++;
+		// Move the deadlines of the higher levels down once the lower level
+		// has completed a rotation
+		for (int level = 1; level < LEVELS; level++) {
+			if ((currentTick & ((1ULL << (level * SLOT_BITS)) - 1)) != 0) {
+				break;
+			}
+			cascade(level);
+		}
+		Deadline **slot = &wheels[0][currentTick & (SLOTS - 1)];
+		while (*slot) {
+			Deadline *deadline = *slot;
+			int type = deadline->type;
+			void *owner = deadline->owner;
+			remove(deadline);
+			emit expired(type, owner);
+		}
+	}
+	if (activeCount == 0) {
+		timer.stop();
+	}
+}
+
+void TimerWheel::insert(Deadline *deadline) {
+	quint64 delta = deadline->expiry - currentTick;
+	// Deadlines which are too far in the future are placed into the highest
+	// level as if they expired after maxDelta ticks. That slot is cascaded
+	// before the real expiry, which is kept, so they are then inserted again
+	// with the remaining delta.
+	quint64 maxDelta = (1ULL << (LEVELS * SLOT_BITS)) - 1;
+	quint64 slotExpiry = deadline->expiry;
+	if (delta > maxDelta) {
+		slotExpiry = currentTick + maxDelta;
+		delta = maxDelta;
+	}
+	int level = 0;
+	while (level < LEVELS - 1 && delta >= (1ULL << ((level + 1) * SLOT_BITS))) {
+		level++;
+	}
+	int slot = (slotExpiry >> (level * SLOT_BITS)) & (SLOTS - 1);
+	deadline->wheel = this;
+	deadline->slot = &wheels[level][slot];
+	deadline->previous = NULL;
+	deadline->next = wheels[level][slot];
+	if (deadline->next) {
+		deadline->next->previous = deadline;
+	}
+	wheels[level][slot] = deadline;
+}
+void TimerWheel::remove(Deadline *deadline) {
+	if (deadline->previous) {
+		deadline->previous->next = deadline->next;
+	} else {
+		*deadline->slot = deadline->next;
+	}
+	if (deadline->next) {
+		deadline->next->previous = deadline->previous;
+	}
+	deadline->wheel = NULL;
+	deadline->slot = NULL;
+	deadline->previous = NULL;
+	deadline->next = NULL;
+	activeCount--;
+}
+void TimerWheel::cascade(int level) {
+	int slot = (currentTick >> (level * SLOT_BITS)) & (SLOTS - 1);
+	Deadline *deadline = wheels[level][slot];
+	wheels[level][slot] = NULL;
+	while (deadline) {
+		Deadline *next = deadline->next;
+		insert(deadline);
+		deadline = next;
+	}
+}
+
+quint64 TimerWheel::getElapsedTicks() {
+	return clock.elapsed() / resolution;
+}
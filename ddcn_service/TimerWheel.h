@@ -0,0 +1,143 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef TIMERWHEEL_H_INCLUDED
+#define TIMERWHEEL_H_INCLUDED
+
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+
+class TimerWheel;
+
+/**
+ * Timeout which is managed by a TimerWheel.
+ *
+ * Deadlines are embedded into the objects which need a timeout, deleting the
+ * object automatically stops the timeout.
+ */
+class Deadline {
+public:
+	Deadline() : wheel(NULL), slot(NULL), previous(NULL), next(NULL),
+			expiry(0), type(0), owner(NULL) {
+	}
+	~Deadline() {
+		stop();
+	}
+
+	/**
+	 * Stops the deadline if it is active.
+	 */
+	void stop();
+	/**
+	 * Returns true if the deadline has been started and has not expired yet.
+	 */
+	bool isActive() const {
+		return wheel != NULL;
+	}
+private:
+	Deadline(const Deadline &other);
+	Deadline &operator=(const Deadline &other);
+
+	TimerWheel *wheel;
+	Deadline **slot;
+	Deadline *previous;
+	Deadline *next;
+	quint64 expiry;
+	int type;
+	void *owner;
+
+	friend class TimerWheel;
+};
+
+/**
+ * Hierarchical timer wheel which manages a large number of coarse timeouts.
+ *
+ * Starting, stopping and expiring a deadline takes constant time regardless of
+ * the number of active deadlines, and only a single QTimer is used, which is
+ * stopped when no deadline is active. Deadlines are rounded up to the
+ * resolution of the wheel.
+ */
+class TimerWheel : public QObject {
+	Q_OBJECT
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param resolution Length of one tick of the wheel in milliseconds.
+	 */
+	TimerWheel(int resolution = 100);
+	/**
+	 * Destructor. Stops all remaining deadlines.
+	 */
+	~TimerWheel();
+
+	/**
+	 * Starts a deadline, restarting it if it is already active.
+	 *
+	 * @param deadline Deadline to start.
+	 * @param msecs Time in milliseconds until the deadline expires.
+	 * @param type Arbitrary value which is passed to expired().
+	 * @param owner Arbitrary pointer which is passed to expired(), usually the
+	 * object containing the deadline.
+	 */
+	void start(Deadline *deadline, int msecs, int type, void *owner);
+	/**
+	 * Returns the number of active deadlines.
+	 */
+	int getActiveCount() {
+		return activeCount;
+	}
+signals:
+	/**
+	 * Emitted when a deadline has expired. The deadline is not active anymore
+	 * at this point, so the owner can safely be deleted by the receiver.
+	 */
+	void expired(int type, void *owner);
+private slots:
+	void onTick();
+private:
+	void insert(Deadline *deadline);
+	void remove(Deadline *deadline);
+	void cascade(int level);
+	quint64 getElapsedTicks();
+
+	static const int LEVELS = 4;
+	static const int SLOT_BITS = 6;
+	static const int SLOTS = 1 << SLOT_BITS;
+
+	int resolution;
+	quint64 currentTick;
+	int activeCount;
+	Deadline *wheels[LEVELS][SLOTS];
+
+	QTimer timer;
+	QElapsedTimer clock;
+
+	friend class Deadline;
+};
+
+#endif
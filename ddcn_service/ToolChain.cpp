@@ -25,54 +25,27 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 
-#include <QProcess>
 #include <QString>
-#include <QFile>
+#include <QRegExp>
 #include "ToolChain.h"
 
-ToolChain::ToolChain(QString path) {
-	QString gccPath = QString(path).replace("*", "gcc");
-	qDebug("Toolchain path: %s", path.toAscii().data());
-	if (QFile(gccPath).exists()) {
-		QProcess *compiler = new QProcess();
-		QProcessEnvironment environment = compiler->processEnvironment();
-		environment.value("LANG", "C");
-		compiler->setProcessEnvironment(environment);
-
-		QString version = "/";
-		QProcessEnvironment env = QProcessEnvironment::systemEnvironment();
-		env.insert("LC_ALL", "C");
-		compiler->setProcessEnvironment(env);
-		compiler->setProcessChannelMode(QProcess::MergedChannels);
-		compiler->start(gccPath, QStringList("-v"));
-		if (!compiler->waitForStarted(500)) {
-			qCritical("Could not start compiler \"%s\".",
-					path.toAscii().data());
-			return;
-		}
-		compiler->waitForFinished(500);
-		while (!compiler->atEnd()) {
-			QString line = compiler->readLine(1000);
-			if (line.startsWith("Target: ")) {
-				version = line.mid(8, line.count() - 9).append(version);
-			} else if (line.startsWith("gcc version")) {
-				// We only need two gcc version numbers
-				version.append(line.mid(12, 3));
-			}
-		}
-		delete compiler;
-		this->version = version;
-		this->path = path;
-	} else {
-		qCritical("Invalid toochain path.");
-	}
-}
-
+QList<ToolChainMapping> ToolChain::mappings = ToolChain::getDefaultMappings();
 
 QString ToolChain::getVersion() const {
 	return this->version;
 }
 
+QString ToolChain::getFingerprint() const {
+	return this->fingerprint;
+}
+
+QString ToolChain::getIdentity() const {
+	if (fingerprint.isEmpty()) {
+		return version;
+	}
+	return fingerprint + " " + version;
+}
+
 QString ToolChain::getPath() const {
 	return this->path;
 }
@@ -100,37 +73,93 @@ bool ToolChain::isCompatible(const QString &sourceToolChain,
 	QString targetTarget = targetToolChain.left(targetToolChain.indexOf("/"));
 	QString targetVersion = targetToolChain.mid(targetToolChain.indexOf("/") + 1);
 	// We only have backwards compatibility
-	// (0.001f = comparison delta :) )
-	if (sourceVersion.toFloat() >= targetVersion.toFloat() - 0.001f) {
+	if (compareVersions(sourceVersion, targetVersion) > 0) {
 		return false;
 	}
 	// Check whether the CPU architecture is compatible
 	QString sourceArch = sourceTarget.left(sourceTarget.indexOf("-"));
 	QString targetArch = targetTarget.left(targetTarget.indexOf("-"));
-	bool archCompatible = false;
-	if ((sourceArch == "i686" || sourceArch == "i586" || sourceArch == "i486")
-			&& (targetArch == "x86_64" || targetArch == "amd64")) {
-		archCompatible = true;
-		// 64bit intel compilers can usually compile 32bit code
-		if (compatibilityParameters != NULL) {
-			compatibilityParameters->append("-m32");
+	if (sourceArch == targetArch) {
+		// Check whether the operating system is compatible
+		if (sourceTarget.contains("linux") && targetTarget.contains("linux")
+				&& sourceTarget.mid(sourceTarget.lastIndexOf("linux"))
+				== targetTarget.mid(targetTarget.lastIndexOf("linux"))) {
+			// Both are linux with the same ABI (e.g. not "gnueabi" and
+			// "gnueabihf"), only the vendor differs
+			return true;
+		} else if (sourceTarget.mid(sourceTarget.indexOf("-"))
+				== targetTarget.mid(targetTarget.indexOf("-"))) {
+			// The target triples are identical
+			return true;
 		}
-	} else if (sourceArch == targetArch) {
-		archCompatible = true;
 	}
-	if (!archCompatible) {
-		return false;
+	// Look for a mapping to a different target, e.g. 64bit intel compilers
+	// can usually compile 32bit code
+	foreach (const ToolChainMapping &mapping, mappings) {
+		QRegExp source(mapping.source, Qt::CaseSensitive, QRegExp::Wildcard);
+		QRegExp target(mapping.target, Qt::CaseSensitive, QRegExp::Wildcard);
+		if (source.exactMatch(sourceTarget) && target.exactMatch(targetTarget)) {
+			if (compatibilityParameters != NULL) {
+				compatibilityParameters->append(mapping.parameters);
+			}
+			return true;
+		}
 	}
-	// Check whether the operating system is compatible
-	if (sourceTarget.contains("linux") && targetTarget.contains("linux")) {
-		// Both are linux
-		return true;
-	} else if (sourceTarget.mid(sourceTarget.indexOf("-"))
-			== targetTarget.mid(targetTarget.indexOf("-"))) {
-		// The target triple only has a different but compatible architecture
+	return false;
+}
+
+int ToolChain::compareVersions(const QString &a, const QString &b) {
+	QStringList aParts = a.split('.');
+	QStringList bParts = b.split('.');
+	for (int i = 0; i < aParts.count() || i < bParts.count(); i++) {
+		int aPart = i < aParts.count() ? aParts[i].toInt() : 0;
+		int bPart = i < bParts.count() ? bParts[i].toInt() : 0;
+		if (aPart != bPart) {
+			return aPart < bPart ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+bool ToolChain::isCompatibleIdentity(const QString &sourceIdentity,
+		const QString &targetIdentity, QStringList *compatibilityParameters) {
+	QString sourceFingerprint = fingerprintFromIdentity(sourceIdentity);
+	if (!sourceFingerprint.isEmpty()
+			&& sourceFingerprint == fingerprintFromIdentity(targetIdentity)) {
 		return true;
-	} else {
-		return false;
 	}
+	return isCompatible(versionFromIdentity(sourceIdentity),
+			versionFromIdentity(targetIdentity), compatibilityParameters);
+}
+
+QString ToolChain::fingerprintFromIdentity(const QString &identity) {
+	int separator = identity.indexOf(' ');
+	if (separator == -1) {
+		return "";
+	}
+	return identity.left(separator);
+}
+
+QString ToolChain::versionFromIdentity(const QString &identity) {
+	return identity.mid(identity.indexOf(' ') + 1);
+}
+
+void ToolChain::setMappings(const QList<ToolChainMapping> &mappings) {
+	ToolChain::mappings = mappings;
 }
 
+QList<ToolChainMapping> ToolChain::getDefaultMappings() {
+	QList<ToolChainMapping> defaults;
+	// 64bit x86 compilers with multilib support
+	defaults.append(ToolChainMapping("i?86-*linux*", "x86_64-*linux*", "-m32"));
+	defaults.append(ToolChainMapping("i?86-*linux*", "amd64-*linux*", "-m32"));
+	defaults.append(ToolChainMapping("x86_64-*linux-gnux32", "x86_64-*linux-gnu", "-mx32"));
+	defaults.append(ToolChainMapping("i?86-*-mingw32", "x86_64-*-mingw32", "-m32"));
+	// Native ARM compilers (e.g. "armv7l-unknown-linux-gnueabihf") and cross
+	// compilers from different vendors (e.g. "arm-none-linux-gnueabi") only
+	// differ in the name, the ABI is part of the triple
+	defaults.append(ToolChainMapping("arm*-*linux-gnueabihf", "arm*-*linux-gnueabihf"));
+	defaults.append(ToolChainMapping("arm*-*linux-gnueabi", "arm*-*linux-gnueabi"));
+	defaults.append(ToolChainMapping("arm*-*-eabi", "arm*-*-eabi"));
+	return defaults;
+}
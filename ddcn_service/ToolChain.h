@@ -27,8 +27,39 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef TOOL_CHAIN_INCLUDED
 #define TOOL_CHAIN_INCLUDED
 
-#include <QProcess>
 #include <QString>
+#include <QList>
+#include <QStringList>
+
+/**
+ * Entry of the cross-target mapping table which declares that jobs for a
+ * source target triple can be compiled by a toolchain for a different target
+ * triple if some additional parameters are passed to the compiler.
+ */
+struct ToolChainMapping {
+	ToolChainMapping() {
+	}
+	ToolChainMapping(const QString &source, const QString &target,
+			const QString &parameters = "")
+			: source(source), target(target),
+			parameters(parameters.split(' ', QString::SkipEmptyParts)) {
+	}
+
+	/**
+	 * Wildcard pattern for the target triple of the source toolchain, e.g.
+	 * "i?86-*linux*".
+	 */
+	QString source;
+	/**
+	 * Wildcard pattern for the target triple of the compiling toolchain.
+	 */
+	QString target;
+	/**
+	 * Parameters which make the compiling toolchain produce code for the
+	 * source target, e.g. "-m32".
+	 */
+	QStringList parameters;
+};
 
 /**
  * Class contains information about the available compiler versions
@@ -37,27 +68,20 @@ class ToolChain {
 public:
 	/**
 	 * Constructor.
-	 * Does not check the values passed to it.
+	 * Does not check the values passed to it, toolchains are usually created
+	 * by ToolChainRegistry which probes the compiler.
 	 *
 	 * @param version Version of the toolchain (e.g. "i686-linux-gnu/4.4" for
 	 * a 32-bit GCC 4.4.x).
 	 * @param path Path to the compilers, instead of "gcc" or "g++" this holds
 	 * a "*", e.g. "/usr/bin/ *" (without the space) points to "/usr/bin/gcc".
+	 * @param fingerprint Hex encoded SHA-1 hash of the compiler binaries, see
+	 * ToolChainRegistry.
 	 */
-	ToolChain(QString version, QString path) : version(version), path(path) {
+	ToolChain(QString version, QString path, QString fingerprint = "")
+			: version(version), path(path), fingerprint(fingerprint) {
 	}
 
-	/**
-	 * Constructor.
-	 * This checks whether the compiler at the path is valid, and if it is not,
-	 * initializes all members of this object to "". If it is valid, the
-	 * correct version is retrieved.
-	 *
-	 * @param path Path to the compilers, instead of "gcc" or "g++" this holds
-	 * a "*", e.g. "/usr/bin/ *" (without the space) points to "/usr/bin/gcc".
-	 */
-	ToolChain(QString path);
-
 	/**
 	 * Constructor.
 	 * Initializes all members with "".
@@ -72,6 +96,18 @@ public:
 	 * @return the gcc target triple
 	 */
 	QString getVersion() const;
+	/**
+	 * Returns the hash of the compiler driver and the compiler proper (cc1
+	 * and cc1plus). Two toolchains with the same fingerprint produce the same
+	 * output. This is "" if the toolchain has not been probed yet.
+	 */
+	QString getFingerprint() const;
+	/**
+	 * Returns the string which identifies the toolchain on the network. This
+	 * is the fingerprint followed by a space and the version, or only the
+	 * version if the fingerprint is not known.
+	 */
+	QString getIdentity() const;
 
 	/**
 	 * Returns the path to the compiler. This is "" (empty string) if the
@@ -109,10 +145,12 @@ public:
 
 	/**
 	 * Checks whether two toolchain targets/versions are compatible. This is
-	 * the case if both architectures are the same or the source arch is x86
-	 * and the target arch is x86_64 (in this case, "-m32" is added to
-	 * compatibilityParameters), and if the rest of the target triple is either
-	 * identical or in both cases contains "linux".
+	 * the case if both architectures are the same and the rest of the target
+	 * triple is either identical or denotes linux with the same ABI, or if one
+	 * of the cross-target mappings (see setMappings()) matches both target
+	 * triples. In the latter case, the parameters of the mapping are added to
+	 * compatibilityParameters. The target compiler must not be older than the
+	 * source compiler.
 	 *
 	 * @param sourceToolChain Source tool chain version, e.g.
 	 * "i686-linux-gnu/4.4".
@@ -125,9 +163,49 @@ public:
 	static bool isCompatible(const QString &sourceToolChain,
 			const QString &targetToolChain,
 			QStringList *compatibilityParameters = NULL);
+	/**
+	 * Compares two version numbers component by component, so that e.g.
+	 * "4.10" is newer than "4.9".
+	 *
+	 * @return A negative value if a is older than b, 0 if both are equal and a
+	 * positive value if a is newer.
+	 */
+	static int compareVersions(const QString &a, const QString &b);
+	/**
+	 * Checks whether a peer with the target toolchain can compile jobs for
+	 * the source toolchain, given their network identities (see
+	 * getIdentity()). Identical fingerprints always match, otherwise the
+	 * versions are compared with isCompatible().
+	 */
+	static bool isCompatibleIdentity(const QString &sourceIdentity,
+			const QString &targetIdentity,
+			QStringList *compatibilityParameters = NULL);
+	/**
+	 * Returns the fingerprint part of a network identity, or "" if it does
+	 * not contain one.
+	 */
+	static QString fingerprintFromIdentity(const QString &identity);
+	/**
+	 * Returns the version part of a network identity.
+	 */
+	static QString versionFromIdentity(const QString &identity);
+
+	/**
+	 * Sets the cross-target mapping table used by isCompatible(). The
+	 * mappings are checked in order, the first match is used.
+	 */
+	static void setMappings(const QList<ToolChainMapping> &mappings);
+	/**
+	 * Returns the built-in mappings, e.g. for compiling 32-bit x86 code with
+	 * an x86_64 compiler or for ARM cross compilers of different vendors.
+	 */
+	static QList<ToolChainMapping> getDefaultMappings();
 private:
+	static QList<ToolChainMapping> mappings;
+
 	QString version;
 	QString path;
+	QString fingerprint;
 };
 
 #endif
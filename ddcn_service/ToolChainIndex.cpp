@@ -0,0 +1,101 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "ToolChainIndex.h"
+
+void ToolChainIndex::setLocalToolChains(const QList<ToolChain> &toolChains) {
+	localToolChains = toolChains;
+	localIndices.clear();
+	for (int i = 0; i < toolChains.count(); i++) {
+		if (!localIndices.contains(toolChains[i].getIdentity())) {
+			localIndices.insert(toolChains[i].getIdentity(), i);
+		}
+	}
+	capabilities.clear();
+	localTargets.clear();
+}
+
+int ToolChainIndex::intern(const QString &identity) {
+	QHash<QString, int>::iterator it = ids.find(identity);
+	if (it != ids.end()) {
+		return it.value();
+	}
+	int id = identities.count();
+	identities.append(identity);
+	ids.insert(identity, id);
+	return id;
+}
+
+QBitArray ToolChainIndex::getCapabilities(const QList<int> &targetIds) {
+	QBitArray result(localToolChains.count());
+	foreach (int targetId, targetIds) {
+		QHash<int, QBitArray>::iterator it = capabilities.find(targetId);
+		if (it == capabilities.end()) {
+			QBitArray row(localToolChains.count());
+			for (int i = 0; i < localToolChains.count(); i++) {
+				if (ToolChain::isCompatibleIdentity(localToolChains[i].getIdentity(),
+						identities[targetId])) {
+					row.setBit(i);
+				}
+			}
+			it = capabilities.insert(targetId, row);
+		}
+		result |= it.value();
+	}
+	return result;
+}
+
+int ToolChainIndex::findLocalTarget(int sourceId,
+		QStringList *compatibilityParameters) {
+	QHash<int, LocalTarget>::iterator it = localTargets.find(sourceId);
+	if (it == localTargets.end()) {
+		const QString &identity = identities[sourceId];
+		LocalTarget target;
+		target.index = -1;
+		// Prefer a toolchain with the same binaries over a compatible one
+		QString fingerprint = ToolChain::fingerprintFromIdentity(identity);
+		for (int i = 0; i < localToolChains.count() && !fingerprint.isEmpty(); i++) {
+			if (localToolChains[i].getFingerprint() == fingerprint) {
+				target.index = i;
+				break;
+			}
+		}
+		for (int i = 0; i < localToolChains.count() && target.index == -1; i++) {
+			QStringList parameters;
+			if (ToolChain::isCompatibleIdentity(identity,
+					localToolChains[i].getIdentity(), &parameters)) {
+				target.index = i;
+				target.compatibilityParameters = parameters;
+			}
+		}
+		it = localTargets.insert(sourceId, target);
+	}
+	if (compatibilityParameters != NULL) {
+		compatibilityParameters->append(it.value().compatibilityParameters);
+	}
+	return it.value().index;
+}
@@ -0,0 +1,113 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef TOOLCHAININDEX_H_INCLUDED
+#define TOOLCHAININDEX_H_INCLUDED
+
+#include "ToolChain.h"
+
+#include <QBitArray>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+
+/**
+ * Precomputed compatibility information between the local toolchains and the
+ * toolchains advertised by other peers.
+ *
+ * Every network identity (see ToolChain::getIdentity()) is interned into a
+ * compact id the first time it is seen. For each advertised identity, the set
+ * of local toolchains whose jobs a peer with that toolchain can compile is
+ * computed once and stored as a bitmap indexed by the position of the local
+ * toolchain. The free slots of a peer carry the union of these bitmaps, so
+ * choosing a slot for a job is a single bit test. Likewise, the local
+ * toolchain which compiles incoming jobs for a remote identity is only
+ * searched once.
+ *
+ * All cached results are discarded when the local toolchains change. Ids are
+ * never reused, the number of distinct identities is bounded by the toolchains
+ * present in the network.
+ */
+class ToolChainIndex {
+public:
+	/**
+	 * Sets the toolchains of this peer. Bit i of the capability bitmaps refers
+	 * to toolChains[i].
+	 */
+	void setLocalToolChains(const QList<ToolChain> &toolChains);
+
+	/**
+	 * Returns the compact id of a network identity, a new id is assigned if
+	 * the identity has not been seen before.
+	 */
+	int intern(const QString &identity);
+	/**
+	 * Returns the position of a local toolchain in the list passed to
+	 * setLocalToolChains(), or -1 if the identity does not belong to a local
+	 * toolchain.
+	 */
+	int getLocalIndex(const QString &identity) {
+		return localIndices.value(identity, -1);
+	}
+
+	/**
+	 * Returns the bitmap of local toolchains which can be compiled by a peer
+	 * advertising the given toolchain ids.
+	 */
+	QBitArray getCapabilities(const QList<int> &targetIds);
+	/**
+	 * Returns the position of the local toolchain which shall compile jobs
+	 * created with the given remote toolchain, or -1 if there is no compatible
+	 * local toolchain. Toolchains with the same fingerprint are preferred.
+	 *
+	 * @param compatibilityParameters If != NULL, receives the additional
+	 * parameters needed for compatibility reasons.
+	 */
+	int findLocalTarget(int sourceId, QStringList *compatibilityParameters = NULL);
+private:
+	struct LocalTarget {
+		int index;
+		QStringList compatibilityParameters;
+	};
+
+	QStringList identities;
+	QHash<QString, int> ids;
+
+	QList<ToolChain> localToolChains;
+	QHash<QString, int> localIndices;
+
+	/**
+	 * Capability bitmap for every advertised toolchain id.
+	 */
+	QHash<int, QBitArray> capabilities;
+	/**
+	 * Local toolchain for every remote toolchain id of incoming jobs.
+	 */
+	QHash<int, LocalTarget> localTargets;
+};
+
+#endif
@@ -0,0 +1,351 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "ToolChainPackageStore.h"
+#include "ToolChainRegistry.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QProcess>
+#include <QRegExp>
+#include <QtConcurrentRun>
+
+QString ToolChainPackageStore::advertisement("+packages");
+
+ToolChainPackageStore::ToolChainPackageStore(QObject *parent) : QObject(parent),
+		settings(QSettings::IniFormat, QSettings::UserScope, "ddcn", "ddcn") {
+	shippingEnabled = settings.value("service/ship_toolchains", false).toBool();
+	receivingEnabled = settings.value("service/accept_toolchain_packages",
+			false).toBool();
+	directory = settings.value("service/toolchain_package_dir",
+			QDir::homePath() + "/.cache/ddcn/toolchains").toString();
+	if (!QDir().mkpath(directory + "/packages")) {
+		qWarning("Could not create the toolchain package directory \"%s\".",
+				directory.toAscii().data());
+		shippingEnabled = false;
+		receivingEnabled = false;
+	}
+	if (receivingEnabled) {
+		loadReceivedPackages();
+	}
+}
+ToolChainPackageStore::~ToolChainPackageStore() {
+	foreach (QObject *child, children()) {
+		QFutureWatcher<Package> *watcher = dynamic_cast<QFutureWatcher<Package>*>(child);
+		if (watcher) {
+			watcher->waitForFinished();
+		}
+	}
+}
+
+void ToolChainPackageStore::setToolChains(const QList<ToolChain> &toolChains) {
+	if (!shippingEnabled) {
+		return;
+	}
+	foreach (const ToolChain &toolChain, toolChains) {
+		QString fingerprint = toolChain.getFingerprint();
+		if (fingerprint.isEmpty() || packageHashes.contains(fingerprint)
+				|| creating.contains(fingerprint)) {
+			continue;
+		}
+		creating.insert(fingerprint);
+		QFutureWatcher<Package> *watcher = new QFutureWatcher<Package>(this);
+		connect(watcher, SIGNAL(finished()), this, SLOT(onPackageCreated()));
+		watcher->setFuture(QtConcurrent::run(createPackage, toolChain,
+				directory));
+	}
+}
+
+QString ToolChainPackageStore::getPackageHash(const ToolChain &toolChain) {
+	return packageHashes.value(toolChain.getFingerprint());
+}
+
+QString ToolChainPackageStore::getPackageFile(const QString &hash) {
+	return packageFiles.value(hash);
+}
+
+void ToolChainPackageStore::addReceivedPackage(const QString &hash,
+		const QString &fileName) {
+	if (!receivingEnabled || extracting.contains(hash)
+			|| receivedToolChains.contains(hash)) {
+		QFile::remove(fileName);
+		return;
+	}
+	extracting.insert(hash);
+	QFutureWatcher<Package> *watcher = new QFutureWatcher<Package>(this);
+	connect(watcher, SIGNAL(finished()), this, SLOT(onPackageExtracted()));
+	watcher->setFuture(QtConcurrent::run(extractPackage, hash, fileName,
+			directory));
+}
+
+void ToolChainPackageStore::onPackageCreated() {
+	QFutureWatcher<Package> *watcher = static_cast<QFutureWatcher<Package>*>(sender());
+	Package package = watcher->result();
+	watcher->deleteLater();
+	creating.remove(package.fingerprint);
+	if (package.hash.isEmpty()) {
+		qWarning("Could not create the package for toolchain %s.",
+				package.fingerprint.toAscii().data());
+		return;
+	}
+	qDebug("Created toolchain package %s.", package.hash.toAscii().data());
+	packageHashes.insert(package.fingerprint, package.hash);
+	packageFiles.insert(package.hash, package.fileName);
+}
+
+void ToolChainPackageStore::onPackageExtracted() {
+	QFutureWatcher<Package> *watcher = static_cast<QFutureWatcher<Package>*>(sender());
+	Package package = watcher->result();
+	watcher->deleteLater();
+	extracting.remove(package.hash);
+	if (package.toolChain.getPath().isEmpty()) {
+		qWarning("Could not extract the toolchain package %s.",
+				package.hash.toAscii().data());
+		return;
+	}
+	qDebug("Received toolchain package %s (%s).", package.hash.toAscii().data(),
+			package.toolChain.getVersion().toAscii().data());
+	receivedToolChains.insert(package.hash, package.toolChain);
+	emit packageReceived(package.hash);
+}
+
+ToolChainPackageStore::Package ToolChainPackageStore::createPackage(
+		const ToolChain &toolChain, const QString &directory) {
+	Package package;
+	package.fingerprint = toolChain.getFingerprint();
+	package.fileName = directory + "/packages/" + package.fingerprint + ".tar.gz";
+	if (!QFile::exists(package.fileName)) {
+		// Collect the drivers, the compilers proper and the assembler
+		QString gccPath = toolChain.getPath("c");
+		QString gxxPath = toolChain.getPath("c++");
+		QStringList programs;
+		programs.append(gccPath);
+		programs.append(runProgram(gccPath,
+				QStringList("-print-prog-name=cc1")).trimmed());
+		programs.append(findProgram(runProgram(gccPath,
+				QStringList("-print-prog-name=as")).trimmed()));
+		if (QFile::exists(gxxPath)) {
+			programs.append(gxxPath);
+			programs.append(runProgram(gxxPath,
+					QStringList("-print-prog-name=cc1plus")).trimmed());
+		} else {
+			gxxPath = "";
+		}
+		QStringList files;
+		foreach (QString program, programs) {
+			QFileInfo info(program);
+			if (info.isAbsolute() && info.exists() && !files.contains(program)) {
+				files.append(program);
+			}
+		}
+		// Add the shared libraries and the dynamic loader
+		QRegExp library("(?:=> |^\\s*)(/\\S+) \\(");
+		foreach (QString program, QStringList(files)) {
+			QStringList lines = runProgram("ldd", QStringList(program)).split('\n');
+			foreach (QString line, lines) {
+				if (library.indexIn(line) != -1 && !files.contains(library.cap(1))) {
+					files.append(library.cap(1));
+				}
+			}
+		}
+		// Write the manifest which tells the receiver how to run the compiler
+		QString staging = package.fileName + ".staging";
+		QDir().mkpath(staging);
+		QFile manifest(staging + "/ddcn_toolchain");
+		if (!manifest.open(QIODevice::WriteOnly)) {
+			return package;
+		}
+		QString manifestContent = "version=" + toolChain.getVersion() + "\n"
+				+ "fingerprint=" + toolChain.getFingerprint() + "\n"
+				+ "gcc=" + gccPath + "\n" + "g++=" + gxxPath + "\n";
+		manifest.write(manifestContent.toLocal8Bit());
+		manifest.close();
+		// The files are stored with their absolute paths, symlinks are
+		// replaced by the files they point to
+		QStringList parameters;
+		parameters << "--create" << "--gzip" << "--dereference"
+				<< "--file" << package.fileName + ".tmp"
+				<< "-C" << staging << "ddcn_toolchain" << "-C" << "/";
+		foreach (QString file, files) {
+			parameters.append(file.mid(1));
+		}
+		bool success;
+		runProgram("tar", parameters, &success);
+		QFile::remove(staging + "/ddcn_toolchain");
+		QDir().rmdir(staging);
+		if (!success || !QFile::rename(package.fileName + ".tmp",
+				package.fileName)) {
+			QFile::remove(package.fileName + ".tmp");
+			return package;
+		}
+	}
+	package.hash = ToolChainRegistry::hashFile(package.fileName).toHex();
+	package.toolChain = toolChain;
+	return package;
+}
+
+ToolChainPackageStore::Package ToolChainPackageStore::extractPackage(
+		const QString &hash, const QString &fileName, const QString &directory) {
+	Package package;
+	package.hash = hash;
+	if (ToolChainRegistry::hashFile(fileName).toHex() != hash.toAscii()) {
+		qWarning("Received toolchain package does not match its hash.");
+		QFile::remove(fileName);
+		return package;
+	}
+	QString target = directory + "/" + hash;
+	QString temporary = target + ".tmp";
+	runProgram("rm", QStringList() << "-rf" << temporary);
+	QDir().mkpath(temporary + "/root");
+	bool success;
+	runProgram("tar", QStringList() << "--extract" << "--gzip" << "--file"
+			<< fileName << "-C" << temporary + "/root", &success);
+	QFile::remove(fileName);
+	QHash<QString, QString> manifest = readManifest(temporary + "/root");
+	if (!success || manifest.value("gcc").isEmpty()) {
+		runProgram("rm", QStringList() << "-rf" << temporary);
+		return package;
+	}
+	// The wrappers already refer to the final location of the package
+	if (!createWrapper(temporary + "/gcc", target + "/root", manifest.value("gcc"))
+			|| (!manifest.value("g++").isEmpty()
+			&& !createWrapper(temporary + "/g++", target + "/root",
+					manifest.value("g++")))
+			|| !QDir().rename(temporary, target)) {
+		runProgram("rm", QStringList() << "-rf" << temporary);
+		return package;
+	}
+	package.fingerprint = manifest.value("fingerprint");
+	package.toolChain = ToolChain(manifest.value("version"), target + "/*",
+			package.fingerprint);
+	return package;
+}
+
+QString ToolChainPackageStore::runProgram(const QString &program,
+		const QStringList &parameters, bool *success) {
+	QProcess process;
+	process.start(program, parameters);
+	bool finished = process.waitForStarted(10000)
+			&& process.waitForFinished(300000);
+	if (!finished) {
+		process.kill();
+		process.waitForFinished(1000);
+	}
+	if (success != NULL) {
+		*success = finished && process.exitStatus() == QProcess::NormalExit
+				&& process.exitCode() == 0;
+	}
+	return QString::fromLocal8Bit(process.readAllStandardOutput().constData());
+}
+
+QString ToolChainPackageStore::findProgram(const QString &name) {
+	if (name.contains('/')) {
+		return name;
+	}
+	QStringList path = QProcessEnvironment::systemEnvironment().value("PATH")
+			.split(':', QString::SkipEmptyParts);
+	foreach (QString directory, path) {
+		QFileInfo info(directory + "/" + name);
+		if (info.exists() && info.isExecutable()) {
+			return info.absoluteFilePath();
+		}
+	}
+	return name;
+}
+
+bool ToolChainPackageStore::createWrapper(const QString &fileName,
+		const QString &root, const QString &driver) {
+	// The paths are passed as single-quoted shell words
+	QString quotedRoot = QString(root).replace("'", "'\\''");
+	QString quotedDriver = QString(driver).replace("'", "'\\''");
+	QString script = "#!/bin/sh\n"
+		"# Created by ddcn, runs a compiler shipped by another peer with the\n"
+		"# package as the root directory, without network access and with\n"
+		"# only the files of the job mounted\n"
+		"exec unshare --user --map-root-user --mount --net --ipc --pid --kill-child sh -c '\n"
+		"root=\"$1\"\n"
+		"shift\n"
+		"dir=$(pwd -P)\n"
+		"mkdir -p \"$root$dir\" && mount -t tmpfs tmpfs \"$root$dir\" || exit 1\n"
+		"set -f\n"
+		"IFS=\"\n\"\n"
+		"for file in $DDCN_JOB_INPUT_FILES; do\n"
+		"\tmkdir -p \"$root${file%/*}\" && touch \"$root$file\" \\\n"
+		"\t\t&& mount --bind \"$file\" \"$root$file\" \\\n"
+		"\t\t&& mount -o remount,bind,ro \"$root$file\" || exit 1\n"
+		"done\n"
+		"for file in $DDCN_JOB_OUTPUT_FILES; do\n"
+		"\ttouch \"$file\" && mkdir -p \"$root${file%/*}\" && touch \"$root$file\" \\\n"
+		"\t\t&& mount --bind \"$file\" \"$root$file\" || exit 1\n"
+		"done\n"
+		"exec unshare --root=\"$root\" --wd=\"$dir\" \"$@\"' sh '"
+		+ quotedRoot + "' '" + quotedDriver + "' \"$@\"\n";
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly)) {
+		return false;
+	}
+	file.write(script.toLocal8Bit());
+	file.close();
+	return file.setPermissions(QFile::ReadOwner | QFile::WriteOwner
+			| QFile::ExeOwner);
+}
+
+QHash<QString, QString> ToolChainPackageStore::readManifest(const QString &root) {
+	QHash<QString, QString> manifest;
+	QFile file(root + "/ddcn_toolchain");
+	if (!file.open(QIODevice::ReadOnly)) {
+		return manifest;
+	}
+	QStringList lines = QString::fromLocal8Bit(file.readAll().constData()).split('\n');
+	foreach (QString line, lines) {
+		int separator = line.indexOf('=');
+		if (separator != -1) {
+			manifest.insert(line.left(separator), line.mid(separator + 1));
+		}
+	}
+	return manifest;
+}
+
+void ToolChainPackageStore::loadReceivedPackages() {
+	QRegExp hashName("^[0-9a-f]{40}$");
+	QStringList entries = QDir(directory).entryList(QStringList(),
+			QDir::Dirs | QDir::NoDotAndDotDot);
+	foreach (QString entry, entries) {
+		if (!hashName.exactMatch(entry)) {
+			continue;
+		}
+		QString packageDirectory = directory + "/" + entry;
+		QHash<QString, QString> manifest = readManifest(packageDirectory + "/root");
+		if (manifest.value("gcc").isEmpty()) {
+			continue;
+		}
+		receivedToolChains.insert(entry, ToolChain(manifest.value("version"),
+				packageDirectory + "/*", manifest.value("fingerprint")));
+	}
+}
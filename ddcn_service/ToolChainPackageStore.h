@@ -0,0 +1,178 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef TOOLCHAINPACKAGESTORE_H_INCLUDED
+#define TOOLCHAINPACKAGESTORE_H_INCLUDED
+
+#include "ToolChain.h"
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QSettings>
+
+template<typename T> class QFutureWatcher;
+
+/**
+ * Manages compiler packages which are shipped to peers without a compatible
+ * toolchain, so that their compiler slots can still be used.
+ *
+ * If "service/ship_toolchains" is enabled (disabled by default), a package is
+ * created in the thread pool for every local toolchain. It is a gzipped
+ * tarball which contains the gcc and g++ drivers, cc1, cc1plus, the assembler
+ * and all shared libraries they need, with their absolute paths, and a
+ * manifest file "ddcn_toolchain". Packages are identified by the SHA-1 hash of
+ * the tarball.
+ *
+ * If "service/accept_toolchain_packages" is enabled, this peer advertises
+ * that it accepts packages. A peer which receives a job from a trusted peer
+ * for a toolchain it does not have requests the package over the bulk channel
+ * once and rejects the job in the meantime. Received packages are verified,
+ * extracted to "service/toolchain_package_dir" and kept there. The compiler
+ * is run through a wrapper script which uses unshare to create user, mount,
+ * network, IPC and PID namespaces, mounts an empty tmpfs over the working
+ * directory within the package, bind-mounts only the input files (read-only)
+ * and the output files of the job which Job passes in DDCN_JOB_INPUT_FILES and
+ * DDCN_JOB_OUTPUT_FILES, and then uses the package as the root directory. This
+ * requires unprivileged user namespaces but no root privileges. As the shipped compiler does not have any headers,
+ * jobs are compiled with "-fpreprocessed".
+ */
+class ToolChainPackageStore : public QObject {
+	Q_OBJECT
+public:
+	ToolChainPackageStore(QObject *parent = NULL);
+	~ToolChainPackageStore();
+
+	/**
+	 * Returns true if packages shall be created for the local toolchains.
+	 */
+	bool isShippingEnabled() {
+		return shippingEnabled;
+	}
+	/**
+	 * Returns true if this peer executes jobs with packages shipped by other
+	 * peers.
+	 */
+	bool isReceivingEnabled() {
+		return receivingEnabled;
+	}
+
+	/**
+	 * Creates packages for all toolchains which do not have one yet.
+	 */
+	void setToolChains(const QList<ToolChain> &toolChains);
+	/**
+	 * Returns the hash of the package of a local toolchain, or "" if the
+	 * package has not been created yet.
+	 */
+	QString getPackageHash(const ToolChain &toolChain);
+	/**
+	 * Returns the file name of a package which has been created for a local
+	 * toolchain, or "" if there is no such package.
+	 */
+	QString getPackageFile(const QString &hash);
+
+	/**
+	 * Returns true if a package received from another peer has been extracted
+	 * and can be used.
+	 */
+	bool hasReceivedToolChain(const QString &hash) {
+		return receivedToolChains.contains(hash);
+	}
+	/**
+	 * Returns a toolchain which runs the compiler of a received package.
+	 */
+	ToolChain getReceivedToolChain(const QString &hash) {
+		return receivedToolChains.value(hash);
+	}
+	/**
+	 * Verifies and extracts a package which has been received from another
+	 * peer in the thread pool. The file is removed afterwards.
+	 */
+	void addReceivedPackage(const QString &hash, const QString &fileName);
+	/**
+	 * Returns true if a package is currently being extracted.
+	 */
+	bool isExtracting(const QString &hash) {
+		return extracting.contains(hash);
+	}
+
+	/**
+	 * String which is added to the advertised toolchain list by peers which
+	 * accept packages.
+	 */
+	static QString advertisement;
+signals:
+	/**
+	 * Emitted when a received package has been extracted and can be used.
+	 */
+	void packageReceived(const QString &hash);
+private slots:
+	void onPackageCreated();
+	void onPackageExtracted();
+private:
+	struct Package {
+		QString fingerprint;
+		QString hash;
+		QString fileName;
+		ToolChain toolChain;
+	};
+
+	static Package createPackage(const ToolChain &toolChain,
+			const QString &directory);
+	static Package extractPackage(const QString &hash, const QString &fileName,
+			const QString &directory);
+	static QString runProgram(const QString &program,
+			const QStringList &parameters, bool *success = NULL);
+	static QString findProgram(const QString &name);
+	static bool createWrapper(const QString &fileName, const QString &root,
+			const QString &driver);
+	static QHash<QString, QString> readManifest(const QString &root);
+
+	void loadReceivedPackages();
+
+	QSettings settings;
+	bool shippingEnabled;
+	bool receivingEnabled;
+	QString directory;
+	/**
+	 * Package hash for every local toolchain fingerprint.
+	 */
+	QHash<QString, QString> packageHashes;
+	/**
+	 * Tarball for every hash in packageHashes.
+	 */
+	QHash<QString, QString> packageFiles;
+	/**
+	 * Fingerprints of the toolchains whose packages are being created.
+	 */
+	QSet<QString> creating;
+	QHash<QString, ToolChain> receivedToolChains;
+	QSet<QString> extracting;
+};
+
+#endif
@@ -0,0 +1,306 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#include "ToolChainRegistry.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QProcess>
+#include <QRegExp>
+#include <QtConcurrentRun>
+
+#include <sys/stat.h>
+
+ToolChainRegistry::ToolChainRegistry(QObject *parent) : QObject(parent),
+		settings(QSettings::IniFormat, QSettings::UserScope, "ddcn", "ddcn"),
+		scanning(false), discovering(false) {
+	loadCache();
+}
+ToolChainRegistry::~ToolChainRegistry() {
+	// Running probes only access their own copies of the data, but we have to
+	// wait for them as the watchers are deleted with this object
+	foreach (QFutureWatcher<ProbeResult> *watcher, probes.keys()) {
+		watcher->waitForFinished();
+	}
+}
+
+void ToolChainRegistry::discover(const QStringList &paths) {
+	if (discovering) {
+		return;
+	}
+	discovering = true;
+	scanning = true;
+	extraPaths = paths;
+	QStringList directories;
+	if (settings.value("service/toolchain_discovery", true).toBool()) {
+		directories = QProcessEnvironment::systemEnvironment().value("PATH")
+				.split(':', QString::SkipEmptyParts);
+		QStringList prefixes = settings.value("service/toolchain_prefixes")
+				.toStringList();
+		foreach (QString prefix, prefixes) {
+			directories.append(prefix);
+			directories.append(prefix + "/bin");
+		}
+	}
+	QFutureWatcher<QStringList> *watcher = new QFutureWatcher<QStringList>(this);
+	connect(watcher, SIGNAL(finished()), this, SLOT(onScanFinished()));
+	watcher->setFuture(QtConcurrent::run(findToolChains, directories));
+}
+
+bool ToolChainRegistry::probe(const QString &path) {
+	if (!QFile::exists(QString(path).replace("*", "gcc"))) {
+		return false;
+	}
+	startProbe(path);
+	return true;
+}
+
+void ToolChainRegistry::onScanFinished() {
+	QFutureWatcher<QStringList> *watcher = static_cast<QFutureWatcher<QStringList>*>(sender());
+	QStringList paths = extraPaths + watcher->result();
+	watcher->deleteLater();
+	scanning = false;
+	extraPaths.clear();
+	paths.removeDuplicates();
+	foreach (QString path, paths) {
+		startProbe(path);
+	}
+	checkDiscoveryFinished();
+}
+
+void ToolChainRegistry::onProbeFinished() {
+	QFutureWatcher<ProbeResult> *watcher = static_cast<QFutureWatcher<ProbeResult>*>(sender());
+	probes.remove(watcher);
+	ProbeResult result = watcher->result();
+	watcher->deleteLater();
+	if (result.version.isEmpty()) {
+		qWarning("Could not probe the compiler \"%s\".",
+				result.path.toAscii().data());
+		if (cache.remove(result.path) != 0) {
+			saveCache();
+		}
+	} else {
+		qDebug("Toolchain %s: %s (%s)", result.path.toAscii().data(),
+				result.version.toAscii().data(),
+				result.fingerprint.toAscii().data());
+		ProbeResult &cached = cache[result.path];
+		if (cached.stamp != result.stamp
+				|| cached.fingerprint != result.fingerprint) {
+			cached = result;
+			saveCache();
+		}
+		emit toolChainFound(ToolChain(result.version, result.path,
+				result.fingerprint));
+	}
+	checkDiscoveryFinished();
+}
+
+QStringList ToolChainRegistry::findToolChains(const QStringList &directories) {
+	// Matches "gcc", "gcc-4.6", "i686-linux-gnu-gcc" etc., but not tools like
+	// "gcc-ar"
+	QRegExp driverName("^(.*-)?gcc(-[0-9][0-9.]*)?$");
+	QStringList paths;
+	foreach (QString directory, directories) {
+		QDir dir(directory);
+		if (!dir.exists()) {
+			continue;
+		}
+		QStringList entries = dir.entryList(QStringList("*gcc*"),
+				QDir::Files | QDir::Executable);
+		foreach (QString entry, entries) {
+			if (!driverName.exactMatch(entry)) {
+				continue;
+			}
+			QString path = dir.absolutePath() + "/" + driverName.cap(1) + "*"
+					+ driverName.cap(2);
+			if (!paths.contains(path)) {
+				paths.append(path);
+			}
+		}
+	}
+	return paths;
+}
+
+ToolChainRegistry::ProbeResult ToolChainRegistry::probeToolChain(
+		const QString &path, const ProbeResult &cached) {
+	// If none of the files changed, the cached result is still valid
+	if (!cached.files.isEmpty() && cached.stamp == createStamp(cached.files)) {
+		return cached;
+	}
+	ProbeResult result;
+	result.path = path;
+	QString gccPath = QString(path).replace("*", "gcc");
+	QString gxxPath = QString(path).replace("*", "g++");
+	// Get the target and the first two components of the version
+	QString target;
+	QString version;
+	QRegExp versionLine("^gcc version ([0-9]+\\.[0-9]+)");
+	QStringList lines = runCompiler(gccPath, QStringList("-v")).split('\n');
+	foreach (QString line, lines) {
+		if (line.startsWith("Target: ")) {
+			target = line.mid(8).trimmed();
+		} else if (versionLine.indexIn(line) != -1) {
+			version = versionLine.cap(1);
+		}
+	}
+	if (target.isEmpty() || version.isEmpty()) {
+		return result;
+	}
+	// Collect the drivers and the compilers proper
+	QStringList programs;
+	programs.append(gccPath);
+	QString cc1 = runCompiler(gccPath,
+			QStringList("-print-prog-name=cc1")).trimmed();
+	programs.append(cc1);
+	if (QFile::exists(gxxPath)) {
+		programs.append(gxxPath);
+		QString cc1plus = runCompiler(gxxPath,
+				QStringList("-print-prog-name=cc1plus")).trimmed();
+		programs.append(cc1plus);
+	}
+	foreach (QString program, programs) {
+		QFileInfo info(program);
+		// -print-prog-name returns the plain name if it was not found
+		if (!info.isAbsolute() || !info.exists()) {
+			continue;
+		}
+		QString fileName = info.canonicalFilePath();
+		if (!result.files.contains(fileName)) {
+			result.files.append(fileName);
+		}
+	}
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	foreach (QString fileName, result.files) {
+		QByteArray fileHash = hashFile(fileName);
+		if (fileHash.isEmpty()) {
+			return result;
+		}
+		hash.addData(fileHash);
+	}
+	result.fingerprint = hash.result().toHex();
+	result.stamp = createStamp(result.files);
+	result.version = target + "/" + version;
+	return result;
+}
+
+QString ToolChainRegistry::runCompiler(const QString &compiler,
+		const QStringList &parameters) {
+	QProcess process;
+	QProcessEnvironment environment = QProcessEnvironment::systemEnvironment();
+	environment.insert("LC_ALL", "C");
+	process.setProcessEnvironment(environment);
+	process.setProcessChannelMode(QProcess::MergedChannels);
+	process.start(compiler, parameters);
+	// This runs in the thread pool, so we can afford generous timeouts for
+	// compilers on slow file systems
+	if (!process.waitForStarted(10000) || !process.waitForFinished(10000)) {
+		process.kill();
+		process.waitForFinished(1000);
+		return "";
+	}
+	return QString::fromLocal8Bit(process.readAll().constData());
+}
+
+QString ToolChainRegistry::createStamp(const QStringList &files) {
+	QStringList stamps;
+	foreach (QString fileName, files) {
+		struct stat info;
+		if (stat(QFile::encodeName(fileName).constData(), &info) == -1) {
+			return "";
+		}
+		stamps.append(QString("%1:%2:%3:%4").arg((qulonglong)info.st_dev)
+				.arg((qulonglong)info.st_ino).arg((qlonglong)info.st_size)
+				.arg((qlonglong)info.st_mtime));
+	}
+	return stamps.join(";");
+}
+
+QByteArray ToolChainRegistry::hashFile(const QString &fileName) {
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return QByteArray();
+	}
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	while (!file.atEnd()) {
+		QByteArray data = file.read(65536);
+		if (data.isEmpty()) {
+			return QByteArray();
+		}
+		hash.addData(data);
+	}
+	return hash.result();
+}
+
+void ToolChainRegistry::startProbe(const QString &path) {
+	if (probes.values().contains(path)) {
+		return;
+	}
+	QFutureWatcher<ProbeResult> *watcher = new QFutureWatcher<ProbeResult>(this);
+	connect(watcher, SIGNAL(finished()), this, SLOT(onProbeFinished()));
+	probes.insert(watcher, path);
+	watcher->setFuture(QtConcurrent::run(probeToolChain, path,
+			cache.value(path)));
+}
+
+void ToolChainRegistry::checkDiscoveryFinished() {
+	if (discovering && !isProbing()) {
+		discovering = false;
+		emit discoveryFinished();
+	}
+}
+
+void ToolChainRegistry::loadCache() {
+	int size = settings.beginReadArray("toolChainCache");
+	for (int i = 0; i < size; i++) {
+		settings.setArrayIndex(i);
+		ProbeResult result;
+		result.path = settings.value("path").toString();
+		result.version = settings.value("version").toString();
+		result.fingerprint = settings.value("fingerprint").toString();
+		result.files = settings.value("files").toStringList();
+		result.stamp = settings.value("stamp").toString();
+		cache.insert(result.path, result);
+	}
+	settings.endArray();
+}
+
+void ToolChainRegistry::saveCache() {
+	settings.beginWriteArray("toolChainCache");
+	int index = 0;
+	foreach (const ProbeResult &result, cache.values()) {
+		settings.setArrayIndex(index++);
+		settings.setValue("path", result.path);
+		settings.setValue("version", result.version);
+		settings.setValue("fingerprint", result.fingerprint);
+		settings.setValue("files", result.files);
+		settings.setValue("stamp", result.stamp);
+	}
+	settings.endArray();
+}
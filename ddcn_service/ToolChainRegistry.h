@@ -0,0 +1,146 @@
+/*
+Copyright 2011 Benjamin Fus, Florian Muenchbach, Mathias Gottschlag. All
+rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+   1. Redistributions of source code must retain the above copyright notice,
+      this list of conditions and the following disclaimer.
+
+   2. Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+	  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS ``AS IS'' AND ANY EXPRESS OR
+IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF
+MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO
+EVENT SHALL THE COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY
+OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef TOOLCHAINREGISTRY_H_INCLUDED
+#define TOOLCHAINREGISTRY_H_INCLUDED
+
+#include "ToolChain.h"
+
+#include <QObject>
+#include <QHash>
+#include <QSettings>
+#include <QStringList>
+
+template<typename T> class QFutureWatcher;
+
+/**
+ * Finds and probes the compilers installed on this machine without blocking
+ * the event loop.
+ *
+ * discover() searches all directories in PATH and the directories configured
+ * in "service/toolchain_prefixes" (each prefix is searched directly and in
+ * its "bin" subdirectory) for gcc drivers like "gcc", "gcc-4.6" or
+ * "x86_64-linux-gnu-gcc-4.6". Every driver is then probed in the thread pool:
+ * "gcc -v" yields the target and version, and the fingerprint is the SHA-1
+ * hash of the gcc and g++ drivers and of cc1 and cc1plus as printed by
+ * "-print-prog-name". Symlinks to the same compiler thus yield the same
+ * fingerprint, while differently patched builds of the same version do not.
+ *
+ * Probing hashes several megabytes, so the results are cached in the
+ * configuration together with the device, inode, size and modification time
+ * of all hashed files and only repeated if one of these changed.
+ */
+class ToolChainRegistry : public QObject {
+	Q_OBJECT
+public:
+	ToolChainRegistry(QObject *parent = NULL);
+	~ToolChainRegistry();
+
+	/**
+	 * Searches for compilers and probes all of them. toolChainFound() is
+	 * emitted for every valid compiler, discoveryFinished() once all of them
+	 * have been probed. Does nothing if discovery is already running.
+	 *
+	 * @param paths Additional toolchain paths (with "*" instead of "gcc")
+	 * which shall be probed, e.g. the configured toolchains.
+	 */
+	void discover(const QStringList &paths = QStringList());
+	/**
+	 * Probes a single toolchain, toolChainFound() is emitted if the compiler
+	 * is valid.
+	 *
+	 * @param path Path to the compilers, a "*" denotes the part where the name
+	 * of the compiler for a certain language is inserted.
+	 * @return False if there is no gcc at the given path.
+	 */
+	bool probe(const QString &path);
+
+	/**
+	 * Returns true while discovery or single probes are running.
+	 */
+	bool isProbing() {
+		return !probes.isEmpty() || scanning;
+	}
+
+	/**
+	 * Returns the binary SHA-1 hash of a file or an empty array if the file
+	 * could not be read. This blocks and should only be called from the thread
+	 * pool.
+	 */
+	static QByteArray hashFile(const QString &fileName);
+signals:
+	/**
+	 * Emitted when a compiler has been probed successfully.
+	 */
+	void toolChainFound(const ToolChain &toolChain);
+	/**
+	 * Emitted when all compilers found by discover() have been probed.
+	 */
+	void discoveryFinished();
+private slots:
+	void onScanFinished();
+	void onProbeFinished();
+private:
+	/**
+	 * Cached probe result of a toolchain.
+	 */
+	struct ProbeResult {
+		QString path;
+		QString version;
+		QString fingerprint;
+		/**
+		 * Files which were hashed for the fingerprint.
+		 */
+		QStringList files;
+		/**
+		 * Device, inode, size and modification time of the files.
+		 */
+		QString stamp;
+	};
+
+	static QStringList findToolChains(const QStringList &directories);
+	static ProbeResult probeToolChain(const QString &path,
+			const ProbeResult &cached);
+	static QString runCompiler(const QString &compiler,
+			const QStringList &parameters);
+	static QString createStamp(const QStringList &files);
+
+	void startProbe(const QString &path);
+	void checkDiscoveryFinished();
+
+	void loadCache();
+	void saveCache();
+
+	QSettings settings;
+	QHash<QString, ProbeResult> cache;
+	QHash<QFutureWatcher<ProbeResult>*, QString> probes;
+	bool scanning;
+	bool discovering;
+	QStringList extraPaths;
+};
+
+#endif
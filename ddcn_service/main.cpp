@@ -42,12 +42,16 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  * objects if the job is executed on a different computer.
  *
  * The D-Bus interface is implemented in the classes ending with *Adaptor, that
- * is, CompilerNetworkAdaptor and CompilerServiceAdaptor.
+ * is, CompilerNetworkAdaptor and CompilerServiceAdaptor. Jobs from ddcn_gcc are
+ * usually received via LocalJobServer instead, which passes the terminal of the
+ * client as file descriptors.
  */
 
 #include "CompilerServiceAdaptor.h"
 #include "CompilerNetworkAdaptor.h"
 #include "DBusStructs.h"
+#include "LocalJobServer.h"
+#include "JobServer.h"
 
 #include <QCoreApplication>
 #include <QDBusConnection>
@@ -80,6 +84,7 @@ int main(int argc, char **argv) {
 	qRegisterMetaType<ariba::utility::NodeID>();
 	qRegisterMetaType<ariba::utility::LinkID>();
 	qRegisterMetaType<ariba::DataMessage>();
+	qRegisterMetaType<Packet>();
 	// Initialize crypto framework
 	TLS::initialize();
 	// Create the compiler network
@@ -93,6 +98,14 @@ int main(int argc, char **argv) {
 			 &app,
 			 SLOT(quit())
 	);
+	// Local clients can bypass D-Bus for jobs
+	LocalJobServer localJobServer(&service);
+	if (!localJobServer.listen()) {
+		qWarning("Could not open the local job socket, only accepting jobs via D-Bus.");
+	}
+	// make can be attached to a jobserver which follows the network capacity
+	JobServer jobServer(&service, &network);
+	jobServer.start();
 	// Create the D-Bus interface
 	QDBusConnection::sessionBus().registerObject("/CompilerService", &service);
 	QDBusConnection::sessionBus().registerObject("/CompilerNetwork", &network);
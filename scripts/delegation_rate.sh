@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# Reports how many of the compile calls in the ParameterParser corpus would be
+# delegated, and fails if any call or test case is not classified as expected.
+# The build directory has to be configured with -DDDCN_BUILD_BENCHMARKS=ON.
+# Further corpora can be recorded with scripts/record_gcc_calls.sh.
+#
+# Usage: delegation_rate.sh <build directory> [corpus...]
+
+SOURCE_DIR="$(cd "$(dirname "$0")/.." && pwd)"
+BUILD_DIR="${1:?Usage: $0 <build directory> [corpus...]}"
+shift
+if [ $# -eq 0 ]; then
+	set -- "$SOURCE_DIR/ddcn_bench/parameter_corpus.txt" \
+		"$SOURCE_DIR/ddcn_bench/parameter_cases.txt"
+fi
+
+DRIVER="$BUILD_DIR/bin/ddcn_parameter_corpus"
+if [ ! -x "$DRIVER" ]; then
+	echo "$DRIVER not found, build with -DDDCN_BUILD_BENCHMARKS=ON." >&2
+	exit 2
+fi
+
+exec "$DRIVER" "$@"
@@ -0,0 +1,28 @@
+#!/bin/bash
+
+# Compiler launcher which records gcc calls for the ParameterParser corpus
+# (see ddcn_bench/ParameterCorpus.cpp) and then runs the compiler.
+#
+# Every call is appended to $DDCN_RECORD_FILE as one line, prefixed with
+# "compile" if it compiles without linking ("-c") and "other" otherwise.
+#
+# Usage:
+#   cmake -DCMAKE_C_COMPILER_LAUNCHER=record_gcc_calls.sh \
+#         -DCMAKE_CXX_COMPILER_LAUNCHER=record_gcc_calls.sh ...
+#   make CC="record_gcc_calls.sh gcc" CXX="record_gcc_calls.sh g++"
+
+if [ -n "$DDCN_RECORD_FILE" ]; then
+	LINE="other"
+	for ARG in "$@"; do
+		if [ "$ARG" = "-c" ]; then
+			LINE="compile"
+		fi
+	done
+	for ARG in "$@"; do
+		# Escape everything the response file syntax treats specially
+		LINE="$LINE $(printf '%s' "$ARG" | sed 's/[\\"'"'"' \t]/\\&/g')"
+	done
+	echo "$LINE" >> "$DDCN_RECORD_FILE"
+fi
+
+exec "$@"